@@ -0,0 +1,69 @@
+"""
+Compares benchmark results of tn_bench with a stored baseline.
+
+use: python3 compare_bench.py baseline.json current.json [--threshold=0.1]
+
+Benchmarks are matched by name and problem size n. A benchmark counts as a
+regression if its median time per call grew by more than threshold (relative)
+compared to the baseline. If any regression is found, the script exits with
+status 1 so that it can be used in scripts and CI jobs.
+"""
+
+import json
+import sys
+
+# color codes as in the makefiles
+RED = "\033[0;31m"
+GREEN = "\033[0;32m"
+NC = "\033[0m"
+
+def load_results(path):
+    with open(path) as file:
+        data = json.load(file)
+    # key (name, n) --> benchmark record
+    return {(b["name"], b["n"]): b for b in data["benchmarks"]}
+
+def main():
+    threshold = 0.1
+    paths = []
+    for arg in sys.argv[1:]:
+        if arg.startswith("--threshold="):
+            threshold = float(arg.split("=", 1)[1])
+        else:
+            paths.append(arg)
+    if len(paths) != 2:
+        print(__doc__)
+        sys.exit(2)
+
+    baseline = load_results(paths[0])
+    current = load_results(paths[1])
+
+    regressions = 0
+    print(f"{'benchmark':<28} {'n':>9} {'baseline [ns]':>15} {'current [ns]':>15} {'change':>9}")
+    for key in sorted(current):
+        name, n = key
+        if key not in baseline:
+            print(f"{name:<28} {n:>9} {'-':>15} {current[key]['median_ns']:>15.1f}      new")
+            continue
+        old = baseline[key]["median_ns"]
+        new = current[key]["median_ns"]
+        change = (new - old) / old
+        if change > threshold:
+            color = RED
+            regressions += 1
+        elif change < -threshold:
+            color = GREEN
+        else:
+            color = NC
+        print(f"{color}{name:<28} {n:>9} {old:>15.1f} {new:>15.1f} {change:>+8.1%}{NC}")
+
+    for key in sorted(set(baseline) - set(current)):
+        print(f"{key[0]:<28} {key[1]:>9} missing in current results")
+
+    if regressions:
+        print(f"> {RED}{regressions} regression(s) above {threshold:.0%}{NC}")
+        sys.exit(1)
+    print(f"> {GREEN}No regressions above {threshold:.0%}{NC}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,475 @@
+/* tn_bench.c
+ *
+ * Microbenchmarks for the kernels of tlib. Built and run by
+ *   make bench
+ * in c_libraries/config. Every kernel family is measured at several problem
+ * sizes. Each measurement consists of a warm-up phase, which also calibrates
+ * how many calls are batched into one sample (so that a sample takes at least
+ * BENCH_MIN_SAMPLE_NS), followed by a number of repetitions. Reported are
+ * minimum, median, 10th and 90th percentile of the time per call as well as
+ * the throughput in the unit of work of the kernel (flop, eval, step, ...).
+ *
+ * Usage:
+ *   ./tn_bench [-o out.json] [-r repetitions] [-f filter]
+ * where filter selects only benchmarks whose name contains the given string.
+ * Results are written as JSON and compared with a stored baseline by
+ * compare_bench.py.
+ *
+ * Benchmarks with suffix _inline use the header-only steppers of
+ * t_ode_inline.h with the same right-hand side and show the gain over the
+ * function pointer calls into libtlib.so.
+ */
+
+#include <time.h>
+#include "../include/t_numerics.h"
+#include "../include/t_ode_inline.h"
+
+#ifndef BENCH_MIN_SAMPLE_NS
+#define BENCH_MIN_SAMPLE_NS 1000000.0
+#endif
+
+#ifndef BENCH_WARMUP_NS
+#define BENCH_WARMUP_NS 20000000.0
+#endif
+
+//################################################################################
+// harness
+
+typedef void bench_kernel (void* state);
+
+typedef struct {
+    FILE* out;          // JSON output
+    int reps;           // number of samples per benchmark
+    const char* filter; // only run benchmarks containing this string
+    int count;          // number of benchmarks written so far
+    double* samples;    // buffer for reps samples
+} bench_ctx;
+
+static double
+bench_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+bench_cmp_double (const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/* linear interpolation between order statistics of sorted array */
+static double
+bench_percentile (const double* sorted, int n, double q)
+{
+    double pos = q * (n - 1);
+    int lo = (int) pos;
+    int hi = lo + 1 < n ? lo + 1 : lo;
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+/*--run kernel(state) repeatedly and write statistics as JSON object--*/
+// work: units of work per call (e.g. flops), unit: name of the unit
+static void
+bench_run (bench_ctx* ctx, const char* name, size_t n,
+           double work, const char* unit,
+           bench_kernel kernel, void* state)
+{
+    if (ctx->filter && !strstr(name, ctx->filter)) {
+        return;
+    }
+
+    /* warm-up: caches, page faults, branch predictors and frequency scaling
+     * settle while we find out how many calls fill one sample */
+    long batch = 1;
+    double start = bench_now();
+    double elapsed = 0.0;
+    while (elapsed < BENCH_WARMUP_NS) {
+        double t0 = bench_now();
+        for (long i = 0; i < batch; i++) {
+            kernel(state);
+        }
+        double dt = bench_now() - t0;
+        if (dt < BENCH_MIN_SAMPLE_NS) {
+            batch *= 2;
+        }
+        elapsed = bench_now() - start;
+    }
+
+    for (int r = 0; r < ctx->reps; r++) {
+        double t0 = bench_now();
+        for (long i = 0; i < batch; i++) {
+            kernel(state);
+        }
+        ctx->samples[r] = (bench_now() - t0) / batch;
+    }
+    qsort(ctx->samples, ctx->reps, sizeof(double), bench_cmp_double);
+
+    double median = bench_percentile(ctx->samples, ctx->reps, 0.5);
+    double p10 = bench_percentile(ctx->samples, ctx->reps, 0.1);
+    double p90 = bench_percentile(ctx->samples, ctx->reps, 0.9);
+    double throughput = work / (median * 1e-9);
+
+    printf("  %-28s n = %-8zu median %12.1f ns  [p10 %12.1f, p90 %12.1f]"
+        "  %10.3g %s/s\n", name, n, median, p10, p90, throughput, unit);
+
+    fprintf(ctx->out, "%s\n    {\"name\": \"%s\", \"n\": %zu, \"reps\": %d, "
+        "\"batch\": %ld, \"min_ns\": %.3f, \"median_ns\": %.3f, "
+        "\"p10_ns\": %.3f, \"p90_ns\": %.3f, \"throughput\": %.6g, "
+        "\"unit\": \"%s/s\"}", ctx->count ? "," : "", name, n, ctx->reps,
+        batch, ctx->samples[0], median, p10, p90, throughput, unit);
+    ctx->count++;
+}
+
+//################################################################################
+// test functions
+
+static double
+bench_integrand (double x, void* params)
+{
+    double omega = *(double*) params;
+    return sin(omega * x) * exp(-0.1 * x * x);
+}
+
+static double complex
+bench_signal (double t, void* params)
+{
+    double sigma = *(double*) params;
+    return exp(-0.5 * t * t / (sigma * sigma));
+}
+
+/* chain of dim/2 harmonic oscillators with nearest neighbour coupling,
+ * y = {x_0, ..., x_{n-1}, v_0, ..., v_{n-1}} */
+static void
+bench_oscillator_chain (double __attribute__((unused)) t, const double y[],
+                        double dy[], void* params)
+{
+    int n = *(int*) params;
+    for (int i = 0; i < n; i++) {
+        double left = i > 0 ? y[i - 1] : 0.0;
+        double right = i < n - 1 ? y[i + 1] : 0.0;
+        dy[i] = y[n + i];
+        dy[n + i] = -2.0 * y[i] + 0.5 * (left + right);
+    }
+}
+
+//################################################################################
+// linear algebra
+
+typedef struct {
+    t_array* x;
+    t_array* y;
+    t_matrix* a;
+    t_matrix* b;
+    t_matrix* c;
+    volatile double sink;
+} linalg_state;
+
+static void
+kernel_dot (void* state)
+{
+    linalg_state* s = state;
+    s->sink = tn_dot_product(s->x, s->y);
+}
+
+static void
+kernel_gemv (void* state)
+{
+    linalg_state* s = state;
+    tn_matrix_dot_vector(s->a, s->x, s->y);
+}
+
+static void
+kernel_gemm (void* state)
+{
+    linalg_state* s = state;
+    tn_matrix_dot_matrix(s->a, s->b, s->c);
+}
+
+static void
+kernel_gauss_seidel_step (void* state)
+{
+    linalg_state* s = state;
+    tn_gauss_seidel_step(s->a, s->x, s->y);
+}
+
+static t_matrix*
+bench_matrix_alloc (size_t n)
+{
+    /* diagonally dominant so that Gauß-Seidel converges */
+    t_matrix* m = t_matrix_alloc(n, n);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            t_matrix_set(m, i, j, i == j ? 2.0 * n : 1.0 / (1.0 + i + j));
+        }
+    }
+    return m;
+}
+
+static void
+bench_linalg (bench_ctx* ctx)
+{
+    size_t dot_sizes[] = {1000, 100000, 1000000};
+    for (size_t k = 0; k < 3; k++) {
+        size_t n = dot_sizes[k];
+        linalg_state s = {0};
+        s.x = tn_linspace_alloc(0.0, 1.0, n);
+        s.y = tn_linspace_alloc(1.0, 2.0, n);
+        bench_run(ctx, "dot", n, 2.0 * n, "flop", kernel_dot, &s);
+        T_ARRAY_FREE(s.x);
+        T_ARRAY_FREE(s.y);
+    }
+
+    size_t mat_sizes[] = {32, 128, 512};
+    for (size_t k = 0; k < 3; k++) {
+        size_t n = mat_sizes[k];
+        linalg_state s = {0};
+        s.a = bench_matrix_alloc(n);
+        s.x = tn_linspace_alloc(0.0, 1.0, n);
+        s.y = t_array_alloc(n);
+        bench_run(ctx, "gemv", n, 2.0 * n * n, "flop", kernel_gemv, &s);
+        bench_run(ctx, "gauss_seidel_step", n, 2.0 * n * n, "flop",
+                  kernel_gauss_seidel_step, &s);
+        T_MATRIX_FREE(s.a);
+        T_ARRAY_FREE(s.x);
+        T_ARRAY_FREE(s.y);
+    }
+
+    size_t gemm_sizes[] = {32, 128, 256};
+    for (size_t k = 0; k < 3; k++) {
+        size_t n = gemm_sizes[k];
+        linalg_state s = {0};
+        s.a = bench_matrix_alloc(n);
+        s.b = bench_matrix_alloc(n);
+        s.c = t_matrix_alloc(n, n);
+        bench_run(ctx, "gemm", n, 2.0 * n * n * n, "flop", kernel_gemm, &s);
+        T_MATRIX_FREE(s.a);
+        T_MATRIX_FREE(s.b);
+        T_MATRIX_FREE(s.c);
+    }
+}
+
+//################################################################################
+// quadrature
+
+typedef struct {
+    double dx;
+    double param;
+    volatile double sink;
+} quad_state;
+
+static void
+kernel_midpoint (void* state)
+{
+    quad_state* s = state;
+    s->sink = tn_integrate_midpoint(bench_integrand, 0.0, 10.0, s->dx, &s->param);
+}
+
+static void
+kernel_simpson (void* state)
+{
+    quad_state* s = state;
+    s->sink = tn_integrate_simpson(bench_integrand, 0.0, 10.0, s->dx, &s->param);
+}
+
+static void
+kernel_fourier (void* state)
+{
+    quad_state* s = state;
+    s->sink = creal(tn_fourier_transform(bench_signal, 10.0, 1.0, s->dx, &s->param));
+}
+
+static void
+bench_quadrature (bench_ctx* ctx)
+{
+    size_t sizes[] = {1000, 100000, 1000000};
+    for (size_t k = 0; k < 3; k++) {
+        size_t n = sizes[k];
+        quad_state s = {.dx = 10.0 / n, .param = 3.0};
+        bench_run(ctx, "integrate_midpoint", n, n, "eval", kernel_midpoint, &s);
+        bench_run(ctx, "integrate_simpson", n, 3.0 * n, "eval", kernel_simpson, &s);
+        s.dx = 20.0 / n;
+        s.param = 1.0;
+        bench_run(ctx, "fourier_transform", n, 3.0 * n, "eval", kernel_fourier, &s);
+    }
+}
+
+//################################################################################
+// ODE steppers
+
+typedef struct {
+    double* y;
+    double* y0;
+    double* k;
+    int dim;
+    int n;
+    double dt;
+} ode_state;
+
+/* every call restarts from same initial state so that the state stays bounded */
+#define BENCH_ODE_KERNEL(stepper, call) \
+    static void \
+    kernel_##stepper (void* state) \
+    { \
+        ode_state* s = state; \
+        memcpy(s->y, s->y0, s->dim * sizeof(double)); \
+        call; \
+    }
+
+BENCH_ODE_KERNEL(euler, tn_euler_step(0.0, s->dt, s->y, bench_oscillator_chain,
+                                      s->dim, &s->n))
+BENCH_ODE_KERNEL(rk2, tn_rk2_step(0.0, s->dt, s->y, bench_oscillator_chain,
+                                  s->dim, &s->n))
+BENCH_ODE_KERNEL(rk4, tn_rk4_step(0.0, s->dt, s->y, s->k, bench_oscillator_chain,
+                                  s->dim, &s->n))
+BENCH_ODE_KERNEL(vv, tn_vv_step(0.0, s->dt, s->y, bench_oscillator_chain,
+                                s->dim, &s->n))
+
+TN_DEFINE_ODE_STEPPERS(bench_inline, bench_oscillator_chain)
+
+BENCH_ODE_KERNEL(euler_inline, bench_inline_euler_step(0.0, s->dt, s->y, s->k,
+                                                       s->dim, &s->n))
+BENCH_ODE_KERNEL(rk2_inline, bench_inline_rk2_step(0.0, s->dt, s->y, s->k,
+                                                   s->dim, &s->n))
+BENCH_ODE_KERNEL(rk4_inline, bench_inline_rk4_step(0.0, s->dt, s->y, s->k,
+                                                   s->dim, &s->n))
+BENCH_ODE_KERNEL(vv_inline, bench_inline_vv_step(0.0, s->dt, s->y, s->k,
+                                                 s->dim, &s->n))
+
+/* whole trajectories of BENCH_ODE_STEPS steps: loop over the .so stepper
+ * against the inlined driver */
+#define BENCH_ODE_STEPS 1000
+
+BENCH_ODE_KERNEL(rk4_loop, for (int n = 0; n < BENCH_ODE_STEPS; n++) {
+                               tn_rk4_step(n * s->dt, s->dt, s->y, s->k,
+                                           bench_oscillator_chain, s->dim, &s->n);
+                           })
+BENCH_ODE_KERNEL(rk4_loop_inline, bench_inline_rk4_integrate(0.0, s->dt,
+                                      BENCH_ODE_STEPS, s->y, s->k, NULL,
+                                      s->dim, &s->n))
+BENCH_ODE_KERNEL(vv_loop, for (int n = 0; n < BENCH_ODE_STEPS; n++) {
+                              tn_vv_step(n * s->dt, s->dt, s->y,
+                                         bench_oscillator_chain, s->dim, &s->n);
+                          })
+BENCH_ODE_KERNEL(vv_loop_inline, bench_inline_vv_integrate(0.0, s->dt,
+                                     BENCH_ODE_STEPS, s->y, s->k, NULL,
+                                     s->dim, &s->n))
+
+static void
+bench_ode (bench_ctx* ctx)
+{
+    int dims[] = {2, 64, 4096};
+    for (size_t k = 0; k < 3; k++) {
+        ode_state s;
+        s.dim = dims[k];
+        s.n = s.dim / 2;
+        s.dt = 1e-3;
+        s.y = malloc(s.dim * sizeof(double));
+        s.y0 = malloc(s.dim * sizeof(double));
+        s.k = malloc(TN_ODE_INLINE_WORK(s.dim) * sizeof(double));
+        exit_if_NULL(s.y);
+        exit_if_NULL(s.y0);
+        exit_if_NULL(s.k);
+        for (int i = 0; i < s.dim; i++) {
+            s.y0[i] = sin(0.1 * i);
+        }
+        bench_run(ctx, "euler_step", s.dim, 1.0, "step", kernel_euler, &s);
+        bench_run(ctx, "rk2_step", s.dim, 1.0, "step", kernel_rk2, &s);
+        bench_run(ctx, "rk4_step", s.dim, 1.0, "step", kernel_rk4, &s);
+        bench_run(ctx, "vv_step", s.dim, 1.0, "step", kernel_vv, &s);
+        bench_run(ctx, "euler_step_inline", s.dim, 1.0, "step",
+                  kernel_euler_inline, &s);
+        bench_run(ctx, "rk2_step_inline", s.dim, 1.0, "step",
+                  kernel_rk2_inline, &s);
+        bench_run(ctx, "rk4_step_inline", s.dim, 1.0, "step",
+                  kernel_rk4_inline, &s);
+        bench_run(ctx, "vv_step_inline", s.dim, 1.0, "step",
+                  kernel_vv_inline, &s);
+        bench_run(ctx, "rk4_integrate", s.dim, BENCH_ODE_STEPS, "step",
+                  kernel_rk4_loop, &s);
+        bench_run(ctx, "rk4_integrate_inline", s.dim, BENCH_ODE_STEPS, "step",
+                  kernel_rk4_loop_inline, &s);
+        bench_run(ctx, "vv_integrate", s.dim, BENCH_ODE_STEPS, "step",
+                  kernel_vv_loop, &s);
+        bench_run(ctx, "vv_integrate_inline", s.dim, BENCH_ODE_STEPS, "step",
+                  kernel_vv_loop_inline, &s);
+        free(s.y);
+        free(s.y0);
+        free(s.k);
+    }
+}
+
+//################################################################################
+// random numbers
+
+typedef struct {
+    int n;
+    int seed;
+} rng_state;
+
+static void
+kernel_rand (void* state)
+{
+    rng_state* s = state;
+    t_array* p = tn_rand_alloc(s->n, 1.0, s->seed++);
+    T_ARRAY_FREE(p);
+}
+
+static void
+bench_rng (bench_ctx* ctx)
+{
+    int sizes[] = {1000, 100000, 1000000};
+    for (size_t k = 0; k < 3; k++) {
+        rng_state s = {.n = sizes[k], .seed = 1};
+        bench_run(ctx, "rand_alloc", s.n, s.n, "number", kernel_rand, &s);
+    }
+}
+
+//################################################################################
+
+int
+main (int argc, char* argv[])
+{
+    const char* path = "bench.json";
+    bench_ctx ctx = {.reps = 21, .filter = NULL, .count = 0};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            ctx.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            ctx.filter = argv[++i];
+        } else {
+            printf("Usage: %s [-o out.json] [-r repetitions] [-f filter]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ctx.reps < 1) {
+        tp_raiseError("Number of repetitions must be positive.");
+    }
+
+    ctx.samples = malloc(ctx.reps * sizeof(double));
+    Null_exit_message(ctx.samples, "Memory allocation failed in tn_bench!");
+    ctx.out = fopen(path, "w");
+    Null_exit_message(ctx.out, "Could not open output file of tn_bench!");
+    fprintf(ctx.out, "{\n  \"reps\": %d,\n  \"benchmarks\": [", ctx.reps);
+
+    printf("> linear algebra\n");
+    bench_linalg(&ctx);
+    printf("> quadrature\n");
+    bench_quadrature(&ctx);
+    printf("> ODE steppers\n");
+    bench_ode(&ctx);
+    printf("> random numbers\n");
+    bench_rng(&ctx);
+
+    fprintf(ctx.out, "\n  ]\n}\n");
+    fclose(ctx.out);
+    free(ctx.samples);
+    printf("> Results written to %s\n", path);
+    return 0;
+}
@@ -41,6 +41,7 @@
 #include <gsl/gsl_randist.h>
 
 #include <gsl/gsl_matrix.h>
+#include <gsl/gsl_matrix_complex_double.h>
 
 #include "t_programcontrol.h"
 
@@ -53,6 +54,20 @@ typedef struct t_array t_array;
 /*-- alloc t_array --*/
 t_array* t_array_alloc (size_t len);
 
+/*-- type of function that releases foreign memory wrapped by t_array --*/
+// data: wrapped pointer, ctx: context passed to t_array_wrap
+typedef void t_release_func (double* data, void* ctx);
+
+/*-- wrap existing memory of len doubles without copying --
+ * When the reference counter drops to 0, release(data, ctx) is called
+ * instead of free. release == NULL: memory is borrowed and not touched. */
+t_array* t_array_wrap (double* data, size_t len,
+                       t_release_func* release, void* ctx);
+
+/*-- share the storage of a contiguous GSL vector (stride 1) without copying --
+ * owner != 0: gsl_vector_free(src) when the last reference is dropped */
+t_array* t_array_wrap_gsl_vector (gsl_vector* src, int owner);
+
 /*-- increment refcnt from t_array --*/
 void t_array_ref(t_array* arr);
 
@@ -65,6 +80,10 @@ double t_array_get (t_array* arr, size_t index);
 /*--- write value into t_array ---*/
 void t_array_set (t_array* arr, size_t index, double value);
 
+/*--- raw pointer to contiguous data and length (e.g. for bindings) ---*/
+double* t_array_data (t_array* arr);
+size_t t_array_len (const t_array* arr);
+
 /* --- copy data into t_array from any source ---
  * stack or heap */
 void t_array_copy_from_any (t_array* arr,
@@ -98,8 +117,23 @@ typedef struct t_matrix t_matrix;
 
 t_matrix* t_matrix_alloc(size_t rows, size_t cols);
 
+/*-- deep copy of src (also for padded rows, tda > size2) --*/
 t_matrix* t_matrix_create_from_gsl_matrix (const gsl_matrix* src);
 
+/*-- rows x cols matrix sharing storage of arr (row major, refcnt of arr +1) --*/
+t_matrix* t_matrix_create_from_t_array (t_array* arr, size_t rows, size_t cols);
+
+/*-- wrap existing memory without copying, element (i, j) at data[i * tda + j] --
+ * tda >= cols is the row stride (cols: contiguous). release as in t_array_wrap:
+ * called when the last reference is dropped, NULL: memory is borrowed. */
+t_matrix* t_matrix_wrap (double* data, size_t rows, size_t cols, size_t tda,
+                         t_release_func* release, void* ctx);
+
+/*-- share the storage of a GSL matrix (with its tda) without copying --
+ * owner != 0: gsl_matrix_free(src) when the last reference is dropped,
+ * owner == 0: src has to outlive the t_matrix */
+t_matrix* t_matrix_wrap_gsl_matrix (gsl_matrix* src, int owner);
+
 void t_matrix_ref (t_matrix* m);
 
 void t_matrix_unref (t_matrix* m);
@@ -108,6 +142,15 @@ void t_matrix_assign_t_array (t_matrix* m, t_array* heap_ptr);
 
 double t_matrix_get (t_matrix* m, size_t i, size_t j);
 
+size_t t_matrix_rows (const t_matrix* m);
+size_t t_matrix_cols (const t_matrix* m);
+/*-- row stride in doubles, == cols unless storage is wrapped with padding --*/
+size_t t_matrix_tda (const t_matrix* m);
+
+/*-- underlying t_array of row major data (no new reference) --
+ * rows are t_matrix_tda(m) apart, len = (rows - 1) * tda + cols */
+t_array* t_matrix_get_t_array (t_matrix* m);
+
 /*----- modify matrix element at (i, j) -----*/
 void t_matrix_set (t_matrix* m, size_t i, size_t j, double value);
 
@@ -131,6 +174,200 @@ void t_matrix_copy_from_gsl_matrix (t_matrix* m, const gsl_matrix* src);
         m = NULL; \
     } while (0)
 
+//--------------------------------------------------------------------------------
+// binary files and memory mapping
+
+/* Binary format: 64 byte header (magic "TLIBBIN", version, dtype, byte order,
+ * shape) followed by the raw row major doubles. Files written on a machine of
+ * other byte order are swapped by the load functions; mapping them is not
+ * possible. */
+
+/*--modes of t_array_mmap, t_matrix_mmap--*/
+enum {
+    T_MMAP_READONLY = 0,  // shared read only, writing crashes (SIGSEGV)
+    T_MMAP_PRIVATE = 1,   // copy on write, changes stay in the process
+    T_MMAP_SHARED = 2     // writable, changes go to the file and other processes
+};
+
+void t_array_save (const t_array* arr, const char* path);
+void t_matrix_save (const t_matrix* m, const char* path);
+
+/*--read file into own memory, matrix files give the flat row major array--*/
+t_array* t_array_load (const char* path);
+t_matrix* t_matrix_load (const char* path);
+
+/*--map file as storage, instant, pages are read on first access--
+ * the mapping lives until the last reference is released */
+t_array* t_array_mmap (const char* path, int mode);
+t_matrix* t_matrix_mmap (const char* path, int mode);
+
+/*--create zero filled (sparse) file and map it T_MMAP_SHARED--*/
+t_matrix* t_matrix_mmap_create (const char* path, size_t rows, size_t cols);
+
+// opaque pointer, file open for appending rows
+typedef struct t_io_writer t_io_writer;
+
+/*--matrix file with cols columns, rows are appended one by one (snapshots)--
+ * the file is complete after t_io_writer_close, which writes the row count;
+ * closing without any row removes the file and raises (no empty matrices) */
+t_io_writer* t_io_writer_open (const char* path, size_t cols);
+void t_io_writer_append (t_io_writer* w, const double* row);
+size_t t_io_writer_rows (const t_io_writer* w);
+size_t t_io_writer_cols (const t_io_writer* w);
+void t_io_writer_close (t_io_writer* w);
+
+//--------------------------------------------------------------------------------
+// complex arrays and matrices
+
+/* Complex counterparts of t_array and t_matrix with the same reference
+ * counting. t_carray is stored interleaved (re0 im0 re1 im1 ..., the layout
+ * of double complex and GSL) or split (all real parts, then all imaginary
+ * parts), which suits SIMD loops over long arrays better. t_cmatrix is always
+ * interleaved, so GSL can use its storage directly. */
+
+/*--storage layouts of t_carray--*/
+enum {
+    T_COMPLEX_INTERLEAVED = 0,
+    T_COMPLEX_SPLIT = 1
+};
+
+// opaque pointers
+typedef struct t_carray t_carray;
+typedef struct t_cmatrix t_cmatrix;
+
+/*--zero initialised array of len complex numbers--*/
+t_carray* t_carray_alloc (size_t len);
+t_carray* t_carray_alloc_split (size_t len);
+
+/*--wrap existing interleaved memory without copying, release as in t_array_wrap--*/
+t_carray* t_carray_wrap (double complex* data, size_t len,
+                         t_release_func* release, void* ctx);
+
+void t_carray_ref (t_carray* arr);
+void t_carray_unref (t_carray* arr);
+
+double complex t_carray_get (const t_carray* arr, size_t index);
+void t_carray_set (t_carray* arr, size_t index, double complex value);
+
+size_t t_carray_len (const t_carray* arr);
+int t_carray_layout (const t_carray* arr);
+
+/*--raw pointer, only for interleaved layout--*/
+double complex* t_carray_data (t_carray* arr);
+
+/*--pointers to real and imaginary parts of element 0 for any layout--
+ * returns the stride: element i is re[i * stride] + I * im[i * stride] */
+size_t t_carray_parts (t_carray* arr, double** re, double** im);
+
+/*--deep copy, converts between layouts--*/
+void t_carray_copy (t_carray* dest, const t_carray* src);
+
+/*--arr = re + I * im, im == NULL: imaginary parts 0--*/
+void t_carray_copy_from_parts (t_carray* arr, const t_array* re, const t_array* im);
+
+#define T_CARRAY_FREE(arr) \
+    do { \
+        t_carray_unref(arr); \
+        arr = NULL; \
+    } while (0)
+
+t_cmatrix* t_cmatrix_alloc (size_t rows, size_t cols);
+
+/*--rows x cols matrix sharing interleaved arr (row major, refcnt of arr +1)--*/
+t_cmatrix* t_cmatrix_create_from_t_carray (t_carray* arr, size_t rows, size_t cols);
+
+/*--share the storage of a GSL complex matrix (with its tda) without copying--
+ * owner != 0: gsl_matrix_complex_free(src) when the last reference is dropped */
+t_cmatrix* t_cmatrix_wrap_gsl_matrix_complex (gsl_matrix_complex* src, int owner);
+
+void t_cmatrix_ref (t_cmatrix* m);
+void t_cmatrix_unref (t_cmatrix* m);
+
+double complex t_cmatrix_get (const t_cmatrix* m, size_t i, size_t j);
+void t_cmatrix_set (t_cmatrix* m, size_t i, size_t j, double complex value);
+
+size_t t_cmatrix_rows (const t_cmatrix* m);
+size_t t_cmatrix_cols (const t_cmatrix* m);
+/*--row stride in complex elements--*/
+size_t t_cmatrix_tda (const t_cmatrix* m);
+
+/*--underlying interleaved t_carray (no new reference)--*/
+t_carray* t_cmatrix_get_t_carray (t_cmatrix* m);
+
+/*--zero copy view for GSL functions (gsl_blas_zgemm, gsl_linalg_complex_* ...)--*/
+gsl_matrix_complex* t_cmatrix_get_gsl_matrix_complex (t_cmatrix* m);
+
+void t_cmatrix_copy (t_cmatrix* dest, const t_cmatrix* src);
+
+#define T_CMATRIX_FREE(m) \
+    do { \
+        t_cmatrix_unref(m); \
+        m = NULL; \
+    } while (0)
+
+//--------------------------------------------------------------------------------
+// fused element-wise expressions
+
+/* Builds composite updates like y = a*x + b*z - c*w as small expression graph
+ * and evaluates it in one pass over the arrays, without temporary arrays:
+ * the arrays are processed in cache sized blocks (SIMD, OpenMP for long
+ * arrays). The compiled program is cached, so an expression built once can
+ * be evaluated in every step of a time loop; arrays changed in place are
+ * simply read again, scalars like dt are changed with tn_expr_set_scalar.
+ *
+ *   tn_expr* e = tn_expr_alloc();
+ *   int x = tn_expr_array(e, x_arr), v = tn_expr_array(e, v_arr);
+ *   int dt = tn_expr_scalar(e, 0.01);
+ *   int step = tn_expr_add(e, x, tn_expr_mul(e, dt, v));
+ *   tn_expr_eval(e, step, x_arr);         // x += dt * v, out may be an input
+ *   tn_expr_free(e);
+ */
+
+// opaque pointer
+typedef struct tn_expr tn_expr;
+
+/*--element-wise operations, binary ones first--*/
+typedef enum {
+    TN_EXPR_ADD,
+    TN_EXPR_SUB,
+    TN_EXPR_MUL,
+    TN_EXPR_DIV,
+    TN_EXPR_POW,
+    TN_EXPR_MIN,
+    TN_EXPR_MAX,
+    TN_EXPR_NEG,
+    TN_EXPR_ABS,
+    TN_EXPR_SQUARE,
+    TN_EXPR_SQRT,
+    TN_EXPR_EXP,
+    TN_EXPR_LOG,
+    TN_EXPR_SIN,
+    TN_EXPR_COS
+} tn_expr_op;
+
+tn_expr* tn_expr_alloc (void);
+void tn_expr_free (tn_expr* e);
+
+/*--leaves, return id of new node; arr is referenced until tn_expr_free--*/
+int tn_expr_array (tn_expr* e, t_array* arr);
+int tn_expr_scalar (tn_expr* e, double value);
+
+/*--operations on nodes a, b, return id of new node--*/
+int tn_expr_binary (tn_expr* e, tn_expr_op op, int a, int b);
+int tn_expr_unary (tn_expr* e, tn_expr_op op, int a);
+int tn_expr_add (tn_expr* e, int a, int b);
+int tn_expr_sub (tn_expr* e, int a, int b);
+int tn_expr_mul (tn_expr* e, int a, int b);
+int tn_expr_div (tn_expr* e, int a, int b);
+
+/*--change leaves without recompiling--*/
+void tn_expr_set_scalar (tn_expr* e, int node, double value);
+void tn_expr_bind (tn_expr* e, int node, t_array* arr);
+
+/*--out = value of node root, all arrays of root need len(out)--
+ * compiled on first call for root and reused afterwards */
+void tn_expr_eval (tn_expr* e, int root, t_array* out);
+
 //################################################################################
 // LinAlg
 
@@ -207,6 +444,66 @@ void tn_gauss_seidel (const t_matrix* m,
                       const t_array* b, t_array* v,
                       double tol, int max_iter);
 
+//--------------------------------------------------------------------------------
+// incremental least squares
+
+/* Linear least squares fit y ~ x * coef (+ intercept) over a stream of rows.
+ * Rows are rotated into the triangular factor of a QR decomposition (Givens),
+ * so memory and work per row only depend on the number of features. The
+ * coefficients, R^2 and MSE of the fit to all rows seen so far are available
+ * at any time without revisiting old data. */
+
+// opaque pointer
+typedef struct tn_lstsq tn_lstsq;
+
+tn_lstsq* tn_lstsq_alloc (size_t n_features, int fit_intercept);
+
+void tn_lstsq_free (tn_lstsq* ls);
+
+/*--forget all rows--*/
+void tn_lstsq_reset (tn_lstsq* ls);
+
+/*--add one row, x has n_features entries--*/
+void tn_lstsq_add_row (tn_lstsq* ls, const double* x, double y);
+
+/*--add batch of rows, x: rows x n_features, y: rows--*/
+void tn_lstsq_add_batch (tn_lstsq* ls, const t_matrix* x, const t_array* y);
+
+/*--coefficients of current fit into coef (len n_features), returns intercept--
+ * coefficients of linearly dependent features are set to 0 */
+double tn_lstsq_solve (const tn_lstsq* ls, t_array* coef);
+
+/*--number of rows, residual sum of squares, MSE and R^2 of current fit--*/
+size_t tn_lstsq_count (const tn_lstsq* ls);
+double tn_lstsq_rss (const tn_lstsq* ls);
+double tn_lstsq_mse (const tn_lstsq* ls);
+double tn_lstsq_r2 (const tn_lstsq* ls);
+
+//--------------------------------------------------------------------------------
+// complex linear algebra
+
+/* Operands may have any t_carray layout. The loops work on real and imaginary
+ * parts separately, so they vectorize for both layouts. */
+
+/*--y = a * x + y--*/
+void tn_caxpy (double complex a, const t_carray* x, t_carray* y);
+
+/*--x = a * x--*/
+void tn_cscale (double complex a, t_carray* x);
+
+/*--sum x_i * y_i (dotu) and sum conj(x_i) * y_i (dotc)--*/
+double complex tn_cdotu (const t_carray* x, const t_carray* y);
+double complex tn_cdotc (const t_carray* x, const t_carray* y);
+
+/*--euclidean norm sqrt(sum |x_i|^2)--*/
+double tn_cnorm (const t_carray* x);
+
+/*--b = A * v, A: rows x cols, v: cols, b: rows--*/
+void tn_cmatrix_dot_vector (const t_cmatrix* a, const t_carray* v, t_carray* b);
+
+/*--c = a * b, c must not share storage with a or b--*/
+void tn_cmatrix_dot_matrix (const t_cmatrix* a, const t_cmatrix* b, t_cmatrix* c);
+
 //################################################################################
 // (functional) analysis
 
@@ -262,6 +559,146 @@ double complex tn_fourier_transform (double complex integrand(double, void *),
                                      double m, double k, double dt, 
                                      void *params);
 
+//--------------------------------------------------------------------------------
+// surrogates of expensive functions
+
+/* Piecewise Chebyshev approximation of a STD_FUNC on [a, b] to a given
+ * tolerance, built once with adaptive bisection; degree 3 gives piecewise
+ * cubics. Evaluating costs a table lookup and degree multiply-adds, and
+ * tn_surrogate_func is a STD_FUNC itself, so the surrogate replaces the
+ * original in every routine. The piece with the largest error is split
+ * first, until all pieces meet the tolerance or max_pieces is reached:
+ *
+ *   tn_surrogate* s = tn_surrogate_build(bessel, &nu, 0.0, 50.0, NULL);
+ *   double integral = tn_integrate_simpson(tn_surrogate_func, 0.0, 50.0, 1e-4, s);
+ */
+
+enum {
+    TN_SURROGATE_SUCCESS = 0,
+    TN_SURROGATE_TOL_NOT_REACHED = 1  // max_pieces or max_level hit
+};
+
+typedef struct {
+    int degree;           // Chebyshev degree per piece, 1 .. 64
+    double atol;          // accepted at error <= atol + rtol * max |f| on [a, b]
+    double rtol;
+    int max_pieces;       // upper limit of the number of pieces
+    int max_level;        // max bisections of [a, b]
+} tn_surrogate_options;
+
+// opaque pointer
+typedef struct tn_surrogate tn_surrogate;
+
+tn_surrogate_options tn_surrogate_default_options (void);
+
+/*--approximation of func(x, params) on [a, b], opt == NULL: defaults--*/
+tn_surrogate* tn_surrogate_build (STD_FUNC func, void* params, double a, double b,
+                                  const tn_surrogate_options* opt);
+void tn_surrogate_free (tn_surrogate* s);
+
+/*--value at x, outside [a, b] the end pieces are extrapolated--*/
+double tn_surrogate_eval (const tn_surrogate* s, double x);
+
+/*--as STD_FUNC, params is the surrogate--*/
+double tn_surrogate_func (double x, void* params);
+
+/*--y[i] = s(x[i]), vectorized; the t_array version is threaded--*/
+void tn_surrogate_eval_ptr (const tn_surrogate* s, const double* x, double* y, size_t n);
+void tn_surrogate_eval_t_array (const tn_surrogate* s, const t_array* x, t_array* y);
+
+/*--number of pieces, max estimated absolute error (compare with atol + rtol *
+ * max |f|) and TN_SURROGATE_* of the build--*/
+size_t tn_surrogate_pieces (const tn_surrogate* s);
+double tn_surrogate_error (const tn_surrogate* s);
+int tn_surrogate_status (const tn_surrogate* s);
+
+//--------------------------------------------------------------------------------
+// fast fourier transform
+
+/*--in-place radix-2 FFT of n complex values, n has to be a power of 2--
+ * sign = -1: forward, X_k = sum_j x_j exp(-2 pi i jk / n)
+ * sign = +1: backward, not normalized (divide by n for the inverse) */
+void tn_fft (double complex* data, size_t n, int sign);
+
+// opaque pointer, bit reversal and twiddle factors for one length
+typedef struct tn_fft_plan tn_fft_plan;
+
+/*--plan for transforms of length n (power of 2), reused for every call--*/
+tn_fft_plan* tn_fft_plan_alloc (size_t n);
+void tn_fft_plan_free (tn_fft_plan* p);
+size_t tn_fft_plan_len (const tn_fft_plan* p);
+
+/*--same transform as tn_fft with the length of the plan--*/
+void tn_fft_execute (const tn_fft_plan* p, double complex* data, int sign);
+
+//--------------------------------------------------------------------------------
+// nonlinear fits (Levenberg-Marquardt)
+
+/* The model is a STD_FUNC, model(x, params), where params points to the
+ * n_params fit parameters followed by the n_fixed fixed parameters (e.g.
+ * double p[] = {amplitude, gamma, omega, <fixed...>}). Optionally, the
+ * Jacobian jac(x, params, grad) writes d model / d p_k into grad[k];
+ * without it, forward differences are used. In batches, model and jac are
+ * called from several threads at once and must not write global state. */
+
+/*--Jacobian of the model w.r.t. the fit parameters--*/
+typedef void FIT_JAC (double x, void* params, double* grad);
+
+typedef struct {
+    int max_iter;         // max number of iterations (Jacobian evaluations)
+    double ftol;          // stop if chi^2 decreases relatively less than ftol
+    double xtol;          // stop if |dp| <= xtol * (|p| + xtol)
+    double gtol;          // stop if max |J^T r| <= gtol
+    double lambda0;       // initial damping
+    int n_threads;        // threads of tn_lm_fit_batch, <= 0: OpenMP default
+} tn_lm_options;
+
+enum {
+    TN_LM_MAX_ITER = 0,   // max_iter reached without convergence
+    TN_LM_FTOL = 1,
+    TN_LM_XTOL = 2,
+    TN_LM_GTOL = 3,
+    TN_LM_NO_PROGRESS = 4 // no step lowers chi^2 anymore
+};
+
+typedef struct {
+    int status;           // TN_LM_*
+    int n_iter;
+    double chi2;          // sum of squared weighted residuals at the result
+    size_t n_eval;        // evaluations of model and jac
+} tn_lm_result;
+
+// opaque workspace of one fit with fixed sizes
+typedef struct tn_lm_work tn_lm_work;
+
+tn_lm_options tn_lm_default_options (void);
+
+tn_lm_work* tn_lm_work_alloc (size_t n_points, size_t n_params, size_t n_fixed);
+void tn_lm_work_free (tn_lm_work* w);
+
+/*--fits p (initial guess in, result out) to the points (x, y +- sigma)--
+ * sigma == NULL: unweighted, fixed == NULL: no fixed parameters,
+ * opt == NULL: tn_lm_default_options() */
+tn_lm_result tn_lm_fit (STD_FUNC model, FIT_JAC* jac,
+                        const t_array* x, const t_array* y, const t_array* sigma,
+                        t_array* p, const t_array* fixed,
+                        const tn_lm_options* opt);
+
+/*--same on raw pointers with preallocated workspace, does not allocate--*/
+tn_lm_result tn_lm_fit_ptr (STD_FUNC model, FIT_JAC* jac,
+                            const double* x, const double* y, const double* sigma,
+                            double* p, const double* fixed,
+                            const tn_lm_options* opt, tn_lm_work* w);
+
+/*--fits one dataset per row of y (n_fits x n_points) in parallel--
+ * x: 1 x n_points (shared grid) or n_fits x n_points, sigma: NULL or like y,
+ * p: n_fits x n_params initial guesses, overwritten by the results,
+ * results: NULL or array of n_fits */
+void tn_lm_fit_batch (STD_FUNC model, FIT_JAC* jac,
+                      const t_matrix* x, const t_matrix* y, const t_matrix* sigma,
+                      t_matrix* p, const t_array* fixed,
+                      const tn_lm_options* opt, tn_lm_result* results);
+
 /*------differentiation according to Stirling------*/
 double tn_diff_1 (STD_FUNC func, double x, double dx, void *params);
 
@@ -299,6 +736,504 @@ void tn_vv_step (double t, double dt,
                  double* y, ODE_FUNC ode_func,
                  int dim, void *params);
 
+//--------------------------------------------------------------------------------
+// numerical derivatives of functions and sampled data
+
+/* tn_diff_1 and tn_diff_2 need a good dx and one call per point and
+ * stencil point. tn_diff_batch differentiates at all points of x with a
+ * vectorized callback: one call per refinement level evaluates the stencil
+ * points of every point that has not converged yet. The steps h0, h0/2,
+ * ... are combined by Richardson extrapolation (Ridders' method), which
+ * chooses the step per point and estimates the error. tn_diff_jacobian does
+ * the same for ODE_FUNC style functions of a vector. Sampled data is
+ * differentiated with finite difference weights for uniform and
+ * non-uniform grids, one-sided at the ends. */
+
+/*--vectorized function y[i] = f(x[i]) for i < n--*/
+typedef void VEC_FUNC (const double* x, double* y, size_t n, void* params);
+
+typedef struct {
+    int accuracy;         // order of the central stencil: 2, 4 or 6
+    double h0;            // first step (not scaled by x), <= 0: automatic
+    int levels;           // steps h0, h0/2, ... in the Richardson table, 1: none
+    double rtol;          // a point stops at this estimated relative error
+} tn_diff_options;
+
+tn_diff_options tn_diff_default_options (void);
+
+/*--df[i] = f^(deriv)(x[i]), deriv 1 or 2; err: NULL or error estimates, at
+ * least the rounding error (inf with levels = 1); opt == NULL: defaults--*/
+void tn_diff_batch (VEC_FUNC func, void* params, const t_array* x, t_array* df,
+                    int deriv, const tn_diff_options* opt, t_array* err);
+
+/*--jac[i * n_in + j] = d f_i / d x_j of func(t, x, f, params) with n_out
+ * outputs; err: NULL or n_out x n_in error estimates--*/
+void tn_diff_jacobian (ODE_FUNC func, double t, const double* x, int n_in, int n_out,
+                       void* params, double* jac, const tn_diff_options* opt,
+                       double* err);
+
+/*--gradient of the scalar output f[0] of func--*/
+void tn_diff_gradient (ODE_FUNC func, double t, const double* x, int n, void* params,
+                       double* grad, const tn_diff_options* opt, double* err);
+
+/*--derivative (1 or 2) of samples with spacing dx, error O(dx^accuracy)--
+ * accuracy 1 .. 8 (odd values are raised), dy must not be y */
+void tn_diff_samples (const t_array* y, double dx, t_array* dy, int deriv, int accuracy);
+
+/*--same on a strictly increasing, non-uniform grid x--*/
+void tn_diff_samples_grid (const t_array* x, const t_array* y, t_array* dy,
+                           int deriv, int accuracy);
+
+//--------------------------------------------------------------------------------
+// events and Poincare sections
+
+/* Event functions g(t, y) are watched during the integration; a sign change
+ * of g within a step is located on the cubic interpolant of the step, so the
+ * crossing time is accurate to O(dt^4) even for large dt. Events are
+ * recorded in a growing tn_event_log (time, state, which event), terminal
+ * events stop the integration at the crossing. Poincare section of the
+ * plane y[2] = 0, crossed upwards:
+ *
+ *   double plane (double t, const double y[], void* p) { return y[2]; }
+ *   tn_event ev = {plane, +1, 0, NULL};
+ *   tn_rk4_integrate_events(f, 0.0, 0.01, n, y, 3, params, &ev, 1, 0.0, log);
+ *   t_matrix* section = tn_event_log_states(log, 0);
+ */
+
+/*--event function, the event happens at its zeros--*/
+typedef double EVENT_FUNC (double t, const double y[], void* params);
+
+typedef struct {
+    EVENT_FUNC* func;
+    int direction;        // +1: only upward zeros, -1: only downward, 0: both
+    int terminal;         // 1: stop the integration at this event
+    void* params;         // passed to func, NULL: params of the ODE
+} tn_event;
+
+enum {
+    TN_EVENTS_DONE = 0,        // all steps taken
+    TN_EVENTS_TERMINATED = 1   // stopped by a terminal event
+};
+
+typedef struct {
+    int status;           // TN_EVENTS_*
+    double t;             // time at the end (of the terminal event)
+    size_t n_steps;
+    size_t n_events;      // events found in this call
+} tn_event_result;
+
+// opaque growing buffer of events
+typedef struct tn_event_log tn_event_log;
+
+tn_event_log* tn_event_log_alloc (int dim);
+void tn_event_log_free (tn_event_log* log);
+void tn_event_log_clear (tn_event_log* log);
+
+/*--k-th recorded event: number of event function, time and state (dim)--*/
+size_t tn_event_log_count (const tn_event_log* log);
+int tn_event_log_index (const tn_event_log* log, size_t k);
+double tn_event_log_time (const tn_event_log* log, size_t k);
+const double* tn_event_log_state (const tn_event_log* log, size_t k);
+
+/*--states of event index (< 0: all events) as rows of a new matrix, NULL if none--*/
+t_matrix* tn_event_log_states (const tn_event_log* log, int index);
+
+/*--n_steps RK4 steps of size dt from t0 with event detection--
+ * y: state at t0 in, state at result.t out; tol: accuracy of the event times
+ * (<= 0: machine precision); log == NULL: events are only counted */
+tn_event_result tn_rk4_integrate_events (ODE_FUNC ode_func, double t0, double dt,
+                                         long n_steps, double* y, int dim, void* params,
+                                         const tn_event* events, int n_events,
+                                         double tol, tn_event_log* log);
+
+//--------------------------------------------------------------------------------
+// implicit integrators for stiff problems
+
+/* Rosenbrock-W (ode23s, order 2) and variable order BDF/NDF (orders 1 to 5)
+ * integrate y from t0 to t_end with adaptive steps. Both solve linear systems
+ * with I - c * J, J = df/dy, and keep J and its LU factorization in the
+ * workspace as long as the steps converge, so a stiff problem needs far fewer
+ * Jacobians and factorizations than steps. J comes from jac or, with
+ * jac == NULL, from forward differences; with a sparsity pattern, columns
+ * without common nonzero rows are perturbed together (e.g. 3 evaluations of
+ * ode_func for a tridiagonal J of any size).
+ *
+ * A call that starts where the previous one with the same workspace ended
+ * (same t and y) continues with the stored step size, order and J, so output
+ * at many times costs no restarts:
+ *   for (k = 1; k <= n_out; k++) tn_bdf_integrate(f, NULL, t[k-1], t[k], y, ...);
+ */
+
+/*--Jacobian jac[i * dim + j] = d dy_i / d y_j of an ODE_FUNC--*/
+typedef void ODE_JAC (double t, const double y[], double* jac, void* params);
+
+typedef struct {
+    double rtol;          // relative tolerance per component
+    double atol;          // absolute tolerance per component
+    double h0;            // initial step size, <= 0: automatic
+    double h_max;         // maximal step size
+    int max_steps;        // max number of accepted steps per call
+    int max_order;        // BDF: highest order, 1..5
+    int ndf;              // BDF: 1: numerical differentiation formulas, 0: plain BDF
+    int max_jac_age;      // Rosenbrock: renew J after that many steps, <= 0: never
+    const unsigned char* sparsity;  // dim x dim row major, nonzero where J can
+                                    // be nonzero, NULL: dense
+} tn_stiff_options;
+
+enum {
+    TN_STIFF_SUCCESS = 0,
+    TN_STIFF_MAX_STEPS = 1,       // max_steps reached before t_end
+    TN_STIFF_STEP_TOO_SMALL = 2   // step size underflow (singularity?)
+};
+
+/*--result and cost of one call--*/
+typedef struct {
+    int status;           // TN_STIFF_*
+    double t;             // time reached (t_end on success)
+    double h;             // proposed next step size
+    int order;            // order used at the end
+    size_t n_steps;       // accepted steps
+    size_t n_rejected;    // rejected steps
+    size_t n_rhs;         // evaluations of ode_func (incl. finite differences)
+    size_t n_jac;         // evaluations of the Jacobian
+    size_t n_lu;          // LU factorizations
+    size_t n_newton;      // BDF: Newton iterations
+} tn_stiff_result;
+
+// opaque workspace, holds the state between calls
+typedef struct tn_stiff_work tn_stiff_work;
+
+tn_stiff_options tn_stiff_default_options (void);
+
+tn_stiff_work* tn_stiff_work_alloc (int dim);
+void tn_stiff_work_free (tn_stiff_work* w);
+
+/*--forget step size, order and Jacobian (e.g. after changing params)--*/
+void tn_stiff_work_reset (tn_stiff_work* w);
+
+/*--y (state at t0 in, state at result.t out), opt == NULL: defaults--*/
+tn_stiff_result tn_rosenbrock_integrate (ODE_FUNC ode_func, ODE_JAC* jac,
+                                         double t0, double t_end, double* y, int dim,
+                                         void* params, const tn_stiff_options* opt,
+                                         tn_stiff_work* w);
+
+tn_stiff_result tn_bdf_integrate (ODE_FUNC ode_func, ODE_JAC* jac,
+                                  double t0, double t_end, double* y, int dim,
+                                  void* params, const tn_stiff_options* opt,
+                                  tn_stiff_work* w);
+
+//--------------------------------------------------------------------------------
+// exponential propagators for linear systems
+
+/* dy/dt = A y with constant A has the exact solution y(t) = exp(t A) y(0),
+ * so steps of any size cost no accuracy. Small A: compute exp(dt A) once
+ * (tn_expm_prop) and apply it for every output time. Large or sparse A:
+ * tn_expmv computes exp(t A) v in a Krylov subspace and only needs products
+ * A x, e.g. of a stencil or sparse format. */
+
+/*--out = exp(t * a), scaling and squaring with Pade approximants--*/
+void tn_expm (const t_matrix* a, double t, t_matrix* out);
+
+// opaque pointer, holds exp(dt A)
+typedef struct tn_expm_prop tn_expm_prop;
+
+tn_expm_prop* tn_expm_prop_alloc (const t_matrix* a, double dt);
+void tn_expm_prop_free (tn_expm_prop* p);
+
+/*--exp(dt A) (no new reference) and dt--*/
+t_matrix* tn_expm_prop_matrix (tn_expm_prop* p);
+double tn_expm_prop_dt (const tn_expm_prop* p);
+
+/*--out = exp(dt A) y, out may be y--*/
+void tn_expm_prop_apply (tn_expm_prop* p, const t_array* y, t_array* out);
+
+/*--row k of traj = exp(k dt A) y0 for k = 0 .. rows - 1--*/
+void tn_expm_prop_trajectory (tn_expm_prop* p, const t_array* y0, t_matrix* traj);
+
+/*--linear operator y = A x on vectors of length n--*/
+typedef void LINOP_FUNC (const double* x, double* y, void* params);
+
+typedef struct {
+    size_t krylov_dim;    // dimension m of the Krylov subspace, 30 is a good start
+    double tol;           // local error tolerance per unit time
+    double anorm;         // estimate of ||A||, <= 0: estimated from a few A x
+    int symmetric;        // 1: A is symmetric, Lanczos instead of Arnoldi
+} tn_expmv_options;
+
+enum {
+    TN_EXPMV_SUCCESS = 0,
+    TN_EXPMV_TOL_NOT_REACHED = 1  // tol too small for krylov_dim, result less accurate
+};
+
+typedef struct {
+    int status;           // TN_EXPMV_*
+    double error;         // estimate of the accumulated error
+    double hump;          // max ||exp(s A) v|| / ||v|| over the substeps
+    size_t n_steps;       // substeps (Krylov subspaces built)
+    size_t n_matvec;      // evaluations of the operator
+} tn_expmv_result;
+
+tn_expmv_options tn_expmv_default_options (void);
+
+/*--out = exp(t A) v, out may be v, opt == NULL: defaults--*/
+tn_expmv_result tn_expmv (LINOP_FUNC matvec, void* params, size_t n, double t,
+                          const double* v, double* out, const tn_expmv_options* opt);
+
+/*--same with a dense t_matrix as operator--*/
+tn_expmv_result tn_expmv_t_matrix (const t_matrix* a, double t, const t_array* v,
+                                   t_array* out, const tn_expmv_options* opt);
+
+//--------------------------------------------------------------------------------
+// finite difference stencils and method of lines
+
+/* Structured 1D, 2D or 3D grids of cells with spacing h; cell (i, j, k) is
+ * centered at ((i + 0.5) h[0], (j + 0.5) h[1], (k + 0.5) h[2]), x fastest.
+ * Fields carry a halo of order / 2 ghost cells per side that the boundary
+ * conditions fill, so the stencils run without boundary cases and vectorize.
+ * tn_mol_rk4 integrates du/dt = D lap(u) + R(t, u) with RK4 and fuses
+ * stencil, reaction and stage updates into one sweep per stage:
+ *
+ *   tn_bc bc[4] = {{TN_BC_DIRICHLET, 0.0}, {TN_BC_DIRICHLET, 0.0},
+ *                  {TN_BC_PERIODIC, 0.0}, {TN_BC_PERIODIC, 0.0}};
+ *   tn_grid* g = tn_grid_alloc(2, n, h, 4, bc);
+ *   t_array* u = tn_grid_field_alloc(g, 1);
+ *   tn_grid_set_interior(g, u, u0);
+ *   tn_mol_rhs heat = {1, &kappa, NULL, NULL, NULL};
+ *   tn_mol_rk4(g, &heat, u, 0.0, dt, n_steps);
+ */
+
+enum {
+    TN_BC_PERIODIC = 0,   // both sides of the axis must be periodic
+    TN_BC_DIRICHLET = 1,  // value on the boundary face
+    TN_BC_NEUMANN = 2     // outward normal derivative on the boundary face
+};
+
+typedef struct {
+    int type;             // TN_BC_*
+    double value;
+} tn_bc;
+
+// opaque pointer, grid sizes and boundary conditions
+typedef struct tn_grid tn_grid;
+
+/*--n, h: ndim entries; order: 2 or 4; bc: low and high side per axis (2 * ndim)--*/
+tn_grid* tn_grid_alloc (int ndim, const size_t n[], const double h[], int order,
+                        const tn_bc bc[]);
+void tn_grid_free (tn_grid* g);
+
+/*--length of one field incl. ghost cells, interior points, ghost cells per side--*/
+size_t tn_grid_len (const tn_grid* g);
+size_t tn_grid_points (const tn_grid* g);
+int tn_grid_halo (const tn_grid* g);
+
+/*--position of interior point (i, j, k) in a field (unused axes: 0)--*/
+size_t tn_grid_index (const tn_grid* g, size_t i, size_t j, size_t k);
+
+/*--zeroed field of n_comp components, one after the other--*/
+t_array* tn_grid_field_alloc (const tn_grid* g, int n_comp);
+
+/*--copy a compact interior (tn_grid_points values, x fastest) in or out--*/
+void tn_grid_set_interior (const tn_grid* g, t_array* field, const double* values);
+void tn_grid_get_interior (const tn_grid* g, const t_array* field, double* values);
+
+/*--fill the ghost cells of all components from the boundary conditions--*/
+void tn_grid_fill_halo (const tn_grid* g, t_array* field, int n_comp);
+
+/*--out = alpha * lap(in) on the interior, fills the ghost cells of in--*/
+void tn_grid_laplacian (const tn_grid* g, t_array* in, t_array* out, double alpha);
+
+/*--pointwise reaction r = R(t, u) for the n_comp components of one cell--*/
+typedef void REACTION_FUNC (double t, const double u[], double r[], void* params);
+
+/* du_c/dt = diffusion[c] * lap(u_laplace_of[c]) + R_c(t, u), e.g. the wave
+ * equation as u' = v, v' = c^2 lap(u): diffusion = {0, c^2},
+ * laplace_of = {0, 0}, reaction returns r = {v, 0} */
+typedef struct {
+    int n_comp;                 // components per cell, up to 16
+    const double* diffusion;    // per component, NULL: all 1
+    const int* laplace_of;      // per component, NULL: own component
+    REACTION_FUNC* reaction;    // NULL: none; called from several threads
+    void* params;
+} tn_mol_rhs;
+
+/*--n_steps RK4 steps of size dt from t0, u: field of rhs->n_comp components--*/
+void tn_mol_rk4 (const tn_grid* g, const tn_mol_rhs* rhs, t_array* u,
+                 double t0, double dt, long n_steps);
+
+//--------------------------------------------------------------------------------
+// split-operator Schroedinger solver
+
+/* Time dependent Schroedinger equation i dpsi/dt = -lap(psi)/(2m) + V psi
+ * (hbar = 1) in 1 to 3 dimensions on a periodic box [lo, hi) of n points per
+ * axis (powers of 2), x_i = lo + i (hi - lo) / n, x fastest. Each step of
+ * the Strang splitting costs two FFTs with precomputed plans and two
+ * pointwise products with precomputed phases. In imaginary time
+ * (imaginary = 1) the steps damp all excited states and psi is normalized
+ * after every step, so psi converges to the ground state:
+ *
+ *   tn_tdse* s = tn_tdse_alloc(1, n, lo, hi, 1.0, 1e-3, 1);
+ *   tn_tdse_set_potential(s, v);
+ *   t_carray_copy_from_parts(tn_tdse_psi(s), guess, NULL);
+ *   tn_tdse_step(s, 5000);
+ *   double e0 = tn_tdse_energy(s);
+ */
+
+/*--content of a snapshot row--*/
+enum {
+    TN_TDSE_DENSITY = 0,  // |psi|^2, points columns
+    TN_TDSE_PSI = 1       // re, im interleaved, 2 * points columns
+};
+
+// opaque pointer, grid, FFT plans, phases and psi
+typedef struct tn_tdse tn_tdse;
+
+/*--n, lo, hi: ndim entries; dt: time step; potential 0 until set--*/
+tn_tdse* tn_tdse_alloc (int ndim, const size_t n[], const double lo[], const double hi[],
+                        double mass, double dt, int imaginary);
+void tn_tdse_free (tn_tdse* s);
+
+/*--wave function (no new reference, interleaved), to be filled before stepping--*/
+t_carray* tn_tdse_psi (tn_tdse* s);
+
+double tn_tdse_time (const tn_tdse* s);
+void tn_tdse_set_time (tn_tdse* s, double t);
+
+/*--V at the grid points (x fastest), recomputes the phases--*/
+void tn_tdse_set_potential (tn_tdse* s, const t_array* v);
+
+/*--n_steps steps of dt--*/
+void tn_tdse_step (tn_tdse* s, long n_steps);
+
+/*--sqrt(integral |psi|^2) and <H> / <psi|psi>--*/
+double tn_tdse_norm (const tn_tdse* s);
+double tn_tdse_energy (tn_tdse* s);
+
+/*--append psi as one row (TN_TDSE_*) to a file--*/
+void tn_tdse_snapshot (tn_tdse* s, t_io_writer* w, int what);
+
+//--------------------------------------------------------------------------------
+// tree code for gravitational and Coulomb forces
+
+/* Barnes-Hut octree over Morton sorted particles: O(N log N) instead of
+ * O(N^2) for all pair forces. Far cells act through their monopole, dipole
+ * and (optionally) quadrupole moments; theta controls the accuracy
+ * (0 = direct sum, 0.5 ~ 5e-4 relative error with quadrupoles). As ODE_FUNC
+ * for tn_vv_step, y holds n positions followed by n velocities:
+ *
+ *   tn_tree* tree = tn_tree_alloc(n, NULL);
+ *   tn_tree_set_weights(tree, mass, NULL);
+ *   tn_vv_step(t, dt, y, tn_tree_ode_func, 6 * n, tree);
+ */
+
+/*--force law--*/
+enum {
+    TN_TREE_GRAVITY = 0,  // a_i = coupling * sum_j m_j (r_j - r_i) / r^3
+    TN_TREE_COULOMB = 1   // a_i = coupling * q_i / m_i * sum_j q_j (r_i - r_j) / r^3
+};
+
+typedef struct {
+    int kind;             // TN_TREE_*
+    double coupling;      // G or Coulomb constant
+    double theta;         // opening angle, cell accepted if size / dist < theta
+    double softening;     // Plummer length, r^2 -> r^2 + softening^2
+    int leaf_size;        // maximal particles per leaf
+    int quadrupole;       // 0: monopole and dipole only
+} tn_tree_options;
+
+/*--gravity, coupling 1, theta 0.5, no softening, leaves of 16, quadrupoles--*/
+tn_tree_options tn_tree_default_options (void);
+
+// opaque pointer, sorted particles and cells
+typedef struct tn_tree tn_tree;
+
+/*--tree for n particles, opt == NULL for the defaults--*/
+tn_tree* tn_tree_alloc (size_t n, const tn_tree_options* opt);
+void tn_tree_free (tn_tree* tree);
+
+/*--n masses (NULL: all 1) and charges (Coulomb only), not copied--*/
+void tn_tree_set_weights (tn_tree* tree, const double* mass, const double* charge);
+
+/*--sorts the particles and rebuilds all cells--*/
+void tn_tree_build (tn_tree* tree, const Vec_3D* pos);
+
+/*--accelerations of all particles of the last build--*/
+void tn_tree_accel (const tn_tree* tree, Vec_3D* acc);
+
+/*--same by direct summation in O(N^2), e.g. for checks of theta--*/
+void tn_tree_direct (tn_tree* tree, const Vec_3D* pos, Vec_3D* acc);
+
+/*--ODE_FUNC, params = tree: dy = (velocities, accelerations), rebuilds the tree--*/
+void tn_tree_ode_func (double t, const double y[], double dy[], void* params);
+
+/*--number of cells of the last build--*/
+size_t tn_tree_nodes (const tn_tree* tree);
+
+//--------------------------------------------------------------------------------
+// neighbour lists for short-range pair forces
+
+/* Linked cells and a Verlet list of radius cutoff + skin make short-range
+ * forces O(N). The list is rebuilt only when a particle moved more than
+ * skin / 2, each rebuild also re-sorts the particles by cell for cache
+ * locality. Axes with box[k] > 0 are periodic (minimum image). Forces are
+ * threaded with per-thread buffers, every pair is evaluated once:
+ *
+ *   tn_lj_params lj = {1.0, 1.0, 2.5};
+ *   tn_nlist* list = tn_nlist_alloc(n, &opt);
+ *   tn_nlist_set_pair(list, tn_pair_lennard_jones, &lj);
+ *   tn_vv_step(t, dt, y, tn_nlist_ode_func, 6 * n, list);
+ */
+
+/*--pair interaction: returns U(r), f = -U'(r) / r, i.e. F_i = f (r_i - r_j)--*/
+typedef double PAIR_FUNC (double r2, double* f, void* params);
+
+typedef struct {
+    double cutoff;        // interaction range
+    double skin;          // list radius cutoff + skin
+    double box[3];        // periodic lengths, <= 0: open axis
+} tn_nlist_options;
+
+/*--cutoff 2.5, skin 0.3, open box--*/
+tn_nlist_options tn_nlist_default_options (void);
+
+// opaque pointer, cells, sorted particles and Verlet list
+typedef struct tn_nlist tn_nlist;
+
+/*--periodic lengths have to be >= 2 (cutoff + skin)--*/
+tn_nlist* tn_nlist_alloc (size_t n, const tn_nlist_options* opt);
+void tn_nlist_free (tn_nlist* list);
+
+void tn_nlist_set_pair (tn_nlist* list, PAIR_FUNC pair, void* params);
+
+/*--n masses for tn_nlist_ode_func (NULL: all 1), not copied--*/
+void tn_nlist_set_masses (tn_nlist* list, const double* mass);
+
+/*--rebuilds if needed (first call, displacement > skin / 2), returns 1 if rebuilt--*/
+int tn_nlist_update (tn_nlist* list, const Vec_3D* pos);
+
+/*--forces the next update to rebuild, e.g. after particles were moved by hand--*/
+void tn_nlist_invalidate (tn_nlist* list);
+
+/*--updates the list and computes all forces, returns the potential energy--*/
+double tn_nlist_forces (tn_nlist* list, const Vec_3D* pos, Vec_3D* force);
+
+/*--ODE_FUNC, params = list: dy = (velocities, forces / masses)--*/
+void tn_nlist_ode_func (double t, const double y[], double dy[], void* params);
+
+/*--pairs in the list, rebuilds so far, energy of the last force evaluation--*/
+size_t tn_nlist_pairs (const tn_nlist* list);
+long tn_nlist_builds (const tn_nlist* list);
+double tn_nlist_energy (const tn_nlist* list);
+
+/*--Lennard-Jones potential, shifted to 0 at the cutoff--*/
+typedef struct {
+    double epsilon;
+    double sigma;
+    double cutoff;        // same as in tn_nlist_options
+} tn_lj_params;
+
+/*--PAIR_FUNC, params = tn_lj_params--*/
+double tn_pair_lennard_jones (double r2, double* f, void* params);
+
 //################################################################################
 // stochastics
 
@@ -312,4 +1247,268 @@ double tn_binomial_distribution (int k, const unsigned int n, const double p);
 /* Generate an array of len n of random numbers from a normal distribution */
 t_array* tn_rand_alloc (int n, double sigma, int seed);
 
+//--------------------------------------------------------------------------------
+// streaming statistics
+
+/* All accumulators work online: samples are added one by one or in chunks
+ * and never stored, so series of arbitrary length can be analysed during a
+ * simulation. Accumulators of different threads/chunks can be merged. */
+
+/*--moments of a series (Welford), value type, e.g. one per thread--*/
+typedef struct {
+    size_t n;
+    double mean;
+    double m2, m3, m4;    // sums of (x - mean)^k
+    double min, max;
+} tn_moments;
+
+void tn_moments_init (tn_moments* m);
+void tn_moments_add (tn_moments* m, double x);
+
+/*--adds all elements, long arrays are split over the OpenMP threads--*/
+void tn_moments_add_t_array (tn_moments* m, const t_array* a);
+
+/*--dest = moments of the union of both series, exact--*/
+void tn_moments_merge (tn_moments* dest, const tn_moments* src);
+
+// NAN if not enough samples; sample variance with n - 1
+double tn_moments_mean (const tn_moments* m);
+double tn_moments_variance (const tn_moments* m);
+double tn_moments_std_error (const tn_moments* m);   // of the mean, uncorrelated
+double tn_moments_skewness (const tn_moments* m);
+double tn_moments_kurtosis (const tn_moments* m);    // excess kurtosis
+
+/*--histogram with n_bins equal bins in [lo, hi), log_bins != 0: equal in log(x)--*/
+// opaque pointer
+typedef struct tn_histogram tn_histogram;
+
+tn_histogram* tn_histogram_alloc (double lo, double hi, size_t n_bins,
+                                  int log_bins);
+void tn_histogram_free (tn_histogram* h);
+void tn_histogram_reset (tn_histogram* h);
+
+void tn_histogram_add (tn_histogram* h, double x);
+void tn_histogram_add_weighted (tn_histogram* h, double x, double w);
+void tn_histogram_add_t_array (tn_histogram* h, const t_array* a);
+
+/*--adds counts of src to dest, both need identical bins--*/
+void tn_histogram_merge (tn_histogram* dest, const tn_histogram* src);
+
+size_t tn_histogram_n_bins (const tn_histogram* h);
+/*--lower edge of bin i, i = n_bins gives hi--*/
+double tn_histogram_edge (const tn_histogram* h, size_t i);
+double tn_histogram_count (const tn_histogram* h, size_t i);
+/*--count / (total * bin width), normalized to 1 incl. under-/overflow--*/
+double tn_histogram_density (const tn_histogram* h, size_t i);
+double tn_histogram_underflow (const tn_histogram* h);
+double tn_histogram_overflow (const tn_histogram* h);
+double tn_histogram_total (const tn_histogram* h);
+
+/*--quantile q in [0, 1] by selection in O(n) instead of sorting--
+ * linear interpolation between order statistics (as numpy's default),
+ * the elements of data are reordered */
+double tn_quantile (t_array* data, double q);
+double tn_median (t_array* data);
+
+/*--out[i] = quantile q[i], ascending q reuse the previous partitions--*/
+void tn_quantiles (t_array* data, const t_array* q, t_array* out);
+
+/*--binning (blocking) analysis of a correlated series--
+ * level l averages blocks of 2^l samples, memory O(n_levels) */
+// opaque pointer
+typedef struct tn_binning tn_binning;
+
+tn_binning* tn_binning_alloc (size_t n_levels);
+void tn_binning_free (tn_binning* b);
+void tn_binning_reset (tn_binning* b);
+
+void tn_binning_add (tn_binning* b, double x);
+void tn_binning_add_t_array (tn_binning* b, const t_array* a);
+
+size_t tn_binning_n_levels (const tn_binning* b);
+/*--number of complete blocks of level--*/
+size_t tn_binning_count (const tn_binning* b, size_t level);
+double tn_binning_mean (const tn_binning* b);
+/*--error of the mean estimated from blocks of level--*/
+double tn_binning_error (const tn_binning* b, size_t level);
+/*--tau_int = 0.5 * (error(level) / error(0))^2, valid on the plateau--*/
+double tn_binning_tau_int (const tn_binning* b, size_t level);
+/*--highest level with at least min_bins blocks (e.g. 32)--*/
+size_t tn_binning_plateau (const tn_binning* b, size_t min_bins);
+
+/*--normalized autocorrelation rho(t), t = 0 .. len(acf) - 1, by FFT--*/
+void tn_autocorr (const t_array* series, t_array* acf);
+
+/*--integrated autocorrelation time 0.5 + sum_t rho(t), by FFT--
+ * summed up to the self-consistent window W >= c * tau_int (Sokal, c ~ 5),
+ * W is written to window if not NULL */
+double tn_tau_int (const t_array* series, double c, size_t* window);
+
+//--------------------------------------------------------------------------------
+// bootstrap and jackknife
+
+/* Errors of nonlinear observables (ratios, susceptibilities, fit results...)
+ * by resampling. data holds n records of dim values each (row-major, len n *
+ * dim, e.g. dim = 2 for pairs (E, E^2)); the estimator maps n records to the
+ * observable. Replicas are evaluated in parallel by OpenMP, so the estimator
+ * must not write global state. */
+
+/*--observable of n records with dim values each--*/
+typedef double ESTIMATOR_FUNC (const double* sample, size_t n, size_t dim,
+                               void* params);
+
+typedef struct {
+    size_t n_replicas;    // number of bootstrap replicas (not used by jackknife)
+    size_t block_len;     // records per block, > 1 for correlated series
+    double confidence;    // of the confidence interval, e.g. 0.6827
+    unsigned long seed;   // bootstrap: replica r uses stream (seed, r)
+    int n_threads;        // <= 0: OpenMP default
+} tn_resample_options;
+
+typedef struct {
+    double estimate;      // estimator on the full data
+    double mean;          // mean of the replicas
+    double bias;          // estimated bias of estimate
+    double corrected;     // estimate - bias
+    double std_error;
+    double ci_lo, ci_hi;  // confidence interval
+} tn_resample_result;
+
+tn_resample_options tn_resample_default_options (void);
+
+/*--(moving block) bootstrap with bias-corrected percentile interval--
+ * replicas: NULL or len n_replicas, receives the replica estimates,
+ * opt == NULL: tn_resample_default_options() */
+void tn_bootstrap (ESTIMATOR_FUNC estimator, const t_array* data, size_t dim,
+                   void* params, const tn_resample_options* opt,
+                   t_array* replicas, tn_resample_result* result);
+
+/*--(blocked) jackknife, leaves out one of n / block_len blocks at a time--
+ * the last n % block_len records are dropped, so all blocks are equal;
+ * normal interval around the bias-corrected estimate,
+ * replicas: NULL or len n / block_len */
+void tn_jackknife (ESTIMATOR_FUNC estimator, const t_array* data, size_t dim,
+                   void* params, const tn_resample_options* opt,
+                   t_array* replicas, tn_resample_result* result);
+
+//--------------------------------------------------------------------------------
+// Markov chain Monte Carlo for lattice spin models
+
+/* Ising (s = +-1), q-state Potts and XY model on a periodic square or cubic
+ * lattice of even L, H = -J sum_<ij> s_i.s_j - h sum_i s_i (Potts:
+ * -J sum delta(s_i, s_j), no field). Local sweeps run on the checkerboard
+ * in parallel with one RNG stream per lattice row, so results do not
+ * depend on the number of threads. Observables are accumulated online:
+ *
+ *   tn_mcmc* mc = tn_mcmc_alloc(&opt, 0.44);
+ *   tn_mcmc_run(mc, TN_MCMC_WOLFF, 1000, 0);      // thermalize
+ *   tn_mcmc_run(mc, TN_MCMC_WOLFF, 100000, 1);    // measure every sweep
+ *   const tn_mcmc_observables* o = tn_mcmc_observables_get(mc);
+ *   // C = beta^2 N var(e), chi = beta N (<m^2> - <|m|>^2)
+ */
+
+/*--models--*/
+enum {
+    TN_MCMC_ISING = 0,
+    TN_MCMC_POTTS = 1,
+    TN_MCMC_XY = 2
+};
+
+/*--updates, one unit of tn_mcmc_sweep each--*/
+enum {
+    TN_MCMC_METROPOLIS = 0,     // checkerboard, every site once
+    TN_MCMC_HEATBATH = 1,       // checkerboard, XY by von Mises sampling
+    TN_MCMC_WOLFF = 2,          // fixed number of clusters, ~N sites in the first sweep
+    TN_MCMC_SWENDSEN_WANG = 3   // all clusters once
+};
+
+typedef struct {
+    int model;            // TN_MCMC_*
+    int ndim;             // 2 or 3
+    size_t L;             // even edge length
+    int q;                // Potts states, 2 .. 64
+    double J;             // coupling, > 0 ferromagnetic
+    double h;             // field along x (Ising, XY)
+    double xy_step;       // maximal angle of XY Metropolis proposals
+    unsigned long seed;   // row r uses stream (seed, r)
+} tn_mcmc_options;
+
+/*--2D Ising, L = 32, q = 3, J = 1, h = 0, xy_step = 1, seed 0--*/
+tn_mcmc_options tn_mcmc_default_options (void);
+
+/*--online averages per site of measured configurations--*/
+typedef struct {
+    tn_moments energy;        // E / N
+    tn_moments magnetization; // |m|, Potts: (q max_k n_k / N - 1) / (q - 1)
+    tn_moments m2;            // m^2, e.g. Binder 1 - <m^4> / (3 <m^2>^2) via kurtosis
+} tn_mcmc_observables;
+
+// opaque pointer, lattice, RNG streams and observables
+typedef struct tn_mcmc tn_mcmc;
+
+/*--ordered start, opt == NULL for the defaults--*/
+tn_mcmc* tn_mcmc_alloc (const tn_mcmc_options* opt, double beta);
+void tn_mcmc_free (tn_mcmc* mc);
+
+/*--a new beta recalibrates the number of clusters of the next Wolff sweep--*/
+void tn_mcmc_set_beta (tn_mcmc* mc, double beta);
+double tn_mcmc_beta (const tn_mcmc* mc);
+size_t tn_mcmc_sites (const tn_mcmc* mc);
+
+/*--ordered (cold) or random (hot) configuration--*/
+void tn_mcmc_order (tn_mcmc* mc);
+void tn_mcmc_randomize (tn_mcmc* mc);
+
+/*--spin of site (x fastest): Ising +-1, Potts state, XY angle--*/
+double tn_mcmc_spin (const tn_mcmc* mc, size_t site);
+
+/*--n_sweeps updates (TN_MCMC_METROPOLIS ...)--*/
+void tn_mcmc_sweep (tn_mcmc* mc, int update, long n_sweeps);
+
+/*--energy and magnetization per site of the current configuration, NULL to skip--*/
+void tn_mcmc_state (const tn_mcmc* mc, double* energy, double* magnetization);
+
+/*--adds the current configuration to the observables--*/
+void tn_mcmc_measure (tn_mcmc* mc);
+const tn_mcmc_observables* tn_mcmc_observables_get (const tn_mcmc* mc);
+void tn_mcmc_reset_observables (tn_mcmc* mc);
+
+/*--n_sweeps sweeps, measures every measure_every sweeps (0: never)--*/
+void tn_mcmc_run (tn_mcmc* mc, int update, long n_sweeps, long measure_every);
+
+/*--parallel tempering: one replica per beta, replicas sweep in parallel,
+ * then neighbouring temperatures try to swap (even and odd pairs alternate)--*/
+// opaque pointer
+typedef struct tn_mcmc_pt tn_mcmc_pt;
+
+tn_mcmc_pt* tn_mcmc_pt_alloc (const tn_mcmc_options* opt, const double* beta,
+                              int n_replicas);
+void tn_mcmc_pt_free (tn_mcmc_pt* pt);
+
+/*--n_rounds of sweeps_per_round sweeps and swap attempts, measure != 0: add
+ * every round to the observables of each temperature--*/
+void tn_mcmc_pt_run (tn_mcmc_pt* pt, int update, long n_rounds, long sweeps_per_round,
+                     int measure);
+
+/*--replica and observables at beta[k], swap rate of beta[k] and beta[k + 1]--*/
+tn_mcmc* tn_mcmc_pt_replica (tn_mcmc_pt* pt, int k);
+const tn_mcmc_observables* tn_mcmc_pt_observables (const tn_mcmc_pt* pt, int k);
+double tn_mcmc_pt_acceptance (const tn_mcmc_pt* pt, int k);
+
+//################################################################################
+// profiling
+
+/* Only active if tlib was built with PROFILE=1 (-DTN_PROFILE). Then every tn_*
+ * kernel of linalg, analysis, ODE and stochastics counts its calls, the
+ * evaluations of the passed callback (STD_FUNC, ODE_FUNC) and its wall time.
+ * Records are kept per thread and merged into a report which is written
+ * automatically at exit to $TN_PROFILE_OUTPUT (default: tn_profile.json). */
+
+/*--write merged report, format by file ending: .csv or JSON otherwise--*/
+// path == NULL --> $TN_PROFILE_OUTPUT or tn_profile.json
+void tn_profile_write_report (const char* path);
+
+/*--set all counters and timers of all threads to 0--*/
+void tn_profile_reset (void);
+
 #endif
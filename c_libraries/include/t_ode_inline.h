@@ -0,0 +1,179 @@
+/* t_ode_inline.h
+ *
+ * -------------------------------------------------------------------------------
+ * Purpose:
+ * Header-only variants of the ODE steppers of t_numerics (Euler, RK2, RK4 and
+ * Velocity-Verlet) plus a driver loop over many steps. The steppers in
+ * libtlib.so call the right-hand side through a function pointer across the
+ * library boundary, so the compiler can neither inline it nor vectorize the
+ * stage loops around it. Here the right-hand side is passed as macro argument,
+ * and all steppers are generated as static inline functions in the translation
+ * unit that also contains the right-hand side.
+ *
+ * Usage:
+ * The right-hand side must have the ODE_FUNC signature and its definition must
+ * be visible before the macro is expanded (ideally static inline):
+ *
+ *   static inline void
+ *   oscillator (double t, const double y[], double dy[], void *params) {...}
+ *
+ *   TN_DEFINE_ODE_STEPPERS(osc, oscillator)
+ *
+ * generates
+ *   osc_euler_step, osc_rk2_step, osc_rk4_step, osc_vv_step
+ *       (double t, double dt, double* y, double* work, int dim, void *params)
+ *   osc_euler_integrate, osc_rk2_integrate, osc_rk4_integrate, osc_vv_integrate
+ *       (double t, double dt, long n_steps, double* y, double* work,
+ *        double* traj, int dim, void *params)
+ *
+ * work is a caller-owned buffer of TN_ODE_INLINE_WORK(dim) doubles which is
+ * reused for every step, so no memory is allocated inside the steppers. The
+ * integrate functions take n_steps steps starting at t and, if traj != NULL,
+ * write the state after every step into traj (n_steps * dim doubles, row i
+ * holds the state at t + (i + 1) * dt). Compile with -O3 (and -march=native)
+ * to let the compiler vectorize the stage loops.
+ *
+ * Nothing has to be linked for this header; it only depends on the C standard.
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ */
+
+#ifndef T_ODE_INLINE_H
+#define T_ODE_INLINE_H
+
+/* number of doubles of the work buffer for all steppers and drivers */
+#define TN_ODE_INLINE_WORK(dim) (5 * (dim))
+
+#define TN_DEFINE_ODE_STEPPERS(prefix, rhs) \
+    \
+    /*------euler-stepper, err ~ O(dt)------*/ \
+    static inline void \
+    prefix##_euler_step (double t, double dt, double* restrict y, \
+                         double* restrict work, int dim, void *params) \
+    { \
+        double* restrict dy = work; \
+        rhs (t, y, dy, params); \
+        for (int i = 0; i < dim; i++) { \
+            y[i] += dt * dy[i]; \
+        } \
+    } \
+    \
+    /*------runge-kutta-2-stepper, err ~ O(dt^2)------*/ \
+    static inline void \
+    prefix##_rk2_step (double t, double dt, double* restrict y, \
+                       double* restrict work, int dim, void *params) \
+    { \
+        double* restrict dy = work; \
+        double* restrict sup = work + dim; \
+        rhs (t, y, dy, params); \
+        for (int i = 0; i < dim; i++) { \
+            sup[i] = y[i] + 0.5 * dt * dy[i]; \
+        } \
+        rhs (t + 0.5 * dt, sup, dy, params); \
+        for (int i = 0; i < dim; i++) { \
+            y[i] += dt * dy[i]; \
+        } \
+    } \
+    \
+    /*------runge-kutta-4-stepper, err ~ O(dt^4)------*/ \
+    static inline void \
+    prefix##_rk4_step (double t, double dt, double* restrict y, \
+                       double* restrict work, int dim, void *params) \
+    { \
+        double* restrict k1 = work + 0 * dim; \
+        double* restrict k2 = work + 1 * dim; \
+        double* restrict k3 = work + 2 * dim; \
+        double* restrict k4 = work + 3 * dim; \
+        double* restrict sup = work + 4 * dim; \
+        rhs (t, y, k1, params); \
+        for (int i = 0; i < dim; i++) { \
+            sup[i] = y[i] + 0.5 * dt * k1[i]; \
+        } \
+        rhs (t + 0.5 * dt, sup, k2, params); \
+        for (int i = 0; i < dim; i++) { \
+            sup[i] = y[i] + 0.5 * dt * k2[i]; \
+        } \
+        rhs (t + 0.5 * dt, sup, k3, params); \
+        for (int i = 0; i < dim; i++) { \
+            sup[i] = y[i] + dt * k3[i]; \
+        } \
+        rhs (t + dt, sup, k4, params); \
+        for (int i = 0; i < dim; i++) { \
+            y[i] += (dt / 6.0) * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]); \
+        } \
+    } \
+    \
+    /*------velocity-verlet-stepper, err ~ O(dt^2)------*/ \
+    /* y = {positions, velocities}, dim must be even. The update of the \
+     * velocities needs the acceleration at t and t + dt; dy holds the \
+     * derivative at t on entry and at t + dt on exit. */ \
+    static inline void \
+    prefix##_vv_kick_drift (double t, double dt, double* restrict y, \
+                            double* restrict dy, double* restrict dy_next, \
+                            int dim, void *params) \
+    { \
+        int half = dim / 2; \
+        for (int i = 0; i < half; i++) { \
+            y[i] += y[half + i] * dt + 0.5 * dy[half + i] * dt * dt; \
+        } \
+        rhs (t + dt, y, dy_next, params); \
+        for (int i = half; i < dim; i++) { \
+            y[i] += 0.5 * (dy_next[i] + dy[i]) * dt; \
+        } \
+        for (int i = 0; i < dim; i++) { \
+            dy[i] = dy_next[i]; \
+        } \
+    } \
+    \
+    static inline void \
+    prefix##_vv_step (double t, double dt, double* restrict y, \
+                      double* restrict work, int dim, void *params) \
+    { \
+        rhs (t, y, work, params); \
+        prefix##_vv_kick_drift (t, dt, y, work, work + dim, dim, params); \
+    } \
+    \
+    /*------driver loops------*/ \
+    TN_ODE_INLINE_DRIVER(prefix, euler) \
+    TN_ODE_INLINE_DRIVER(prefix, rk2) \
+    TN_ODE_INLINE_DRIVER(prefix, rk4) \
+    \
+    /* Velocity-Verlet reuses the acceleration at the end of a step as the one \
+     * at the beginning of the next step --> one evaluation of rhs per step */ \
+    static inline void \
+    prefix##_vv_integrate (double t, double dt, long n_steps, double* restrict y, \
+                           double* restrict work, double* restrict traj, \
+                           int dim, void *params) \
+    { \
+        rhs (t, y, work, params); \
+        for (long n = 0; n < n_steps; n++) { \
+            prefix##_vv_kick_drift (t + n * dt, dt, y, work, work + dim, \
+                                    dim, params); \
+            if (traj) { \
+                for (int i = 0; i < dim; i++) { \
+                    traj[n * dim + i] = y[i]; \
+                } \
+            } \
+        } \
+    }
+
+/* helper of TN_DEFINE_ODE_STEPPERS, not meant to be used directly */
+#define TN_ODE_INLINE_DRIVER(prefix, stepper) \
+    static inline void \
+    prefix##_##stepper##_integrate (double t, double dt, long n_steps, \
+                                    double* restrict y, double* restrict work, \
+                                    double* restrict traj, int dim, \
+                                    void *params) \
+    { \
+        for (long n = 0; n < n_steps; n++) { \
+            prefix##_##stepper##_step (t + n * dt, dt, y, work, dim, params); \
+            if (traj) { \
+                for (int i = 0; i < dim; i++) { \
+                    traj[n * dim + i] = y[i]; \
+                } \
+            } \
+        } \
+    }
+
+#endif
@@ -8,6 +8,12 @@
 // constructor and destructor (unref)
 //-----------------------------------
 
+static void /* release of memory allocated by t_array_alloc */
+t_array_release_own (double* data, void* ctx __attribute__((unused)))
+{
+    free(data);
+}
+
 t_array*
 t_array_alloc (size_t len)
 {
@@ -17,9 +23,47 @@ t_array_alloc (size_t len)
     Null_exit_message(arr->ptr, "Memory allocation failed in t_array_alloc!");
     arr->len = len;
     arr->refcnt = 1;
+    arr->release = t_array_release_own;
+    arr->release_ctx = NULL;
+    return arr;
+}
+
+t_array*
+t_array_wrap (double* data, size_t len,
+              t_release_func* release, void* ctx)
+{
+    if (!data && len > 0) {
+        tp_raiseError("Null pointer in t_array_wrap.");
+    }
+    t_array* arr = malloc(sizeof(t_array));
+    Null_exit_message(arr, "Memory allocation failed in t_array_wrap!");
+    arr->ptr = data;
+    arr->len = len;
+    arr->refcnt = 1;
+    arr->release = release;
+    arr->release_ctx = ctx;
     return arr;
 }
 
+static void /* release of a wrapped gsl_vector owned by the t_array */
+release_gsl_vector (double* data __attribute__((unused)), void* ctx)
+{
+    gsl_vector_free((gsl_vector*)ctx);
+}
+
+t_array*
+t_array_wrap_gsl_vector (gsl_vector* src, int owner)
+{
+    if (!src) {
+        tp_raiseError("Null pointer in t_array_wrap_gsl_vector.");
+    }
+    if (src->stride != 1 && src->size > 1) {
+        tp_raiseError("t_array_wrap_gsl_vector needs a gsl_vector with stride 1.");
+    }
+    return t_array_wrap(src->data, src->size,
+                        owner ? release_gsl_vector : NULL, src);
+}
+
 void
 t_array_ref(t_array* arr)
 {
@@ -36,7 +80,9 @@ t_array_unref (t_array* arr)
             #if DEBUG == 1
             printf("> Freeing array at %p\n", (void*)arr);
             #endif
-            free(arr->ptr);
+            if (arr->release) {
+                arr->release(arr->ptr, arr->release_ctx);
+            }
             free(arr);
         }
     }
@@ -70,6 +116,24 @@ t_array_set (t_array* arr, size_t index, double value)
     arr->ptr[index] = value;
 }
 
+double*
+t_array_data (t_array* arr)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_array_data.");
+    }
+    return arr->ptr;
+}
+
+size_t
+t_array_len (const t_array* arr)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_array_len.");
+    }
+    return arr->len;
+}
+
 //-----------------------------------
 // copy functions (shallow and deep)
 //-----------------------------------
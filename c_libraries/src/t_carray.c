@@ -0,0 +1,201 @@
+#include "t_numerics_intern.h"
+
+//================================================================================
+//    complex arrays
+//================================================================================
+
+//-----------------------------------
+// constructor and destructor (unref)
+//-----------------------------------
+
+static void /* release of memory allocated by t_carray_alloc */
+t_carray_release_own (double* data, void* ctx __attribute__((unused)))
+{
+    free(data);
+}
+
+static t_carray*
+carray_alloc (size_t len, int layout)
+{
+    t_carray* arr = malloc(sizeof(t_carray));
+    Null_exit_message(arr, "Memory allocation failed in t_carray_alloc!");
+    arr->ptr = (double*) calloc(2 * len, sizeof(double));
+    Null_exit_message(arr->ptr, "Memory allocation failed in t_carray_alloc!");
+    arr->len = len;
+    arr->layout = layout;
+    arr->refcnt = 1;
+    arr->release = t_carray_release_own;
+    arr->release_ctx = NULL;
+    return arr;
+}
+
+t_carray*
+t_carray_alloc (size_t len)
+{
+    return carray_alloc(len, T_COMPLEX_INTERLEAVED);
+}
+
+t_carray*
+t_carray_alloc_split (size_t len)
+{
+    return carray_alloc(len, T_COMPLEX_SPLIT);
+}
+
+t_carray*
+t_carray_wrap (double complex* data, size_t len,
+               t_release_func* release, void* ctx)
+{
+    if (!data && len > 0) {
+        tp_raiseError("Null pointer in t_carray_wrap.");
+    }
+    t_carray* arr = malloc(sizeof(t_carray));
+    Null_exit_message(arr, "Memory allocation failed in t_carray_wrap!");
+    // double complex has the layout of double[2] (C99)
+    arr->ptr = (double*) data;
+    arr->len = len;
+    arr->layout = T_COMPLEX_INTERLEAVED;
+    arr->refcnt = 1;
+    arr->release = release;
+    arr->release_ctx = ctx;
+    return arr;
+}
+
+void
+t_carray_ref (t_carray* arr)
+{
+    if (arr) {
+        arr->refcnt++;
+    }
+}
+
+void
+t_carray_unref (t_carray* arr)
+{
+    if (arr) {
+        if (--arr->refcnt == 0) {
+            #if DEBUG == 1
+            printf("> Freeing complex array at %p\n", (void*)arr);
+            #endif
+            if (arr->release) {
+                arr->release(arr->ptr, arr->release_ctx);
+            }
+            free(arr);
+        }
+    }
+}
+
+//-----------------------------------
+// getter and setter
+//-----------------------------------
+
+double complex
+t_carray_get (const t_carray* arr, size_t index)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_carray_get.");
+    }
+    if (index >= arr->len) {
+        tp_raiseError("Invalid index in t_carray_get.");
+    }
+    t_cview v = t_carray_view(arr);
+    return v.re[index * v.stride] + I * v.im[index * v.stride];
+}
+
+void
+t_carray_set (t_carray* arr, size_t index, double complex value)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_carray_set.");
+    }
+    if (index >= arr->len) {
+        tp_raiseError("Invalid index in t_carray_set.");
+    }
+    t_cview v = t_carray_view(arr);
+    v.re[index * v.stride] = creal(value);
+    v.im[index * v.stride] = cimag(value);
+}
+
+size_t
+t_carray_len (const t_carray* arr)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_carray_len.");
+    }
+    return arr->len;
+}
+
+int
+t_carray_layout (const t_carray* arr)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_carray_layout.");
+    }
+    return arr->layout;
+}
+
+double complex*
+t_carray_data (t_carray* arr)
+{
+    if (!arr) {
+        tp_raiseError("Invalid array in t_carray_data.");
+    }
+    if (arr->layout != T_COMPLEX_INTERLEAVED) {
+        tp_raiseError("t_carray_data needs interleaved layout, "
+                      "use t_carray_parts for split arrays.");
+    }
+    return (double complex*) arr->ptr;
+}
+
+size_t
+t_carray_parts (t_carray* arr, double** re, double** im)
+{
+    if (!arr || !re || !im) {
+        tp_raiseError("Null pointer in t_carray_parts.");
+    }
+    t_cview v = t_carray_view(arr);
+    *re = v.re;
+    *im = v.im;
+    return v.stride;
+}
+
+//-----------------------------------
+// copy functions (deep)
+//-----------------------------------
+
+void
+t_carray_copy (t_carray* dest, const t_carray* src)
+{
+    if (!dest || !src) {
+        tp_raiseError("Null pointer in t_carray_copy.");
+    }
+    if (dest->len != src->len) {
+        tp_raiseError("Incompatible array lengths in t_carray_copy.");
+    }
+    if (dest->layout == src->layout) {
+        memcpy(dest->ptr, src->ptr, 2 * src->len * sizeof(double));
+        return;
+    }
+    // conversion between interleaved and split layout
+    t_cview d = t_carray_view(dest);
+    t_cview s = t_carray_view(src);
+    for (size_t i = 0; i < src->len; i++) {
+        d.re[i * d.stride] = s.re[i * s.stride];
+        d.im[i * d.stride] = s.im[i * s.stride];
+    }
+}
+
+void
+t_carray_copy_from_parts (t_carray* arr, const t_array* re, const t_array* im)
+{
+    if (!arr || !re) {
+        tp_raiseError("Null pointer in t_carray_copy_from_parts.");
+    }
+    if (re->len != arr->len || (im && im->len != arr->len)) {
+        tp_raiseError("Incompatible array lengths in t_carray_copy_from_parts.");
+    }
+    t_cview v = t_carray_view(arr);
+    for (size_t i = 0; i < arr->len; i++) {
+        v.re[i * v.stride] = re->ptr[i];
+        v.im[i * v.stride] = im ? im->ptr[i] : 0.0;
+    }
+}
@@ -0,0 +1,199 @@
+#include "t_numerics_intern.h"
+
+//================================================================================
+//    complex matrices
+//================================================================================
+
+//-----------------------------------
+// constructor and destructor (unref)
+//-----------------------------------
+
+static t_cmatrix* /* matrix on interleaved storage arr (refcnt of arr +1) */
+cmatrix_on_storage (t_carray* arr, size_t rows, size_t cols, size_t tda)
+{
+    if (rows == 0 || cols == 0) {
+        tp_raiseError("Neither rows nor columns can be zero!");
+    }
+    if (arr->layout != T_COMPLEX_INTERLEAVED) {
+        tp_raiseError("Complex matrices need interleaved storage.");
+    }
+    if (tda < cols || (rows - 1) * tda + cols > arr->len) {
+        tp_raiseError("Storage too small for matrix of this shape and row stride.");
+    }
+    t_cmatrix* m = malloc(sizeof(t_cmatrix));
+    Null_exit_message(m, "Memory allocation failed in t_cmatrix_alloc!");
+
+    m->rows = rows;
+    m->cols = cols;
+    m->tda = tda;
+    m->data = arr;
+    t_carray_ref(arr);
+
+    // zero copy view for GSL, same memory
+    gsl_matrix_complex_view v =
+        gsl_matrix_complex_view_array_with_tda(arr->ptr, rows, cols, tda);
+    m->view = v.matrix;
+    m->refcnt = 1;
+    return m;
+}
+
+t_cmatrix*
+t_cmatrix_alloc (size_t rows, size_t cols)
+{
+    if (rows == 0 || cols == 0) {
+        tp_raiseError("Neither rows nor columns can be zero!");
+    }
+    t_carray* arr = t_carray_alloc(rows * cols);
+    t_cmatrix* m = cmatrix_on_storage(arr, rows, cols, cols);
+    T_CARRAY_FREE(arr);
+    return m;
+}
+
+t_cmatrix*
+t_cmatrix_create_from_t_carray (t_carray* arr, size_t rows, size_t cols)
+{
+    if (!arr) {
+        tp_raiseError("Null pointer in t_cmatrix_create_from_t_carray.");
+    }
+    if (rows * cols != arr->len) {
+        tp_raiseError("Incompatible array size in t_cmatrix_create_from_t_carray.");
+    }
+    return cmatrix_on_storage(arr, rows, cols, cols);
+}
+
+static void /* release of a wrapped gsl_matrix_complex owned by the t_cmatrix */
+release_gsl_matrix_complex (double* data __attribute__((unused)), void* ctx)
+{
+    gsl_matrix_complex_free((gsl_matrix_complex*)ctx);
+}
+
+t_cmatrix*
+t_cmatrix_wrap_gsl_matrix_complex (gsl_matrix_complex* src, int owner)
+{
+    if (!src) {
+        tp_raiseError("Null pointer in t_cmatrix_wrap_gsl_matrix_complex.");
+    }
+    t_carray* arr = t_carray_wrap((double complex*)src->data,
+                                  (src->size1 - 1) * src->tda + src->size2,
+                                  owner ? release_gsl_matrix_complex : NULL, src);
+    t_cmatrix* m = cmatrix_on_storage(arr, src->size1, src->size2, src->tda);
+    T_CARRAY_FREE(arr);
+    return m;
+}
+
+void
+t_cmatrix_ref (t_cmatrix* m)
+{
+    if (m) {
+        m->refcnt++;
+    }
+}
+
+void
+t_cmatrix_unref (t_cmatrix* m)
+{
+    if (m) {
+        if (--m->refcnt == 0) {
+            #if DEBUG == 1
+            printf("> Freeing complex matrix at %p\n", (void*)m);
+            #endif
+            t_carray_unref(m->data);
+            free(m);
+        }
+    }
+}
+
+//-----------------------------------
+// setter and getter
+//-----------------------------------
+
+double complex
+t_cmatrix_get (const t_cmatrix* m, size_t i, size_t j)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_get.");
+    }
+    if (i >= m->rows || j >= m->cols) {
+        tp_raiseError("Index out of bounds in t_cmatrix_get.");
+    }
+    const double* p = m->data->ptr + 2 * (i * m->tda + j);
+    return p[0] + I * p[1];
+}
+
+void
+t_cmatrix_set (t_cmatrix* m, size_t i, size_t j, double complex value)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_set.");
+    }
+    if (i >= m->rows || j >= m->cols) {
+        tp_raiseError("Index out of bounds in t_cmatrix_set.");
+    }
+    double* p = m->data->ptr + 2 * (i * m->tda + j);
+    p[0] = creal(value);
+    p[1] = cimag(value);
+}
+
+size_t
+t_cmatrix_rows (const t_cmatrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_rows.");
+    }
+    return m->rows;
+}
+
+size_t
+t_cmatrix_cols (const t_cmatrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_cols.");
+    }
+    return m->cols;
+}
+
+size_t
+t_cmatrix_tda (const t_cmatrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_tda.");
+    }
+    return m->tda;
+}
+
+t_carray*
+t_cmatrix_get_t_carray (t_cmatrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_get_t_carray.");
+    }
+    return m->data;
+}
+
+gsl_matrix_complex*
+t_cmatrix_get_gsl_matrix_complex (t_cmatrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_cmatrix_get_gsl_matrix_complex.");
+    }
+    return &m->view;
+}
+
+//-----------------------------------
+// copy functions (deep)
+//-----------------------------------
+
+void
+t_cmatrix_copy (t_cmatrix* dest, const t_cmatrix* src)
+{
+    if (!dest || !src) {
+        tp_raiseError("Null pointer in t_cmatrix_copy.");
+    }
+    if (dest->rows != src->rows || dest->cols != src->cols) {
+        tp_raiseError("Incompatible matrix size in t_cmatrix_copy.");
+    }
+    for (size_t i = 0; i < src->rows; i++) {
+        memcpy(dest->data->ptr + 2 * i * dest->tda, src->data->ptr + 2 * i * src->tda,
+               2 * src->cols * sizeof(double));
+    }
+}
@@ -0,0 +1,431 @@
+#include "t_numerics_intern.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//================================================================================
+//    binary files and memory mapping
+//================================================================================
+
+/* File layout: a header of T_IO_HEADER_SIZE bytes followed by the raw row
+ * major data. All header fields and the data are written in the byte order
+ * of the writing machine; the endian marker tells the reader whether it has
+ * to swap. The data starts at a multiple of 64 bytes, so a mapping of the
+ * whole file gives correctly aligned doubles. */
+
+#define T_IO_MAGIC "TLIBBIN"
+#define T_IO_VERSION 1
+#define T_IO_ENDIAN_MARKER 0x01020304u
+#define T_IO_HEADER_SIZE 64
+
+// dtype codes
+#define T_IO_FLOAT64 1
+
+typedef struct {
+    char magic[8];        // "TLIBBIN\0"
+    uint32_t version;
+    uint32_t endian;      // T_IO_ENDIAN_MARKER in the writer's byte order
+    uint32_t dtype;
+    uint32_t ndim;        // 1: t_array, 2: t_matrix
+    uint64_t shape[2];    // len or rows, cols
+    uint64_t data_offset;
+    char reserved[16];
+} t_io_header;
+
+_Static_assert(sizeof(t_io_header) == T_IO_HEADER_SIZE,
+               "Header of tlib binary files has to be 64 bytes");
+
+// mapping kept alive by the wrapping t_array
+typedef struct {
+    void* base;
+    size_t size;
+} t_io_mapping;
+
+static void
+io_error (const char* what, const char* path)
+{
+    char message[512];
+    snprintf(message, sizeof(message), "%s: %s", what, path);
+    tp_raiseError(message);
+}
+
+static void
+swap_bytes (void* p, size_t size, size_t count)
+{
+    unsigned char* b = p;
+    for (size_t k = 0; k < count; k++, b += size) {
+        for (size_t i = 0; i < size / 2; i++) {
+            unsigned char tmp = b[i];
+            b[i] = b[size - 1 - i];
+            b[size - 1 - i] = tmp;
+        }
+    }
+}
+
+/* checks header, converts it to native byte order, returns 1 if the data
+ * is stored in foreign byte order */
+static int
+check_header (t_io_header* h, const char* path)
+{
+    if (memcmp(h->magic, T_IO_MAGIC, sizeof(T_IO_MAGIC)) != 0) {
+        io_error("Not a tlib binary file", path);
+    }
+    int swapped = 0;
+    if (h->endian != T_IO_ENDIAN_MARKER) {
+        swap_bytes(&h->endian, sizeof(uint32_t), 1);
+        if (h->endian != T_IO_ENDIAN_MARKER) {
+            io_error("Corrupt endian marker in tlib binary file", path);
+        }
+        swap_bytes(&h->version, sizeof(uint32_t), 1);
+        swap_bytes(&h->dtype, sizeof(uint32_t), 1);
+        swap_bytes(&h->ndim, sizeof(uint32_t), 1);
+        swap_bytes(h->shape, sizeof(uint64_t), 2);
+        swap_bytes(&h->data_offset, sizeof(uint64_t), 1);
+        swapped = 1;
+    }
+    if (h->version > T_IO_VERSION) {
+        io_error("Unsupported version of tlib binary file", path);
+    }
+    if (h->dtype != T_IO_FLOAT64) {
+        io_error("Unsupported dtype in tlib binary file", path);
+    }
+    if (h->ndim != 1 && h->ndim != 2) {
+        io_error("Unsupported number of dimensions in tlib binary file", path);
+    }
+    if (h->ndim == 1) {
+        h->shape[1] = 1;
+    }
+    if (h->data_offset < T_IO_HEADER_SIZE || h->data_offset % sizeof(double) != 0) {
+        io_error("Invalid data offset in tlib binary file", path);
+    }
+    return swapped;
+}
+
+static t_io_header
+make_header (uint32_t ndim, size_t rows, size_t cols)
+{
+    t_io_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, T_IO_MAGIC, sizeof(T_IO_MAGIC));
+    h.version = T_IO_VERSION;
+    h.endian = T_IO_ENDIAN_MARKER;
+    h.dtype = T_IO_FLOAT64;
+    h.ndim = ndim;
+    h.shape[0] = rows;
+    h.shape[1] = ndim == 2 ? cols : 0;
+    h.data_offset = T_IO_HEADER_SIZE;
+    return h;
+}
+
+static void
+write_file (const char* path, const double* data,
+            uint32_t ndim, size_t rows, size_t cols, size_t tda)
+{
+    t_io_header h = make_header(ndim, rows, cols);
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        io_error("Could not open file for writing", path);
+    }
+    // rows of strided matrices are written without their padding
+    int failed = fwrite(&h, sizeof(h), 1, f) != 1;
+    if (tda == cols) {
+        failed = failed || fwrite(data, sizeof(double), rows * cols, f) != rows * cols;
+    }
+    else {
+        for (size_t i = 0; i < rows && !failed; i++) {
+            failed = fwrite(data + i * tda, sizeof(double), cols, f) != cols;
+        }
+    }
+    if (failed) {
+        fclose(f);
+        io_error("Could not write file", path);
+    }
+    if (fclose(f) != 0) {
+        io_error("Could not write file", path);
+    }
+}
+
+/* reads the whole file into a new t_array, shape of the file in rows, cols */
+static t_array*
+read_file (const char* path, size_t* rows, size_t* cols)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        io_error("Could not open file", path);
+    }
+    t_io_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1) {
+        fclose(f);
+        io_error("File too short for tlib binary header", path);
+    }
+    int swapped = check_header(&h, path);
+    size_t n = h.shape[0] * h.shape[1];
+    t_array* arr = t_array_alloc(n);
+    if (fseek(f, (long)h.data_offset, SEEK_SET) != 0
+        || fread(arr->ptr, sizeof(double), n, f) != n) {
+        fclose(f);
+        io_error("File shorter than its header states", path);
+    }
+    fclose(f);
+    if (swapped) {
+        swap_bytes(arr->ptr, sizeof(double), n);
+    }
+    *rows = h.shape[0];
+    *cols = h.shape[1];
+    return arr;
+}
+
+static void
+release_mapping (double* data __attribute__((unused)), void* ctx)
+{
+    t_io_mapping* map = ctx;
+    munmap(map->base, map->size);
+    free(map);
+}
+
+/* maps the whole file, returns its data as t_array owning the mapping */
+static t_array*
+map_file (const char* path, int mode, size_t* rows, size_t* cols)
+{
+    int writable = mode == T_MMAP_SHARED;
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        io_error("Could not open file", path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < T_IO_HEADER_SIZE) {
+        close(fd);
+        io_error("File too short for tlib binary header", path);
+    }
+    size_t size = (size_t)st.st_size;
+
+    int prot = PROT_READ;
+    int flags = MAP_SHARED;
+    if (mode == T_MMAP_PRIVATE) {
+        prot |= PROT_WRITE;
+        flags = MAP_PRIVATE;
+    }
+    else if (mode == T_MMAP_SHARED) {
+        prot |= PROT_WRITE;
+    }
+    else if (mode != T_MMAP_READONLY) {
+        close(fd);
+        tp_raiseError("Unknown mode in t_array_mmap/t_matrix_mmap.");
+    }
+    void* base = mmap(NULL, size, prot, flags, fd, 0);
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    if (base == MAP_FAILED) {
+        io_error("mmap failed", path);
+    }
+
+    t_io_header h;
+    memcpy(&h, base, sizeof(h));
+    if (check_header(&h, path)) {
+        munmap(base, size);
+        io_error("File has foreign byte order and cannot be mapped, "
+                 "use t_array_load/t_matrix_load", path);
+    }
+    size_t n = h.shape[0] * h.shape[1];
+    if (h.data_offset + n * sizeof(double) > size) {
+        munmap(base, size);
+        io_error("File shorter than its header states", path);
+    }
+
+    t_io_mapping* map = malloc(sizeof(t_io_mapping));
+    Null_exit_message(map, "Memory allocation failed in t_array_mmap!");
+    map->base = base;
+    map->size = size;
+    *rows = h.shape[0];
+    *cols = h.shape[1];
+    return t_array_wrap((double*)((char*)base + h.data_offset), n,
+                        release_mapping, map);
+}
+
+//-----------------------------------
+// save and load
+//-----------------------------------
+
+void
+t_array_save (const t_array* arr, const char* path)
+{
+    if (!arr) {
+        tp_raiseError("Null pointer in t_array_save.");
+    }
+    write_file(path, arr->ptr, 1, arr->len, 1, 1);
+}
+
+void
+t_matrix_save (const t_matrix* m, const char* path)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_matrix_save.");
+    }
+    write_file(path, m->data->ptr, 2, m->rows, m->cols, m->tda);
+}
+
+t_array*
+t_array_load (const char* path)
+{
+    size_t rows, cols;
+    // matrices are loaded as flat row major array
+    return read_file(path, &rows, &cols);
+}
+
+t_matrix*
+t_matrix_load (const char* path)
+{
+    size_t rows, cols;
+    t_array* arr = read_file(path, &rows, &cols);
+    t_matrix* m = t_matrix_create_from_t_array(arr, rows, cols);
+    T_ARRAY_FREE(arr);
+    return m;
+}
+
+//-----------------------------------
+// memory mapping
+//-----------------------------------
+
+t_array*
+t_array_mmap (const char* path, int mode)
+{
+    size_t rows, cols;
+    return map_file(path, mode, &rows, &cols);
+}
+
+t_matrix*
+t_matrix_mmap (const char* path, int mode)
+{
+    size_t rows, cols;
+    t_array* arr = map_file(path, mode, &rows, &cols);
+    t_matrix* m = t_matrix_create_from_t_array(arr, rows, cols);
+    T_ARRAY_FREE(arr);
+    return m;
+}
+
+t_matrix*
+t_matrix_mmap_create (const char* path, size_t rows, size_t cols)
+{
+    if (rows == 0 || cols == 0) {
+        tp_raiseError("Neither rows nor columns can be zero!");
+    }
+    t_io_header h = make_header(2, rows, cols);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        io_error("Could not create file", path);
+    }
+    // sparse file, pages are only allocated when they are written
+    off_t size = (off_t)(T_IO_HEADER_SIZE + rows * cols * sizeof(double));
+    if (write(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)
+        || ftruncate(fd, size) != 0) {
+        close(fd);
+        io_error("Could not write file", path);
+    }
+    close(fd);
+    return t_matrix_mmap(path, T_MMAP_SHARED);
+}
+
+//-----------------------------------
+// streaming writer
+//-----------------------------------
+
+/* Rows are appended to an open file through stdio buffering; the header is
+ * written with 0 rows first and gets the final count on close, the file is
+ * then an ordinary matrix file for t_matrix_load and t_matrix_mmap. Closing
+ * without any row removes the file and raises, as matrices cannot be empty. */
+
+struct t_io_writer {
+    FILE* f;
+    char* path;
+    size_t cols;
+    size_t rows;
+};
+
+t_io_writer*
+t_io_writer_open (const char* path, size_t cols)
+{
+    if (!path) {
+        tp_raiseError("Null pointer in t_io_writer_open.");
+    }
+    if (cols == 0) {
+        tp_raiseError("Neither rows nor columns can be zero!");
+    }
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        io_error("Could not open file for writing", path);
+    }
+    t_io_header h = make_header(2, 0, cols);
+    if (fwrite(&h, sizeof(h), 1, f) != 1) {
+        fclose(f);
+        io_error("Could not write file", path);
+    }
+    t_io_writer* w = malloc(sizeof(t_io_writer));
+    Null_exit_message(w, "Memory allocation failed in t_io_writer_open!");
+    w->path = malloc(strlen(path) + 1);
+    Null_exit_message(w->path, "Memory allocation failed in t_io_writer_open!");
+    strcpy(w->path, path);
+    w->f = f;
+    w->cols = cols;
+    w->rows = 0;
+    return w;
+}
+
+void
+t_io_writer_append (t_io_writer* w, const double* row)
+{
+    if (!w || !row) {
+        tp_raiseError("Null pointer in t_io_writer_append.");
+    }
+    if (fwrite(row, sizeof(double), w->cols, w->f) != w->cols) {
+        io_error("Could not write file", w->path);
+    }
+    w->rows++;
+}
+
+size_t
+t_io_writer_rows (const t_io_writer* w)
+{
+    if (!w) {
+        tp_raiseError("Null pointer in t_io_writer_rows.");
+    }
+    return w->rows;
+}
+
+size_t
+t_io_writer_cols (const t_io_writer* w)
+{
+    if (!w) {
+        tp_raiseError("Null pointer in t_io_writer_cols.");
+    }
+    return w->cols;
+}
+
+void
+t_io_writer_close (t_io_writer* w)
+{
+    if (!w) {
+        return;
+    }
+    if (w->rows == 0) {
+        // t_matrix_load and t_matrix_mmap need at least one row, no file is
+        // better than one that cannot be read
+        fclose(w->f);
+        remove(w->path);
+        io_error("No rows appended, file removed", w->path);
+    }
+    uint64_t rows = w->rows;
+    int failed = fseek(w->f, (long)offsetof(t_io_header, shape), SEEK_SET) != 0
+                 || fwrite(&rows, sizeof(rows), 1, w->f) != 1;
+    failed = fclose(w->f) != 0 || failed;
+    if (failed) {
+        io_error("Could not write file", w->path);
+    }
+    free(w->path);
+    free(w);
+}
@@ -19,6 +19,7 @@ t_matrix_alloc(size_t rows, size_t cols)
 
     m->rows = rows;
     m->cols = cols;
+    m->tda = cols;
 
     // allocate large block
     m->data = t_array_alloc(rows * cols);
@@ -51,6 +52,75 @@ t_matrix_create_from_gsl_matrix (const gsl_matrix* src)
     return m;
 }
 
+static t_matrix* /* matrix on storage arr with row stride tda (refcnt of arr +1) */
+matrix_on_storage (t_array* arr, size_t rows, size_t cols, size_t tda)
+{
+    if (rows == 0 || cols == 0) {
+        tp_raiseError("Neither rows nor columns can be zero!");
+    }
+    if (tda < cols || (rows - 1) * tda + cols > arr->len) {
+        tp_raiseError("Storage too small for matrix of this shape and row stride.");
+    }
+    t_matrix* m = malloc(sizeof(t_matrix));
+    Null_exit_message(m, "Memory allocation failed in t_matrix_create_from_t_array!");
+
+    m->rows = rows;
+    m->cols = cols;
+    m->tda = tda;
+    m->data = arr;
+    t_array_ref(arr);
+
+    gsl_matrix_view v = gsl_matrix_view_array_with_tda(arr->ptr, rows, cols, tda);
+    m->view = v.matrix;
+
+    m->refcnt = 1;
+    m->cache_valid = 1;
+
+    return m;
+}
+
+t_matrix*
+t_matrix_create_from_t_array (t_array* arr, size_t rows, size_t cols)
+{
+    if (!arr) {
+        tp_raiseError("Null pointer in t_matrix_create_from_t_array.");
+    }
+    if (rows * cols != arr->len) {
+        tp_raiseError("Incompatible array size in t_matrix_create_from_t_array.");
+    }
+    return matrix_on_storage(arr, rows, cols, cols);
+}
+
+t_matrix*
+t_matrix_wrap (double* data, size_t rows, size_t cols, size_t tda,
+               t_release_func* release, void* ctx)
+{
+    if (rows == 0 || cols == 0 || tda < cols) {
+        tp_raiseError("t_matrix_wrap needs rows, cols > 0 and tda >= cols.");
+    }
+    // storage ends with the last element, padding behind it is not required
+    t_array* arr = t_array_wrap(data, (rows - 1) * tda + cols, release, ctx);
+    t_matrix* m = matrix_on_storage(arr, rows, cols, tda);
+    T_ARRAY_FREE(arr);
+    return m;
+}
+
+static void /* release of a wrapped gsl_matrix owned by the t_matrix */
+release_gsl_matrix (double* data __attribute__((unused)), void* ctx)
+{
+    gsl_matrix_free((gsl_matrix*)ctx);
+}
+
+t_matrix*
+t_matrix_wrap_gsl_matrix (gsl_matrix* src, int owner)
+{
+    if (!src) {
+        tp_raiseError("Null pointer in t_matrix_wrap_gsl_matrix.");
+    }
+    return t_matrix_wrap(src->data, src->size1, src->size2, src->tda,
+                         owner ? release_gsl_matrix : NULL, src);
+}
+
 void
 t_matrix_ref (t_matrix* m)
 {
@@ -86,7 +156,7 @@ t_matrix_get (t_matrix* m, size_t i, size_t j)
     if (i >= m->rows || j >= m->cols) {
         tp_raiseError("Index out of bounds in t_matrix_get.");
     }
-    return m->data->ptr[i * m->cols + j];
+    return m->data->ptr[i * m->tda + j];
 }
 
 void
@@ -98,7 +168,43 @@ t_matrix_set(t_matrix* m, size_t i, size_t j, double value)
     if (i >= m->rows || j >= m->cols) {
         tp_raiseError("Index out of bounds in t_matrix_set.");
     }
-    m->data->ptr[i * m->cols + j] = value;
+    m->data->ptr[i * m->tda + j] = value;
+}
+
+size_t
+t_matrix_rows (const t_matrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_matrix_rows.");
+    }
+    return m->rows;
+}
+
+size_t
+t_matrix_cols (const t_matrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_matrix_cols.");
+    }
+    return m->cols;
+}
+
+size_t
+t_matrix_tda (const t_matrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_matrix_tda.");
+    }
+    return m->tda;
+}
+
+t_array*
+t_matrix_get_t_array (t_matrix* m)
+{
+    if (!m) {
+        tp_raiseError("Null pointer in t_matrix_get_t_array.");
+    }
+    return m->data;
 }
 
 //-----------------------------------
@@ -109,7 +215,8 @@ static inline void /* helper function (--> non public) */
 build_cache (t_matrix* m)
 {
     if (m->cache_valid) return;
-    gsl_matrix_view v = gsl_matrix_view_array(m->data->ptr, m->rows, m->cols);
+    gsl_matrix_view v = gsl_matrix_view_array_with_tda(m->data->ptr, m->rows,
+                                                       m->cols, m->tda);
     m->view = v.matrix;
     m->cache_valid = 1;
 }
@@ -131,6 +238,7 @@ t_matrix_assign_t_array (t_matrix* m, t_array* heap_ptr)
     t_array_unref(m->data);
     m->data = heap_ptr;
     t_array_ref(heap_ptr);
+    m->tda = m->cols;
     m->cache_valid = 0;
     build_cache (m);
 }
@@ -148,13 +256,26 @@ t_matrix_get_gsl_matrix(t_matrix* m)
 // copy functions (deep)
 //-----------------------------------
 
+static void /* rows x cols block between storages with row strides */
+copy_rows (double* dest, size_t dest_tda, const double* src, size_t src_tda,
+           size_t rows, size_t cols)
+{
+    if (dest_tda == cols && src_tda == cols) {
+        memcpy(dest, src, rows * cols * sizeof(double));
+        return;
+    }
+    for (size_t i = 0; i < rows; i++) {
+        memcpy(dest + i * dest_tda, src + i * src_tda, cols * sizeof(double));
+    }
+}
+
 void
 t_matrix_copy_from_array (t_matrix* m, const double* ptr)
 {   
     if (!m || !ptr) {
         tp_raiseError("Null pointer in t_matrix_copy_from_array.");
     }
-    memcpy(m->data->ptr, ptr, m->rows * m->cols * sizeof(double));
+    copy_rows(m->data->ptr, m->tda, ptr, m->cols, m->rows, m->cols);
 }
 
 void
@@ -166,7 +287,7 @@ t_matrix_copy_from_t_array (t_matrix* m, const t_array* arr)
     if (m->rows * m->cols != arr->len) {
         tp_raiseError("Incompatible array size in t_matrix_copy_from_t_array.");
     }
-    memcpy(m->data->ptr, arr->ptr, m->rows * m->cols * sizeof(double));
+    copy_rows(m->data->ptr, m->tda, arr->ptr, m->cols, m->rows, m->cols);
 }
 
 void
@@ -178,7 +299,8 @@ t_matrix_copy (t_matrix* dest, const t_matrix* src)
     if (dest->rows != src->rows || dest->cols != src->cols) {
         tp_raiseError("Incompatible matrix size in t_matrix_copy.");
     }
-    memcpy(dest->data->ptr, src->data->ptr, src->rows * src->cols * sizeof(double));
+    copy_rows(dest->data->ptr, dest->tda, src->data->ptr, src->tda,
+              src->rows, src->cols);
 }
 
 void
@@ -190,5 +312,6 @@ t_matrix_copy_from_gsl_matrix (t_matrix* m, const gsl_matrix* src)
     if (m->rows != src->size1 || m->cols != src->size2) {
         tp_raiseError("Incompatible matrix size in t_matrix_copy_from_gsl_matrix.");
     }
-    memcpy(m->data->ptr, src->data, m->rows * m->cols * sizeof(double));
+    // rows of GSL matrices may be padded (tda > size2)
+    copy_rows(m->data->ptr, m->tda, src->data, src->tda, m->rows, m->cols);
 }
@@ -10,19 +10,224 @@ struct t_array {
     double* ptr;
     size_t len;
     size_t refcnt;        // reference counter
+    // frees ptr when refcnt drops to 0 (free for own memory)
+    t_release_func* release;
+    void* release_ctx;
 };
 
 struct t_matrix {
     size_t rows;
     size_t cols;         
-    t_array* data;        // contiguous memory block
+    size_t tda;           // row stride in doubles (>= cols, GSL naming)
+    t_array* data;        // memory block, element (i, j) at i * tda + j
     gsl_matrix view;      // direct GSL matrix (view)
     // flag if view was updated after altered pointer
     int cache_valid;      
     size_t refcnt;        // reference counter
 };
 
+struct t_carray {
+    // interleaved: re0 im0 re1 im1 ..., split: re0 re1 ... im0 im1 ...
+    double* ptr;
+    size_t len;           // number of complex elements
+    int layout;           // T_COMPLEX_INTERLEAVED or T_COMPLEX_SPLIT
+    size_t refcnt;
+    t_release_func* release;
+    void* release_ctx;
+};
+
+struct t_cmatrix {
+    size_t rows;
+    size_t cols;
+    size_t tda;           // row stride in complex elements
+    t_carray* data;       // interleaved, element (i, j) at i * tda + j
+    gsl_matrix_complex view;
+    size_t refcnt;
+};
+
+// real and imaginary part of element i at re[i * stride], im[i * stride]
+typedef struct {
+    double* re;
+    double* im;
+    size_t stride;
+} t_cview;
+
+static inline t_cview
+t_carray_view (const t_carray* a)
+{
+    t_cview v;
+    if (a->layout == T_COMPLEX_SPLIT) {
+        v.re = a->ptr;
+        v.im = a->ptr + a->len;
+        v.stride = 1;
+    }
+    else {
+        v.re = a->ptr;
+        v.im = a->ptr + 1;
+        v.stride = 2;
+    }
+    return v;
+}
+
 static inline void build_cache (t_matrix* m);
 
 static inline double
 tn_dot_prod_ptr(const double* x, const double* y, size_t len);
+
+/* LU decomposition with partial pivoting of the row major n x n matrix a in
+ * place, returns 0 or -1 if singular (tn_linalg.c) */
+int tn_lu_decomp_ptr (double* a, int* piv, int n);
+
+/* solves LU x = b in place with the result of tn_lu_decomp_ptr */
+void tn_lu_solve_ptr (const double* lu, const int* piv, int n, double* b);
+
+//--------------------------------------------------------------------------------
+// profiling
+//
+// Compiled in with -DTN_PROFILE (makefile: make build PROFILE=1), otherwise all
+// macros expand to nothing. Every instrumented function gets one entry in
+// TN_PROFILE_KERNELS. Usage inside a function:
+//   TN_PROFILE_BEGIN(tn_foo);      --> first statement, counts call, starts timer
+//   TN_PROFILE_CALLBACKS(n);       --> n evaluations of user callback
+//   TN_PROFILE_END();              --> before every return
+// Times are inclusive, i.e. nested tn_* calls are contained in the caller.
+
+#define TN_PROFILE_KERNELS(X) \
+    /* tn_linalg.c */ \
+    X(tn_dot_product) \
+    X(tn_matrix_dot_vector) \
+    X(tn_matrix_dot_matrix) \
+    X(tn_vec_dist) \
+    X(tn_len_vec_3d) \
+    X(tn_len_vec_2d) \
+    X(tn_len_vec) \
+    X(tn_norm_vec) \
+    X(tn_norm_vec_sum_1) \
+    X(tn_print_vec) \
+    X(tn_print_matrix) \
+    X(tn_gauss_seidel_step) \
+    X(tn_gauss_seidel) \
+    /* tn_lstsq.c */ \
+    X(tn_lstsq_add_batch) \
+    X(tn_lstsq_solve) \
+    /* tn_clinalg.c */ \
+    X(tn_caxpy) \
+    X(tn_cscale) \
+    X(tn_cdotu) \
+    X(tn_cdotc) \
+    X(tn_cnorm) \
+    X(tn_cmatrix_dot_vector) \
+    X(tn_cmatrix_dot_matrix) \
+    /* tn_expr.c */ \
+    X(tn_expr_eval) \
+    /* tn_analysis.c */ \
+    X(tn_factorial) \
+    X(tn_solve_quadratic_real) \
+    X(tn_find_root) \
+    X(tn_integrate_midpoint) \
+    X(tn_integrate_simpson) \
+    X(tn_fourier_transform) \
+    X(tn_fft) \
+    X(tn_diff_1) \
+    X(tn_diff_2) \
+    /* tn_fit.c */ \
+    X(tn_lm_fit_ptr) \
+    /* tn_ode.c */ \
+    X(tn_euler_step) \
+    X(tn_rk2_step) \
+    X(tn_rk4_step) \
+    X(tn_vv_step) \
+    /* tn_diff.c */ \
+    X(tn_diff_batch) \
+    X(tn_diff_jacobian) \
+    X(tn_diff_samples) \
+    X(tn_diff_samples_grid) \
+    /* tn_events.c */ \
+    X(tn_rk4_integrate_events) \
+    /* tn_stiff.c */ \
+    X(tn_rosenbrock_integrate) \
+    X(tn_bdf_integrate) \
+    /* tn_expm.c */ \
+    X(tn_expm) \
+    X(tn_expm_prop_apply) \
+    X(tn_expm_prop_trajectory) \
+    X(tn_expmv) \
+    /* tn_stencil.c */ \
+    X(tn_grid_laplacian) \
+    X(tn_mol_rk4) \
+    /* tn_tdse.c */ \
+    X(tn_tdse_step) \
+    /* tn_surrogate.c */ \
+    X(tn_surrogate_build) \
+    X(tn_surrogate_eval_t_array) \
+    /* tn_tree.c */ \
+    X(tn_tree_build) \
+    X(tn_tree_accel) \
+    X(tn_tree_direct) \
+    /* tn_nlist.c */ \
+    X(tn_nlist_update) \
+    X(tn_nlist_forces) \
+    /* tn_mcmc.c */ \
+    X(tn_mcmc_sweep) \
+    X(tn_mcmc_pt_run) \
+    /* tn_stats.c */ \
+    X(tn_binomialCoeff) \
+    X(tn_binomial_distribution) \
+    X(tn_normal_distribution) \
+    X(tn_cumulative_distr) \
+    X(tn_rand_alloc) \
+    X(tn_moments_add_t_array) \
+    X(tn_histogram_add_t_array) \
+    X(tn_quantile) \
+    X(tn_quantiles) \
+    X(tn_binning_add_t_array) \
+    X(tn_autocorr) \
+    X(tn_tau_int) \
+    X(tn_bootstrap) \
+    X(tn_jackknife)
+
+typedef enum {
+    #define TN_PROFILE_ENUM(name) TN_PROF_##name,
+    TN_PROFILE_KERNELS(TN_PROFILE_ENUM)
+    #undef TN_PROFILE_ENUM
+    TN_PROF_COUNT
+} tn_prof_id;
+
+#ifdef TN_PROFILE
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t calls;       // number of calls of kernel
+    uint64_t callbacks;   // evaluations of STD_FUNC, ODE_FUNC etc.
+    uint64_t ns;          // accumulated wall time in nanoseconds
+} tn_prof_record;
+
+// buffer of calling thread, allocated and registered on first use
+extern _Thread_local tn_prof_record* tn_prof_tls;
+tn_prof_record* tn_prof_thread_buffer_alloc (void);
+uint64_t tn_prof_now (void);
+
+static inline tn_prof_record*
+tn_prof_thread_buffer (void)
+{
+    return tn_prof_tls ? tn_prof_tls : tn_prof_thread_buffer_alloc();
+}
+
+#define TN_PROFILE_BEGIN(name) \
+    tn_prof_record* tn_prof_rec_ = \
+        &tn_prof_thread_buffer()[TN_PROF_##name]; \
+    uint64_t tn_prof_t0_ = tn_prof_now(); \
+    tn_prof_rec_->calls++
+
+#define TN_PROFILE_CALLBACKS(n) (tn_prof_rec_->callbacks += (uint64_t)(n))
+
+#define TN_PROFILE_END() (tn_prof_rec_->ns += tn_prof_now() - tn_prof_t0_)
+
+#else
+
+#define TN_PROFILE_BEGIN(name) ((void)0)
+#define TN_PROFILE_CALLBACKS(n) ((void)0)
+#define TN_PROFILE_END() ((void)0)
+
+#endif
@@ -11,11 +11,15 @@
 long int
 tn_factorial (long int n)
 {
+    TN_PROFILE_BEGIN(tn_factorial);
+    long int result;
     if (n == 0) {
-        return 1;
+        result = 1;
     } else {
-        return n * tn_factorial (n - 1);
+        result = n * tn_factorial (n - 1);
     }
+    TN_PROFILE_END();
+    return result;
 }
 
 //--------------------------------------------------------------------------------
@@ -25,6 +29,7 @@ tn_factorial (long int n)
 Tuple
 tn_solve_quadratic_real (double a, double b, double c)
 {
+    TN_PROFILE_BEGIN(tn_solve_quadratic_real);
     Tuple solution;
 
     if (b > 0) {
@@ -35,6 +40,7 @@ tn_solve_quadratic_real (double a, double b, double c)
         solution.x2 = (2.0 * c) / (-b + sqrt(b * b + 4.0 * a * c));
     }
     
+    TN_PROFILE_END();
     return solution;
 }
 
@@ -43,12 +49,15 @@ tn_find_root (STD_FUNC func, double x0, double dx,
               double tol, int max_iter, double close,
               void *params)
 {
+    TN_PROFILE_BEGIN(tn_find_root);
     /* filter 0 as root because when calculating relative error
      * we devide by current x which in this case would be 0 */
+    TN_PROFILE_CALLBACKS(1);
     if (func(0, params) == 0) {
         printf("> In Newton-Raphson 0 is a root.\n");
         printf("  Make sure your initial guess is far enough away from 0 "
             "to find a different root!\n");
+        TN_PROFILE_END();
         return 0;
     }
 
@@ -58,6 +67,8 @@ tn_find_root (STD_FUNC func, double x0, double dx,
     while (iter <= max_iter) {
         x_old = x;
         x -= func(x, params) / tn_diff_1 (func, x, dx, params);
+        // derivative evaluations are counted in tn_diff_1
+        TN_PROFILE_CALLBACKS(1);
         if (fabs((x - x_old) / x) <= tol) {
             break;
         }
@@ -72,10 +83,12 @@ tn_find_root (STD_FUNC func, double x0, double dx,
         tp_raiseWarning ("Result of Newton-Raphson is nan. Following values of "
             "this programm might be meaningless!\n");
     }
+    TN_PROFILE_CALLBACKS(1);
     if (fabs(func(x, params)) > close) {
         tp_raiseWarning ("Function at root found by Newton-Raphson has greater "
             "deviation than wanted!\n");
     }
+    TN_PROFILE_END();
     return x;
 }
 
@@ -88,7 +101,7 @@ tn_integrate_midpoint (STD_FUNC integrand, double a,
                        double b, double dx,
                        void *params)
 {
-    
+    TN_PROFILE_BEGIN(tn_integrate_midpoint);
     double sum = 0;
     // number of iterations rounded up because that way no precision is lost
     int N = ceil((b - a) / dx);
@@ -101,6 +114,8 @@ tn_integrate_midpoint (STD_FUNC integrand, double a,
         sum += A;
     }   
 
+    TN_PROFILE_CALLBACKS(N);
+    TN_PROFILE_END();
     return sum;
 }
 
@@ -110,6 +125,7 @@ tn_integrate_simpson (STD_FUNC integrand, double a,
                       double b, double dx,
                       void *params)
 {
+    TN_PROFILE_BEGIN(tn_integrate_simpson);
     double sum = 0;
 
     int N = ceil((b - a) / dx);
@@ -126,6 +142,8 @@ tn_integrate_simpson (STD_FUNC integrand, double a,
         sum += summand;
     } 
 
+    TN_PROFILE_CALLBACKS(3 * N);
+    TN_PROFILE_END();
     return sum;
 }
 
@@ -134,6 +152,7 @@ tn_fourier_transform (double complex integrand(double, void *),
                       double m, double k, double dt,
                       void *params)
 {
+    TN_PROFILE_BEGIN(tn_fourier_transform);
     double complex sum = 0;
     double complex summand;
     int N = ceil((2 * m) / dt);
@@ -149,6 +168,8 @@ tn_fourier_transform (double complex integrand(double, void *),
                            * cexp(-I*k*(t + dt));
         sum += summand;
     }
+    TN_PROFILE_CALLBACKS(3 * N);
+    TN_PROFILE_END();
     return sum * (dt/6.0);
 }
 
@@ -159,12 +180,165 @@ tn_fourier_transform (double complex integrand(double, void *),
 double
 tn_diff_1 (STD_FUNC func, double x, double dx, void *params)
 {
-    return (func(x + dx, params) - func(x - dx, params)) / (2.0 * dx);
+    TN_PROFILE_BEGIN(tn_diff_1);
+    double diff = (func(x + dx, params) - func(x - dx, params)) / (2.0 * dx);
+    TN_PROFILE_CALLBACKS(2);
+    TN_PROFILE_END();
+    return diff;
 }
 
 double
 tn_diff_2 (STD_FUNC func, double x, double dx, void *params)
 {
-    return (func(x + dx, params) - 2.0 * func(x, params)
-           + func(x - dx, params)) / (dx * dx);
+    TN_PROFILE_BEGIN(tn_diff_2);
+    double diff = (func(x + dx, params) - 2.0 * func(x, params)
+                  + func(x - dx, params)) / (dx * dx);
+    TN_PROFILE_CALLBACKS(3);
+    TN_PROFILE_END();
+    return diff;
+}
+
+//--------------------------------------------------------------------------------
+//    fast fourier transform
+//--------------------------------------------------------------------------------
+
+void
+tn_fft (double complex* data, size_t n, int sign)
+{
+    TN_PROFILE_BEGIN(tn_fft);
+    if (n == 0 || (n & (n - 1)) != 0) {
+        tp_raiseError("Length of tn_fft has to be a power of 2!");
+    }
+    // bit reversal permutation
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            double complex tmp = data[i];
+            data[i] = data[j];
+            data[j] = tmp;
+        }
+    }
+    // butterflies, twiddle factors are evaluated directly (no recurrence)
+    // to keep the rounding error independent of n
+    double s = sign < 0 ? -1.0 : 1.0;
+    for (size_t half = 1; half < n; half <<= 1) {
+        for (size_t k = 0; k < half; k++) {
+            double complex w = cexp(s * I * M_PI * (double)k / (double)half);
+            for (size_t i = k; i < n; i += 2 * half) {
+                double complex u = data[i];
+                double complex v = w * data[i + half];
+                data[i] = u + v;
+                data[i + half] = u - v;
+            }
+        }
+    }
+    TN_PROFILE_END();
+}
+
+/* A plan holds the bit reversal permutation and the twiddle factors
+ * exp(-2 pi i k / n), k < n / 2, so repeated transforms of the same length
+ * (time stepping) evaluate no trigonometric functions. The butterflies
+ * spell out the complex arithmetic (no __muldc3 calls). */
+struct tn_fft_plan {
+    size_t n;
+    size_t n_swaps;
+    size_t* swaps;        // pairs (i, j) of the bit reversal, i < j
+    double* twiddle;      // re, im of exp(-2 pi i k / n), k < n / 2
+};
+
+tn_fft_plan*
+tn_fft_plan_alloc (size_t n)
+{
+    if (n == 0 || (n & (n - 1)) != 0) {
+        tp_raiseError("Length of tn_fft_plan has to be a power of 2!");
+    }
+    tn_fft_plan* p = malloc(sizeof(tn_fft_plan));
+    Null_exit_message(p, "Memory allocation failed in tn_fft_plan_alloc!");
+    p->n = n;
+    p->n_swaps = 0;
+    p->swaps = malloc(n * sizeof(size_t));
+    p->twiddle = malloc((n > 1 ? n : 2) * sizeof(double));
+    if (!p->swaps || !p->twiddle) {
+        tp_raiseError("Memory allocation failed in tn_fft_plan_alloc!");
+    }
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            p->swaps[2 * p->n_swaps] = i;
+            p->swaps[2 * p->n_swaps + 1] = j;
+            p->n_swaps++;
+        }
+    }
+    for (size_t k = 0; k < n / 2; k++) {
+        double phi = -2.0 * M_PI * (double)k / (double)n;
+        p->twiddle[2 * k] = cos(phi);
+        p->twiddle[2 * k + 1] = sin(phi);
+    }
+    return p;
+}
+
+void
+tn_fft_plan_free (tn_fft_plan* p)
+{
+    if (!p) {
+        return;
+    }
+    free(p->swaps);
+    free(p->twiddle);
+    free(p);
+}
+
+size_t
+tn_fft_plan_len (const tn_fft_plan* p)
+{
+    if (!p) {
+        tp_raiseError("Null pointer in tn_fft_plan_len.");
+    }
+    return p->n;
+}
+
+void
+tn_fft_execute (const tn_fft_plan* p, double complex* data, int sign)
+{
+    if (!p || !data) {
+        tp_raiseError("Null pointer in tn_fft_execute.");
+    }
+    double* x = (double*)data;
+    for (size_t s = 0; s < p->n_swaps; s++) {
+        size_t i = 2 * p->swaps[2 * s];
+        size_t j = 2 * p->swaps[2 * s + 1];
+        double re = x[i];
+        double im = x[i + 1];
+        x[i] = x[j];
+        x[i + 1] = x[j + 1];
+        x[j] = re;
+        x[j + 1] = im;
+    }
+    // backward transform: conjugate twiddle factors
+    double s_im = sign < 0 ? 1.0 : -1.0;
+    const size_t n = p->n;
+    for (size_t half = 1, step = n / 2; half < n; half <<= 1, step >>= 1) {
+        for (size_t k = 0; k < half; k++) {
+            double wr = p->twiddle[2 * k * step];
+            double wi = s_im * p->twiddle[2 * k * step + 1];
+            for (size_t i = k; i < n; i += 2 * half) {
+                double* a = x + 2 * i;
+                double* b = x + 2 * (i + half);
+                double vr = wr * b[0] - wi * b[1];
+                double vi = wr * b[1] + wi * b[0];
+                b[0] = a[0] - vr;
+                b[1] = a[1] - vi;
+                a[0] += vr;
+                a[1] += vi;
+            }
+        }
+    }
 }
@@ -0,0 +1,197 @@
+#include "t_numerics_intern.h"
+
+//================================================================================
+//    complex linear algebra
+//================================================================================
+
+/* All kernels work on the real and imaginary parts given by t_carray_view
+ * (stride 1 for split, 2 for interleaved storage) and spell out the complex
+ * arithmetic. This keeps the loops free of calls to __muldc3 (C99 Annex G
+ * multiplication with inf/nan handling) and lets the compiler vectorize them,
+ * for split arrays with plain unit stride loads. */
+
+// minimal number of multiply-adds for threading tn_cmatrix_dot_matrix
+#define TN_CLINALG_PARALLEL_MIN 1000000
+
+static void
+check_len (const t_carray* x, const t_carray* y, char name[])
+{
+    if (!x || !y) {
+        tp_raiseError(name);
+    }
+    if (x->len != y->len) {
+        tp_raiseError(name);
+    }
+}
+
+/* y += a * x for n elements given by parts and strides */
+static inline void
+axpy_parts (double ar, double ai, const double* xr, const double* xi, size_t sx,
+            double* yr, double* yi, size_t sy, size_t n)
+{
+    #pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        double re = xr[i * sx];
+        double im = xi[i * sx];
+        yr[i * sy] += ar * re - ai * im;
+        yi[i * sy] += ar * im + ai * re;
+    }
+}
+
+/* sum of (conj) x_i * y_i for n elements given by parts and strides,
+ * conj = -1.0: conjugate x, conj = 1.0: plain product */
+static inline double complex
+dot_parts (const double* xr, const double* xi, size_t sx,
+           const double* yr, const double* yi, size_t sy,
+           size_t n, double conj)
+{
+    double sum_re = 0.0;
+    double sum_im = 0.0;
+    #pragma omp simd reduction(+:sum_re, sum_im)
+    for (size_t i = 0; i < n; i++) {
+        double a = xr[i * sx];
+        double b = conj * xi[i * sx];
+        double c = yr[i * sy];
+        double d = yi[i * sy];
+        sum_re += a * c - b * d;
+        sum_im += a * d + b * c;
+    }
+    return sum_re + I * sum_im;
+}
+
+void
+tn_caxpy (double complex a, const t_carray* x, t_carray* y)
+{
+    TN_PROFILE_BEGIN(tn_caxpy);
+    check_len(x, y, "Incompatible arrays in tn_caxpy.");
+    t_cview vx = t_carray_view(x);
+    t_cview vy = t_carray_view(y);
+    axpy_parts(creal(a), cimag(a), vx.re, vx.im, vx.stride,
+               vy.re, vy.im, vy.stride, x->len);
+    TN_PROFILE_END();
+}
+
+void
+tn_cscale (double complex a, t_carray* x)
+{
+    TN_PROFILE_BEGIN(tn_cscale);
+    if (!x) {
+        tp_raiseError("Null pointer in tn_cscale.");
+    }
+    t_cview v = t_carray_view(x);
+    double ar = creal(a);
+    double ai = cimag(a);
+    double* xr = v.re;
+    double* xi = v.im;
+    size_t s = v.stride;
+    #pragma omp simd
+    for (size_t i = 0; i < x->len; i++) {
+        double re = xr[i * s];
+        double im = xi[i * s];
+        xr[i * s] = ar * re - ai * im;
+        xi[i * s] = ar * im + ai * re;
+    }
+    TN_PROFILE_END();
+}
+
+double complex
+tn_cdotu (const t_carray* x, const t_carray* y)
+{
+    TN_PROFILE_BEGIN(tn_cdotu);
+    check_len(x, y, "Incompatible arrays in tn_cdotu.");
+    t_cview vx = t_carray_view(x);
+    t_cview vy = t_carray_view(y);
+    double complex sum = dot_parts(vx.re, vx.im, vx.stride,
+                                   vy.re, vy.im, vy.stride, x->len, 1.0);
+    TN_PROFILE_END();
+    return sum;
+}
+
+double complex
+tn_cdotc (const t_carray* x, const t_carray* y)
+{
+    TN_PROFILE_BEGIN(tn_cdotc);
+    check_len(x, y, "Incompatible arrays in tn_cdotc.");
+    t_cview vx = t_carray_view(x);
+    t_cview vy = t_carray_view(y);
+    double complex sum = dot_parts(vx.re, vx.im, vx.stride,
+                                   vy.re, vy.im, vy.stride, x->len, -1.0);
+    TN_PROFILE_END();
+    return sum;
+}
+
+double
+tn_cnorm (const t_carray* x)
+{
+    TN_PROFILE_BEGIN(tn_cnorm);
+    if (!x) {
+        tp_raiseError("Null pointer in tn_cnorm.");
+    }
+    t_cview v = t_carray_view(x);
+    const double* xr = v.re;
+    const double* xi = v.im;
+    size_t s = v.stride;
+    double sum = 0.0;
+    #pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < x->len; i++) {
+        sum += xr[i * s] * xr[i * s] + xi[i * s] * xi[i * s];
+    }
+    TN_PROFILE_END();
+    return sqrt(sum);
+}
+
+void
+tn_cmatrix_dot_vector (const t_cmatrix* a, const t_carray* v, t_carray* b)
+{
+    TN_PROFILE_BEGIN(tn_cmatrix_dot_vector);
+    if (!a || !v || !b) {
+        tp_raiseError("Null pointer in tn_cmatrix_dot_vector.");
+    }
+    if (v->len != a->cols || b->len != a->rows) {
+        tp_raiseError("Incompatible sizes in tn_cmatrix_dot_vector.");
+    }
+    if (b == v || b == a->data) {
+        tp_raiseError("Output of tn_cmatrix_dot_vector must not be an input.");
+    }
+    t_cview vv = t_carray_view(v);
+    t_cview vb = t_carray_view(b);
+    for (size_t i = 0; i < a->rows; i++) {
+        const double* row = a->data->ptr + 2 * i * a->tda;
+        double complex s = dot_parts(row, row + 1, 2,
+                                     vv.re, vv.im, vv.stride, a->cols, 1.0);
+        vb.re[i * vb.stride] = creal(s);
+        vb.im[i * vb.stride] = cimag(s);
+    }
+    TN_PROFILE_END();
+}
+
+void
+tn_cmatrix_dot_matrix (const t_cmatrix* a, const t_cmatrix* b, t_cmatrix* c)
+{
+    TN_PROFILE_BEGIN(tn_cmatrix_dot_matrix);
+    if (!a || !b || !c) {
+        tp_raiseError("Null pointer in tn_cmatrix_dot_matrix.");
+    }
+    if (a->cols != b->rows || c->rows != a->rows || c->cols != b->cols) {
+        tp_raiseError("Incompatible sizes in tn_cmatrix_dot_matrix.");
+    }
+    if (c->data == a->data || c->data == b->data) {
+        tp_raiseError("Output of tn_cmatrix_dot_matrix must not be an input.");
+    }
+    // i-k-j order: row i of c accumulates a_ik * (row k of b), all rows are
+    // traversed contiguously
+    long rows = (long)a->rows;
+    #pragma omp parallel for schedule(static) \
+        if(a->rows * a->cols * b->cols >= TN_CLINALG_PARALLEL_MIN)
+    for (long i = 0; i < rows; i++) {
+        double* c_row = c->data->ptr + 2 * (size_t)i * c->tda;
+        memset(c_row, 0, 2 * c->cols * sizeof(double));
+        const double* a_row = a->data->ptr + 2 * (size_t)i * a->tda;
+        for (size_t k = 0; k < a->cols; k++) {
+            const double* b_row = b->data->ptr + 2 * k * b->tda;
+            axpy_parts(a_row[2 * k], a_row[2 * k + 1], b_row, b_row + 1, 2,
+                       c_row, c_row + 1, 2, b->cols);
+        }
+    }
+    TN_PROFILE_END();
+}
@@ -0,0 +1,554 @@
+#include "t_numerics_intern.h"
+
+#include <float.h>
+
+//================================================================================
+//    batched numerical differentiation
+//================================================================================
+
+/* Derivatives of functions are central differences of accuracy 2, 4 or 6
+ * for the steps h0, h0/2, h0/4, ..., combined in a Richardson table
+ * (Ridders' method). The leading error terms h^p, h^(p+2), ... are
+ * eliminated column by column; the entry whose neighbours agree best is
+ * taken, and its disagreement is the error estimate. A point stops when
+ * the estimate reaches rtol or when the diagonal of the table starts to
+ * grow while the estimate is near the rounding error of the differences.
+ * So the step is chosen per point and h0 only has to be large enough.
+ *
+ * tn_diff_batch passes all stencil points of all points still refining to
+ * one call of the VEC_FUNC per level. Sampled data is differentiated with
+ * Fornberg's weights, which work for any (non-uniform) grid and for the
+ * one-sided stencils at the ends. */
+
+// points of sampled data needed for threading
+#define TN_DIFF_PARALLEL_MIN 100000
+#define TN_DIFF_MAX_ACCURACY 6
+#define TN_DIFF_MAX_LEVELS 32
+// errors up to this multiple of the rounding error count as rounding
+#define TN_DIFF_NOISE_FACTOR 1000.0
+// smallest step of the table in units of DBL_EPSILON |x|
+#define TN_DIFF_MIN_STEP 16.0
+
+tn_diff_options
+tn_diff_default_options (void)
+{
+    tn_diff_options opt;
+    opt.accuracy = 2;
+    opt.h0 = 0.0;
+    opt.levels = 8;
+    opt.rtol = 1e-13;
+    return opt;
+}
+
+/* weights c[m] of the central stencil, D = (sum c_m (f_m -+ f_-m) (+ c_0 f_0)) / h^deriv */
+typedef struct {
+    int deriv;
+    int accuracy;
+    int r;                // half width
+    double c[TN_DIFF_MAX_ACCURACY / 2 + 1];
+} stencil;
+
+static stencil
+make_stencil (int deriv, int accuracy)
+{
+    stencil s = {deriv, accuracy, accuracy / 2, {0.0}};
+    if (deriv == 1) {
+        switch (accuracy) {
+        case 2:
+            s.c[1] = 0.5;
+            break;
+        case 4:
+            s.c[1] = 8.0 / 12.0;
+            s.c[2] = -1.0 / 12.0;
+            break;
+        default:
+            s.c[1] = 45.0 / 60.0;
+            s.c[2] = -9.0 / 60.0;
+            s.c[3] = 1.0 / 60.0;
+        }
+    }
+    else {
+        switch (accuracy) {
+        case 2:
+            s.c[0] = -2.0;
+            s.c[1] = 1.0;
+            break;
+        case 4:
+            s.c[0] = -30.0 / 12.0;
+            s.c[1] = 16.0 / 12.0;
+            s.c[2] = -1.0 / 12.0;
+            break;
+        default:
+            s.c[0] = -490.0 / 180.0;
+            s.c[1] = 270.0 / 180.0;
+            s.c[2] = -27.0 / 180.0;
+            s.c[3] = 2.0 / 180.0;
+        }
+    }
+    return s;
+}
+
+static void
+check_options (const tn_diff_options* opt, int deriv, char name[])
+{
+    if (deriv != 1 && deriv != 2) {
+        tp_raiseError(name);
+    }
+    if (opt->accuracy != 2 && opt->accuracy != 4 && opt->accuracy != 6) {
+        tp_raiseError(name);
+    }
+    if (opt->levels < 1 || opt->levels > TN_DIFF_MAX_LEVELS) {
+        tp_raiseError(name);
+    }
+}
+
+/* first step for a point at x: the truncation error depends on the scale of
+ * f, not on |x|, so only the floor that keeps the last step of the table
+ * resolvable relative to x grows with |x| */
+static double
+first_step (const tn_diff_options* opt, int deriv, double x)
+{
+    double h = 0.1;
+    if (opt->h0 > 0.0) {
+        h = opt->h0;
+    }
+    // without extrapolation: truncation h^p and rounding eps / h^d balanced
+    else if (opt->levels == 1) {
+        h = pow(DBL_EPSILON, 1.0 / (opt->accuracy + deriv));
+    }
+    double h_min = ldexp(TN_DIFF_MIN_STEP * DBL_EPSILON * fabs(x), opt->levels - 1);
+    return fmax(h, h_min);
+}
+
+//-----------------------------------
+// Richardson table
+//-----------------------------------
+
+/* one entry per derivative: the last row of the table and the best value */
+typedef struct {
+    double* prev;         // levels
+    double* cur;          // levels
+    double best;
+    double err;
+    double noise;         // rounding error of the differences behind best
+    double diag;          // change of the last diagonal entry
+    int done;
+} table;
+
+static void
+table_init (table* t, double* storage, int levels)
+{
+    t->prev = storage;
+    t->cur = storage + levels;
+    t->best = 0.0;
+    t->err = INFINITY;
+    t->noise = 0.0;
+    t->diag = INFINITY;
+    t->done = 0;
+}
+
+/* adds D(h0 / 2^level), noise: rounding error of d */
+static void
+table_add (table* t, int level, double d, double noise, int accuracy, double rtol)
+{
+    t->cur[0] = d;
+    if (level == 0) {
+        t->best = d;
+        t->noise = noise;
+    }
+    double fac = pow(2.0, accuracy);
+    for (int j = 1; j <= level; j++) {
+        t->cur[j] = (fac * t->cur[j - 1] - t->prev[j - 1]) / (fac - 1.0);
+        double e = fmax(fabs(t->cur[j] - t->cur[j - 1]), fabs(t->cur[j] - t->prev[j - 1]));
+        if (e <= t->err) {
+            t->err = e;
+            t->best = t->cur[j];
+            t->noise = noise;
+        }
+        fac *= 4.0;
+    }
+    // the first columns can agree by accident while h is still large, so a
+    // growing diagonal only ends the point once the error is near rounding
+    if (level > 0) {
+        t->diag = fabs(t->cur[level] - t->prev[level - 1]);
+        int growing = t->diag >= 2.0 * t->err;
+        if ((growing && t->err <= TN_DIFF_NOISE_FACTOR * noise)
+            || t->err <= rtol * fabs(t->best)) {
+            t->done = 1;
+        }
+    }
+    double* swap = t->prev;
+    t->prev = t->cur;
+    t->cur = swap;
+}
+
+/* error of a point: a table that ran out of levels without meeting rtol or
+ * the rounding criterion has not converged, the agreement of two entries
+ * can be accidental (h0 too large), so its last diagonal change counts;
+ * entries that agree exactly still carry the rounding error eps |f| / h^d */
+static double
+table_error (const table* t)
+{
+    double e = t->done ? t->err : fmax(t->err, t->diag);
+    return fmax(e, t->noise);
+}
+
+//-----------------------------------
+// functions
+//-----------------------------------
+
+void
+tn_diff_batch (VEC_FUNC func, void* params, const t_array* x, t_array* df,
+               int deriv, const tn_diff_options* opt, t_array* err)
+{
+    TN_PROFILE_BEGIN(tn_diff_batch);
+    if (!func || !x || !df) {
+        tp_raiseError("Null pointer in tn_diff_batch.");
+    }
+    if (df->len != x->len || (err && err->len != x->len)) {
+        tp_raiseError("Incompatible array lengths in tn_diff_batch.");
+    }
+    tn_diff_options o = opt ? *opt : tn_diff_default_options();
+    check_options(&o, deriv, "Invalid derivative order or options in tn_diff_batch.");
+    const size_t n = x->len;
+    const int levels = o.levels;
+    stencil st = make_stencil(deriv, o.accuracy);
+    const int n_off = 2 * st.r;
+
+    table* tab = malloc(n * sizeof(table));
+    double* rows = malloc(n * 2 * levels * sizeof(double));
+    size_t* active = malloc(n * sizeof(size_t));
+    double* h = malloc(n * sizeof(double));
+    double* f0 = deriv == 2 ? malloc(n * sizeof(double)) : NULL;
+    double* xs = malloc(n * n_off * sizeof(double));
+    double* ys = malloc(n * n_off * sizeof(double));
+    if (!tab || !rows || !active || !h || (deriv == 2 && !f0) || !xs || !ys) {
+        tp_raiseError("Memory allocation failed in tn_diff_batch!");
+    }
+    const double* xp = x->ptr;
+    size_t n_calls = 0;
+    for (size_t i = 0; i < n; i++) {
+        table_init(&tab[i], rows + i * 2 * levels, levels);
+        active[i] = i;
+        h[i] = first_step(&o, deriv, xp[i]);
+    }
+    if (deriv == 2) {
+        func(xp, f0, n, params);
+        n_calls += n;
+    }
+
+    size_t n_active = n;
+    for (int level = 0; level < levels && n_active > 0; level++) {
+        // stencil points of all active x in one call
+        for (size_t a = 0; a < n_active; a++) {
+            size_t i = active[a];
+            // step exactly representable relative to x
+            volatile double xh = xp[i] + h[i];
+            h[i] = xh - xp[i];
+            for (int m = 1; m <= st.r; m++) {
+                xs[a * n_off + 2 * (m - 1)] = xp[i] + m * h[i];
+                xs[a * n_off + 2 * (m - 1) + 1] = xp[i] - m * h[i];
+            }
+        }
+        func(xs, ys, n_active * n_off, params);
+        n_calls += n_active * n_off;
+
+        size_t n_next = 0;
+        for (size_t a = 0; a < n_active; a++) {
+            size_t i = active[a];
+            const double* y = ys + a * n_off;
+            double d = 0.0;
+            double mag = 0.0;
+            if (deriv == 1) {
+                for (int m = 1; m <= st.r; m++) {
+                    d += st.c[m] * (y[2 * (m - 1)] - y[2 * (m - 1) + 1]);
+                    mag += fabs(st.c[m]) * (fabs(y[2 * (m - 1)]) + fabs(y[2 * (m - 1) + 1]));
+                }
+                d /= h[i];
+                mag /= h[i];
+            }
+            else {
+                d = st.c[0] * f0[i];
+                mag = fabs(d);
+                for (int m = 1; m <= st.r; m++) {
+                    d += st.c[m] * (y[2 * (m - 1)] + y[2 * (m - 1) + 1]);
+                    mag += fabs(st.c[m]) * (fabs(y[2 * (m - 1)]) + fabs(y[2 * (m - 1) + 1]));
+                }
+                d /= h[i] * h[i];
+                mag /= h[i] * h[i];
+            }
+            table_add(&tab[i], level, d, DBL_EPSILON * mag, o.accuracy, o.rtol);
+            h[i] *= 0.5;
+            if (!tab[i].done) {
+                active[n_next++] = i;
+            }
+        }
+        n_active = n_next;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        df->ptr[i] = tab[i].best;
+        if (err) {
+            err->ptr[i] = table_error(&tab[i]);
+        }
+    }
+    free(tab);
+    free(rows);
+    free(active);
+    free(h);
+    free(f0);
+    free(xs);
+    free(ys);
+    TN_PROFILE_CALLBACKS(n_calls);
+    TN_PROFILE_END();
+}
+
+void
+tn_diff_jacobian (ODE_FUNC func, double t, const double* x, int n_in, int n_out,
+                  void* params, double* jac, const tn_diff_options* opt, double* err)
+{
+    TN_PROFILE_BEGIN(tn_diff_jacobian);
+    if (!func || !x || !jac) {
+        tp_raiseError("Null pointer in tn_diff_jacobian.");
+    }
+    if (n_in <= 0 || n_out <= 0) {
+        tp_raiseError("tn_diff_jacobian needs n_in > 0 and n_out > 0!");
+    }
+    tn_diff_options o = opt ? *opt : tn_diff_default_options();
+    check_options(&o, 1, "Invalid options in tn_diff_jacobian.");
+    const int levels = o.levels;
+    stencil st = make_stencil(1, o.accuracy);
+    const size_t m_out = (size_t)n_out;
+
+    table* tab = malloc(m_out * sizeof(table));
+    double* rows = malloc(m_out * 2 * levels * sizeof(double));
+    double* xw = malloc((size_t)n_in * sizeof(double));
+    double* f_plus = malloc(m_out * sizeof(double));
+    double* f_minus = malloc(m_out * sizeof(double));
+    double* d = malloc(2 * m_out * sizeof(double));
+    double* mag = d + m_out;
+    if (!tab || !rows || !xw || !f_plus || !f_minus || !d) {
+        tp_raiseError("Memory allocation failed in tn_diff_jacobian!");
+    }
+    memcpy(xw, x, (size_t)n_in * sizeof(double));
+    size_t n_calls = 0;
+
+    // column j: all outputs refine together until each has converged
+    for (int j = 0; j < n_in; j++) {
+        for (size_t i = 0; i < m_out; i++) {
+            table_init(&tab[i], rows + i * 2 * levels, levels);
+        }
+        double h = first_step(&o, 1, x[j]);
+        int all_done = 0;
+        for (int level = 0; level < levels && !all_done; level++) {
+            volatile double xh = x[j] + h;
+            double he = xh - x[j];
+            memset(d, 0, m_out * sizeof(double));
+            memset(mag, 0, m_out * sizeof(double));
+            for (int m = 1; m <= st.r; m++) {
+                xw[j] = x[j] + m * he;
+                func(t, xw, f_plus, params);
+                xw[j] = x[j] - m * he;
+                func(t, xw, f_minus, params);
+                n_calls += 2;
+                for (size_t i = 0; i < m_out; i++) {
+                    d[i] += st.c[m] * (f_plus[i] - f_minus[i]);
+                    mag[i] += fabs(st.c[m]) * (fabs(f_plus[i]) + fabs(f_minus[i]));
+                }
+            }
+            xw[j] = x[j];
+            all_done = 1;
+            for (size_t i = 0; i < m_out; i++) {
+                if (!tab[i].done) {
+                    table_add(&tab[i], level, d[i] / he, DBL_EPSILON * mag[i] / he,
+                              o.accuracy, o.rtol);
+                    all_done = all_done && tab[i].done;
+                }
+            }
+            h *= 0.5;
+        }
+        for (size_t i = 0; i < m_out; i++) {
+            jac[i * n_in + j] = tab[i].best;
+            if (err) {
+                err[i * n_in + j] = table_error(&tab[i]);
+            }
+        }
+    }
+    free(tab);
+    free(rows);
+    free(xw);
+    free(f_plus);
+    free(f_minus);
+    free(d);
+    TN_PROFILE_CALLBACKS(n_calls);
+    TN_PROFILE_END();
+}
+
+void
+tn_diff_gradient (ODE_FUNC func, double t, const double* x, int n, void* params,
+                  double* grad, const tn_diff_options* opt, double* err)
+{
+    tn_diff_jacobian(func, t, x, n, 1, params, grad, opt, err);
+}
+
+//-----------------------------------
+// sampled data
+//-----------------------------------
+
+/* Fornberg (1988): weights w[k] of the derivative deriv at z from the
+ * values at x[0..n-1]; c is scratch of n * (deriv + 1) */
+static void
+fornberg (double z, const double* x, int n, int deriv, double* c, double* w)
+{
+    const int m1 = deriv + 1;
+    memset(c, 0, (size_t)n * m1 * sizeof(double));
+    double c1 = 1.0;
+    double c4 = x[0] - z;
+    c[0] = 1.0;
+    for (int i = 1; i < n; i++) {
+        int mn = i < deriv ? i : deriv;
+        double c2 = 1.0;
+        double c5 = c4;
+        c4 = x[i] - z;
+        for (int j = 0; j < i; j++) {
+            double c3 = x[i] - x[j];
+            c2 *= c3;
+            if (j == i - 1) {
+                for (int k = mn; k >= 1; k--) {
+                    c[i * m1 + k] = c1 * (k * c[(i - 1) * m1 + k - 1]
+                                          - c5 * c[(i - 1) * m1 + k]) / c2;
+                }
+                c[i * m1] = -c1 * c5 * c[(i - 1) * m1] / c2;
+            }
+            for (int k = mn; k >= 1; k--) {
+                c[j * m1 + k] = (c4 * c[j * m1 + k] - k * c[j * m1 + k - 1]) / c3;
+            }
+            c[j * m1] = c4 * c[j * m1] / c3;
+        }
+        c1 = c2;
+    }
+    for (int k = 0; k < n; k++) {
+        w[k] = c[k * m1 + deriv];
+    }
+}
+
+/* number of points of the stencils of sampled data */
+static int
+sample_points (int deriv, int accuracy, size_t n, char name[])
+{
+    if ((deriv != 1 && deriv != 2) || accuracy < 1 || accuracy > 8) {
+        tp_raiseError(name);
+    }
+    int np = accuracy + deriv;
+    if ((size_t)np > n) {
+        tp_raiseError(name);
+    }
+    return np;
+}
+
+void
+tn_diff_samples (const t_array* y, double dx, t_array* dy, int deriv, int accuracy)
+{
+    TN_PROFILE_BEGIN(tn_diff_samples);
+    if (!y || !dy) {
+        tp_raiseError("Null pointer in tn_diff_samples.");
+    }
+    if (dy->len != y->len || dy == y || dx <= 0.0) {
+        tp_raiseError("Incompatible arguments in tn_diff_samples.");
+    }
+    // even accuracy: the central stencil of the interior is exact to it
+    accuracy += accuracy % 2;
+    const size_t n = y->len;
+    const int np = sample_points(deriv, accuracy, n,
+                                 "Invalid order, accuracy or too few points in tn_diff_samples.");
+    const int r = accuracy / 2;
+    const double scale = deriv == 1 ? 1.0 / dx : 1.0 / (dx * dx);
+
+    // offsets in units of dx: central stencil and one-sided windows
+    double grid[16];
+    double c[16 * 3];
+    double w_center[16];
+    double w_edge[8][16];
+    for (int k = 0; k < 2 * r + 1; k++) {
+        grid[k] = k - r;
+    }
+    fornberg(0.0, grid, 2 * r + 1, deriv, c, w_center);
+    for (int k = 0; k < np; k++) {
+        grid[k] = k;
+    }
+    // points 0 .. r - 1 at the low end use the window 0 .. np - 1, the high
+    // end the mirrored weights with a sign (-1)^deriv
+    for (int e = 0; e < r; e++) {
+        fornberg((double)e, grid, np, deriv, c, w_edge[e]);
+    }
+    const double* yp = y->ptr;
+    double* out = dy->ptr;
+    const double sign = deriv == 1 ? -1.0 : 1.0;
+    for (int e = 0; e < r && (size_t)e < n; e++) {
+        double lo = 0.0;
+        double hi = 0.0;
+        for (int k = 0; k < np; k++) {
+            lo += w_edge[e][k] * yp[k];
+            hi += w_edge[e][k] * yp[n - 1 - k];
+        }
+        out[e] = scale * lo;
+        out[n - 1 - e] = sign * scale * hi;
+    }
+    long lo_i = r;
+    long hi_i = (long)n - r;
+    #pragma omp parallel for simd schedule(static) if(n >= TN_DIFF_PARALLEL_MIN)
+    for (long i = lo_i; i < hi_i; i++) {
+        double s = 0.0;
+        for (int k = 0; k < 2 * r + 1; k++) {
+            s += w_center[k] * yp[i - r + k];
+        }
+        out[i] = scale * s;
+    }
+    TN_PROFILE_END();
+}
+
+void
+tn_diff_samples_grid (const t_array* x, const t_array* y, t_array* dy,
+                      int deriv, int accuracy)
+{
+    TN_PROFILE_BEGIN(tn_diff_samples_grid);
+    if (!x || !y || !dy) {
+        tp_raiseError("Null pointer in tn_diff_samples_grid.");
+    }
+    if (x->len != y->len || dy->len != y->len || dy == y || dy == x) {
+        tp_raiseError("Incompatible arguments in tn_diff_samples_grid.");
+    }
+    const size_t n = y->len;
+    const int np = sample_points(deriv, accuracy, n,
+                                 "Invalid order, accuracy or too few points in tn_diff_samples_grid.");
+    const double* xp = x->ptr;
+    for (size_t i = 1; i < n; i++) {
+        if (!(xp[i] > xp[i - 1])) {
+            tp_raiseError("Grid of tn_diff_samples_grid has to be strictly increasing.");
+        }
+    }
+    const double* yp = y->ptr;
+    double* out = dy->ptr;
+    long nl = (long)n;
+    // window of np points around i, shifted inside at the ends; weights
+    // are computed relative to x_i for accuracy on shifted grids
+    #pragma omp parallel for schedule(static) if(n >= TN_DIFF_PARALLEL_MIN / 10)
+    for (long i = 0; i < nl; i++) {
+        double c[10 * 3];
+        double w[10];
+        double grid[10];
+        long start = i - (np - 1) / 2;
+        start = start < 0 ? 0 : start;
+        start = start + np > nl ? nl - np : start;
+        for (int k = 0; k < np; k++) {
+            grid[k] = xp[start + k] - xp[i];
+        }
+        fornberg(0.0, grid, np, deriv, c, w);
+        double s = 0.0;
+        for (int k = 0; k < np; k++) {
+            s += w[k] * yp[start + k];
+        }
+        out[i] = s;
+    }
+    TN_PROFILE_END();
+}
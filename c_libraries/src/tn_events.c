@@ -0,0 +1,375 @@
+#include "t_numerics_intern.h"
+
+#include <float.h>
+
+//================================================================================
+//    event detection during integration
+//================================================================================
+
+/* After every RK4 step the event functions are evaluated at the new state
+ * and compared with their values at the old one. A sign change (in the
+ * requested direction) is located by bracketed root finding (Illinois) on
+ * the cubic Hermite interpolant through (y0, f0) and (y1, f1) of the step,
+ * which is accurate to O(dt^4) like RK4 itself and needs no extra calls of
+ * ode_func: f1 is the first stage of the next step. The state buffers of
+ * old and new step are swapped, not copied. */
+
+struct tn_event_log {
+    int dim;
+    size_t count;
+    size_t capacity;
+    int* index;           // which event function
+    double* t;
+    double* y;            // count x dim
+};
+
+tn_event_log*
+tn_event_log_alloc (int dim)
+{
+    if (dim <= 0) {
+        tp_raiseError("tn_event_log_alloc needs dim > 0!");
+    }
+    tn_event_log* log = malloc(sizeof(tn_event_log));
+    Null_exit_message(log, "Memory allocation failed in tn_event_log_alloc!");
+    log->dim = dim;
+    log->count = 0;
+    log->capacity = 0;
+    log->index = NULL;
+    log->t = NULL;
+    log->y = NULL;
+    return log;
+}
+
+void
+tn_event_log_free (tn_event_log* log)
+{
+    if (!log) {
+        return;
+    }
+    free(log->index);
+    free(log->t);
+    free(log->y);
+    free(log);
+}
+
+void
+tn_event_log_clear (tn_event_log* log)
+{
+    if (!log) {
+        tp_raiseError("Null pointer in tn_event_log_clear.");
+    }
+    log->count = 0;
+}
+
+static void
+log_append (tn_event_log* log, int index, double t, const double* y)
+{
+    if (log->count == log->capacity) {
+        // grows geometrically, amortized O(1) per event
+        size_t capacity = log->capacity ? 2 * log->capacity : 64;
+        int* new_index = realloc(log->index, capacity * sizeof(int));
+        Null_exit_message(new_index, "Memory allocation failed in tn_event_log!");
+        log->index = new_index;
+        double* new_t = realloc(log->t, capacity * sizeof(double));
+        Null_exit_message(new_t, "Memory allocation failed in tn_event_log!");
+        log->t = new_t;
+        double* new_y = realloc(log->y, capacity * log->dim * sizeof(double));
+        Null_exit_message(new_y, "Memory allocation failed in tn_event_log!");
+        log->y = new_y;
+        log->capacity = capacity;
+    }
+    log->index[log->count] = index;
+    log->t[log->count] = t;
+    memcpy(log->y + log->count * log->dim, y, log->dim * sizeof(double));
+    log->count++;
+}
+
+size_t
+tn_event_log_count (const tn_event_log* log)
+{
+    if (!log) {
+        tp_raiseError("Null pointer in tn_event_log_count.");
+    }
+    return log->count;
+}
+
+static void
+check_entry (const tn_event_log* log, size_t k, char name[])
+{
+    if (!log) {
+        tp_raiseError(name);
+    }
+    if (k >= log->count) {
+        tp_raiseError("Invalid index in tn_event_log.");
+    }
+}
+
+int
+tn_event_log_index (const tn_event_log* log, size_t k)
+{
+    check_entry(log, k, "Null pointer in tn_event_log_index.");
+    return log->index[k];
+}
+
+double
+tn_event_log_time (const tn_event_log* log, size_t k)
+{
+    check_entry(log, k, "Null pointer in tn_event_log_time.");
+    return log->t[k];
+}
+
+const double*
+tn_event_log_state (const tn_event_log* log, size_t k)
+{
+    check_entry(log, k, "Null pointer in tn_event_log_state.");
+    return log->y + k * log->dim;
+}
+
+t_matrix*
+tn_event_log_states (const tn_event_log* log, int index)
+{
+    if (!log) {
+        tp_raiseError("Null pointer in tn_event_log_states.");
+    }
+    size_t rows = 0;
+    for (size_t k = 0; k < log->count; k++) {
+        rows += index < 0 || log->index[k] == index;
+    }
+    if (rows == 0) {
+        return NULL;
+    }
+    t_matrix* m = t_matrix_alloc(rows, log->dim);
+    double* row = m->data->ptr;
+    for (size_t k = 0; k < log->count; k++) {
+        if (index < 0 || log->index[k] == index) {
+            memcpy(row, log->y + k * log->dim, log->dim * sizeof(double));
+            row += m->tda;
+        }
+    }
+    return m;
+}
+
+//-----------------------------------
+// driver
+//-----------------------------------
+
+/* one RK4 step y1 = y0 + ..., f0 = f(t, y0) is known, k: 3 * dim */
+static void
+rk4_step_fsal (ODE_FUNC ode_func, double t, double dt, const double* y0,
+               const double* f0, double* y1, double* k, int dim, void* params)
+{
+    double* k2 = k;
+    double* k3 = k + dim;
+    double* k4 = k + 2 * dim;
+    for (int i = 0; i < dim; i++) {
+        y1[i] = y0[i] + 0.5 * dt * f0[i];
+    }
+    ode_func(t + 0.5 * dt, y1, k2, params);
+    for (int i = 0; i < dim; i++) {
+        y1[i] = y0[i] + 0.5 * dt * k2[i];
+    }
+    ode_func(t + 0.5 * dt, y1, k3, params);
+    for (int i = 0; i < dim; i++) {
+        y1[i] = y0[i] + dt * k3[i];
+    }
+    ode_func(t + dt, y1, k4, params);
+    for (int i = 0; i < dim; i++) {
+        y1[i] = y0[i] + (dt / 6.0) * (f0[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+    }
+}
+
+/* cubic Hermite interpolant of the step at t0 + s * dt */
+static void
+hermite (double s, double dt, const double* y0, const double* f0,
+         const double* y1, const double* f1, double* y, int dim)
+{
+    double s1 = 1.0 - s;
+    double h00 = (1.0 + 2.0 * s) * s1 * s1;
+    double h10 = s * s1 * s1 * dt;
+    double h01 = s * s * (3.0 - 2.0 * s);
+    double h11 = -s * s * s1 * dt;
+    for (int i = 0; i < dim; i++) {
+        y[i] = h00 * y0[i] + h10 * f0[i] + h01 * y1[i] + h11 * f1[i];
+    }
+}
+
+typedef struct {
+    double t0, dt;
+    const double *y0, *f0, *y1, *f1;
+    double* y;            // interpolated state
+    int dim;
+} step_data;
+
+static double
+event_value (const tn_event* ev, double t, const double* y, void* params)
+{
+    return ev->func(t, y, ev->params ? ev->params : params);
+}
+
+static int
+crossed (const tn_event* ev, double g_old, double g_new)
+{
+    int up = g_old < 0.0 && g_new >= 0.0;
+    int down = g_old > 0.0 && g_new <= 0.0;
+    return (up && ev->direction >= 0) || (down && ev->direction <= 0);
+}
+
+/* root of g on the interpolant in [0, 1] (units of dt), g(0) = g_a, g(1) = g_b
+ * of opposite sign; Illinois variant of regula falsi, tol in units of dt */
+static double
+locate (const tn_event* ev, const step_data* st, void* params,
+        double g_a, double g_b, double tol)
+{
+    // crossed() ensures g_a != 0, g_b == 0 is a root at the end of the step
+    if (g_b == 0.0) {
+        return 1.0;
+    }
+    double a = 0.0;
+    double b = 1.0;
+    int side = 0;
+    for (int iter = 0; iter < 100 && b - a > tol; iter++) {
+        double s = (a * g_b - b * g_a) / (g_b - g_a);
+        // keep the secant point inside the bracket
+        s = fmin(fmax(s, a + 0.5 * tol), b - 0.5 * tol);
+        hermite(s, st->dt, st->y0, st->f0, st->y1, st->f1, st->y, st->dim);
+        double g = event_value(ev, st->t0 + s * st->dt, st->y, params);
+        if (g == 0.0) {
+            return s;
+        }
+        if ((g > 0.0) == (g_a > 0.0)) {
+            a = s;
+            g_a = g;
+            if (side == 1) {
+                g_b *= 0.5;
+            }
+            side = 1;
+        }
+        else {
+            b = s;
+            g_b = g;
+            if (side == -1) {
+                g_a *= 0.5;
+            }
+            side = -1;
+        }
+    }
+    // right end of the bracket: the event has certainly happened there
+    return b;
+}
+
+tn_event_result
+tn_rk4_integrate_events (ODE_FUNC ode_func, double t0, double dt, long n_steps,
+                         double* y, int dim, void* params,
+                         const tn_event* events, int n_events, double tol,
+                         tn_event_log* log)
+{
+    TN_PROFILE_BEGIN(tn_rk4_integrate_events);
+    if (!ode_func || !y || (n_events > 0 && !events)) {
+        tp_raiseError("Null pointer in tn_rk4_integrate_events.");
+    }
+    if (dt <= 0.0) {
+        tp_raiseError("tn_rk4_integrate_events needs dt > 0.");
+    }
+    if (log && log->dim != dim) {
+        tp_raiseError("Dimension of event log does not match in tn_rk4_integrate_events.");
+    }
+    if (n_events < 0) {
+        n_events = 0;
+    }
+    if (tol <= 0.0) {
+        tol = 4.0 * DBL_EPSILON * (fabs(t0) + fabs(n_steps * dt));
+    }
+    double tol_s = fmax(tol / dt, 4.0 * DBL_EPSILON);
+
+    size_t n = (size_t)dim;
+    double* block = malloc((7 * n + 3 * (size_t)n_events) * sizeof(double));
+    Null_exit_message(block, "Memory allocation failed in tn_rk4_integrate_events!");
+    double* y_a = block;              // old and new state, swapped every step
+    double* y_b = y_a + n;
+    double* f_a = y_b + n;
+    double* f_b = f_a + n;
+    double* k = f_b + n;              // 3 * dim
+    double* y_event = k;              // k is free again after the step
+    double* g_a = block + 7 * n;
+    double* g_b = g_a + n_events;
+    double* s_hit = g_b + n_events;   // location of crossings in this step
+    int* order = malloc((n_events > 0 ? n_events : 1) * sizeof(int));
+    Null_exit_message(order, "Memory allocation failed in tn_rk4_integrate_events!");
+
+    tn_event_result res = {0};
+    res.status = TN_EVENTS_DONE;
+    size_t n_calls = 1;
+
+    memcpy(y_a, y, n * sizeof(double));
+    ode_func(t0, y_a, f_a, params);
+    for (int e = 0; e < n_events; e++) {
+        g_a[e] = event_value(&events[e], t0, y_a, params);
+    }
+
+    double t = t0;
+    for (long step = 0; step < n_steps; step++) {
+        rk4_step_fsal(ode_func, t, dt, y_a, f_a, y_b, k, dim, params);
+        double t_new = t0 + (step + 1) * dt;
+        ode_func(t_new, y_b, f_b, params);
+        n_calls += 4;
+        res.n_steps++;
+
+        // crossings in this step
+        int n_hit = 0;
+        step_data st = {t, dt, y_a, f_a, y_b, f_b, y_event, dim};
+        for (int e = 0; e < n_events; e++) {
+            g_b[e] = event_value(&events[e], t_new, y_b, params);
+            if (crossed(&events[e], g_a[e], g_b[e])) {
+                s_hit[e] = locate(&events[e], &st, params, g_a[e], g_b[e], tol_s);
+                // sorted by time of crossing
+                int pos = n_hit++;
+                while (pos > 0 && s_hit[order[pos - 1]] > s_hit[e]) {
+                    order[pos] = order[pos - 1];
+                    pos--;
+                }
+                order[pos] = e;
+            }
+        }
+        int terminated = 0;
+        for (int h = 0; h < n_hit && !terminated; h++) {
+            int e = order[h];
+            double t_event = t + s_hit[e] * dt;
+            hermite(s_hit[e], dt, y_a, f_a, y_b, f_b, y_event, dim);
+            if (log) {
+                log_append(log, e, t_event, y_event);
+            }
+            res.n_events++;
+            if (events[e].terminal) {
+                terminated = 1;
+                res.status = TN_EVENTS_TERMINATED;
+                res.t = t_event;
+                memcpy(y, y_event, n * sizeof(double));
+            }
+        }
+        if (terminated) {
+            break;
+        }
+
+        // the new step starts from the end of this one
+        double* swap = y_a;
+        y_a = y_b;
+        y_b = swap;
+        swap = f_a;
+        f_a = f_b;
+        f_b = swap;
+        swap = g_a;
+        g_a = g_b;
+        g_b = swap;
+        t = t_new;
+    }
+    if (res.status == TN_EVENTS_DONE) {
+        res.t = t;
+        memcpy(y, y_a, n * sizeof(double));
+    }
+
+    free(order);
+    free(block);
+    TN_PROFILE_CALLBACKS(n_calls);
+    TN_PROFILE_END();
+    return res;
+}
@@ -0,0 +1,610 @@
+#include "t_numerics_intern.h"
+
+#include <float.h>
+
+//================================================================================
+//    matrix exponential and exponential propagators
+//================================================================================
+
+/* Solutions of dy/dt = A y with constant A are y(t) = exp(t A) y(0), exact
+ * for any step size. Small A: exp(t A) is computed densely by scaling and
+ * squaring with Pade approximants (Higham 2005) and can be cached in a
+ * tn_expm_prop. Large or sparse A: exp(t A) v is approximated in a Krylov
+ * subspace of dimension m (Arnoldi, Lanczos for symmetric A) with adaptive
+ * substeps and error estimate (Sidje 1998, Expokit), only products A x are
+ * needed. */
+
+// largest norms of t A for which Pade approximants of degree 3, 5, 7, 9 and
+// 13 are accurate to double precision without scaling
+static const double theta[5] = {
+    1.495585217958292e-2, 2.539398330063230e-1, 9.504178996162932e-1,
+    2.097847961257068e0, 5.371920351148152e0
+};
+
+static const double pade3[4] = {120.0, 60.0, 12.0, 1.0};
+static const double pade5[6] = {30240.0, 15120.0, 3360.0, 420.0, 30.0, 1.0};
+static const double pade7[8] = {17297280.0, 8648640.0, 1995840.0, 277200.0,
+                                25200.0, 1512.0, 56.0, 1.0};
+static const double pade9[10] = {17643225600.0, 8821612800.0, 2075673600.0,
+                                 302702400.0, 30270240.0, 2162160.0, 110880.0,
+                                 3960.0, 90.0, 1.0};
+static const double pade13[14] = {64764752532480000.0, 32382376266240000.0,
+                                  7771770303897600.0, 1187353796428800.0,
+                                  129060195264000.0, 10559470521600.0,
+                                  670442572800.0, 33522128640.0, 1323241920.0,
+                                  40840800.0, 960960.0, 16380.0, 182.0, 1.0};
+
+// number of n x n buffers needed by expm_ptr
+#define TN_EXPM_BUFFERS 7
+
+/* c = a * b, all row major n x n, c must not be a or b */
+static void
+matmul (const double* a, const double* b, double* c, size_t n)
+{
+    for (size_t i = 0; i < n * n; i++) {
+        c[i] = 0.0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = 0; k < n; k++) {
+            double aik = a[i * n + k];
+            if (aik == 0.0) {
+                continue;
+            }
+            for (size_t j = 0; j < n; j++) {
+                c[i * n + j] += aik * b[k * n + j];
+            }
+        }
+    }
+}
+
+/* maximal absolute column sum */
+static double
+norm_1 (const double* a, size_t n)
+{
+    double max = 0.0;
+    for (size_t j = 0; j < n; j++) {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            sum += fabs(a[i * n + j]);
+        }
+        max = fmax(max, sum);
+    }
+    return max;
+}
+
+/* out = exp(t a) for row major n x n a (lda n), buf: TN_EXPM_BUFFERS * n * n
+ * doubles, piv: n ints; out may not overlap buf */
+static void
+expm_ptr (const double* a, size_t n, double t, double* out, double* buf, int* piv)
+{
+    size_t nn = n * n;
+    double* a1 = buf;
+    double* a2 = a1 + nn;
+    double* a4 = a2 + nn;
+    double* a6 = a4 + nn;
+    double* u = a6 + nn;
+    double* v = u + nn;
+    double* tmp = v + nn;
+
+    for (size_t i = 0; i < nn; i++) {
+        a1[i] = t * a[i];
+    }
+    double norm = norm_1(a1, n);
+    int s = 0;
+    int degree = 13;
+    const double* b = pade13;
+    if (norm <= theta[0]) {
+        degree = 3;
+        b = pade3;
+    }
+    else if (norm <= theta[1]) {
+        degree = 5;
+        b = pade5;
+    }
+    else if (norm <= theta[2]) {
+        degree = 7;
+        b = pade7;
+    }
+    else if (norm <= theta[3]) {
+        degree = 9;
+        b = pade9;
+    }
+    else if (norm > theta[4]) {
+        s = (int)ceil(log2(norm / theta[4]));
+        double scale = ldexp(1.0, -s);
+        for (size_t i = 0; i < nn; i++) {
+            a1[i] *= scale;
+        }
+    }
+
+    matmul(a1, a1, a2, n);
+    if (degree == 13) {
+        matmul(a2, a2, a4, n);
+        matmul(a2, a4, a6, n);
+        // u = a1 * (a6 * (b13 a6 + b11 a4 + b9 a2) + b7 a6 + b5 a4 + b3 a2 + b1 I)
+        // v = a6 * (b12 a6 + b10 a4 + b8 a2) + b6 a6 + b4 a4 + b2 a2 + b0 I
+        for (size_t i = 0; i < nn; i++) {
+            tmp[i] = b[13] * a6[i] + b[11] * a4[i] + b[9] * a2[i];
+        }
+        matmul(a6, tmp, u, n);
+        for (size_t i = 0; i < nn; i++) {
+            u[i] += b[7] * a6[i] + b[5] * a4[i] + b[3] * a2[i];
+            tmp[i] = b[12] * a6[i] + b[10] * a4[i] + b[8] * a2[i];
+        }
+        matmul(a6, tmp, v, n);
+        for (size_t i = 0; i < nn; i++) {
+            v[i] += b[6] * a6[i] + b[4] * a4[i] + b[2] * a2[i];
+        }
+    }
+    else {
+        // sum over even powers: u ~ sum b_(2k+1) a^(2k), v ~ sum b_(2k) a^(2k)
+        double* power = a4;
+        for (size_t i = 0; i < nn; i++) {
+            u[i] = b[3] * a2[i];
+            v[i] = b[2] * a2[i];
+            power[i] = a2[i];
+        }
+        for (int k = 4; k < degree; k += 2) {
+            matmul(power, a2, tmp, n);
+            memcpy(power, tmp, nn * sizeof(double));
+            for (size_t i = 0; i < nn; i++) {
+                u[i] += b[k + 1] * power[i];
+                v[i] += b[k] * power[i];
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        u[i * n + i] += b[1];
+        v[i * n + i] += b[0];
+    }
+    matmul(a1, u, tmp, n);
+
+    // (v - u) x = (v + u), u = tmp now
+    for (size_t i = 0; i < nn; i++) {
+        double p = v[i] + tmp[i];
+        v[i] -= tmp[i];
+        u[i] = p;
+    }
+    if (tn_lu_decomp_ptr(v, piv, (int)n) != 0) {
+        tp_raiseError("Singular Pade denominator in tn_expm.");
+    }
+    // solve column by column, a2 holds one column
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i < n; i++) {
+            a2[i] = u[i * n + j];
+        }
+        tn_lu_solve_ptr(v, piv, (int)n, a2);
+        for (size_t i = 0; i < n; i++) {
+            out[i * n + j] = a2[i];
+        }
+    }
+    // undo scaling: exp(A) = exp(A / 2^s)^(2^s)
+    for (int k = 0; k < s; k++) {
+        matmul(out, out, tmp, n);
+        memcpy(out, tmp, nn * sizeof(double));
+    }
+}
+
+static double
+dot (const double* x, const double* y, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+/* contiguous copy of square m */
+static double*
+square_copy (const t_matrix* m, char name[])
+{
+    if (m->rows != m->cols) {
+        tp_raiseError(name);
+    }
+    size_t n = m->rows;
+    double* a = malloc(n * n * sizeof(double));
+    Null_exit_message(a, "Memory allocation failed in tn_expm!");
+    for (size_t i = 0; i < n; i++) {
+        memcpy(a + i * n, m->data->ptr + i * m->tda, n * sizeof(double));
+    }
+    return a;
+}
+
+static void
+expm_t_matrix (const t_matrix* a, double t, t_matrix* out)
+{
+    size_t n = a->rows;
+    double* a_copy = square_copy(a, "tn_expm needs a square matrix.");
+    double* buf = malloc((TN_EXPM_BUFFERS + 1) * n * n * sizeof(double));
+    int* piv = malloc(n * sizeof(int));
+    Null_exit_message(buf, "Memory allocation failed in tn_expm!");
+    Null_exit_message(piv, "Memory allocation failed in tn_expm!");
+    double* result = buf + TN_EXPM_BUFFERS * n * n;
+    expm_ptr(a_copy, n, t, result, buf, piv);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(out->data->ptr + i * out->tda, result + i * n, n * sizeof(double));
+    }
+    free(piv);
+    free(buf);
+    free(a_copy);
+}
+
+void
+tn_expm (const t_matrix* a, double t, t_matrix* out)
+{
+    TN_PROFILE_BEGIN(tn_expm);
+    if (!a || !out) {
+        tp_raiseError("Null pointer in tn_expm.");
+    }
+    if (out->rows != a->rows || out->cols != a->cols) {
+        tp_raiseError("Incompatible matrix sizes in tn_expm.");
+    }
+    expm_t_matrix(a, t, out);
+    TN_PROFILE_END();
+}
+
+//-----------------------------------
+// cached propagator
+//-----------------------------------
+
+struct tn_expm_prop {
+    t_matrix* e;          // exp(dt A)
+    double dt;
+    double* tmp;          // result buffer, so that out may be y
+};
+
+tn_expm_prop*
+tn_expm_prop_alloc (const t_matrix* a, double dt)
+{
+    if (!a) {
+        tp_raiseError("Null pointer in tn_expm_prop_alloc.");
+    }
+    tn_expm_prop* p = malloc(sizeof(tn_expm_prop));
+    Null_exit_message(p, "Memory allocation failed in tn_expm_prop_alloc!");
+    p->e = t_matrix_alloc(a->rows, a->cols);
+    p->dt = dt;
+    p->tmp = malloc(a->rows * sizeof(double));
+    Null_exit_message(p->tmp, "Memory allocation failed in tn_expm_prop_alloc!");
+    tn_expm(a, dt, p->e);
+    return p;
+}
+
+void
+tn_expm_prop_free (tn_expm_prop* p)
+{
+    if (!p) {
+        return;
+    }
+    T_MATRIX_FREE(p->e);
+    free(p->tmp);
+    free(p);
+}
+
+t_matrix*
+tn_expm_prop_matrix (tn_expm_prop* p)
+{
+    if (!p) {
+        tp_raiseError("Null pointer in tn_expm_prop_matrix.");
+    }
+    return p->e;
+}
+
+double
+tn_expm_prop_dt (const tn_expm_prop* p)
+{
+    if (!p) {
+        tp_raiseError("Null pointer in tn_expm_prop_dt.");
+    }
+    return p->dt;
+}
+
+/* out = e * y on raw pointers, out may be y */
+static void
+prop_apply_ptr (tn_expm_prop* p, const double* y, double* out)
+{
+    const t_matrix* e = p->e;
+    size_t n = e->rows;
+    for (size_t i = 0; i < n; i++) {
+        p->tmp[i] = dot(e->data->ptr + i * e->tda, y, n);
+    }
+    memcpy(out, p->tmp, n * sizeof(double));
+}
+
+void
+tn_expm_prop_apply (tn_expm_prop* p, const t_array* y, t_array* out)
+{
+    TN_PROFILE_BEGIN(tn_expm_prop_apply);
+    if (!p || !y || !out) {
+        tp_raiseError("Null pointer in tn_expm_prop_apply.");
+    }
+    if (y->len != p->e->rows || out->len != p->e->rows) {
+        tp_raiseError("Incompatible array lengths in tn_expm_prop_apply.");
+    }
+    prop_apply_ptr(p, y->ptr, out->ptr);
+    TN_PROFILE_END();
+}
+
+void
+tn_expm_prop_trajectory (tn_expm_prop* p, const t_array* y0, t_matrix* traj)
+{
+    TN_PROFILE_BEGIN(tn_expm_prop_trajectory);
+    if (!p || !y0 || !traj) {
+        tp_raiseError("Null pointer in tn_expm_prop_trajectory.");
+    }
+    size_t n = p->e->rows;
+    if (y0->len != n || traj->cols != n) {
+        tp_raiseError("Incompatible sizes in tn_expm_prop_trajectory.");
+    }
+    double* row = traj->data->ptr;
+    memcpy(row, y0->ptr, n * sizeof(double));
+    for (size_t k = 1; k < traj->rows; k++) {
+        prop_apply_ptr(p, row, row + traj->tda);
+        row += traj->tda;
+    }
+    TN_PROFILE_END();
+}
+
+//-----------------------------------
+// Krylov subspace: exp(t A) v
+//-----------------------------------
+
+tn_expmv_options
+tn_expmv_default_options (void)
+{
+    tn_expmv_options opt = {
+        .krylov_dim = 30,
+        .tol = 1e-10,
+        .anorm = 0.0,
+        .symmetric = 0
+    };
+    return opt;
+}
+
+/* rounds x up to 2 significant digits like Expokit */
+static double
+round_step (double x)
+{
+    double s = pow(10.0, floor(log10(x)) - 1.0);
+    return ceil(x / s) * s;
+}
+
+static double
+norm_2 (const double* x, size_t n)
+{
+    return sqrt(dot(x, x, n));
+}
+
+tn_expmv_result
+tn_expmv (LINOP_FUNC matvec, void* params, size_t n, double t,
+          const double* v, double* out, const tn_expmv_options* opt)
+{
+    TN_PROFILE_BEGIN(tn_expmv);
+    tn_expmv_options default_opt = tn_expmv_default_options();
+    if (!opt) {
+        opt = &default_opt;
+    }
+    if (!matvec || !v || !out) {
+        tp_raiseError("Null pointer in tn_expmv.");
+    }
+    if (opt->tol <= 0.0) {
+        tp_raiseError("tn_expmv needs tol > 0.");
+    }
+    tn_expmv_result res = {0};
+    size_t m = opt->krylov_dim < n ? opt->krylov_dim : n;
+    if (m < 2) {
+        m = n < 2 ? n : 2;
+    }
+    size_t mh = m + 2;    // size of the augmented Hessenberg matrix
+    const int max_reject = 10;
+    const double breakdown_tol = 1e-7;
+    const double gamma = 0.9;
+    const double delta = 1.2;
+
+    double* krylov = malloc((m + 1) * n * sizeof(double));
+    double* p = malloc(n * sizeof(double));
+    double* h = malloc((TN_EXPM_BUFFERS + 4) * mh * mh * sizeof(double));
+    int* piv = malloc(mh * sizeof(int));
+    Null_exit_message(krylov, "Memory allocation failed in tn_expmv!");
+    Null_exit_message(p, "Memory allocation failed in tn_expmv!");
+    Null_exit_message(h, "Memory allocation failed in tn_expmv!");
+    Null_exit_message(piv, "Memory allocation failed in tn_expmv!");
+    double* f = h + mh * mh;          // exp(t h), leading dimension mh
+    double* hb = f + mh * mh;         // leading block of h, contiguous
+    double* e = hb + mh * mh;         // exp of hb
+    double* buf = e + mh * mh;
+
+    // out may be v
+    double beta = norm_2(v, n);
+    double v_norm = beta;
+    if (out != v) {
+        memcpy(out, v, n * sizeof(double));
+    }
+    res.hump = beta;
+    if (beta == 0.0 || t == 0.0 || n == 0) {
+        res.hump = 1.0;
+        goto finish;
+    }
+
+    double anorm = opt->anorm;
+    if (anorm <= 0.0) {
+        // lower bound of ||A||_2 by a few power iterations from v
+        memcpy(krylov, v, n * sizeof(double));
+        for (int k = 0; k < 4; k++) {
+            double nx = norm_2(krylov, n);
+            if (nx == 0.0) {
+                break;
+            }
+            for (size_t i = 0; i < n; i++) {
+                krylov[i] /= nx;
+            }
+            matvec(krylov, p, params);
+            res.n_matvec++;
+            anorm = fmax(anorm, norm_2(p, n));
+            memcpy(krylov, p, n * sizeof(double));
+        }
+        if (anorm == 0.0) {
+            // A v = 0 in the subspace: exp(t A) v = v
+            goto finish;
+        }
+    }
+
+    double sign = t < 0.0 ? -1.0 : 1.0;
+    double t_out = fabs(t);
+    double t_now = 0.0;
+    double xm = 1.0 / m;
+    double tol = opt->tol;
+    double fact = pow((m + 1) / exp(1.0), m + 1) * sqrt(2.0 * M_PI * (m + 1));
+    double t_new = round_step(1.0 / anorm * pow(fact * tol / (4.0 * beta * anorm), xm));
+    double rndoff = anorm * DBL_EPSILON;
+
+    while (t_now < t_out) {
+        res.n_steps++;
+        double t_step = fmin(t_out - t_now, t_new);
+        size_t mb = m;
+        int k1 = 2;
+        for (size_t i = 0; i < mh * mh; i++) {
+            h[i] = 0.0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            krylov[i] = out[i] / beta;
+        }
+        // Arnoldi, for symmetric A Lanczos (orthogonalize against 2 vectors)
+        for (size_t j = 0; j < m; j++) {
+            matvec(krylov + j * n, p, params);
+            res.n_matvec++;
+            size_t i0 = (opt->symmetric && j > 0) ? j - 1 : 0;
+            for (size_t i = i0; i <= j; i++) {
+                double hij = dot(krylov + i * n, p, n);
+                h[i * mh + j] = hij;
+                for (size_t l = 0; l < n; l++) {
+                    p[l] -= hij * krylov[i * n + l];
+                }
+            }
+            double s = norm_2(p, n);
+            if (s < breakdown_tol * anorm) {
+                // happy breakdown: the subspace is invariant, exact solution
+                k1 = 0;
+                mb = j + 1;
+                t_step = t_out - t_now;
+                break;
+            }
+            h[(j + 1) * mh + j] = s;
+            for (size_t l = 0; l < n; l++) {
+                krylov[(j + 1) * n + l] = p[l] / s;
+            }
+        }
+        double avnorm = 0.0;
+        if (k1 != 0) {
+            h[(m + 1) * mh + m] = 1.0;
+            matvec(krylov + m * n, p, params);
+            res.n_matvec++;
+            avnorm = norm_2(p, n);
+        }
+
+        double err_loc = 0.0;
+        size_t mx = mb + k1;
+        for (int reject = 0; ; reject++) {
+            // exp of the leading mx x mx block of h
+            for (size_t i = 0; i < mx; i++) {
+                memcpy(hb + i * mx, h + i * mh, mx * sizeof(double));
+            }
+            expm_ptr(hb, mx, sign * t_step, e, buf, piv);
+            for (size_t i = 0; i < mx; i++) {
+                memcpy(f + i * mh, e + i * mx, mx * sizeof(double));
+            }
+            if (k1 == 0) {
+                err_loc = breakdown_tol;
+                break;
+            }
+            double phi1 = fabs(beta * f[m * mh]);
+            double phi2 = fabs(beta * f[(m + 1) * mh] * avnorm);
+            if (phi1 > 10.0 * phi2) {
+                err_loc = phi2;
+                xm = 1.0 / m;
+            }
+            else if (phi1 > phi2) {
+                err_loc = phi1 * phi2 / (phi1 - phi2);
+                xm = 1.0 / m;
+            }
+            else {
+                err_loc = phi1;
+                xm = 1.0 / (m - 1);
+            }
+            if (err_loc <= delta * t_step * tol) {
+                break;
+            }
+            if (reject == max_reject) {
+                res.status = TN_EXPMV_TOL_NOT_REACHED;
+                break;
+            }
+            t_step = round_step(gamma * t_step * pow(t_step * tol / err_loc, xm));
+        }
+
+        // out = beta * V f[:, 0]
+        mx = mb + (k1 > 0 ? k1 - 1 : 0);
+        for (size_t l = 0; l < n; l++) {
+            out[l] = 0.0;
+        }
+        for (size_t i = 0; i < mx; i++) {
+            double c = beta * f[i * mh];
+            for (size_t l = 0; l < n; l++) {
+                out[l] += c * krylov[i * n + l];
+            }
+        }
+        beta = norm_2(out, n);
+        res.hump = fmax(res.hump, beta);
+
+        t_now += t_step;
+        if (err_loc > 0.0) {
+            t_new = round_step(gamma * t_step * pow(t_step * tol / err_loc, xm));
+        }
+        res.error += fmax(err_loc, rndoff);
+        if (beta == 0.0) {
+            break;
+        }
+    }
+    res.hump /= v_norm;
+
+finish:
+    free(piv);
+    free(h);
+    free(p);
+    free(krylov);
+    TN_PROFILE_CALLBACKS(res.n_matvec);
+    TN_PROFILE_END();
+    return res;
+}
+
+static void
+t_matrix_matvec (const double* x, double* y, void* params)
+{
+    const t_matrix* a = params;
+    for (size_t i = 0; i < a->rows; i++) {
+        y[i] = dot(a->data->ptr + i * a->tda, x, a->cols);
+    }
+}
+
+tn_expmv_result
+tn_expmv_t_matrix (const t_matrix* a, double t, const t_array* v, t_array* out,
+                   const tn_expmv_options* opt)
+{
+    if (!a || !v || !out) {
+        tp_raiseError("Null pointer in tn_expmv_t_matrix.");
+    }
+    if (a->rows != a->cols || v->len != a->rows || out->len != a->rows) {
+        tp_raiseError("Incompatible sizes in tn_expmv_t_matrix.");
+    }
+    tn_expmv_options o = opt ? *opt : tn_expmv_default_options();
+    if (o.anorm <= 0.0) {
+        // infinity norm, as Expokit
+        for (size_t i = 0; i < a->rows; i++) {
+            double sum = 0.0;
+            for (size_t j = 0; j < a->cols; j++) {
+                sum += fabs(a->data->ptr[i * a->tda + j]);
+            }
+            o.anorm = fmax(o.anorm, sum);
+        }
+    }
+    return tn_expmv(t_matrix_matvec, (void*)a, a->rows, t, v->ptr, out->ptr, &o);
+}
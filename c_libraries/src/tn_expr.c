@@ -0,0 +1,472 @@
+#include "t_numerics_intern.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    fused element-wise expressions
+//================================================================================
+
+/* Nodes are appended in creation order, so operands always have smaller ids
+ * than the nodes using them and the node list is already topologically
+ * sorted. Compiling for a root keeps only the reachable operations and maps
+ * them onto a few block registers (linear scan over the last uses). The
+ * evaluation walks the arrays in blocks of TN_EXPR_BLOCK elements; every
+ * operation runs over one block at a time, so intermediate results stay in
+ * cache and every operand array is read once and the output written once. */
+
+// elements per block, registers of all threads should stay in L1/L2
+#define TN_EXPR_BLOCK 512
+// arrays shorter than this are evaluated by one thread
+#define TN_EXPR_PARALLEL_MIN 32768
+
+enum { NODE_ARRAY, NODE_SCALAR, NODE_OP };
+
+typedef struct {
+    int kind;             // NODE_*
+    tn_expr_op op;
+    int a, b;             // operands (b = -1 for unary ops)
+    t_array* arr;         // NODE_ARRAY
+    double value;         // NODE_SCALAR
+} expr_node;
+
+// instruction of the compiled program
+typedef struct {
+    tn_expr_op op;
+    int dest;             // register, -1: output
+    int a, b;             // node ids of operands
+} expr_instr;
+
+struct tn_expr {
+    expr_node* nodes;
+    size_t n_nodes;
+    size_t capacity;
+
+    // compiled program (cache), valid while root and nodes do not change
+    int compiled_root;
+    size_t compiled_nodes;
+    expr_instr* prog;
+    size_t n_instr;
+    int* reg_of;          // register holding the result of node, -1: none
+    int* inputs;          // array nodes read by the program
+    size_t n_inputs;
+    size_t n_regs;
+    double* regs;         // n_threads x n_regs x TN_EXPR_BLOCK
+    int n_threads;
+};
+
+tn_expr*
+tn_expr_alloc (void)
+{
+    tn_expr* e = calloc(1, sizeof(tn_expr));
+    Null_exit_message(e, "Memory allocation failed in tn_expr_alloc!");
+    e->compiled_root = -1;
+    return e;
+}
+
+void
+tn_expr_free (tn_expr* e)
+{
+    if (!e) {
+        return;
+    }
+    for (size_t i = 0; i < e->n_nodes; i++) {
+        if (e->nodes[i].kind == NODE_ARRAY) {
+            t_array_unref(e->nodes[i].arr);
+        }
+    }
+    free(e->nodes);
+    free(e->prog);
+    free(e->reg_of);
+    free(e->inputs);
+    free(e->regs);
+    free(e);
+}
+
+static int
+push_node (tn_expr* e, expr_node node)
+{
+    if (e->n_nodes == e->capacity) {
+        size_t capacity = e->capacity ? 2 * e->capacity : 16;
+        expr_node* nodes = realloc(e->nodes, capacity * sizeof(expr_node));
+        Null_exit_message(nodes, "Memory allocation failed in tn_expr!");
+        e->nodes = nodes;
+        e->capacity = capacity;
+    }
+    e->nodes[e->n_nodes] = node;
+    return (int)e->n_nodes++;
+}
+
+static void
+check_node (const tn_expr* e, int id, int kind)
+{
+    if (id < 0 || (size_t)id >= e->n_nodes) {
+        tp_raiseError("Invalid node of tn_expr!");
+    }
+    if (kind >= 0 && e->nodes[id].kind != kind) {
+        tp_raiseError("Node of tn_expr has the wrong kind!");
+    }
+}
+
+int
+tn_expr_array (tn_expr* e, t_array* arr)
+{
+    if (!arr) {
+        tp_raiseError("Null pointer in tn_expr_array.");
+    }
+    t_array_ref(arr);
+    expr_node node = { .kind = NODE_ARRAY, .a = -1, .b = -1, .arr = arr };
+    return push_node(e, node);
+}
+
+int
+tn_expr_scalar (tn_expr* e, double value)
+{
+    expr_node node = { .kind = NODE_SCALAR, .a = -1, .b = -1, .value = value };
+    return push_node(e, node);
+}
+
+static int
+is_unary (tn_expr_op op)
+{
+    return op >= TN_EXPR_NEG;
+}
+
+int
+tn_expr_binary (tn_expr* e, tn_expr_op op, int a, int b)
+{
+    if (is_unary(op)) {
+        tp_raiseError("tn_expr_binary needs a binary operation!");
+    }
+    check_node(e, a, -1);
+    check_node(e, b, -1);
+    expr_node node = { .kind = NODE_OP, .op = op, .a = a, .b = b };
+    return push_node(e, node);
+}
+
+int
+tn_expr_unary (tn_expr* e, tn_expr_op op, int a)
+{
+    if (!is_unary(op)) {
+        tp_raiseError("tn_expr_unary needs a unary operation!");
+    }
+    check_node(e, a, -1);
+    expr_node node = { .kind = NODE_OP, .op = op, .a = a, .b = -1 };
+    return push_node(e, node);
+}
+
+int
+tn_expr_add (tn_expr* e, int a, int b)
+{
+    return tn_expr_binary(e, TN_EXPR_ADD, a, b);
+}
+
+int
+tn_expr_sub (tn_expr* e, int a, int b)
+{
+    return tn_expr_binary(e, TN_EXPR_SUB, a, b);
+}
+
+int
+tn_expr_mul (tn_expr* e, int a, int b)
+{
+    return tn_expr_binary(e, TN_EXPR_MUL, a, b);
+}
+
+int
+tn_expr_div (tn_expr* e, int a, int b)
+{
+    return tn_expr_binary(e, TN_EXPR_DIV, a, b);
+}
+
+void
+tn_expr_set_scalar (tn_expr* e, int node, double value)
+{
+    check_node(e, node, NODE_SCALAR);
+    e->nodes[node].value = value;
+}
+
+void
+tn_expr_bind (tn_expr* e, int node, t_array* arr)
+{
+    check_node(e, node, NODE_ARRAY);
+    if (!arr) {
+        tp_raiseError("Null pointer in tn_expr_bind.");
+    }
+    t_array_ref(arr);
+    t_array_unref(e->nodes[node].arr);
+    e->nodes[node].arr = arr;
+}
+
+//-----------------------------------
+// compilation
+//-----------------------------------
+
+static void
+compile (tn_expr* e, int root)
+{
+    size_t n = e->n_nodes;
+    char* used = calloc(n, 1);
+    int* last_use = malloc(n * sizeof(int));
+    int* free_regs = malloc(n * sizeof(int));
+    int* reg_of = malloc(n * sizeof(int));
+    int* inputs = malloc(n * sizeof(int));
+    expr_instr* prog = malloc(n * sizeof(expr_instr));
+    if (!used || !last_use || !free_regs || !reg_of || !inputs || !prog) {
+        tp_raiseError("Memory allocation failed in tn_expr compilation!");
+    }
+
+    // reachable nodes and position of their last use
+    used[root] = 1;
+    for (int i = root; i >= 0; i--) {
+        last_use[i] = -1;
+        if (!used[i] || e->nodes[i].kind != NODE_OP) {
+            continue;
+        }
+        used[e->nodes[i].a] = 1;
+        if (e->nodes[i].b >= 0) {
+            used[e->nodes[i].b] = 1;
+        }
+    }
+    for (int i = 0; i <= root; i++) {
+        if (used[i] && e->nodes[i].kind == NODE_OP) {
+            last_use[e->nodes[i].a] = i;
+            if (e->nodes[i].b >= 0) {
+                last_use[e->nodes[i].b] = i;
+            }
+        }
+    }
+
+    // linear scan, a register is free again after the last use of its node;
+    // the result may overwrite an operand's register (element-wise ops)
+    size_t n_instr = 0;
+    size_t n_regs = 0;
+    size_t n_free = 0;
+    size_t n_inputs = 0;
+    for (int i = 0; i <= root; i++) {
+        reg_of[i] = -1;
+        if (used[i] && e->nodes[i].kind == NODE_ARRAY) {
+            inputs[n_inputs++] = i;
+        }
+        if (!used[i] || e->nodes[i].kind != NODE_OP) {
+            continue;
+        }
+        const expr_node* node = &e->nodes[i];
+        int operands[2] = { node->a, node->b };
+        for (int k = 0; k < 2; k++) {
+            int o = operands[k];
+            if (o >= 0 && last_use[o] == i && reg_of[o] >= 0
+                && (k == 0 || o != node->a)) {
+                free_regs[n_free++] = reg_of[o];
+            }
+        }
+        int dest = -1;
+        if (i != root) {
+            dest = n_free ? free_regs[--n_free] : (int)n_regs++;
+        }
+        reg_of[i] = dest;
+        prog[n_instr++] = (expr_instr){ node->op, dest, node->a, node->b };
+    }
+    free(used);
+    free(last_use);
+    free(free_regs);
+
+    free(e->prog);
+    free(e->reg_of);
+    free(e->inputs);
+    e->prog = prog;
+    e->n_instr = n_instr;
+    e->reg_of = reg_of;
+    e->inputs = inputs;
+    e->n_inputs = n_inputs;
+    if (n_regs != e->n_regs) {
+        free(e->regs);
+        e->regs = NULL;
+        e->n_threads = 0;
+    }
+    e->n_regs = n_regs;
+    e->compiled_root = root;
+    e->compiled_nodes = n;
+}
+
+//-----------------------------------
+// evaluation
+//-----------------------------------
+
+// operand of an instruction within the current block
+typedef struct {
+    const double* p;      // NULL: scalar
+    double s;
+} expr_operand;
+
+static inline expr_operand
+operand (const tn_expr* e, int id, size_t offset, const double* regs)
+{
+    const expr_node* node = &e->nodes[id];
+    expr_operand o = { NULL, 0.0 };
+    if (node->kind == NODE_ARRAY) {
+        o.p = node->arr->ptr + offset;
+    }
+    else if (node->kind == NODE_SCALAR) {
+        o.s = node->value;
+    }
+    else {
+        o.p = regs + (size_t)e->reg_of[id] * TN_EXPR_BLOCK;
+    }
+    return o;
+}
+
+// r[i] = f(a[i], b[i]) with a, b vector or scalar, vectorized by the compiler
+#define EXPR_BINARY_LOOP(F) \
+    do { \
+        if (x.p && y.p) { \
+            _Pragma("omp simd") \
+            for (size_t i = 0; i < len; i++) { \
+                double u = x.p[i], v = y.p[i]; r[i] = (F); } \
+        } \
+        else if (x.p) { \
+            double v = y.s; \
+            _Pragma("omp simd") \
+            for (size_t i = 0; i < len; i++) { \
+                double u = x.p[i]; r[i] = (F); } \
+        } \
+        else if (y.p) { \
+            double u = x.s; \
+            _Pragma("omp simd") \
+            for (size_t i = 0; i < len; i++) { \
+                double v = y.p[i]; r[i] = (F); } \
+        } \
+        else { \
+            double u = x.s, v = y.s; \
+            for (size_t i = 0; i < len; i++) { r[i] = (F); } \
+        } \
+    } while (0)
+
+#define EXPR_UNARY_LOOP(F) \
+    do { \
+        if (x.p) { \
+            _Pragma("omp simd") \
+            for (size_t i = 0; i < len; i++) { \
+                double u = x.p[i]; r[i] = (F); } \
+        } \
+        else { \
+            double u = x.s; \
+            for (size_t i = 0; i < len; i++) { r[i] = (F); } \
+        } \
+    } while (0)
+
+static void
+run_instr (const expr_instr* in, expr_operand x, expr_operand y,
+           double* r, size_t len)
+{
+    switch (in->op) {
+        case TN_EXPR_ADD: EXPR_BINARY_LOOP(u + v); break;
+        case TN_EXPR_SUB: EXPR_BINARY_LOOP(u - v); break;
+        case TN_EXPR_MUL: EXPR_BINARY_LOOP(u * v); break;
+        case TN_EXPR_DIV: EXPR_BINARY_LOOP(u / v); break;
+        case TN_EXPR_POW: EXPR_BINARY_LOOP(pow(u, v)); break;
+        case TN_EXPR_MIN: EXPR_BINARY_LOOP(u < v ? u : v); break;
+        case TN_EXPR_MAX: EXPR_BINARY_LOOP(u > v ? u : v); break;
+        case TN_EXPR_NEG: EXPR_UNARY_LOOP(-u); break;
+        case TN_EXPR_ABS: EXPR_UNARY_LOOP(fabs(u)); break;
+        case TN_EXPR_SQUARE: EXPR_UNARY_LOOP(u * u); break;
+        case TN_EXPR_SQRT: EXPR_UNARY_LOOP(sqrt(u)); break;
+        case TN_EXPR_EXP: EXPR_UNARY_LOOP(exp(u)); break;
+        case TN_EXPR_LOG: EXPR_UNARY_LOOP(log(u)); break;
+        case TN_EXPR_SIN: EXPR_UNARY_LOOP(sin(u)); break;
+        case TN_EXPR_COS: EXPR_UNARY_LOOP(cos(u)); break;
+    }
+}
+
+static void
+eval_block (const tn_expr* e, double* regs, double* out,
+            size_t offset, size_t len)
+{
+    for (size_t k = 0; k < e->n_instr; k++) {
+        const expr_instr* in = &e->prog[k];
+        expr_operand x = operand(e, in->a, offset, regs);
+        expr_operand y = { NULL, 0.0 };
+        if (in->b >= 0) {
+            y = operand(e, in->b, offset, regs);
+        }
+        // last instruction writes into the output directly; all operands of
+        // this block have been read before, so out may alias an operand
+        double* r = in->dest < 0 ? out + offset
+                                 : regs + (size_t)in->dest * TN_EXPR_BLOCK;
+        run_instr(in, x, y, r, len);
+    }
+}
+
+void
+tn_expr_eval (tn_expr* e, int root, t_array* out)
+{
+    TN_PROFILE_BEGIN(tn_expr_eval);
+    check_node(e, root, -1);
+    if (!out) {
+        tp_raiseError("Null pointer in tn_expr_eval.");
+    }
+    const size_t len = out->len;
+    const expr_node* r = &e->nodes[root];
+
+    // roots without operation are a copy or a fill
+    if (r->kind != NODE_OP) {
+        if (r->kind == NODE_ARRAY) {
+            if (r->arr->len != len) {
+                tp_raiseError("Incompatible array lengths in tn_expr_eval!");
+            }
+            memmove(out->ptr, r->arr->ptr, len * sizeof(double));
+        }
+        else {
+            for (size_t i = 0; i < len; i++) {
+                out->ptr[i] = r->value;
+            }
+        }
+        TN_PROFILE_END();
+        return;
+    }
+
+    if (e->compiled_root != root || e->compiled_nodes != e->n_nodes) {
+        compile(e, root);
+    }
+    for (size_t k = 0; k < e->n_inputs; k++) {
+        if (e->nodes[e->inputs[k]].arr->len != len) {
+            tp_raiseError("Incompatible array lengths in tn_expr_eval!");
+        }
+    }
+
+    const size_t n_blocks = (len + TN_EXPR_BLOCK - 1) / TN_EXPR_BLOCK;
+    int n_threads = 1;
+#ifdef _OPENMP
+    if (len >= TN_EXPR_PARALLEL_MIN) {
+        n_threads = omp_get_max_threads();
+    }
+#endif
+    // registers are kept for the next evaluation (time loops)
+    if (e->n_regs > 0 && e->n_threads < n_threads) {
+        free(e->regs);
+        e->regs = malloc((size_t)n_threads * e->n_regs * TN_EXPR_BLOCK
+                         * sizeof(double));
+        Null_exit_message(e->regs, "Memory allocation failed in tn_expr_eval!");
+        e->n_threads = n_threads;
+    }
+
+    const tn_expr* ce = e;
+    double* out_ptr = out->ptr;
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1)
+    {
+        int id = 0;
+#ifdef _OPENMP
+        id = omp_get_thread_num();
+#endif
+        double* regs = ce->regs ? ce->regs + (size_t)id * ce->n_regs * TN_EXPR_BLOCK
+                                : NULL;
+        #pragma omp for schedule(static)
+        for (size_t blk = 0; blk < n_blocks; blk++) {
+            size_t offset = blk * TN_EXPR_BLOCK;
+            size_t n = len - offset < TN_EXPR_BLOCK ? len - offset : TN_EXPR_BLOCK;
+            eval_block(ce, regs, out_ptr, offset, n);
+        }
+    }
+    TN_PROFILE_END();
+}
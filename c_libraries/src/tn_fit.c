@@ -0,0 +1,367 @@
+#include "t_numerics_intern.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    nonlinear least squares (Levenberg-Marquardt)
+//================================================================================
+
+/* minimizes chi^2 = sum_i ((y_i - model(x_i; p)) / sigma_i)^2 over p.
+ * Every iteration solves (J^T J + lambda * diag(J^T J)) dp = J^T r with the
+ * weighted residuals r and Jacobian J of the model w.r.t. p. lambda shrinks
+ * after successful steps (Gauss-Newton) and grows after failed ones
+ * (gradient descent). All buffers are in tn_lm_work, so a fit does not
+ * allocate and a batch allocates one workspace per thread. */
+
+struct tn_lm_work {
+    size_t n_points;
+    size_t n_params;
+    size_t n_fixed;
+    double* jac;          // n_points x n_params, weighted Jacobian
+    double* res;          // n_points, weighted residuals at p
+    double* res_trial;    // n_points, weighted residuals at trial p
+    double* jtj;          // n_params x n_params
+    double* chol;         // n_params x n_params, damped system
+    double* grad;         // n_params, J^T r
+    double* delta;        // n_params, step
+    double* p_model;      // n_params + n_fixed, parameters passed to model
+    double* p_trial;      // n_params + n_fixed
+};
+
+tn_lm_options
+tn_lm_default_options (void)
+{
+    tn_lm_options opt = {
+        .max_iter = 200,
+        .ftol = 1e-10,
+        .xtol = 1e-10,
+        .gtol = 1e-12,
+        .lambda0 = 1e-3,
+        .n_threads = 0
+    };
+    return opt;
+}
+
+tn_lm_work*
+tn_lm_work_alloc (size_t n_points, size_t n_params, size_t n_fixed)
+{
+    if (n_params == 0 || n_points < n_params) {
+        tp_raiseError("Levenberg-Marquardt needs 0 < n_params <= n_points!");
+    }
+    tn_lm_work* w = malloc(sizeof(tn_lm_work));
+    Null_exit_message(w, "Memory allocation failed in tn_lm_work_alloc!");
+    w->n_points = n_points;
+    w->n_params = n_params;
+    w->n_fixed = n_fixed;
+
+    // one block for all buffers
+    size_t n_total = n_points * n_params + 2 * n_points
+                   + 2 * n_params * n_params + 2 * n_params
+                   + 2 * (n_params + n_fixed);
+    double* block = malloc(n_total * sizeof(double));
+    Null_exit_message(block, "Memory allocation failed in tn_lm_work_alloc!");
+
+    w->jac = block;
+    w->res = w->jac + n_points * n_params;
+    w->res_trial = w->res + n_points;
+    w->jtj = w->res_trial + n_points;
+    w->chol = w->jtj + n_params * n_params;
+    w->grad = w->chol + n_params * n_params;
+    w->delta = w->grad + n_params;
+    w->p_model = w->delta + n_params;
+    w->p_trial = w->p_model + n_params + n_fixed;
+    return w;
+}
+
+void
+tn_lm_work_free (tn_lm_work* w)
+{
+    if (!w) {
+        return;
+    }
+    free(w->jac);
+    free(w);
+}
+
+/* weighted residuals (y - model) / sigma and chi^2 at parameters p */
+static double
+tn_lm_residuals (STD_FUNC model, double* p, const double* x, const double* y,
+                 const double* sigma, size_t n_points, double* res)
+{
+    double chi2 = 0.0;
+    for (size_t i = 0; i < n_points; i++) {
+        double r = y[i] - model(x[i], p);
+        if (sigma) {
+            r /= sigma[i];
+        }
+        res[i] = r;
+        chi2 += r * r;
+    }
+    return chi2;
+}
+
+/* Jacobian of the weighted model, analytic or by forward differences;
+ * returns number of evaluations of model or jac */
+static size_t
+tn_lm_jacobian (STD_FUNC model, FIT_JAC* jac, tn_lm_work* w,
+                const double* x, const double* y, const double* sigma)
+{
+    const size_t n = w->n_points;
+    const size_t m = w->n_params;
+    if (jac) {
+        for (size_t i = 0; i < n; i++) {
+            jac(x[i], w->p_model, w->jac + i * m);
+            if (sigma) {
+                for (size_t k = 0; k < m; k++) {
+                    w->jac[i * m + k] /= sigma[i];
+                }
+            }
+        }
+        return n;
+    }
+    // res holds (y - f(p)) / sigma --> (f(p + h) - f(p)) / sigma
+    // = res - (y - f(p + h)) / sigma, one evaluation per point and parameter
+    memcpy(w->p_trial, w->p_model, (m + w->n_fixed) * sizeof(double));
+    for (size_t k = 0; k < m; k++) {
+        double h = 1.4901161193847656e-08 * fmax(fabs(w->p_model[k]), 1e-8);
+        w->p_trial[k] = w->p_model[k] + h;
+        // exactly representable step
+        h = w->p_trial[k] - w->p_model[k];
+        for (size_t i = 0; i < n; i++) {
+            double r_h = y[i] - model(x[i], w->p_trial);
+            if (sigma) {
+                r_h /= sigma[i];
+            }
+            w->jac[i * m + k] = (w->res[i] - r_h) / h;
+        }
+        w->p_trial[k] = w->p_model[k];
+    }
+    return n * m;
+}
+
+/* Cholesky decomposition of symmetric positive definite a (m x m) in place,
+ * returns 0 if a is not positive definite */
+static int
+tn_lm_cholesky (double* a, size_t m)
+{
+    for (size_t j = 0; j < m; j++) {
+        double d = a[j * m + j];
+        for (size_t k = 0; k < j; k++) {
+            d -= a[j * m + k] * a[j * m + k];
+        }
+        if (!(d > 0.0)) {
+            return 0;
+        }
+        d = sqrt(d);
+        a[j * m + j] = d;
+        for (size_t i = j + 1; i < m; i++) {
+            double s = a[i * m + j];
+            for (size_t k = 0; k < j; k++) {
+                s -= a[i * m + k] * a[j * m + k];
+            }
+            a[i * m + j] = s / d;
+        }
+    }
+    return 1;
+}
+
+/* solves L L^T x = b with the factor of tn_lm_cholesky, b is overwritten by x */
+static void
+tn_lm_cholesky_solve (const double* l, double* b, size_t m)
+{
+    for (size_t i = 0; i < m; i++) {
+        for (size_t k = 0; k < i; k++) {
+            b[i] -= l[i * m + k] * b[k];
+        }
+        b[i] /= l[i * m + i];
+    }
+    for (size_t i = m; i-- > 0;) {
+        for (size_t k = i + 1; k < m; k++) {
+            b[i] -= l[k * m + i] * b[k];
+        }
+        b[i] /= l[i * m + i];
+    }
+}
+
+tn_lm_result
+tn_lm_fit_ptr (STD_FUNC model, FIT_JAC* jac,
+               const double* x, const double* y, const double* sigma,
+               double* p, const double* fixed,
+               const tn_lm_options* opt, tn_lm_work* w)
+{
+    TN_PROFILE_BEGIN(tn_lm_fit_ptr);
+    const size_t n = w->n_points;
+    const size_t m = w->n_params;
+    tn_lm_options defaults = tn_lm_default_options();
+    if (!opt) {
+        opt = &defaults;
+    }
+    tn_lm_result result = {.status = TN_LM_MAX_ITER, .n_iter = 0,
+                           .chi2 = 0.0, .n_eval = 0};
+
+    memcpy(w->p_model, p, m * sizeof(double));
+    if (w->n_fixed) {
+        memcpy(w->p_model + m, fixed, w->n_fixed * sizeof(double));
+    }
+    memcpy(w->p_trial, w->p_model, (m + w->n_fixed) * sizeof(double));
+
+    double chi2 = tn_lm_residuals(model, w->p_model, x, y, sigma, n, w->res);
+    result.n_eval += n;
+    double lambda = opt->lambda0;
+
+    while (result.n_iter < opt->max_iter) {
+        result.n_iter++;
+        result.n_eval += tn_lm_jacobian(model, jac, w, x, y, sigma);
+
+        // normal equations J^T J and gradient J^T r
+        double g_max = 0.0;
+        for (size_t k = 0; k < m; k++) {
+            double g = 0.0;
+            for (size_t i = 0; i < n; i++) {
+                g += w->jac[i * m + k] * w->res[i];
+            }
+            w->grad[k] = g;
+            g_max = fmax(g_max, fabs(g));
+            for (size_t l = 0; l <= k; l++) {
+                double s = 0.0;
+                for (size_t i = 0; i < n; i++) {
+                    s += w->jac[i * m + k] * w->jac[i * m + l];
+                }
+                w->jtj[k * m + l] = s;
+                w->jtj[l * m + k] = s;
+            }
+        }
+        if (g_max <= opt->gtol) {
+            result.status = TN_LM_GTOL;
+            break;
+        }
+
+        // increase damping until a step lowers chi^2
+        int improved = 0;
+        while (lambda < 1e16) {
+            for (size_t k = 0; k < m * m; k++) {
+                w->chol[k] = w->jtj[k];
+            }
+            for (size_t k = 0; k < m; k++) {
+                w->chol[k * m + k] += lambda * fmax(w->jtj[k * m + k], 1e-300);
+                w->delta[k] = w->grad[k];
+            }
+            if (!tn_lm_cholesky(w->chol, m)) {
+                lambda *= 10.0;
+                continue;
+            }
+            tn_lm_cholesky_solve(w->chol, w->delta, m);
+            for (size_t k = 0; k < m; k++) {
+                w->p_trial[k] = w->p_model[k] + w->delta[k];
+            }
+            double chi2_trial = tn_lm_residuals(model, w->p_trial, x, y, sigma,
+                                                n, w->res_trial);
+            result.n_eval += n;
+            if (chi2_trial < chi2) {
+                improved = 1;
+                double decrease = chi2 - chi2_trial;
+                double step = 0.0, size = 0.0;
+                for (size_t k = 0; k < m; k++) {
+                    step += w->delta[k] * w->delta[k];
+                    size += w->p_model[k] * w->p_model[k];
+                }
+                memcpy(w->p_model, w->p_trial, m * sizeof(double));
+                double* tmp = w->res;
+                w->res = w->res_trial;
+                w->res_trial = tmp;
+                chi2 = chi2_trial;
+                lambda = fmax(lambda / 10.0, 1e-15);
+                if (decrease <= opt->ftol * chi2_trial) {
+                    result.status = TN_LM_FTOL;
+                } else if (sqrt(step) <= opt->xtol * (sqrt(size) + opt->xtol)) {
+                    result.status = TN_LM_XTOL;
+                }
+                break;
+            }
+            lambda *= 10.0;
+        }
+        if (!improved) {
+            // no step lowers chi^2 anymore: p is a minimum within precision
+            result.status = TN_LM_NO_PROGRESS;
+            break;
+        }
+        if (result.status != TN_LM_MAX_ITER) {
+            break;
+        }
+    }
+
+    memcpy(p, w->p_model, m * sizeof(double));
+    result.chi2 = chi2;
+    TN_PROFILE_CALLBACKS(result.n_eval);
+    TN_PROFILE_END();
+    return result;
+}
+
+tn_lm_result
+tn_lm_fit (STD_FUNC model, FIT_JAC* jac,
+           const t_array* x, const t_array* y, const t_array* sigma,
+           t_array* p, const t_array* fixed, const tn_lm_options* opt)
+{
+    if (x->len != y->len || (sigma && sigma->len != y->len)) {
+        tp_raiseError("Incompatible array lengths in tn_lm_fit");
+    }
+    tn_lm_work* w = tn_lm_work_alloc(x->len, p->len, fixed ? fixed->len : 0);
+    tn_lm_result result = tn_lm_fit_ptr(model, jac, x->ptr, y->ptr,
+                                        sigma ? sigma->ptr : NULL, p->ptr,
+                                        fixed ? fixed->ptr : NULL, opt, w);
+    tn_lm_work_free(w);
+    return result;
+}
+
+void
+tn_lm_fit_batch (STD_FUNC model, FIT_JAC* jac,
+                 const t_matrix* x, const t_matrix* y, const t_matrix* sigma,
+                 t_matrix* p, const t_array* fixed,
+                 const tn_lm_options* opt, tn_lm_result* results)
+{
+    const size_t n_fits = y->rows;
+    const size_t n_points = y->cols;
+    const size_t n_params = p->cols;
+    const size_t n_fixed = fixed ? fixed->len : 0;
+    if (x->cols != n_points || (x->rows != 1 && x->rows != n_fits)
+        || p->rows != n_fits
+        || (sigma && (sigma->rows != n_fits || sigma->cols != n_points))) {
+        tp_raiseError("Incompatible shapes in tn_lm_fit_batch");
+    }
+    tn_lm_options defaults = tn_lm_default_options();
+    if (!opt) {
+        opt = &defaults;
+    }
+    const double* x_ptr = x->data->ptr;
+    const double* y_ptr = y->data->ptr;
+    const double* s_ptr = sigma ? sigma->data->ptr : NULL;
+    const double* f_ptr = fixed ? fixed->ptr : NULL;
+    double* p_ptr = p->data->ptr;
+    // row strides, all rows share the grid of a single row x
+    const size_t x_stride = x->rows == 1 ? 0 : x->tda;
+    const size_t s_stride = sigma ? sigma->tda : 0;
+
+#ifdef _OPENMP
+    const int n_threads = opt->n_threads > 0 ? opt->n_threads
+                                             : omp_get_max_threads();
+#endif
+
+    // model and jac must be thread safe, every thread has its own workspace
+    #pragma omp parallel num_threads(n_threads)
+    {
+        tn_lm_work* w = tn_lm_work_alloc(n_points, n_params, n_fixed);
+        #pragma omp for schedule(dynamic, 16)
+        for (size_t f = 0; f < n_fits; f++) {
+            tn_lm_result r = tn_lm_fit_ptr(model, jac, x_ptr + f * x_stride,
+                                           y_ptr + f * y->tda,
+                                           s_ptr ? s_ptr + f * s_stride : NULL,
+                                           p_ptr + f * p->tda, f_ptr, opt, w);
+            if (results) {
+                results[f] = r;
+            }
+        }
+        tn_lm_work_free(w);
+    }
+}
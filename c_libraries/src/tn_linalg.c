@@ -7,6 +7,7 @@
 double
 tn_dot_product (const t_array* x, const t_array* y)
 {   
+    TN_PROFILE_BEGIN(tn_dot_product);
     if (x->len != y->len) {
         tp_raiseError("Incompatible array lengths in tn_dot_product");
     }
@@ -14,6 +15,7 @@ tn_dot_product (const t_array* x, const t_array* y)
     for (size_t i = 0; i < x->len; i++) {
         sum += x->ptr[i] * y->ptr[i];
     }
+    TN_PROFILE_END();
     return sum;
 }
 
@@ -30,6 +32,7 @@ tn_dot_prod_ptr(const double* x, const double* y, size_t len)
 void
 tn_matrix_dot_vector (t_matrix* m, const t_array* v, t_array* b)
 {
+    TN_PROFILE_BEGIN(tn_matrix_dot_vector);
     double sum_row = 0.0;
     for (size_t i = 0; i < m->rows; i++) {
         sum_row = 0;
@@ -38,11 +41,13 @@ tn_matrix_dot_vector (t_matrix* m, const t_array* v, t_array* b)
         }
         b->ptr[i] = sum_row;
     }
+    TN_PROFILE_END();
 }
 
 void
 tn_matrix_dot_matrix (t_matrix* a, t_matrix* b, t_matrix* c)
 {
+    TN_PROFILE_BEGIN(tn_matrix_dot_matrix);
     double sum;
     for (size_t i = 0; i < a->rows; i++) {
         for (size_t j = 0; j < b->cols; j++) {
@@ -53,48 +58,63 @@ tn_matrix_dot_matrix (t_matrix* a, t_matrix* b, t_matrix* c)
             t_matrix_set(c, i, j, sum);
         }
     }
+    TN_PROFILE_END();
 }
 
 double
 tn_vec_dist (t_array* y1, t_array* y2)
 {
+    TN_PROFILE_BEGIN(tn_vec_dist);
     double sum = 0.0;
     for (size_t i = 0; i < y1->len; i++) {
         sum += (y1->ptr[i] - y2->ptr[i]) * (y1->ptr[i] - y2->ptr[i]);
     }
+    TN_PROFILE_END();
     return sqrt(sum);
 }
 
 double
 tn_len_vec_3d (t_array* y)
 {
-    return sqrt(tn_dot_product(y, y));
+    TN_PROFILE_BEGIN(tn_len_vec_3d);
+    double len = sqrt(tn_dot_product(y, y));
+    TN_PROFILE_END();
+    return len;
 }
 
 double
 tn_len_vec (t_array* y)
 {
-    return sqrt(tn_dot_product(y, y));
+    TN_PROFILE_BEGIN(tn_len_vec);
+    double len = sqrt(tn_dot_product(y, y));
+    TN_PROFILE_END();
+    return len;
 }
 
 double
 tn_len_vec_2d (t_array* y)
 {
-    return sqrt(y->ptr[0] * y->ptr[0] + y->ptr[1] * y->ptr[1]);
+    TN_PROFILE_BEGIN(tn_len_vec_2d);
+    double len = sqrt(y->ptr[0] * y->ptr[0] + y->ptr[1] * y->ptr[1]);
+    TN_PROFILE_END();
+    return len;
 }
 
 void
 tn_norm_vec (t_array* v)
 {
+    TN_PROFILE_BEGIN(tn_norm_vec);
     double len = tn_len_vec (v);
     for (size_t i = 0; i < v->len; i++) {
         v->ptr[i] = v->ptr[i] / len;
     }
+    TN_PROFILE_END();
 }
 
 void
 tn_norm_vec_sum_1 (t_array* v)
 {
+    TN_PROFILE_BEGIN(tn_norm_vec_sum_1);
     double len = 0.0;
     for (size_t i = 0; i < v->len; i++) {
         len += v->ptr[i];
@@ -102,19 +122,23 @@ tn_norm_vec_sum_1 (t_array* v)
     for (size_t i = 0; i < v->len; i++) {
         v->ptr[i] = v->ptr[i] / len;
     }
+    TN_PROFILE_END();
 }
 
 void
 tn_print_vec (t_array* v, char vec_name[])
 {
+    TN_PROFILE_BEGIN(tn_print_vec);
     for (size_t i = 0; i < v->len; i++) {
         printf("  %s[%zu]: %g\n", vec_name, i, v->ptr[i]);
     }
+    TN_PROFILE_END();
 }
 
 void
 tn_print_matrix (t_matrix* m)
 {
+    TN_PROFILE_BEGIN(tn_print_matrix);
     /* at corners Unicode chars U+2308 to U+230B are used
      * (gaussian brackets) */
     for (size_t i = 0; i < m->rows; i++) {
@@ -137,21 +161,90 @@ tn_print_matrix (t_matrix* m)
         }
         printf("\n");
     }
+    TN_PROFILE_END();
 }
 
 //--------------------------------------------------------------------------------
 // algorithm to solve system of linear equations
 
+/* LU decomposition with partial pivoting in place, returns 0 or -1 if singular */
+int
+tn_lu_decomp_ptr (double* a, int* piv, int n)
+{
+    for (int k = 0; k < n; k++) {
+        int p = k;
+        double max = fabs(a[k * n + k]);
+        for (int i = k + 1; i < n; i++) {
+            if (fabs(a[i * n + k]) > max) {
+                max = fabs(a[i * n + k]);
+                p = i;
+            }
+        }
+        piv[k] = p;
+        if (max == 0.0) {
+            return -1;
+        }
+        if (p != k) {
+            for (int j = 0; j < n; j++) {
+                double tmp = a[k * n + j];
+                a[k * n + j] = a[p * n + j];
+                a[p * n + j] = tmp;
+            }
+        }
+        double inv = 1.0 / a[k * n + k];
+        for (int i = k + 1; i < n; i++) {
+            double l = a[i * n + k] * inv;
+            a[i * n + k] = l;
+            if (l != 0.0) {
+                for (int j = k + 1; j < n; j++) {
+                    a[i * n + j] -= l * a[k * n + j];
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* solves LU x = b in place */
+void
+tn_lu_solve_ptr (const double* lu, const int* piv, int n, double* b)
+{
+    for (int k = 0; k < n; k++) {
+        if (piv[k] != k) {
+            double tmp = b[k];
+            b[k] = b[piv[k]];
+            b[piv[k]] = tmp;
+        }
+    }
+    for (int i = 1; i < n; i++) {
+        double sum = b[i];
+        for (int j = 0; j < i; j++) {
+            sum -= lu[i * n + j] * b[j];
+        }
+        b[i] = sum;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double sum = b[i];
+        for (int j = i + 1; j < n; j++) {
+            sum -= lu[i * n + j] * b[j];
+        }
+        b[i] = sum / lu[i * n + i];
+    }
+}
+
+
 void
 tn_gauss_seidel_step (const t_matrix* m,
                       const t_array* b,
                       t_array* v)
 {
+    TN_PROFILE_BEGIN(tn_gauss_seidel_step);
     // idea for algorithm: https://youtu.be/zf2-YCo2qfU?si=7UzeM_o9JpRcizW7&t=292
     for(size_t i = 0; i < m->rows; i++){
         // a[i] is i^th row of a
-        v->ptr[i] += (b->ptr[i] - tn_dot_prod_ptr(m->data->ptr + i * m->cols, v->ptr, v->len)) / m->data->ptr[i * m->cols + i];
+        v->ptr[i] += (b->ptr[i] - tn_dot_prod_ptr(m->data->ptr + i * m->tda, v->ptr, v->len)) / m->data->ptr[i * m->tda + i];
     }
+    TN_PROFILE_END();
 }
 
 void
@@ -159,11 +252,12 @@ tn_gauss_seidel (const t_matrix* m,
                  const t_array* b, t_array* v,
                  double tol, int max_iter)
 {   
+    TN_PROFILE_BEGIN(tn_gauss_seidel);
     if (m->rows != m->cols) {
         tp_raiseError("Matrix A must be quadratic for Gauß-Seidel algorithm!\n");
     }
     for (size_t i = 0; i < m->rows; i++) {
-        if (m->data->ptr[i * m->cols + i] == 0) {
+        if (m->data->ptr[i * m->tda + i] == 0) {
             tp_raiseError("At least one diagonal element of matrix A is 0. "
                 "Gauß-Seidel algorithm is not applicable!\n");
         }
@@ -181,6 +275,7 @@ tn_gauss_seidel (const t_matrix* m,
         if(err <= tol){
             printf("> Solution of Gauß-Seidel was found using %d iterations.\n", k);
             t_array_unref(old_v);
+            TN_PROFILE_END();
             return;
         }
     }
@@ -190,5 +285,6 @@ tn_gauss_seidel (const t_matrix* m,
         "consecutive iteration steps of %g.\n  Following calculations might be "
         "faulty!\n", max_iter, err);
     t_array_unref(old_v);
+    TN_PROFILE_END();
     return;
 }
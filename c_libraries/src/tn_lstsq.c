@@ -0,0 +1,201 @@
+#include "t_numerics_intern.h"
+
+//================================================================================
+//    incremental least squares
+//================================================================================
+
+/* The rows [x, (1), y] of the augmented design matrix are rotated one by one
+ * into the upper triangular factor R of its QR decomposition (Givens). R is
+ * (p + 1) x (p + 1) with p = n_features (+ 1 for the intercept), its last
+ * column is Q^T y and R[p][p]^2 is the residual sum of squares of the current
+ * fit. Memory and work per row are O(p^2), independent of the number of rows,
+ * and old rows are never needed again. */
+
+struct tn_lstsq {
+    size_t n_features;
+    size_t p;             // number of coefficients incl. intercept
+    int fit_intercept;
+    t_matrix* r;          // augmented triangular factor (p + 1) x (p + 1)
+    double* row;          // buffer for the augmented row being rotated in
+    size_t n;             // number of rows seen
+    double y_mean;        // running mean of y (Welford)
+    double y_m2;          // running sum of squared deviations of y
+};
+
+tn_lstsq*
+tn_lstsq_alloc (size_t n_features, int fit_intercept)
+{
+    if (n_features == 0 && !fit_intercept) {
+        tp_raiseError("tn_lstsq_alloc needs at least one coefficient!");
+    }
+    tn_lstsq* ls = malloc(sizeof(tn_lstsq));
+    Null_exit_message(ls, "Memory allocation failed in tn_lstsq_alloc!");
+
+    ls->n_features = n_features;
+    ls->fit_intercept = fit_intercept ? 1 : 0;
+    ls->p = n_features + ls->fit_intercept;
+    ls->r = t_matrix_alloc(ls->p + 1, ls->p + 1);
+    ls->row = malloc((ls->p + 1) * sizeof(double));
+    Null_exit_message(ls->row, "Memory allocation failed in tn_lstsq_alloc!");
+
+    tn_lstsq_reset(ls);
+    return ls;
+}
+
+void
+tn_lstsq_free (tn_lstsq* ls)
+{
+    if (!ls) {
+        return;
+    }
+    T_MATRIX_FREE(ls->r);
+    free(ls->row);
+    free(ls);
+}
+
+void
+tn_lstsq_reset (tn_lstsq* ls)
+{
+    memset(ls->r->data->ptr, 0, (ls->p + 1) * (ls->p + 1) * sizeof(double));
+    ls->n = 0;
+    ls->y_mean = 0.0;
+    ls->y_m2 = 0.0;
+}
+
+/* rotates ls->row into R, entries of row are destroyed */
+static inline void
+tn_lstsq_rotate_row (tn_lstsq* ls)
+{
+    const size_t dim = ls->p + 1;
+    double* r = ls->r->data->ptr;
+    double* v = ls->row;
+    for (size_t i = 0; i < dim; i++) {
+        if (v[i] == 0.0) {
+            continue;
+        }
+        double* r_i = r + i * dim;
+        double rho = hypot(r_i[i], v[i]);
+        double c = r_i[i] / rho;
+        double s = v[i] / rho;
+        r_i[i] = rho;
+        for (size_t j = i + 1; j < dim; j++) {
+            double tmp = c * r_i[j] + s * v[j];
+            v[j] = c * v[j] - s * r_i[j];
+            r_i[j] = tmp;
+        }
+    }
+}
+
+void
+tn_lstsq_add_row (tn_lstsq* ls, const double* x, double y)
+{
+    memcpy(ls->row, x, ls->n_features * sizeof(double));
+    if (ls->fit_intercept) {
+        ls->row[ls->n_features] = 1.0;
+    }
+    ls->row[ls->p] = y;
+    tn_lstsq_rotate_row(ls);
+
+    // accumulators for total sum of squares (R^2)
+    ls->n++;
+    double delta = y - ls->y_mean;
+    ls->y_mean += delta / (double) ls->n;
+    ls->y_m2 += delta * (y - ls->y_mean);
+}
+
+void
+tn_lstsq_add_batch (tn_lstsq* ls, const t_matrix* x, const t_array* y)
+{
+    TN_PROFILE_BEGIN(tn_lstsq_add_batch);
+    if (x->cols != ls->n_features || x->rows != y->len) {
+        tp_raiseError("Incompatible shapes in tn_lstsq_add_batch");
+    }
+    for (size_t k = 0; k < x->rows; k++) {
+        tn_lstsq_add_row(ls, x->data->ptr + k * x->tda, y->ptr[k]);
+    }
+    TN_PROFILE_END();
+}
+
+double
+tn_lstsq_solve (const tn_lstsq* ls, t_array* coef)
+{
+    TN_PROFILE_BEGIN(tn_lstsq_solve);
+    if (coef->len != ls->n_features) {
+        tp_raiseError("Length of coef must equal n_features in tn_lstsq_solve");
+    }
+    const size_t dim = ls->p + 1;
+    const double* r = ls->r->data->ptr;
+
+    // diagonal entries below this are treated as 0 (rank deficient R)
+    double r_max = 0.0;
+    for (size_t i = 0; i < ls->p; i++) {
+        r_max = fmax(r_max, fabs(r[i * dim + i]));
+    }
+    double r_tol = r_max * ls->p * 2.220446049250313e-16;
+
+    // back substitution R[:p, :p] * beta = R[:p, p] directly into coef, the
+    // intercept (last entry of beta if fitted) is kept in a local variable
+    double* beta = coef->ptr;
+    const size_t n_features = ls->n_features;
+    double intercept = 0.0;
+    int deficient = 0;
+    for (size_t i = ls->p; i-- > 0;) {
+        double diag = r[i * dim + i];
+        double b_i = 0.0;
+        if (fabs(diag) <= r_tol) {
+            deficient = 1;
+        }
+        else {
+            double sum = r[i * dim + ls->p];
+            for (size_t j = i + 1; j < ls->p; j++) {
+                sum -= r[i * dim + j] * (j < n_features ? beta[j] : intercept);
+            }
+            b_i = sum / diag;
+        }
+        if (i < n_features) {
+            beta[i] = b_i;
+        }
+        else {
+            intercept = b_i;
+        }
+    }
+    if (deficient && ls->n > 0) {
+        tp_raiseWarning("tn_lstsq_solve: design matrix is rank deficient, "
+            "coefficients of dependent features are set to 0.\n");
+    }
+
+    TN_PROFILE_END();
+    return intercept;
+}
+
+size_t
+tn_lstsq_count (const tn_lstsq* ls)
+{
+    return ls->n;
+}
+
+double
+tn_lstsq_rss (const tn_lstsq* ls)
+{
+    double r_pp = t_matrix_get(ls->r, ls->p, ls->p);
+    return r_pp * r_pp;
+}
+
+double
+tn_lstsq_mse (const tn_lstsq* ls)
+{
+    return ls->n ? tn_lstsq_rss(ls) / (double) ls->n : NAN;
+}
+
+double
+tn_lstsq_r2 (const tn_lstsq* ls)
+{
+    if (ls->n == 0) {
+        return NAN;
+    }
+    if (ls->y_m2 == 0.0) {
+        // constant y: perfect fit has R^2 = 1 (as in sklearn), otherwise 0
+        return tn_lstsq_rss(ls) == 0.0 ? 1.0 : 0.0;
+    }
+    return 1.0 - tn_lstsq_rss(ls) / ls->y_m2;
+}
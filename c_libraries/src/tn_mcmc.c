@@ -0,0 +1,1085 @@
+#include "t_numerics_intern.h"
+
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    Markov chain Monte Carlo for lattice spin models
+//================================================================================
+
+/* Lattice: L^ndim sites, periodic, x fastest. Ising spins are stored as
+ * int8 (+1/-1), Potts states as int8 (0 .. q-1), XY spins as unit vectors
+ * in two arrays (cos, sin), so local fields need no trigonometry.
+ *
+ * Local updates (Metropolis, heat bath) run on the checkerboard: all sites
+ * of one colour (x + y + z even or odd) only have neighbours of the other
+ * colour and are updated in parallel over the lattice rows. Every row owns
+ * an RNG stream (xoshiro256**, seeded by splitmix64), so the chain does not
+ * depend on the number of threads. Boltzmann factors of Ising and Potts
+ * are tabulated for the 2 ndim + 1 possible neighbour sums.
+ *
+ * Cluster updates: Wolff builds single clusters serially; Swendsen-Wang
+ * activates all bonds in parallel over rows, labels the clusters with a
+ * union-find and flips them in parallel. XY spins use the embedded Ising
+ * variables along a random mirror direction (Wolff 1989). With a field h
+ * the cluster flip is accepted with the Metropolis (Wolff) or heat bath
+ * (Swendsen-Wang) probability of its field energy. */
+
+// minimal number of sites for threading
+#define TN_MCMC_PARALLEL_MIN 4096
+#define TN_MCMC_MAX_Q 64
+// neighbour sums of Ising/Potts run from -2 ndim to 2 ndim
+#define TN_MCMC_TABLE 13
+#define TN_MCMC_TABLE_MID 6
+
+struct tn_mcmc {
+    tn_mcmc_options opt;
+    size_t n;             // sites
+    size_t rows;          // L^(ndim - 1)
+    double beta;
+    int8_t* spin;         // Ising, Potts
+    double* sx;           // XY
+    double* sy;
+    uint64_t (*rng)[4];   // one stream per row
+    uint64_t master[4];   // serial parts (cluster choices)
+    // Ising: acceptance [s > 0][sum], heat bath p(+1)[sum]; Potts: exp(beta J k)
+    double metro[2][TN_MCMC_TABLE];
+    double p_up[TN_MCMC_TABLE];
+    double boltz[TN_MCMC_TABLE];
+    // cluster work space, allocated on first use
+    size_t* stack;
+    size_t* parent;
+    uint8_t* bond;
+    double* cluster_de;
+    int8_t* cluster_new;
+    long wolff_clusters;  // clusters per sweep, 0: not yet calibrated
+    tn_mcmc_observables obs;
+};
+
+tn_mcmc_options
+tn_mcmc_default_options (void)
+{
+    tn_mcmc_options opt;
+    opt.model = TN_MCMC_ISING;
+    opt.ndim = 2;
+    opt.L = 32;
+    opt.q = 3;
+    opt.J = 1.0;
+    opt.h = 0.0;
+    opt.xy_step = 1.0;
+    opt.seed = 0;
+    return opt;
+}
+
+//-----------------------------------
+// random numbers
+//-----------------------------------
+
+static inline uint64_t
+splitmix_next (uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void
+rng_seed (uint64_t s[4], uint64_t seed, uint64_t stream)
+{
+    uint64_t state = seed ^ (stream * 0xd1b54a32d192ed03ULL);
+    for (int k = 0; k < 4; k++) {
+        s[k] = splitmix_next(&state);
+    }
+}
+
+static inline uint64_t
+rotl (uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* xoshiro256** */
+static inline uint64_t
+rng_next (uint64_t s[4])
+{
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/* uniform in [0, 1) */
+static inline double
+rng_uniform (uint64_t s[4])
+{
+    return (double)(rng_next(s) >> 11) * 0x1.0p-53;
+}
+
+/* uniform in 0 .. n - 1 */
+static inline size_t
+rng_index (uint64_t s[4], size_t n)
+{
+    return (size_t)(rng_uniform(s) * (double)n);
+}
+
+//-----------------------------------
+// setup
+//-----------------------------------
+
+static void
+update_tables (tn_mcmc* mc)
+{
+    const double bj = mc->beta * mc->opt.J;
+    const double bh = mc->beta * mc->opt.h;
+    for (int k = 0; k < TN_MCMC_TABLE; k++) {
+        int sum = k - TN_MCMC_TABLE_MID;
+        // Ising: dE = 2 s (J sum + h)
+        mc->metro[1][k] = fmin(1.0, exp(-2.0 * (bj * sum + bh)));
+        mc->metro[0][k] = fmin(1.0, exp(2.0 * (bj * sum + bh)));
+        mc->p_up[k] = 1.0 / (1.0 + exp(-2.0 * (bj * sum + bh)));
+        mc->boltz[k] = exp(bj * sum);
+    }
+}
+
+tn_mcmc*
+tn_mcmc_alloc (const tn_mcmc_options* opt, double beta)
+{
+    tn_mcmc* mc = malloc(sizeof(tn_mcmc));
+    Null_exit_message(mc, "Memory allocation failed in tn_mcmc_alloc!");
+    mc->opt = opt ? *opt : tn_mcmc_default_options();
+    const tn_mcmc_options* o = &mc->opt;
+    if (o->ndim < 2 || o->ndim > 3) {
+        tp_raiseError("tn_mcmc_alloc supports 2 and 3 dimensions!");
+    }
+    if (o->L < 2 || o->L % 2 != 0) {
+        tp_raiseError("tn_mcmc_alloc needs an even L for the checkerboard!");
+    }
+    if (o->model == TN_MCMC_POTTS && (o->q < 2 || o->q > TN_MCMC_MAX_Q)) {
+        tp_raiseError("tn_mcmc_alloc: Potts q has to be in 2 .. 64!");
+    }
+    if (o->model < TN_MCMC_ISING || o->model > TN_MCMC_XY) {
+        tp_raiseError("tn_mcmc_alloc: unknown model!");
+    }
+    mc->rows = o->ndim == 2 ? o->L : o->L * o->L;
+    mc->n = mc->rows * o->L;
+    mc->spin = NULL;
+    mc->sx = NULL;
+    mc->sy = NULL;
+    if (o->model == TN_MCMC_XY) {
+        mc->sx = malloc(2 * mc->n * sizeof(double));
+        Null_exit_message(mc->sx, "Memory allocation failed in tn_mcmc_alloc!");
+        mc->sy = mc->sx + mc->n;
+    }
+    else {
+        mc->spin = malloc(mc->n);
+        Null_exit_message(mc->spin, "Memory allocation failed in tn_mcmc_alloc!");
+    }
+    mc->rng = malloc(mc->rows * sizeof(*mc->rng));
+    Null_exit_message(mc->rng, "Memory allocation failed in tn_mcmc_alloc!");
+    for (size_t r = 0; r < mc->rows; r++) {
+        rng_seed(mc->rng[r], o->seed, r + 1);
+    }
+    rng_seed(mc->master, o->seed, 0);
+    mc->stack = NULL;
+    mc->parent = NULL;
+    mc->bond = NULL;
+    mc->cluster_de = NULL;
+    mc->cluster_new = NULL;
+    mc->wolff_clusters = 0;
+    mc->beta = beta;
+    tn_mcmc_set_beta(mc, beta);
+    tn_mcmc_order(mc);
+    tn_mcmc_reset_observables(mc);
+    return mc;
+}
+
+void
+tn_mcmc_free (tn_mcmc* mc)
+{
+    if (!mc) {
+        return;
+    }
+    free(mc->spin);
+    free(mc->sx);
+    free(mc->rng);
+    free(mc->stack);
+    free(mc->parent);
+    free(mc->bond);
+    free(mc->cluster_de);
+    free(mc->cluster_new);
+    free(mc);
+}
+
+void
+tn_mcmc_set_beta (tn_mcmc* mc, double beta)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_set_beta.");
+    }
+    // cluster sizes depend strongly on beta, recalibrate the Wolff sweep
+    if (beta != mc->beta) {
+        mc->wolff_clusters = 0;
+    }
+    mc->beta = beta;
+    update_tables(mc);
+}
+
+double
+tn_mcmc_beta (const tn_mcmc* mc)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_beta.");
+    }
+    return mc->beta;
+}
+
+size_t
+tn_mcmc_sites (const tn_mcmc* mc)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_sites.");
+    }
+    return mc->n;
+}
+
+void
+tn_mcmc_order (tn_mcmc* mc)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_order.");
+    }
+    for (size_t i = 0; i < mc->n; i++) {
+        if (mc->opt.model == TN_MCMC_XY) {
+            mc->sx[i] = 1.0;
+            mc->sy[i] = 0.0;
+        }
+        else {
+            mc->spin[i] = mc->opt.model == TN_MCMC_ISING ? 1 : 0;
+        }
+    }
+}
+
+void
+tn_mcmc_randomize (tn_mcmc* mc)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_randomize.");
+    }
+    const size_t L = mc->opt.L;
+    for (size_t r = 0; r < mc->rows; r++) {
+        for (size_t x = 0; x < L; x++) {
+            size_t i = r * L + x;
+            if (mc->opt.model == TN_MCMC_XY) {
+                double phi = 2.0 * M_PI * rng_uniform(mc->rng[r]);
+                mc->sx[i] = cos(phi);
+                mc->sy[i] = sin(phi);
+            }
+            else if (mc->opt.model == TN_MCMC_ISING) {
+                mc->spin[i] = rng_uniform(mc->rng[r]) < 0.5 ? 1 : -1;
+            }
+            else {
+                mc->spin[i] = (int8_t)rng_index(mc->rng[r], (size_t)mc->opt.q);
+            }
+        }
+    }
+}
+
+double
+tn_mcmc_spin (const tn_mcmc* mc, size_t site)
+{
+    if (!mc || site >= mc->n) {
+        tp_raiseError("Invalid site in tn_mcmc_spin.");
+    }
+    if (mc->opt.model == TN_MCMC_XY) {
+        return atan2(mc->sy[site], mc->sx[site]);
+    }
+    return mc->spin[site];
+}
+
+//-----------------------------------
+// geometry
+//-----------------------------------
+
+/* first sites of row r and of its neighbour rows: y - 1, y + 1, z - 1, z + 1
+ * (2D: the z rows are r itself) */
+static inline void
+row_bases (const tn_mcmc* mc, size_t r, size_t base[5])
+{
+    const size_t L = mc->opt.L;
+    size_t y = r % L;
+    size_t z = r / L;
+    size_t ym = y == 0 ? L - 1 : y - 1;
+    size_t yp = y == L - 1 ? 0 : y + 1;
+    base[0] = r * L;
+    base[1] = (z * L + ym) * L;
+    base[2] = (z * L + yp) * L;
+    if (mc->opt.ndim == 3) {
+        size_t zm = z == 0 ? L - 1 : z - 1;
+        size_t zp = z == L - 1 ? 0 : z + 1;
+        base[3] = (zm * L + y) * L;
+        base[4] = (zp * L + y) * L;
+    }
+    else {
+        base[3] = base[4] = base[0];
+    }
+}
+
+/* the 2 ndim neighbours of site i, returns their number */
+static inline int
+site_neighbours (const tn_mcmc* mc, size_t i, size_t nb[6])
+{
+    const size_t L = mc->opt.L;
+    size_t x = i % L;
+    size_t base[5];
+    row_bases(mc, i / L, base);
+    nb[0] = base[0] + (x == 0 ? L - 1 : x - 1);
+    nb[1] = base[0] + (x == L - 1 ? 0 : x + 1);
+    nb[2] = base[1] + x;
+    nb[3] = base[2] + x;
+    if (mc->opt.ndim == 3) {
+        nb[4] = base[3] + x;
+        nb[5] = base[4] + x;
+        return 6;
+    }
+    return 4;
+}
+
+//-----------------------------------
+// checkerboard sweeps
+//-----------------------------------
+
+/* von Mises angle with concentration kappa (Best & Fisher 1979), returns
+ * cos and sin of the angle relative to the mean direction */
+static void
+von_mises (uint64_t s[4], double kappa, double* c, double* sn)
+{
+    if (kappa < 1e-8) {
+        double phi = 2.0 * M_PI * rng_uniform(s);
+        *c = cos(phi);
+        *sn = sin(phi);
+        return;
+    }
+    double tau = 1.0 + sqrt(1.0 + 4.0 * kappa * kappa);
+    double rho = (tau - sqrt(2.0 * tau)) / (2.0 * kappa);
+    double r = (1.0 + rho * rho) / (2.0 * rho);
+    double f;
+    for (;;) {
+        double z = cos(M_PI * rng_uniform(s));
+        f = (1.0 + r * z) / (r + z);
+        double cc = kappa * (r - f);
+        double u2 = rng_uniform(s);
+        if (cc * (2.0 - cc) > u2 || log(cc / u2) + 1.0 >= cc) {
+            break;
+        }
+    }
+    f = fmax(-1.0, fmin(1.0, f));
+    *c = f;
+    *sn = (rng_uniform(s) < 0.5 ? -1.0 : 1.0) * sqrt(1.0 - f * f);
+}
+
+static void
+sweep_local (tn_mcmc* mc, int heatbath)
+{
+    const size_t L = mc->opt.L;
+    const long rows = (long)mc->rows;
+    const int ndim = mc->opt.ndim;
+    const int model = mc->opt.model;
+    const int q = mc->opt.q;
+    const double J = mc->opt.J;
+    const double h = mc->opt.h;
+    const double beta = mc->beta;
+    const double step = mc->opt.xy_step;
+    int8_t* s = mc->spin;
+    double* sx = mc->sx;
+    double* sy = mc->sy;
+    for (int colour = 0; colour < 2; colour++) {
+        #pragma omp parallel for schedule(static) if(mc->n >= TN_MCMC_PARALLEL_MIN)
+        for (long r = 0; r < rows; r++) {
+            uint64_t* rng = mc->rng[r];
+            size_t base[5];
+            row_bases(mc, (size_t)r, base);
+            size_t y = (size_t)r % L;
+            size_t z = (size_t)r / L;
+            for (size_t x = (colour + y + z) & 1; x < L; x += 2) {
+                size_t nb[6] = {base[0] + (x == 0 ? L - 1 : x - 1),
+                                base[0] + (x == L - 1 ? 0 : x + 1),
+                                base[1] + x, base[2] + x, 0, 0};
+                int n_nb = 4;
+                if (ndim == 3) {
+                    nb[4] = base[3] + x;
+                    nb[5] = base[4] + x;
+                    n_nb = 6;
+                }
+                size_t i = base[0] + x;
+                if (model == TN_MCMC_ISING) {
+                    int sum = 0;
+                    for (int k = 0; k < n_nb; k++) {
+                        sum += s[nb[k]];
+                    }
+                    int t = sum + TN_MCMC_TABLE_MID;
+                    if (heatbath) {
+                        s[i] = rng_uniform(rng) < mc->p_up[t] ? 1 : -1;
+                    }
+                    else if (rng_uniform(rng) < mc->metro[s[i] > 0][t]) {
+                        s[i] = (int8_t)-s[i];
+                    }
+                }
+                else if (model == TN_MCMC_POTTS) {
+                    int count[TN_MCMC_MAX_Q];
+                    if (heatbath) {
+                        memset(count, 0, (size_t)q * sizeof(int));
+                        for (int k = 0; k < n_nb; k++) {
+                            count[s[nb[k]]]++;
+                        }
+                        double total = 0.0;
+                        for (int m = 0; m < q; m++) {
+                            total += mc->boltz[count[m] + TN_MCMC_TABLE_MID];
+                        }
+                        double u = rng_uniform(rng) * total;
+                        int m = 0;
+                        for (; m < q - 1; m++) {
+                            u -= mc->boltz[count[m] + TN_MCMC_TABLE_MID];
+                            if (u < 0.0) {
+                                break;
+                            }
+                        }
+                        s[i] = (int8_t)m;
+                    }
+                    else {
+                        // one of the q - 1 other states
+                        int m = (int)rng_index(rng, (size_t)(q - 1));
+                        m += m >= s[i];
+                        int d = 0;
+                        for (int k = 0; k < n_nb; k++) {
+                            d += (s[nb[k]] == m) - (s[nb[k]] == s[i]);
+                        }
+                        // exp(beta J d) >= 1 accepts downhill moves for
+                        // either sign of J
+                        if (rng_uniform(rng) < mc->boltz[d + TN_MCMC_TABLE_MID]) {
+                            s[i] = (int8_t)m;
+                        }
+                    }
+                }
+                else {
+                    // local field, E_i = -H . s_i
+                    double hx = h;
+                    double hy = 0.0;
+                    for (int k = 0; k < n_nb; k++) {
+                        hx += J * sx[nb[k]];
+                        hy += J * sy[nb[k]];
+                    }
+                    if (heatbath) {
+                        double norm = sqrt(hx * hx + hy * hy);
+                        double c;
+                        double sn;
+                        von_mises(rng, beta * norm, &c, &sn);
+                        if (norm > 0.0) {
+                            double ux = hx / norm;
+                            double uy = hy / norm;
+                            sx[i] = c * ux - sn * uy;
+                            sy[i] = sn * ux + c * uy;
+                        }
+                        else {
+                            sx[i] = c;
+                            sy[i] = sn;
+                        }
+                    }
+                    else {
+                        double phi = step * (2.0 * rng_uniform(rng) - 1.0);
+                        double c = cos(phi);
+                        double sn = sin(phi);
+                        double nx = c * sx[i] - sn * sy[i];
+                        double ny = sn * sx[i] + c * sy[i];
+                        double de = -(hx * (nx - sx[i]) + hy * (ny - sy[i]));
+                        if (de <= 0.0 || rng_uniform(rng) < exp(-beta * de)) {
+                            // keep |s| = 1 against accumulated rounding
+                            double inv = 1.0 / sqrt(nx * nx + ny * ny);
+                            sx[i] = nx * inv;
+                            sy[i] = ny * inv;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//-----------------------------------
+// cluster updates
+//-----------------------------------
+
+static void
+cluster_alloc (tn_mcmc* mc)
+{
+    if (mc->stack) {
+        return;
+    }
+    mc->stack = malloc(mc->n * sizeof(size_t));
+    mc->parent = malloc(mc->n * sizeof(size_t));
+    mc->bond = calloc(mc->n, 1);
+    mc->cluster_de = malloc(mc->n * sizeof(double));
+    mc->cluster_new = malloc(mc->n);
+    if (!mc->stack || !mc->parent || !mc->bond || !mc->cluster_de || !mc->cluster_new) {
+        tp_raiseError("Memory allocation failed in tn_mcmc_sweep!");
+    }
+}
+
+/* Ising or XY value of site i along the mirror direction (rx, ry) */
+static inline double
+embedded (const tn_mcmc* mc, size_t i, double rx, double ry)
+{
+    if (mc->opt.model == TN_MCMC_XY) {
+        return mc->sx[i] * rx + mc->sy[i] * ry;
+    }
+    return mc->spin[i];
+}
+
+/* flips site i: Ising sign, Potts to state, XY mirrored at (rx, ry) */
+static inline void
+flip_site (tn_mcmc* mc, size_t i, int8_t state, double rx, double ry)
+{
+    if (mc->opt.model == TN_MCMC_XY) {
+        double p = 2.0 * (mc->sx[i] * rx + mc->sy[i] * ry);
+        mc->sx[i] -= p * rx;
+        mc->sy[i] -= p * ry;
+    }
+    else if (mc->opt.model == TN_MCMC_ISING) {
+        mc->spin[i] = (int8_t)-mc->spin[i];
+    }
+    else {
+        mc->spin[i] = state;
+    }
+}
+
+/* one Wolff cluster, returns its size */
+static size_t
+wolff_cluster (tn_mcmc* mc)
+{
+    const int model = mc->opt.model;
+    const double bj = mc->beta * mc->opt.J;
+    double rx = 0.0;
+    double ry = 0.0;
+    if (model == TN_MCMC_XY) {
+        double phi = 2.0 * M_PI * rng_uniform(mc->master);
+        rx = cos(phi);
+        ry = sin(phi);
+    }
+    size_t seed = rng_index(mc->master, mc->n);
+    int8_t old_state = 0;
+    int8_t new_state = 0;
+    double p_potts = 0.0;
+    if (model == TN_MCMC_POTTS) {
+        old_state = mc->spin[seed];
+        int m = (int)rng_index(mc->master, (size_t)(mc->opt.q - 1));
+        new_state = (int8_t)(m + (m >= old_state));
+        p_potts = 1.0 - exp(-bj);
+    }
+    // bond[i] marks cluster members, cleared at the end
+    size_t size = 0;
+    size_t top = 0;
+    double de_field = 0.0;
+    mc->bond[seed] = 1;
+    mc->stack[size++] = seed;
+    while (top < size) {
+        size_t i = mc->stack[top++];
+        // value of i before its flip (it is flipped when popped)
+        double ei = embedded(mc, i, rx, ry);
+        size_t nb[6];
+        int n_nb = site_neighbours(mc, i, nb);
+        for (int k = 0; k < n_nb; k++) {
+            size_t j = nb[k];
+            if (mc->bond[j]) {
+                continue;
+            }
+            double p;
+            if (model == TN_MCMC_POTTS) {
+                p = mc->spin[j] == old_state ? p_potts : 0.0;
+            }
+            else {
+                double x = bj * ei * embedded(mc, j, rx, ry);
+                p = x > 0.0 ? 1.0 - exp(-2.0 * x) : 0.0;
+            }
+            if (p > 0.0 && rng_uniform(mc->master) < p) {
+                mc->bond[j] = 1;
+                mc->stack[size++] = j;
+            }
+        }
+        if (model == TN_MCMC_XY) {
+            de_field += 2.0 * mc->opt.h * ei * rx;
+        }
+        else if (model == TN_MCMC_ISING) {
+            de_field += 2.0 * mc->opt.h * ei;
+        }
+        flip_site(mc, i, new_state, rx, ry);
+    }
+    // the field is not part of the bond probabilities: accept the flip
+    if (de_field > 0.0 && rng_uniform(mc->master) >= exp(-mc->beta * de_field)) {
+        for (size_t k = 0; k < size; k++) {
+            size_t i = mc->stack[k];
+            flip_site(mc, i, old_state, rx, ry);
+        }
+    }
+    for (size_t k = 0; k < size; k++) {
+        mc->bond[mc->stack[k]] = 0;
+    }
+    return size;
+}
+
+static inline size_t
+uf_find (size_t* parent, size_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void
+swendsen_wang (tn_mcmc* mc)
+{
+    const size_t L = mc->opt.L;
+    const long rows = (long)mc->rows;
+    const long n = (long)mc->n;
+    const int ndim = mc->opt.ndim;
+    const int model = mc->opt.model;
+    const double bj = mc->beta * mc->opt.J;
+    double rx = 0.0;
+    double ry = 0.0;
+    if (model == TN_MCMC_XY) {
+        double phi = 2.0 * M_PI * rng_uniform(mc->master);
+        rx = cos(phi);
+        ry = sin(phi);
+    }
+    const double p_potts = 1.0 - exp(-bj);
+
+    // bonds to +x, +y, +z as bits
+    #pragma omp parallel for schedule(static) if(n >= TN_MCMC_PARALLEL_MIN)
+    for (long r = 0; r < rows; r++) {
+        uint64_t* rng = mc->rng[r];
+        size_t base[5];
+        row_bases(mc, (size_t)r, base);
+        for (size_t x = 0; x < L; x++) {
+            size_t i = base[0] + x;
+            size_t nb[3] = {base[0] + (x == L - 1 ? 0 : x + 1), base[2] + x,
+                            ndim == 3 ? base[4] + x : 0};
+            uint8_t bits = 0;
+            for (int k = 0; k < ndim; k++) {
+                size_t j = nb[k];
+                double p;
+                if (model == TN_MCMC_POTTS) {
+                    p = mc->spin[i] == mc->spin[j] ? p_potts : 0.0;
+                }
+                else {
+                    double v = bj * embedded(mc, i, rx, ry) * embedded(mc, j, rx, ry);
+                    p = v > 0.0 ? 1.0 - exp(-2.0 * v) : 0.0;
+                }
+                if (p > 0.0 && rng_uniform(rng) < p) {
+                    bits |= (uint8_t)(1u << k);
+                }
+            }
+            mc->bond[i] = bits;
+        }
+    }
+
+    // clusters, union by index keeps the smallest site as root
+    for (long i = 0; i < n; i++) {
+        mc->parent[i] = (size_t)i;
+    }
+    for (size_t i = 0; i < mc->n; i++) {
+        if (!mc->bond[i]) {
+            continue;
+        }
+        size_t base[5];
+        row_bases(mc, i / L, base);
+        size_t x = i % L;
+        size_t nb[3] = {base[0] + (x == L - 1 ? 0 : x + 1), base[2] + x,
+                        ndim == 3 ? base[4] + x : 0};
+        for (int k = 0; k < ndim; k++) {
+            if (mc->bond[i] & (1u << k)) {
+                size_t a = uf_find(mc->parent, i);
+                size_t b = uf_find(mc->parent, nb[k]);
+                if (a < b) {
+                    mc->parent[b] = a;
+                }
+                else if (b < a) {
+                    mc->parent[a] = b;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < mc->n; i++) {
+        mc->parent[i] = uf_find(mc->parent, i);
+        mc->bond[i] = 0;
+    }
+
+    // new value of every cluster
+    if (model == TN_MCMC_POTTS) {
+        for (size_t i = 0; i < mc->n; i++) {
+            if (mc->parent[i] == i) {
+                mc->cluster_new[i] = (int8_t)rng_index(mc->master, (size_t)mc->opt.q);
+            }
+        }
+    }
+    else {
+        // heat bath between flipped and not flipped with the field energy
+        memset(mc->cluster_de, 0, mc->n * sizeof(double));
+        if (mc->opt.h != 0.0) {
+            for (size_t i = 0; i < mc->n; i++) {
+                double e = embedded(mc, i, rx, ry);
+                mc->cluster_de[mc->parent[i]] += 2.0 * mc->opt.h * e
+                                                 * (model == TN_MCMC_XY ? rx : 1.0);
+            }
+        }
+        for (size_t i = 0; i < mc->n; i++) {
+            if (mc->parent[i] == i) {
+                double p = 1.0 / (1.0 + exp(mc->beta * mc->cluster_de[i]));
+                mc->cluster_new[i] = rng_uniform(mc->master) < p;
+            }
+        }
+    }
+    #pragma omp parallel for schedule(static) if(n >= TN_MCMC_PARALLEL_MIN)
+    for (long i = 0; i < n; i++) {
+        int8_t v = mc->cluster_new[mc->parent[i]];
+        if (model == TN_MCMC_POTTS) {
+            mc->spin[i] = v;
+        }
+        else if (v) {
+            flip_site(mc, (size_t)i, 0, rx, ry);
+        }
+    }
+}
+
+void
+tn_mcmc_sweep (tn_mcmc* mc, int update, long n_sweeps)
+{
+    TN_PROFILE_BEGIN(tn_mcmc_sweep);
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_sweep.");
+    }
+    if ((update == TN_MCMC_WOLFF || update == TN_MCMC_SWENDSEN_WANG)
+        && mc->opt.model == TN_MCMC_POTTS && mc->opt.J < 0.0) {
+        tp_raiseError("tn_mcmc_sweep: cluster updates need J > 0 for Potts!");
+    }
+    for (long s = 0; s < n_sweeps; s++) {
+        switch (update) {
+            case TN_MCMC_METROPOLIS:
+                sweep_local(mc, 0);
+                break;
+            case TN_MCMC_HEATBATH:
+                sweep_local(mc, 1);
+                break;
+            case TN_MCMC_WOLFF:
+                cluster_alloc(mc);
+                if (mc->wolff_clusters == 0) {
+                    // first sweep: clusters until n sites were flipped. Later
+                    // sweeps use that fixed number, stopping at a flipped
+                    // size would correlate the measurements with the clusters.
+                    size_t flipped = 0;
+                    while (flipped < mc->n) {
+                        flipped += wolff_cluster(mc);
+                        mc->wolff_clusters++;
+                    }
+                }
+                else {
+                    for (long c = 0; c < mc->wolff_clusters; c++) {
+                        wolff_cluster(mc);
+                    }
+                }
+                break;
+            case TN_MCMC_SWENDSEN_WANG:
+                cluster_alloc(mc);
+                swendsen_wang(mc);
+                break;
+            default:
+                tp_raiseError("tn_mcmc_sweep: unknown update!");
+        }
+    }
+    TN_PROFILE_END();
+}
+
+//-----------------------------------
+// observables
+//-----------------------------------
+
+void
+tn_mcmc_state (const tn_mcmc* mc, double* energy, double* magnetization)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_state.");
+    }
+    const size_t L = mc->opt.L;
+    const long rows = (long)mc->rows;
+    const int ndim = mc->opt.ndim;
+    const int model = mc->opt.model;
+    const int q = mc->opt.q;
+    double bonds = 0.0;
+    double mx = 0.0;
+    double my = 0.0;
+    long count[TN_MCMC_MAX_Q] = {0};
+    #pragma omp parallel for reduction(+:bonds, mx, my, count[:TN_MCMC_MAX_Q]) \
+        if(mc->n >= TN_MCMC_PARALLEL_MIN)
+    for (long r = 0; r < rows; r++) {
+        size_t base[5];
+        row_bases(mc, (size_t)r, base);
+        for (size_t x = 0; x < L; x++) {
+            size_t i = base[0] + x;
+            size_t nb[3] = {base[0] + (x == L - 1 ? 0 : x + 1), base[2] + x,
+                            ndim == 3 ? base[4] + x : 0};
+            for (int k = 0; k < ndim; k++) {
+                size_t j = nb[k];
+                if (model == TN_MCMC_ISING) {
+                    bonds += mc->spin[i] * mc->spin[j];
+                }
+                else if (model == TN_MCMC_POTTS) {
+                    bonds += mc->spin[i] == mc->spin[j];
+                }
+                else {
+                    bonds += mc->sx[i] * mc->sx[j] + mc->sy[i] * mc->sy[j];
+                }
+            }
+            if (model == TN_MCMC_XY) {
+                mx += mc->sx[i];
+                my += mc->sy[i];
+            }
+            else if (model == TN_MCMC_ISING) {
+                mx += mc->spin[i];
+            }
+            else {
+                count[mc->spin[i]]++;
+            }
+        }
+    }
+    const double n = (double)mc->n;
+    double e = -mc->opt.J * bonds;
+    double m;
+    if (model == TN_MCMC_POTTS) {
+        long max = 0;
+        for (int k = 0; k < q; k++) {
+            max = count[k] > max ? count[k] : max;
+        }
+        m = (q * max / n - 1.0) / (q - 1.0);
+    }
+    else {
+        e -= mc->opt.h * mx;
+        m = sqrt(mx * mx + my * my) / n;
+    }
+    if (energy) {
+        *energy = e / n;
+    }
+    if (magnetization) {
+        *magnetization = m;
+    }
+}
+
+void
+tn_mcmc_reset_observables (tn_mcmc* mc)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_reset_observables.");
+    }
+    tn_moments_init(&mc->obs.energy);
+    tn_moments_init(&mc->obs.magnetization);
+    tn_moments_init(&mc->obs.m2);
+}
+
+static void
+observables_add (tn_mcmc_observables* obs, double e, double m)
+{
+    tn_moments_add(&obs->energy, e);
+    tn_moments_add(&obs->magnetization, m);
+    tn_moments_add(&obs->m2, m * m);
+}
+
+void
+tn_mcmc_measure (tn_mcmc* mc)
+{
+    double e;
+    double m;
+    tn_mcmc_state(mc, &e, &m);
+    observables_add(&mc->obs, e, m);
+}
+
+const tn_mcmc_observables*
+tn_mcmc_observables_get (const tn_mcmc* mc)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_observables_get.");
+    }
+    return &mc->obs;
+}
+
+void
+tn_mcmc_run (tn_mcmc* mc, int update, long n_sweeps, long measure_every)
+{
+    if (!mc) {
+        tp_raiseError("Null pointer in tn_mcmc_run.");
+    }
+    for (long s = 1; s <= n_sweeps; s++) {
+        tn_mcmc_sweep(mc, update, 1);
+        if (measure_every > 0 && s % measure_every == 0) {
+            tn_mcmc_measure(mc);
+        }
+    }
+}
+
+//-----------------------------------
+// parallel tempering
+//-----------------------------------
+
+struct tn_mcmc_pt {
+    int n_rep;
+    tn_mcmc** rep;
+    double* beta;         // ascending as given
+    int* at;              // at[k]: replica at beta[k]
+    tn_mcmc_observables* obs;  // per temperature
+    long* tries;          // swaps of beta[k] and beta[k + 1]
+    long* accepted;
+    uint64_t rng[4];
+    long rounds;
+};
+
+tn_mcmc_pt*
+tn_mcmc_pt_alloc (const tn_mcmc_options* opt, const double* beta, int n_replicas)
+{
+    if (!beta || n_replicas < 1) {
+        tp_raiseError("tn_mcmc_pt_alloc needs at least one beta!");
+    }
+    tn_mcmc_pt* pt = malloc(sizeof(tn_mcmc_pt));
+    Null_exit_message(pt, "Memory allocation failed in tn_mcmc_pt_alloc!");
+    tn_mcmc_options o = opt ? *opt : tn_mcmc_default_options();
+    pt->n_rep = n_replicas;
+    pt->rep = malloc((size_t)n_replicas * sizeof(tn_mcmc*));
+    pt->beta = malloc((size_t)n_replicas * sizeof(double));
+    pt->at = malloc((size_t)n_replicas * sizeof(int));
+    pt->obs = malloc((size_t)n_replicas * sizeof(tn_mcmc_observables));
+    pt->tries = calloc((size_t)n_replicas, sizeof(long));
+    pt->accepted = calloc((size_t)n_replicas, sizeof(long));
+    if (!pt->rep || !pt->beta || !pt->at || !pt->obs || !pt->tries || !pt->accepted) {
+        tp_raiseError("Memory allocation failed in tn_mcmc_pt_alloc!");
+    }
+    uint64_t seed = (uint64_t)o.seed;
+    for (int k = 0; k < n_replicas; k++) {
+        // independent streams per replica
+        uint64_t state = seed + (uint64_t)k;
+        o.seed = (unsigned long)splitmix_next(&state);
+        pt->rep[k] = tn_mcmc_alloc(&o, beta[k]);
+        pt->beta[k] = beta[k];
+        pt->at[k] = k;
+        tn_moments_init(&pt->obs[k].energy);
+        tn_moments_init(&pt->obs[k].magnetization);
+        tn_moments_init(&pt->obs[k].m2);
+    }
+    rng_seed(pt->rng, seed, (uint64_t)-1);
+    pt->rounds = 0;
+    return pt;
+}
+
+void
+tn_mcmc_pt_free (tn_mcmc_pt* pt)
+{
+    if (!pt) {
+        return;
+    }
+    for (int k = 0; k < pt->n_rep; k++) {
+        tn_mcmc_free(pt->rep[k]);
+    }
+    free(pt->rep);
+    free(pt->beta);
+    free(pt->at);
+    free(pt->obs);
+    free(pt->tries);
+    free(pt->accepted);
+    free(pt);
+}
+
+void
+tn_mcmc_pt_run (tn_mcmc_pt* pt, int update, long n_rounds, long sweeps_per_round,
+                int measure)
+{
+    TN_PROFILE_BEGIN(tn_mcmc_pt_run);
+    if (!pt) {
+        tp_raiseError("Null pointer in tn_mcmc_pt_run.");
+    }
+    const int n_rep = pt->n_rep;
+    double* e = malloc((size_t)n_rep * sizeof(double));
+    double* m = malloc((size_t)n_rep * sizeof(double));
+    Null_exit_message(e, "Memory allocation failed in tn_mcmc_pt_run!");
+    Null_exit_message(m, "Memory allocation failed in tn_mcmc_pt_run!");
+    const double n_sites = (double)pt->rep[0]->n;
+    for (long round = 0; round < n_rounds; round++) {
+        // replicas in parallel, their sweeps run serially inside
+        #pragma omp parallel for schedule(dynamic, 1) if(n_rep > 1)
+        for (int k = 0; k < n_rep; k++) {
+            tn_mcmc* mc = pt->rep[pt->at[k]];
+            tn_mcmc_sweep(mc, update, sweeps_per_round);
+            tn_mcmc_state(mc, &e[k], &m[k]);
+        }
+        if (measure) {
+            for (int k = 0; k < n_rep; k++) {
+                observables_add(&pt->obs[k], e[k], m[k]);
+            }
+        }
+        // neighbouring temperatures, even and odd pairs alternating
+        for (int k = (int)(pt->rounds & 1); k + 1 < n_rep; k += 2) {
+            double delta = (pt->beta[k] - pt->beta[k + 1]) * (e[k] - e[k + 1]) * n_sites;
+            pt->tries[k]++;
+            if (delta >= 0.0 || rng_uniform(pt->rng) < exp(delta)) {
+                int swap = pt->at[k];
+                pt->at[k] = pt->at[k + 1];
+                pt->at[k + 1] = swap;
+                tn_mcmc* lo = pt->rep[pt->at[k]];
+                tn_mcmc* hi = pt->rep[pt->at[k + 1]];
+                // the Wolff calibration belongs to the temperature, not to
+                // the replica, so it is exchanged together with beta
+                long clusters_lo = hi->wolff_clusters;
+                long clusters_hi = lo->wolff_clusters;
+                tn_mcmc_set_beta(lo, pt->beta[k]);
+                tn_mcmc_set_beta(hi, pt->beta[k + 1]);
+                lo->wolff_clusters = clusters_lo;
+                hi->wolff_clusters = clusters_hi;
+                pt->accepted[k]++;
+            }
+        }
+        pt->rounds++;
+    }
+    free(e);
+    free(m);
+    TN_PROFILE_END();
+}
+
+tn_mcmc*
+tn_mcmc_pt_replica (tn_mcmc_pt* pt, int k)
+{
+    if (!pt || k < 0 || k >= pt->n_rep) {
+        tp_raiseError("Invalid temperature in tn_mcmc_pt_replica.");
+    }
+    return pt->rep[pt->at[k]];
+}
+
+const tn_mcmc_observables*
+tn_mcmc_pt_observables (const tn_mcmc_pt* pt, int k)
+{
+    if (!pt || k < 0 || k >= pt->n_rep) {
+        tp_raiseError("Invalid temperature in tn_mcmc_pt_observables.");
+    }
+    return &pt->obs[k];
+}
+
+double
+tn_mcmc_pt_acceptance (const tn_mcmc_pt* pt, int k)
+{
+    if (!pt || k < 0 || k + 1 >= pt->n_rep) {
+        tp_raiseError("Invalid pair in tn_mcmc_pt_acceptance.");
+    }
+    return pt->tries[k] ? (double)pt->accepted[k] / pt->tries[k] : 0.0;
+}
@@ -0,0 +1,567 @@
+#include "t_numerics_intern.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    cell and Verlet lists for short-range pair forces
+//================================================================================
+
+/* Rebuild: the particles are binned into cells of edge >= cutoff + skin
+ * (counting sort, periodic axes wrapped) and stored in cell order; this
+ * sorted order is kept until the next rebuild, so the force loop reads
+ * positions nearly sequentially. The Verlet list (CSR, each pair once,
+ * j > i in sorted order) is filled from the 27 surrounding cells in two
+ * threaded passes: count, then fill.
+ *
+ * The list stays valid while no particle moved more than skin / 2 since
+ * the rebuild: two particles can then approach by at most the skin.
+ * tn_nlist_update checks the displacements and rebuilds only if needed.
+ *
+ * Forces: each thread accumulates the reaction forces f_j of its pairs in
+ * a buffer of its own, the buffers are summed in a second parallel loop.
+ * This keeps the half list (half the pair evaluations) without atomics. */
+
+// minimal number of particles for threading
+#define TN_NLIST_PARALLEL_MIN 2048
+// at most this many cells per particle, coarser cells stay correct
+#define TN_NLIST_CELLS_PER_PARTICLE 4
+
+struct tn_nlist {
+    size_t n;
+    tn_nlist_options opt;
+    PAIR_FUNC* pair;
+    void* pair_params;
+    const double* mass;
+    // sorted order of the last rebuild
+    size_t* perm;         // sorted index -> original index
+    Vec_3D* xs;           // sorted positions
+    Vec_3D* ref;          // positions at the rebuild, original order
+    // cells
+    int n_cell[3];
+    double cell_lo[3];
+    double cell_inv[3];   // cells per length
+    size_t* cell_start;   // particles of cell c: [cell_start[c], cell_start[c + 1])
+    size_t cap_cells;
+    size_t* cell_of;      // cell of original particle
+    // Verlet list (CSR over sorted particles)
+    size_t* start;
+    size_t* nbr;
+    size_t cap_nbr;
+    // per-thread force buffers
+    Vec_3D* buf;
+    int n_buf;
+    double energy;
+    long builds;
+    int valid;
+};
+
+tn_nlist_options
+tn_nlist_default_options (void)
+{
+    tn_nlist_options opt;
+    opt.cutoff = 2.5;
+    opt.skin = 0.3;
+    opt.box[0] = opt.box[1] = opt.box[2] = 0.0;
+    return opt;
+}
+
+tn_nlist*
+tn_nlist_alloc (size_t n, const tn_nlist_options* opt)
+{
+    if (n == 0) {
+        tp_raiseError("tn_nlist_alloc needs at least one particle!");
+    }
+    tn_nlist* list = malloc(sizeof(tn_nlist));
+    Null_exit_message(list, "Memory allocation failed in tn_nlist_alloc!");
+    list->n = n;
+    list->opt = opt ? *opt : tn_nlist_default_options();
+    if (list->opt.cutoff <= 0.0 || list->opt.skin < 0.0) {
+        tp_raiseError("tn_nlist_alloc needs cutoff > 0 and skin >= 0!");
+    }
+    double r_list = list->opt.cutoff + list->opt.skin;
+    for (int k = 0; k < 3; k++) {
+        // minimum image needs at most one image in range
+        if (list->opt.box[k] > 0.0 && list->opt.box[k] < 2.0 * r_list) {
+            tp_raiseError("tn_nlist_alloc: periodic box smaller than 2 (cutoff + skin)!");
+        }
+    }
+    list->pair = NULL;
+    list->pair_params = NULL;
+    list->mass = NULL;
+    list->perm = malloc(n * sizeof(size_t));
+    list->xs = malloc(n * sizeof(Vec_3D));
+    list->ref = malloc(n * sizeof(Vec_3D));
+    list->cell_of = malloc(n * sizeof(size_t));
+    list->start = malloc((n + 1) * sizeof(size_t));
+    if (!list->perm || !list->xs || !list->ref || !list->cell_of || !list->start) {
+        tp_raiseError("Memory allocation failed in tn_nlist_alloc!");
+    }
+    list->cap_cells = 0;
+    list->cell_start = NULL;
+    list->cap_nbr = 0;
+    list->nbr = NULL;
+    list->buf = NULL;
+    list->n_buf = 0;
+    list->energy = 0.0;
+    list->builds = 0;
+    list->valid = 0;
+    return list;
+}
+
+void
+tn_nlist_free (tn_nlist* list)
+{
+    if (!list) {
+        return;
+    }
+    free(list->perm);
+    free(list->xs);
+    free(list->ref);
+    free(list->cell_of);
+    free(list->start);
+    free(list->cell_start);
+    free(list->nbr);
+    free(list->buf);
+    free(list);
+}
+
+void
+tn_nlist_set_pair (tn_nlist* list, PAIR_FUNC pair, void* params)
+{
+    if (!list || !pair) {
+        tp_raiseError("Null pointer in tn_nlist_set_pair.");
+    }
+    list->pair = pair;
+    list->pair_params = params;
+}
+
+void
+tn_nlist_set_masses (tn_nlist* list, const double* mass)
+{
+    if (!list) {
+        tp_raiseError("Null pointer in tn_nlist_set_masses.");
+    }
+    list->mass = mass;
+}
+
+size_t
+tn_nlist_pairs (const tn_nlist* list)
+{
+    if (!list) {
+        tp_raiseError("Null pointer in tn_nlist_pairs.");
+    }
+    return list->valid ? list->start[list->n] : 0;
+}
+
+long
+tn_nlist_builds (const tn_nlist* list)
+{
+    if (!list) {
+        tp_raiseError("Null pointer in tn_nlist_builds.");
+    }
+    return list->builds;
+}
+
+double
+tn_nlist_energy (const tn_nlist* list)
+{
+    if (!list) {
+        tp_raiseError("Null pointer in tn_nlist_energy.");
+    }
+    return list->energy;
+}
+
+//-----------------------------------
+// geometry
+//-----------------------------------
+
+/* d -> its minimum image on the periodic axes */
+static inline void
+min_image (const double box[3], double d[3])
+{
+    for (int k = 0; k < 3; k++) {
+        if (box[k] > 0.0) {
+            d[k] -= box[k] * round(d[k] / box[k]);
+        }
+    }
+}
+
+/* cell index along axis k of coordinate x */
+static inline int
+cell_coord (const tn_nlist* list, int k, double x)
+{
+    double box = list->opt.box[k];
+    double u = x - list->cell_lo[k];
+    if (box > 0.0) {
+        u -= box * floor(u / box);
+    }
+    int c = (int)(u * list->cell_inv[k]);
+    // rounding at the upper edge
+    return c < 0 ? 0 : (c >= list->n_cell[k] ? list->n_cell[k] - 1 : c);
+}
+
+/* cell grid of edge >= cutoff + skin over the box or the bounding box */
+static void
+setup_cells (tn_nlist* list, const Vec_3D* pos)
+{
+    const long n = (long)list->n;
+    const double r_list = list->opt.cutoff + list->opt.skin;
+    double lo[3] = {INFINITY, INFINITY, INFINITY};
+    double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    #pragma omp parallel for reduction(min:lo[:3]) reduction(max:hi[:3]) if(list->n >= TN_NLIST_PARALLEL_MIN)
+    for (long i = 0; i < n; i++) {
+        lo[0] = fmin(lo[0], pos[i].x);
+        lo[1] = fmin(lo[1], pos[i].y);
+        lo[2] = fmin(lo[2], pos[i].z);
+        hi[0] = fmax(hi[0], pos[i].x);
+        hi[1] = fmax(hi[1], pos[i].y);
+        hi[2] = fmax(hi[2], pos[i].z);
+    }
+    double len[3];
+    for (int k = 0; k < 3; k++) {
+        if (list->opt.box[k] > 0.0) {
+            list->cell_lo[k] = 0.0;
+            len[k] = list->opt.box[k];
+        }
+        else {
+            list->cell_lo[k] = lo[k];
+            len[k] = fmax(hi[k] - lo[k], r_list);
+        }
+        double c = floor(len[k] / r_list);
+        list->n_cell[k] = c < 1.0 ? 1 : (c > 1024.0 ? 1024 : (int)c);
+    }
+    // sparse systems: fewer, larger cells
+    size_t max_cells = TN_NLIST_CELLS_PER_PARTICLE * list->n + 27;
+    while ((size_t)list->n_cell[0] * list->n_cell[1] * list->n_cell[2] > max_cells) {
+        int k_max = 0;
+        for (int k = 1; k < 3; k++) {
+            if (list->n_cell[k] > list->n_cell[k_max]) {
+                k_max = k;
+            }
+        }
+        list->n_cell[k_max] = (list->n_cell[k_max] + 1) / 2;
+    }
+    for (int k = 0; k < 3; k++) {
+        list->cell_inv[k] = list->n_cell[k] / len[k];
+    }
+    size_t n_cells = (size_t)list->n_cell[0] * list->n_cell[1] * list->n_cell[2];
+    if (n_cells + 1 > list->cap_cells) {
+        free(list->cell_start);
+        list->cell_start = malloc((n_cells + 1) * sizeof(size_t));
+        Null_exit_message(list->cell_start, "Memory allocation failed in tn_nlist_update!");
+        list->cap_cells = n_cells + 1;
+    }
+}
+
+/* distinct neighbouring cells (incl. c itself) of cell (cx, cy, cz) */
+static int
+neighbour_cells (const tn_nlist* list, const int cell[3], size_t out[27])
+{
+    int count = 0;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int c[3] = {cell[0] + dx, cell[1] + dy, cell[2] + dz};
+                int inside = 1;
+                for (int k = 0; k < 3; k++) {
+                    if (c[k] < 0 || c[k] >= list->n_cell[k]) {
+                        if (list->opt.box[k] > 0.0) {
+                            c[k] = (c[k] + list->n_cell[k]) % list->n_cell[k];
+                        }
+                        else {
+                            inside = 0;
+                        }
+                    }
+                }
+                if (!inside) {
+                    continue;
+                }
+                size_t index = ((size_t)c[2] * list->n_cell[1] + c[1]) * list->n_cell[0] + c[0];
+                // fewer than 3 cells along an axis: the same cell twice
+                int seen = 0;
+                for (int m = 0; m < count; m++) {
+                    seen |= out[m] == index;
+                }
+                if (!seen) {
+                    out[count++] = index;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+/* pairs j > i (sorted) within cutoff + skin of sorted particle i, stored
+ * to nbr if not NULL; returns their number */
+static size_t
+scan_neighbours (const tn_nlist* list, size_t i, size_t* nbr)
+{
+    const double r2_list = (list->opt.cutoff + list->opt.skin)
+                           * (list->opt.cutoff + list->opt.skin);
+    int cell[3];
+    cell[0] = cell_coord(list, 0, list->xs[i].x);
+    cell[1] = cell_coord(list, 1, list->xs[i].y);
+    cell[2] = cell_coord(list, 2, list->xs[i].z);
+    size_t cells[27];
+    int n_cells = neighbour_cells(list, cell, cells);
+    size_t count = 0;
+    for (int m = 0; m < n_cells; m++) {
+        size_t begin = list->cell_start[cells[m]];
+        size_t end = list->cell_start[cells[m] + 1];
+        if (begin <= i) {
+            begin = i + 1;
+        }
+        for (size_t j = begin; j < end; j++) {
+            double d[3] = {list->xs[j].x - list->xs[i].x,
+                           list->xs[j].y - list->xs[i].y,
+                           list->xs[j].z - list->xs[i].z};
+            min_image(list->opt.box, d);
+            if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] < r2_list) {
+                if (nbr) {
+                    nbr[count] = j;
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static void
+rebuild (tn_nlist* list, const Vec_3D* pos)
+{
+    const size_t n = list->n;
+    const long ln = (long)n;
+    setup_cells(list, pos);
+    size_t n_cells = (size_t)list->n_cell[0] * list->n_cell[1] * list->n_cell[2];
+
+    // counting sort by cell, stable: cell order is the new particle order
+    #pragma omp parallel for schedule(static) if(ln >= TN_NLIST_PARALLEL_MIN)
+    for (long i = 0; i < ln; i++) {
+        size_t cx = (size_t)cell_coord(list, 0, pos[i].x);
+        size_t cy = (size_t)cell_coord(list, 1, pos[i].y);
+        size_t cz = (size_t)cell_coord(list, 2, pos[i].z);
+        list->cell_of[i] = (cz * list->n_cell[1] + cy) * list->n_cell[0] + cx;
+    }
+    memset(list->cell_start, 0, (n_cells + 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; i++) {
+        list->cell_start[list->cell_of[i] + 1]++;
+    }
+    for (size_t c = 0; c < n_cells; c++) {
+        list->cell_start[c + 1] += list->cell_start[c];
+    }
+    // cell_start serves as fill position and is shifted back below
+    for (size_t i = 0; i < n; i++) {
+        size_t c = list->cell_of[i];
+        list->perm[list->cell_start[c]++] = i;
+    }
+    for (size_t c = n_cells; c > 0; c--) {
+        list->cell_start[c] = list->cell_start[c - 1];
+    }
+    list->cell_start[0] = 0;
+
+    #pragma omp parallel for schedule(static) if(ln >= TN_NLIST_PARALLEL_MIN)
+    for (long i = 0; i < ln; i++) {
+        list->xs[i] = pos[list->perm[i]];
+        list->ref[i] = pos[i];
+    }
+
+    // Verlet list: count, prefix sum, fill
+    #pragma omp parallel for schedule(dynamic, 256) if(ln >= TN_NLIST_PARALLEL_MIN)
+    for (long i = 0; i < ln; i++) {
+        list->start[i + 1] = scan_neighbours(list, (size_t)i, NULL);
+    }
+    list->start[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        list->start[i + 1] += list->start[i];
+    }
+    size_t n_pairs = list->start[n];
+    if (n_pairs > list->cap_nbr) {
+        free(list->nbr);
+        list->cap_nbr = n_pairs + n_pairs / 4 + 16;
+        list->nbr = malloc(list->cap_nbr * sizeof(size_t));
+        Null_exit_message(list->nbr, "Memory allocation failed in tn_nlist_update!");
+    }
+    #pragma omp parallel for schedule(dynamic, 256) if(ln >= TN_NLIST_PARALLEL_MIN)
+    for (long i = 0; i < ln; i++) {
+        scan_neighbours(list, (size_t)i, list->nbr + list->start[i]);
+    }
+    list->builds++;
+    list->valid = 1;
+}
+
+int
+tn_nlist_update (tn_nlist* list, const Vec_3D* pos)
+{
+    TN_PROFILE_BEGIN(tn_nlist_update);
+    if (!list || !pos) {
+        tp_raiseError("Null pointer in tn_nlist_update.");
+    }
+    int rebuilt = 0;
+    if (!list->valid) {
+        rebuild(list, pos);
+        rebuilt = 1;
+    }
+    else {
+        const long n = (long)list->n;
+        double max2 = 0.0;
+        #pragma omp parallel for reduction(max:max2) if(list->n >= TN_NLIST_PARALLEL_MIN)
+        for (long i = 0; i < n; i++) {
+            double d[3] = {pos[i].x - list->ref[i].x,
+                           pos[i].y - list->ref[i].y,
+                           pos[i].z - list->ref[i].z};
+            // wrapped coordinates count as the short way
+            min_image(list->opt.box, d);
+            max2 = fmax(max2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+        double half_skin = 0.5 * list->opt.skin;
+        if (max2 > half_skin * half_skin) {
+            rebuild(list, pos);
+            rebuilt = 1;
+        }
+    }
+    TN_PROFILE_END();
+    return rebuilt;
+}
+
+void
+tn_nlist_invalidate (tn_nlist* list)
+{
+    if (!list) {
+        tp_raiseError("Null pointer in tn_nlist_invalidate.");
+    }
+    list->valid = 0;
+}
+
+//-----------------------------------
+// forces
+//-----------------------------------
+
+double
+tn_nlist_forces (tn_nlist* list, const Vec_3D* pos, Vec_3D* force)
+{
+    TN_PROFILE_BEGIN(tn_nlist_forces);
+    if (!list || !pos || !force) {
+        tp_raiseError("Null pointer in tn_nlist_forces.");
+    }
+    if (!list->pair) {
+        tp_raiseError("tn_nlist_forces needs a pair function, see tn_nlist_set_pair.");
+    }
+    tn_nlist_update(list, pos);
+    const size_t n = list->n;
+    const long ln = (long)n;
+    int n_threads = 1;
+#ifdef _OPENMP
+    if (n >= TN_NLIST_PARALLEL_MIN) {
+        n_threads = omp_get_max_threads();
+    }
+#endif
+    if (n_threads > list->n_buf) {
+        free(list->buf);
+        list->buf = malloc((size_t)n_threads * n * sizeof(Vec_3D));
+        Null_exit_message(list->buf, "Memory allocation failed in tn_nlist_forces!");
+        list->n_buf = n_threads;
+    }
+    const double rc2 = list->opt.cutoff * list->opt.cutoff;
+    PAIR_FUNC* pair = list->pair;
+    void* params = list->pair_params;
+    double energy = 0.0;
+    size_t calls = 0;
+
+    #pragma omp parallel num_threads(n_threads) reduction(+:energy, calls)
+    {
+        // the team may be smaller than n_threads (e.g. nested in a parallel
+        // region), only its buffers are zeroed and summed
+        int t = 0;
+        int nt = 1;
+#ifdef _OPENMP
+        t = omp_get_thread_num();
+        nt = omp_get_num_threads();
+#endif
+        Vec_3D* f = list->buf + (size_t)t * n;
+        memset(f, 0, n * sizeof(Vec_3D));
+        // current positions in the sorted order of the last rebuild
+        #pragma omp for schedule(static)
+        for (long i = 0; i < ln; i++) {
+            list->xs[i] = pos[list->perm[i]];
+        }
+        #pragma omp for schedule(dynamic, 128)
+        for (long i = 0; i < ln; i++) {
+            const Vec_3D xi = list->xs[i];
+            double fx = 0.0;
+            double fy = 0.0;
+            double fz = 0.0;
+            for (size_t k = list->start[i]; k < list->start[i + 1]; k++) {
+                size_t j = list->nbr[k];
+                double d[3] = {xi.x - list->xs[j].x, xi.y - list->xs[j].y, xi.z - list->xs[j].z};
+                min_image(list->opt.box, d);
+                double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                if (r2 >= rc2) {
+                    continue;
+                }
+                double f_r;
+                energy += pair(r2, &f_r, params);
+                calls++;
+                fx += f_r * d[0];
+                fy += f_r * d[1];
+                fz += f_r * d[2];
+                f[j].x -= f_r * d[0];
+                f[j].y -= f_r * d[1];
+                f[j].z -= f_r * d[2];
+            }
+            f[i].x += fx;
+            f[i].y += fy;
+            f[i].z += fz;
+        }
+        // implicit barrier: all buffers complete
+        #pragma omp for schedule(static)
+        for (long i = 0; i < ln; i++) {
+            Vec_3D sum = list->buf[i];
+            for (int u = 1; u < nt; u++) {
+                const Vec_3D* b = list->buf + (size_t)u * n + i;
+                sum.x += b->x;
+                sum.y += b->y;
+                sum.z += b->z;
+            }
+            force[list->perm[i]] = sum;
+        }
+    }
+    TN_PROFILE_CALLBACKS(calls);
+    list->energy = energy;
+    TN_PROFILE_END();
+    return energy;
+}
+
+void
+tn_nlist_ode_func (double t __attribute__((unused)), const double y[], double dy[],
+                   void* params)
+{
+    tn_nlist* list = params;
+    size_t n3 = 3 * list->n;
+    Vec_3D* acc = (Vec_3D*)(dy + n3);
+    tn_nlist_forces(list, (const Vec_3D*)y, acc);
+    memcpy(dy, y + n3, n3 * sizeof(double));
+    if (list->mass) {
+        for (size_t i = 0; i < list->n; i++) {
+            acc[i].x /= list->mass[i];
+            acc[i].y /= list->mass[i];
+            acc[i].z /= list->mass[i];
+        }
+    }
+}
+
+double
+tn_pair_lennard_jones (double r2, double* f, void* params)
+{
+    const tn_lj_params* p = params;
+    double s2 = p->sigma * p->sigma;
+    double x6 = s2 / r2;
+    x6 = x6 * x6 * x6;
+    double xc6 = s2 / (p->cutoff * p->cutoff);
+    xc6 = xc6 * xc6 * xc6;
+    // -U'(r) / r, potential shifted to 0 at the cutoff
+    *f = 24.0 * p->epsilon * x6 * (2.0 * x6 - 1.0) / r2;
+    return 4.0 * p->epsilon * (x6 * (x6 - 1.0) - xc6 * (xc6 - 1.0));
+}
@@ -5,6 +5,7 @@ tn_euler_step (double t, double dt,
                double* y, ODE_FUNC ode_func,
                int dim, void *params)
 {
+    TN_PROFILE_BEGIN(tn_euler_step);
     double* dy = (double *) malloc(dim * sizeof(double));
     exit_if_NULL (dy);
     
@@ -17,6 +18,8 @@ tn_euler_step (double t, double dt,
     }
 
     free(dy);
+    TN_PROFILE_CALLBACKS(1);
+    TN_PROFILE_END();
 }
 
 void
@@ -24,6 +27,7 @@ tn_rk2_step(double t, double dt,
             double* y, ODE_FUNC ode_func,
             int dim, void *params)
 {
+    TN_PROFILE_BEGIN(tn_rk2_step);
     double* dy = (double *) malloc(dim * sizeof(double));
     exit_if_NULL (dy);
 
@@ -47,6 +51,8 @@ tn_rk2_step(double t, double dt,
 
     free(dy);
     free(sup);
+    TN_PROFILE_CALLBACKS(2);
+    TN_PROFILE_END();
 }
 
 void
@@ -55,6 +61,7 @@ tn_rk4_step (double t, double dt,
              ODE_FUNC ode_func, int dim,
              void *params)
 {
+    TN_PROFILE_BEGIN(tn_rk4_step);
     /* allocate kArray before applying this function using:
      * double* kArray = (double *) malloc(5 * dim * sizeof(double)); */
     double* k1 = kArray + 0 * dim;
@@ -89,6 +96,8 @@ tn_rk4_step (double t, double dt,
     for (int i = 0; i < dim; i++) {
         y[i] += (dt/ 6.0) * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
     }
+    TN_PROFILE_CALLBACKS(4);
+    TN_PROFILE_END();
 }
 
 void
@@ -96,6 +105,7 @@ tn_vv_step (double t, double dt,
             double* y, ODE_FUNC ode_func,
             int dim, void *params)
 {
+    TN_PROFILE_BEGIN(tn_vv_step);
     double* dy = (double *) malloc(dim * sizeof(double));
     exit_if_NULL(dy);
 
@@ -125,4 +135,6 @@ tn_vv_step (double t, double dt,
 
     free(dy_next);
     free(dy);
+    TN_PROFILE_CALLBACKS(2);
+    TN_PROFILE_END();
 }
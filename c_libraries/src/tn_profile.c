@@ -0,0 +1,157 @@
+#include "t_numerics_intern.h"
+
+//================================================================================
+//    profiling
+//================================================================================
+
+/* Each thread writes only into its own buffer (no locks or atomics in the hot
+ * path). Buffers are registered in a global list so that they survive the
+ * thread and can be merged into one report at exit. */
+
+#ifdef TN_PROFILE
+
+#include <pthread.h>
+#include <time.h>
+
+static const char* tn_prof_names[TN_PROF_COUNT] = {
+    #define TN_PROFILE_NAME(name) #name,
+    TN_PROFILE_KERNELS(TN_PROFILE_NAME)
+    #undef TN_PROFILE_NAME
+};
+
+typedef struct tn_prof_node {
+    tn_prof_record records[TN_PROF_COUNT];
+    struct tn_prof_node* next;
+} tn_prof_node;
+
+_Thread_local tn_prof_record* tn_prof_tls = NULL;
+
+static tn_prof_node* tn_prof_head = NULL;
+static size_t tn_prof_nthreads = 0;
+static pthread_mutex_t tn_prof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+tn_prof_atexit (void)
+{
+    tn_profile_write_report (NULL);
+}
+
+uint64_t
+tn_prof_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+tn_prof_record*
+tn_prof_thread_buffer_alloc (void)
+{
+    tn_prof_node* node = calloc(1, sizeof(tn_prof_node));
+    Null_exit_message(node, "Memory allocation failed in tn_prof_thread_buffer_alloc!");
+
+    pthread_mutex_lock(&tn_prof_lock);
+    // first buffer of the process registers the report at exit
+    if (tn_prof_head == NULL) {
+        atexit(tn_prof_atexit);
+    }
+    node->next = tn_prof_head;
+    tn_prof_head = node;
+    tn_prof_nthreads++;
+    pthread_mutex_unlock(&tn_prof_lock);
+
+    tn_prof_tls = node->records;
+    return tn_prof_tls;
+}
+
+void
+tn_profile_reset (void)
+{
+    pthread_mutex_lock(&tn_prof_lock);
+    for (tn_prof_node* node = tn_prof_head; node; node = node->next) {
+        memset(node->records, 0, sizeof(node->records));
+    }
+    pthread_mutex_unlock(&tn_prof_lock);
+}
+
+void
+tn_profile_write_report (const char* path)
+{
+    if (!path) {
+        path = getenv("TN_PROFILE_OUTPUT");
+    }
+    if (!path || path[0] == '\0') {
+        path = "tn_profile.json";
+    }
+
+    // merge per-thread buffers
+    tn_prof_record total[TN_PROF_COUNT];
+    memset(total, 0, sizeof(total));
+    pthread_mutex_lock(&tn_prof_lock);
+    size_t nthreads = tn_prof_nthreads;
+    for (tn_prof_node* node = tn_prof_head; node; node = node->next) {
+        for (int k = 0; k < TN_PROF_COUNT; k++) {
+            total[k].calls += node->records[k].calls;
+            total[k].callbacks += node->records[k].callbacks;
+            total[k].ns += node->records[k].ns;
+        }
+    }
+    pthread_mutex_unlock(&tn_prof_lock);
+
+    FILE* file = fopen(path, "w");
+    if (Null_message(file, "Could not open file for profiling report.")) {
+        return;
+    }
+
+    // format is chosen by file ending: *.csv --> CSV, everything else JSON
+    size_t len = strlen(path);
+    int csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+
+    if (csv) {
+        fprintf(file, "name,calls,callback_evals,total_ns,mean_ns\n");
+    } else {
+        fprintf(file, "{\n  \"unit\": \"ns\",\n  \"threads\": %zu,\n"
+            "  \"kernels\": [", nthreads);
+    }
+    int first = 1;
+    for (int k = 0; k < TN_PROF_COUNT; k++) {
+        if (total[k].calls == 0) {
+            continue;
+        }
+        double mean = (double) total[k].ns / (double) total[k].calls;
+        if (csv) {
+            fprintf(file, "%s,%llu,%llu,%llu,%.1f\n", tn_prof_names[k],
+                (unsigned long long) total[k].calls,
+                (unsigned long long) total[k].callbacks,
+                (unsigned long long) total[k].ns, mean);
+        } else {
+            fprintf(file, "%s\n    {\"name\": \"%s\", \"calls\": %llu, "
+                "\"callback_evals\": %llu, \"total_ns\": %llu, \"mean_ns\": %.1f}",
+                first ? "" : ",", tn_prof_names[k],
+                (unsigned long long) total[k].calls,
+                (unsigned long long) total[k].callbacks,
+                (unsigned long long) total[k].ns, mean);
+        }
+        first = 0;
+    }
+    if (!csv) {
+        fprintf(file, "\n  ]\n}\n");
+    }
+    fclose(file);
+}
+
+#else
+
+void
+tn_profile_reset (void)
+{
+}
+
+void
+tn_profile_write_report (__attribute__((unused)) const char* path)
+{
+    tp_raiseWarning ("tlib was built without profiling (PROFILE=1). "
+        "No report is written.\n");
+}
+
+#endif
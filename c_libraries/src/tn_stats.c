@@ -1,26 +1,40 @@
 #include "t_numerics_intern.h"
 
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// arrays shorter than this are accumulated by one thread
+#define TN_STATS_PARALLEL_MIN 65536
+
 //################################################################################
 // stochastic
 
 int
 tn_binomialCoeff (const unsigned int n, const unsigned int k)
 {
+    TN_PROFILE_BEGIN(tn_binomialCoeff);
+    int result;
     if (k > n) {
         tp_raiseWarning ("In binomial coefficient k should not be greater than n. "
             "0 is returned.\n  But you might want to check your calculations.\n");
-        return 0;
+        result = 0;
     }
-
     // base conditions
-    if (k == 0 || k == n)
-        return 1;
+    else if (k == 0 || k == n)
+        result = 1;
 
-    if (k == 1 || k == n - 1)
-        return n;
+    else if (k == 1 || k == n - 1)
+        result = n;
 
     // recursively add the value 
-    return tn_binomialCoeff (n - 1, k - 1) + tn_binomialCoeff (n - 1, k);
+    else
+        result = tn_binomialCoeff (n - 1, k - 1) + tn_binomialCoeff (n - 1, k);
+
+    TN_PROFILE_END();
+    return result;
 }
 
 // probability distributions
@@ -28,31 +42,41 @@ tn_binomialCoeff (const unsigned int n, const unsigned int k)
 double
 tn_binomial_distribution (int k, const unsigned int n, const double p)
 {
-    return tn_binomialCoeff (n, k) * pow(p, k) * pow(1 - p, n - k);
+    TN_PROFILE_BEGIN(tn_binomial_distribution);
+    double prob = tn_binomialCoeff (n, k) * pow(p, k) * pow(1 - p, n - k);
+    TN_PROFILE_END();
+    return prob;
 }
 
 double
 tn_normal_distribution (double x, void *params)
 {
+    TN_PROFILE_BEGIN(tn_normal_distribution);
     double *array = (double *)params;
     double mu = array[0];
     double sigma = array[1];
-    return (1.0 / (sigma * sqrt(2.0 * M_PI))) * exp(-0.5 * ((x - mu) / sigma)
-            * ((x - mu) / sigma));
+    double prob = (1.0 / (sigma * sqrt(2.0 * M_PI))) * exp(-0.5 * ((x - mu) / sigma)
+                  * ((x - mu) / sigma));
+    TN_PROFILE_END();
+    return prob;
 }
 
 double
 tn_cumulative_distr (double x, void *params)
 {
+    TN_PROFILE_BEGIN(tn_cumulative_distr);
     double *array = (double *)params;
     double mu = array[0];
     double sigma = array[1];
-    return 0.5 * (1 + erf((x - mu) / (sigma * sqrt(2))));
+    double prob = 0.5 * (1 + erf((x - mu) / (sigma * sqrt(2))));
+    TN_PROFILE_END();
+    return prob;
 }
 
 t_array*
 tn_rand_alloc (int n, double sigma, int seed)
 {
+    TN_PROFILE_BEGIN(tn_rand_alloc);
     t_array* p = t_array_alloc(n);
 
     gsl_rng *r;
@@ -68,5 +92,868 @@ tn_rand_alloc (int n, double sigma, int seed)
         p->ptr[i] = gsl_ran_gaussian (r, sigma);
     }
     gsl_rng_free(r);
+    TN_PROFILE_END();
     return p;
 }
+
+//--------------------------------------------------------------------------------
+// streaming moments (Welford / Pébay)
+
+/* Central moment sums M_k = sum (x - mean)^k are updated per sample and can be
+ * merged exactly, so threads or chunks accumulate independently and combine
+ * their results afterwards without ever storing the series. */
+
+void
+tn_moments_init (tn_moments* m)
+{
+    m->n = 0;
+    m->mean = 0.0;
+    m->m2 = 0.0;
+    m->m3 = 0.0;
+    m->m4 = 0.0;
+    m->min = INFINITY;
+    m->max = -INFINITY;
+}
+
+void
+tn_moments_add (tn_moments* m, double x)
+{
+    double n1 = (double)m->n;
+    double n = n1 + 1.0;
+    double delta = x - m->mean;
+    double dn = delta / n;
+    double dn2 = dn * dn;
+    double term = delta * dn * n1;
+
+    m->mean += dn;
+    m->m4 += term * dn2 * (n * n - 3.0 * n + 3.0)
+             + 6.0 * dn2 * m->m2 - 4.0 * dn * m->m3;
+    m->m3 += term * dn * (n - 2.0) - 3.0 * dn * m->m2;
+    m->m2 += term;
+    m->n++;
+    if (x < m->min) m->min = x;
+    if (x > m->max) m->max = x;
+}
+
+void
+tn_moments_merge (tn_moments* dest, const tn_moments* src)
+{
+    if (src->n == 0) {
+        return;
+    }
+    if (dest->n == 0) {
+        *dest = *src;
+        return;
+    }
+    double na = (double)dest->n;
+    double nb = (double)src->n;
+    double n = na + nb;
+    double delta = src->mean - dest->mean;
+    double d2 = delta * delta;
+
+    double m2 = dest->m2 + src->m2 + d2 * na * nb / n;
+    double m3 = dest->m3 + src->m3
+                + d2 * delta * na * nb * (na - nb) / (n * n)
+                + 3.0 * delta * (na * src->m2 - nb * dest->m2) / n;
+    double m4 = dest->m4 + src->m4
+                + d2 * d2 * na * nb * (na * na - na * nb + nb * nb) / (n * n * n)
+                + 6.0 * d2 * (na * na * src->m2 + nb * nb * dest->m2) / (n * n)
+                + 4.0 * delta * (na * src->m3 - nb * dest->m3) / n;
+
+    dest->mean += delta * nb / n;
+    dest->m2 = m2;
+    dest->m3 = m3;
+    dest->m4 = m4;
+    dest->n += src->n;
+    if (src->min < dest->min) dest->min = src->min;
+    if (src->max > dest->max) dest->max = src->max;
+}
+
+void
+tn_moments_add_t_array (tn_moments* m, const t_array* a)
+{
+    TN_PROFILE_BEGIN(tn_moments_add_t_array);
+    const double* x = a->ptr;
+    size_t len = a->len;
+    tn_moments total;
+    tn_moments_init(&total);
+
+#ifdef _OPENMP
+    if (len >= TN_STATS_PARALLEL_MIN) {
+        // one accumulator per thread, merged in thread order afterwards so
+        // that the result does not depend on the scheduling
+        int n_threads = omp_get_max_threads();
+        tn_moments* part = malloc(n_threads * sizeof(tn_moments));
+        Null_exit_message(part, "Memory allocation failed in tn_moments_add_t_array!");
+
+        #pragma omp parallel num_threads(n_threads)
+        {
+            int id = omp_get_thread_num();
+            int nt = omp_get_num_threads();
+            size_t lo = len * id / nt;
+            size_t hi = len * (id + 1) / nt;
+            tn_moments_init(&part[id]);
+            for (size_t i = lo; i < hi; i++) {
+                tn_moments_add(&part[id], x[i]);
+            }
+            if (id == 0) {
+                for (int t = nt; t < n_threads; t++) {
+                    tn_moments_init(&part[t]);
+                }
+            }
+        }
+        for (int t = 0; t < n_threads; t++) {
+            tn_moments_merge(&total, &part[t]);
+        }
+        free(part);
+    }
+    else
+#endif
+    {
+        for (size_t i = 0; i < len; i++) {
+            tn_moments_add(&total, x[i]);
+        }
+    }
+    tn_moments_merge(m, &total);
+    TN_PROFILE_END();
+}
+
+double
+tn_moments_mean (const tn_moments* m)
+{
+    return m->n ? m->mean : NAN;
+}
+
+double
+tn_moments_variance (const tn_moments* m)
+{
+    return m->n > 1 ? m->m2 / (double)(m->n - 1) : NAN;
+}
+
+double
+tn_moments_std_error (const tn_moments* m)
+{
+    return m->n > 1 ? sqrt(tn_moments_variance(m) / (double)m->n) : NAN;
+}
+
+double
+tn_moments_skewness (const tn_moments* m)
+{
+    if (m->n < 2 || m->m2 == 0.0) {
+        return NAN;
+    }
+    return sqrt((double)m->n) * m->m3 / pow(m->m2, 1.5);
+}
+
+double
+tn_moments_kurtosis (const tn_moments* m)
+{
+    if (m->n < 2 || m->m2 == 0.0) {
+        return NAN;
+    }
+    return (double)m->n * m->m4 / (m->m2 * m->m2) - 3.0;
+}
+
+//--------------------------------------------------------------------------------
+// histograms
+
+struct tn_histogram {
+    size_t n_bins;
+    int log_bins;
+    double lo;
+    double hi;
+    double offset;        // lo or log(lo)
+    double scale;         // bins per unit of x or log(x)
+    double* counts;       // (weighted) counts per bin
+    double underflow;
+    double overflow;
+    double total;         // sum of all weights incl. under-/overflow
+};
+
+tn_histogram*
+tn_histogram_alloc (double lo, double hi, size_t n_bins, int log_bins)
+{
+    if (n_bins == 0 || !(hi > lo)) {
+        tp_raiseError("tn_histogram_alloc needs n_bins > 0 and hi > lo!");
+    }
+    if (log_bins && !(lo > 0.0)) {
+        tp_raiseError("Logarithmic bins of tn_histogram need lo > 0!");
+    }
+    tn_histogram* h = malloc(sizeof(tn_histogram));
+    Null_exit_message(h, "Memory allocation failed in tn_histogram_alloc!");
+    h->counts = malloc(n_bins * sizeof(double));
+    Null_exit_message(h->counts, "Memory allocation failed in tn_histogram_alloc!");
+
+    h->n_bins = n_bins;
+    h->log_bins = log_bins ? 1 : 0;
+    h->lo = lo;
+    h->hi = hi;
+    h->offset = log_bins ? log(lo) : lo;
+    h->scale = n_bins / (log_bins ? log(hi) - log(lo) : hi - lo);
+    tn_histogram_reset(h);
+    return h;
+}
+
+void
+tn_histogram_free (tn_histogram* h)
+{
+    if (!h) {
+        return;
+    }
+    free(h->counts);
+    free(h);
+}
+
+void
+tn_histogram_reset (tn_histogram* h)
+{
+    memset(h->counts, 0, h->n_bins * sizeof(double));
+    h->underflow = 0.0;
+    h->overflow = 0.0;
+    h->total = 0.0;
+}
+
+void
+tn_histogram_add_weighted (tn_histogram* h, double x, double w)
+{
+    h->total += w;
+    if (x < h->lo) {
+        h->underflow += w;
+        return;
+    }
+    if (x >= h->hi) {
+        h->overflow += w;
+        return;
+    }
+    double u = h->log_bins ? log(x) : x;
+    size_t i = (size_t)((u - h->offset) * h->scale);
+    // rounding right below hi
+    if (i >= h->n_bins) {
+        i = h->n_bins - 1;
+    }
+    h->counts[i] += w;
+}
+
+void
+tn_histogram_add (tn_histogram* h, double x)
+{
+    tn_histogram_add_weighted(h, x, 1.0);
+}
+
+void
+tn_histogram_add_t_array (tn_histogram* h, const t_array* a)
+{
+    TN_PROFILE_BEGIN(tn_histogram_add_t_array);
+    for (size_t i = 0; i < a->len; i++) {
+        tn_histogram_add_weighted(h, a->ptr[i], 1.0);
+    }
+    TN_PROFILE_END();
+}
+
+void
+tn_histogram_merge (tn_histogram* dest, const tn_histogram* src)
+{
+    if (dest->n_bins != src->n_bins || dest->log_bins != src->log_bins
+        || dest->lo != src->lo || dest->hi != src->hi) {
+        tp_raiseError("Only histograms with identical bins can be merged!");
+    }
+    for (size_t i = 0; i < dest->n_bins; i++) {
+        dest->counts[i] += src->counts[i];
+    }
+    dest->underflow += src->underflow;
+    dest->overflow += src->overflow;
+    dest->total += src->total;
+}
+
+size_t
+tn_histogram_n_bins (const tn_histogram* h)
+{
+    return h->n_bins;
+}
+
+double
+tn_histogram_edge (const tn_histogram* h, size_t i)
+{
+    if (i > h->n_bins) {
+        tp_raiseError("Index of histogram edge out of range!");
+    }
+    if (i == h->n_bins) {
+        return h->hi;
+    }
+    double u = h->offset + (double)i / h->scale;
+    return h->log_bins ? exp(u) : u;
+}
+
+double
+tn_histogram_count (const tn_histogram* h, size_t i)
+{
+    if (i >= h->n_bins) {
+        tp_raiseError("Index of histogram bin out of range!");
+    }
+    return h->counts[i];
+}
+
+double
+tn_histogram_density (const tn_histogram* h, size_t i)
+{
+    double width = tn_histogram_edge(h, i + 1) - tn_histogram_edge(h, i);
+    return h->total > 0.0 ? tn_histogram_count(h, i) / (h->total * width) : 0.0;
+}
+
+double
+tn_histogram_underflow (const tn_histogram* h)
+{
+    return h->underflow;
+}
+
+double
+tn_histogram_overflow (const tn_histogram* h)
+{
+    return h->overflow;
+}
+
+double
+tn_histogram_total (const tn_histogram* h)
+{
+    return h->total;
+}
+
+//--------------------------------------------------------------------------------
+// quantiles by selection
+
+/* Moves the k-th smallest element of a[lo..hi] to position k with all smaller
+ * ones before and all larger ones behind it (Hoare/Wirth), expected O(n). */
+static void
+select_kth (double* a, size_t lo, size_t hi, size_t k)
+{
+    while (lo < hi) {
+        // median of three as pivot, protects against (reversed) sorted input
+        size_t mid = lo + (hi - lo) / 2;
+        double x = a[mid];
+        if ((a[lo] < x) != (a[lo] < a[hi])) x = a[lo];
+        else if ((a[hi] < x) != (a[hi] < a[lo])) x = a[hi];
+
+        size_t i = lo;
+        size_t j = hi;
+        while (i <= j) {
+            while (a[i] < x) i++;
+            while (x < a[j]) j--;
+            if (i <= j) {
+                double tmp = a[i];
+                a[i] = a[j];
+                a[j] = tmp;
+                i++;
+                if (j == 0) break;
+                j--;
+            }
+        }
+        if (j < k) lo = i;
+        if (k < i) hi = j;
+    }
+}
+
+/* quantile of a[from..n-1] if elements before from are known to be smaller */
+static double
+quantile_ptr (double* a, size_t n, size_t from, double q)
+{
+    double h = (n - 1) * q;
+    size_t k = (size_t)h;
+    double frac = h - (double)k;
+    if (k < from) {
+        k = from;
+        frac = 0.0;
+    }
+    select_kth(a, from, n - 1, k);
+    double value = a[k];
+    if (frac > 0.0 && k + 1 < n) {
+        // next order statistic is the minimum of the upper partition
+        double next = a[k + 1];
+        for (size_t i = k + 2; i < n; i++) {
+            if (a[i] < next) next = a[i];
+        }
+        value += frac * (next - value);
+    }
+    return value;
+}
+
+double
+tn_quantile (t_array* data, double q)
+{
+    TN_PROFILE_BEGIN(tn_quantile);
+    if (data->len == 0 || !(q >= 0.0 && q <= 1.0)) {
+        tp_raiseError("tn_quantile needs data and 0 <= q <= 1!");
+    }
+    double value = quantile_ptr(data->ptr, data->len, 0, q);
+    TN_PROFILE_END();
+    return value;
+}
+
+double
+tn_median (t_array* data)
+{
+    return tn_quantile(data, 0.5);
+}
+
+void
+tn_quantiles (t_array* data, const t_array* q, t_array* out)
+{
+    TN_PROFILE_BEGIN(tn_quantiles);
+    if (data->len == 0 || q->len != out->len) {
+        tp_raiseError("tn_quantiles needs data and len(q) == len(out)!");
+    }
+    size_t n = data->len;
+    size_t from = 0;
+    double q_prev = 0.0;
+    for (size_t i = 0; i < q->len; i++) {
+        double qi = q->ptr[i];
+        if (!(qi >= 0.0 && qi <= 1.0)) {
+            tp_raiseError("tn_quantiles needs 0 <= q <= 1!");
+        }
+        // for ascending q only the part above the last selection is searched
+        if (qi < q_prev) {
+            from = 0;
+        }
+        out->ptr[i] = quantile_ptr(data->ptr, n, from, qi);
+        from = (size_t)((n - 1) * qi);
+        q_prev = qi;
+    }
+    TN_PROFILE_END();
+}
+
+//--------------------------------------------------------------------------------
+// binning analysis
+
+/* Level l holds the moments of the means of 2^l consecutive samples. Every
+ * sample touches at most all levels once, so the series itself is never kept.
+ * For correlated data the error of the mean grows with l until the bins are
+ * longer than the autocorrelation time and then settles on a plateau. */
+
+struct tn_binning {
+    size_t n_levels;
+    tn_moments* levels;
+    double* pending;      // first half of the next bin of every level
+    unsigned char* has_pending;
+};
+
+tn_binning*
+tn_binning_alloc (size_t n_levels)
+{
+    if (n_levels == 0) {
+        tp_raiseError("tn_binning_alloc needs at least one level!");
+    }
+    tn_binning* b = malloc(sizeof(tn_binning));
+    Null_exit_message(b, "Memory allocation failed in tn_binning_alloc!");
+    b->levels = malloc(n_levels * sizeof(tn_moments));
+    b->pending = malloc(n_levels * sizeof(double));
+    b->has_pending = malloc(n_levels);
+    if (!b->levels || !b->pending || !b->has_pending) {
+        tp_raiseError("Memory allocation failed in tn_binning_alloc!");
+    }
+    b->n_levels = n_levels;
+    tn_binning_reset(b);
+    return b;
+}
+
+void
+tn_binning_free (tn_binning* b)
+{
+    if (!b) {
+        return;
+    }
+    free(b->levels);
+    free(b->pending);
+    free(b->has_pending);
+    free(b);
+}
+
+void
+tn_binning_reset (tn_binning* b)
+{
+    for (size_t l = 0; l < b->n_levels; l++) {
+        tn_moments_init(&b->levels[l]);
+    }
+    memset(b->has_pending, 0, b->n_levels);
+}
+
+void
+tn_binning_add (tn_binning* b, double x)
+{
+    for (size_t l = 0; l < b->n_levels; l++) {
+        tn_moments_add(&b->levels[l], x);
+        if (!b->has_pending[l]) {
+            b->pending[l] = x;
+            b->has_pending[l] = 1;
+            return;
+        }
+        x = 0.5 * (b->pending[l] + x);
+        b->has_pending[l] = 0;
+    }
+}
+
+void
+tn_binning_add_t_array (tn_binning* b, const t_array* a)
+{
+    TN_PROFILE_BEGIN(tn_binning_add_t_array);
+    for (size_t i = 0; i < a->len; i++) {
+        tn_binning_add(b, a->ptr[i]);
+    }
+    TN_PROFILE_END();
+}
+
+size_t
+tn_binning_n_levels (const tn_binning* b)
+{
+    return b->n_levels;
+}
+
+static void
+check_level (const tn_binning* b, size_t level)
+{
+    if (level >= b->n_levels) {
+        tp_raiseError("Level of tn_binning out of range!");
+    }
+}
+
+size_t
+tn_binning_count (const tn_binning* b, size_t level)
+{
+    check_level(b, level);
+    return b->levels[level].n;
+}
+
+double
+tn_binning_mean (const tn_binning* b)
+{
+    return tn_moments_mean(&b->levels[0]);
+}
+
+double
+tn_binning_error (const tn_binning* b, size_t level)
+{
+    check_level(b, level);
+    return tn_moments_std_error(&b->levels[level]);
+}
+
+double
+tn_binning_tau_int (const tn_binning* b, size_t level)
+{
+    double ratio = tn_binning_error(b, level) / tn_binning_error(b, 0);
+    return 0.5 * ratio * ratio;
+}
+
+size_t
+tn_binning_plateau (const tn_binning* b, size_t min_bins)
+{
+    size_t level = 0;
+    for (size_t l = 1; l < b->n_levels; l++) {
+        if (b->levels[l].n < min_bins || b->levels[l].n < 2) {
+            break;
+        }
+        level = l;
+    }
+    return level;
+}
+
+//--------------------------------------------------------------------------------
+// autocorrelation
+
+/* rho(t) for t < m of x[0..n-1] by Wiener-Khinchin: |FFT|^2 of the zero padded
+ * (against circular wrap) centred series transformed back */
+static void
+autocorr_ptr (const double* x, size_t n, double* rho, size_t m)
+{
+    size_t len = 1;
+    while (len < 2 * n) {
+        len <<= 1;
+    }
+    double complex* buf = calloc(len, sizeof(double complex));
+    Null_exit_message(buf, "Memory allocation failed in tn_autocorr!");
+
+    double mean = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        mean += x[i];
+    }
+    mean /= (double)n;
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = x[i] - mean;
+    }
+    tn_fft(buf, len, -1);
+    for (size_t i = 0; i < len; i++) {
+        double re = creal(buf[i]);
+        double im = cimag(buf[i]);
+        buf[i] = re * re + im * im;
+    }
+    tn_fft(buf, len, 1);
+
+    double c0 = creal(buf[0]);
+    if (c0 <= 0.0) {
+        tp_raiseWarning("Series of tn_autocorr is constant, rho(t > 0) = 0.\n");
+    }
+    rho[0] = 1.0;
+    for (size_t t = 1; t < m; t++) {
+        rho[t] = c0 > 0.0 ? creal(buf[t]) / c0 : 0.0;
+    }
+    free(buf);
+}
+
+void
+tn_autocorr (const t_array* series, t_array* acf)
+{
+    TN_PROFILE_BEGIN(tn_autocorr);
+    if (series->len == 0 || acf->len > series->len) {
+        tp_raiseError("tn_autocorr needs 0 < len(acf) <= len(series)!");
+    }
+    autocorr_ptr(series->ptr, series->len, acf->ptr, acf->len);
+    TN_PROFILE_END();
+}
+
+double
+tn_tau_int (const t_array* series, double c, size_t* window)
+{
+    TN_PROFILE_BEGIN(tn_tau_int);
+    size_t n = series->len;
+    if (n < 2) {
+        tp_raiseError("tn_tau_int needs at least two samples!");
+    }
+    double* rho = malloc(n * sizeof(double));
+    Null_exit_message(rho, "Memory allocation failed in tn_tau_int!");
+    autocorr_ptr(series->ptr, n, rho, n);
+
+    // self-consistent window W >= c * tau_int(W) (Sokal)
+    double tau = 0.5;
+    size_t w = 1;
+    for (; w < n; w++) {
+        tau += rho[w];
+        if ((double)w >= c * tau) {
+            break;
+        }
+    }
+    if (w == n) {
+        w = n - 1;
+        tp_raiseWarning("No window found in tn_tau_int, series too short.\n");
+    }
+    if (window) {
+        *window = w;
+    }
+    free(rho);
+    TN_PROFILE_END();
+    return tau;
+}
+
+//--------------------------------------------------------------------------------
+// bootstrap and jackknife
+
+/* Every replica draws from its own random stream, seeded from (seed, replica),
+ * so the results do not depend on the number of threads or the scheduling.
+ * Each thread allocates its index and sample buffers once and reuses them for
+ * all of its replicas. Correlated series are resampled in blocks of block_len
+ * records (moving block bootstrap, leave-one-block-out jackknife). */
+
+tn_resample_options
+tn_resample_default_options (void)
+{
+    tn_resample_options opt = {
+        .n_replicas = 1000,
+        .block_len = 1,
+        .confidence = 0.6827,
+        .seed = 0,
+        .n_threads = 0
+    };
+    return opt;
+}
+
+/* splitmix64, cheap to seed per replica and good enough to draw indices */
+static inline uint64_t
+stream_next (uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t
+stream_seed (uint64_t seed, uint64_t replica)
+{
+    uint64_t state = seed ^ (replica * 0xd1b54a32d192ed03ULL);
+    return stream_next(&state);
+}
+
+/* z with Phi(z) = p, bisection on erfc (only called a few times) */
+static double
+normal_quantile (double p)
+{
+    double lo = -40.0;
+    double hi = 40.0;
+    for (int i = 0; i < 200 && hi - lo > 1e-14; i++) {
+        double mid = 0.5 * (lo + hi);
+        if (0.5 * erfc(-mid / M_SQRT2) < p) lo = mid;
+        else hi = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+#ifdef _OPENMP
+static int
+resample_threads (const tn_resample_options* opt)
+{
+    return opt->n_threads > 0 ? opt->n_threads : omp_get_max_threads();
+}
+#endif
+
+static size_t
+resample_records (const t_array* data, size_t dim, size_t block_len)
+{
+    if (dim == 0 || data->len == 0 || data->len % dim != 0) {
+        tp_raiseError("Length of resampled data has to be a multiple of dim > 0!");
+    }
+    size_t n = data->len / dim;
+    if (block_len == 0 || block_len > n) {
+        tp_raiseError("block_len of resampling has to be in [1, number of records]!");
+    }
+    return n;
+}
+
+void
+tn_bootstrap (ESTIMATOR_FUNC estimator, const t_array* data, size_t dim,
+              void* params, const tn_resample_options* opt,
+              t_array* replicas, tn_resample_result* result)
+{
+    TN_PROFILE_BEGIN(tn_bootstrap);
+    tn_resample_options defaults = tn_resample_default_options();
+    if (!opt) {
+        opt = &defaults;
+    }
+    const size_t b = opt->block_len;
+    const size_t n = resample_records(data, dim, b);
+    const size_t n_rep = opt->n_replicas;
+    if (n_rep < 2 || (replicas && replicas->len != n_rep)) {
+        tp_raiseError("tn_bootstrap needs n_replicas >= 2 and len(replicas) == n_replicas!");
+    }
+    t_array* rep = replicas ? replicas : t_array_alloc(n_rep);
+    double* theta = rep->ptr;
+    const double* x = data->ptr;
+    const size_t n_blocks = (n + b - 1) / b;
+    const size_t n_starts = n - b + 1;
+    const uint64_t seed = opt->seed;
+
+    #pragma omp parallel num_threads(resample_threads(opt))
+    {
+        size_t* start = malloc(n_blocks * sizeof(size_t));
+        double* sample = malloc(n * dim * sizeof(double));
+        if (!start || !sample) {
+            tp_raiseError("Memory allocation failed in tn_bootstrap!");
+        }
+        #pragma omp for schedule(dynamic, 8)
+        for (size_t r = 0; r < n_rep; r++) {
+            uint64_t state = stream_seed(seed, r);
+            for (size_t k = 0; k < n_blocks; k++) {
+                start[k] = stream_next(&state) % n_starts;
+            }
+            // concatenate the drawn blocks, the last one is cut to length n
+            size_t filled = 0;
+            for (size_t k = 0; k < n_blocks; k++) {
+                size_t len = n - filled < b ? n - filled : b;
+                memcpy(sample + filled * dim, x + start[k] * dim,
+                       len * dim * sizeof(double));
+                filled += len;
+            }
+            theta[r] = estimator(sample, n, dim, params);
+        }
+        free(start);
+        free(sample);
+    }
+
+    double estimate = estimator(x, n, dim, params);
+    tn_moments m;
+    tn_moments_init(&m);
+    size_t below = 0;
+    for (size_t r = 0; r < n_rep; r++) {
+        tn_moments_add(&m, theta[r]);
+        below += theta[r] < estimate;
+    }
+    result->estimate = estimate;
+    result->mean = tn_moments_mean(&m);
+    result->bias = result->mean - estimate;
+    result->corrected = estimate - result->bias;
+    result->std_error = sqrt(m.m2 / (double)(n_rep - 1));
+
+    // bias-corrected percentile interval (Efron), z0 from the fraction of
+    // replicas below the estimate; without bias it is the plain percentile one
+    double frac = ((double)below + 0.5) / ((double)n_rep + 1.0);
+    double z0 = normal_quantile(frac);
+    double z = normal_quantile(0.5 * (1.0 + opt->confidence));
+    double q_lo = 0.5 * erfc(-(2.0 * z0 - z) / M_SQRT2);
+    double q_hi = 0.5 * erfc(-(2.0 * z0 + z) / M_SQRT2);
+    // replicas are reordered by the selection only if they are internal
+    t_array* sel = rep;
+    if (replicas) {
+        sel = t_array_alloc(n_rep);
+        memcpy(sel->ptr, theta, n_rep * sizeof(double));
+    }
+    result->ci_lo = tn_quantile(sel, q_lo);
+    result->ci_hi = tn_quantile(sel, q_hi);
+    T_ARRAY_FREE(sel);
+    TN_PROFILE_CALLBACKS(n_rep + 1);
+    TN_PROFILE_END();
+}
+
+void
+tn_jackknife (ESTIMATOR_FUNC estimator, const t_array* data, size_t dim,
+              void* params, const tn_resample_options* opt,
+              t_array* replicas, tn_resample_result* result)
+{
+    TN_PROFILE_BEGIN(tn_jackknife);
+    tn_resample_options defaults = tn_resample_default_options();
+    if (!opt) {
+        opt = &defaults;
+    }
+    const size_t b = opt->block_len;
+    // equal blocks only, the last n % b records are dropped; the full
+    // estimate uses the same records as the replicas
+    const size_t n_blocks = resample_records(data, dim, b) / b;
+    const size_t n = n_blocks * b;
+    if (n_blocks < 2 || (replicas && replicas->len != n_blocks)) {
+        tp_raiseError("tn_jackknife needs >= 2 blocks and len(replicas) == n / block_len!");
+    }
+    t_array* rep = replicas ? replicas : t_array_alloc(n_blocks);
+    double* theta = rep->ptr;
+    const double* x = data->ptr;
+
+    #pragma omp parallel num_threads(resample_threads(opt))
+    {
+        double* sample = malloc((n - b) * dim * sizeof(double));
+        Null_exit_message(sample, "Memory allocation failed in tn_jackknife!");
+        #pragma omp for schedule(dynamic, 8)
+        for (size_t k = 0; k < n_blocks; k++) {
+            size_t lo = k * b;
+            size_t hi = lo + b;
+            memcpy(sample, x, lo * dim * sizeof(double));
+            memcpy(sample + lo * dim, x + hi * dim, (n - hi) * dim * sizeof(double));
+            theta[k] = estimator(sample, n - b, dim, params);
+        }
+        free(sample);
+    }
+
+    double estimate = estimator(x, n, dim, params);
+    tn_moments m;
+    tn_moments_init(&m);
+    for (size_t k = 0; k < n_blocks; k++) {
+        tn_moments_add(&m, theta[k]);
+    }
+    double nb = (double)n_blocks;
+    result->estimate = estimate;
+    result->mean = tn_moments_mean(&m);
+    result->bias = (nb - 1.0) * (result->mean - estimate);
+    result->corrected = estimate - result->bias;
+    result->std_error = sqrt((nb - 1.0) / nb * m.m2);
+    // normal interval around the bias-corrected estimate
+    double z = normal_quantile(0.5 * (1.0 + opt->confidence));
+    result->ci_lo = result->corrected - z * result->std_error;
+    result->ci_hi = result->corrected + z * result->std_error;
+    if (!replicas) {
+        T_ARRAY_FREE(rep);
+    }
+    TN_PROFILE_CALLBACKS(n_blocks + 1);
+    TN_PROFILE_END();
+}
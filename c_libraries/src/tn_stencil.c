@@ -0,0 +1,536 @@
+#include "t_numerics_intern.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    finite difference stencils on structured grids
+//================================================================================
+
+/* Fields are stored with a halo of ghost cells (1 for order 2, 2 for order 4)
+ * around the interior, x fastest: the stencil loops need no boundary cases
+ * and the inner loop over x is a plain unit stride loop the compiler
+ * vectorizes. The boundary conditions only fill the ghost cells.
+ *
+ * The interior is traversed in tiles of whole x rows and TN_STENCIL_TILE_Y
+ * rows in y, walking through z inside a tile: the planes k - 1, k, k + 1 of
+ * the tile stay in cache, so every value is loaded from memory about once
+ * per sweep instead of once per stencil point. Tiles are distributed over
+ * the threads. */
+
+// rows in y per tile
+#define TN_STENCIL_TILE_Y 16
+// points in x per tile (long 1D grids are split for the threads)
+#define TN_STENCIL_TILE_X 4096
+// minimal number of interior points for threading
+#define TN_STENCIL_PARALLEL_MIN 32768
+// max number of components of tn_mol_rhs
+#define TN_STENCIL_MAX_COMP 16
+
+struct tn_grid {
+    int ndim;
+    int order;
+    int halo;
+    size_t n[3];          // interior points, 1 for unused axes
+    size_t pad[3];        // points incl. ghost cells
+    size_t stride[3];
+    size_t len;           // length of one field
+    double h[3];
+    tn_bc bc[6];          // low and high side per axis
+};
+
+tn_grid*
+tn_grid_alloc (int ndim, const size_t n[], const double h[], int order,
+               const tn_bc bc[])
+{
+    if (ndim < 1 || ndim > 3) {
+        tp_raiseError("tn_grid_alloc supports 1 to 3 dimensions!");
+    }
+    if (!n || !h || !bc) {
+        tp_raiseError("Null pointer in tn_grid_alloc.");
+    }
+    if (order != 2 && order != 4) {
+        tp_raiseError("tn_grid_alloc supports stencils of order 2 and 4!");
+    }
+    tn_grid* g = malloc(sizeof(tn_grid));
+    Null_exit_message(g, "Memory allocation failed in tn_grid_alloc!");
+    g->ndim = ndim;
+    g->order = order;
+    g->halo = order / 2;
+    g->len = 1;
+    for (int d = 0; d < 3; d++) {
+        if (d < ndim) {
+            if (n[d] < (size_t)g->halo || h[d] <= 0.0) {
+                free(g);
+                tp_raiseError("tn_grid_alloc needs n >= order / 2 and h > 0!");
+            }
+            tn_bc lo = bc[2 * d];
+            tn_bc hi = bc[2 * d + 1];
+            if ((lo.type == TN_BC_PERIODIC) != (hi.type == TN_BC_PERIODIC)) {
+                free(g);
+                tp_raiseError("Periodic boundaries must be periodic on both sides!");
+            }
+            g->n[d] = n[d];
+            g->pad[d] = n[d] + 2 * g->halo;
+            g->h[d] = h[d];
+            g->bc[2 * d] = lo;
+            g->bc[2 * d + 1] = hi;
+        }
+        else {
+            g->n[d] = 1;
+            g->pad[d] = 1;
+            g->h[d] = 1.0;
+            g->bc[2 * d] = g->bc[2 * d + 1] = (tn_bc){TN_BC_PERIODIC, 0.0};
+        }
+        g->stride[d] = g->len;
+        g->len *= g->pad[d];
+    }
+    return g;
+}
+
+void
+tn_grid_free (tn_grid* g)
+{
+    free(g);
+}
+
+size_t
+tn_grid_len (const tn_grid* g)
+{
+    if (!g) {
+        tp_raiseError("Null pointer in tn_grid_len.");
+    }
+    return g->len;
+}
+
+size_t
+tn_grid_points (const tn_grid* g)
+{
+    if (!g) {
+        tp_raiseError("Null pointer in tn_grid_points.");
+    }
+    return g->n[0] * g->n[1] * g->n[2];
+}
+
+int
+tn_grid_halo (const tn_grid* g)
+{
+    if (!g) {
+        tp_raiseError("Null pointer in tn_grid_halo.");
+    }
+    return g->halo;
+}
+
+/* offset of the interior point (i, j, k) in a field */
+static inline size_t
+offset (const tn_grid* g, size_t i, size_t j, size_t k)
+{
+    size_t o = i + g->halo;
+    if (g->ndim > 1) {
+        o += (j + g->halo) * g->stride[1];
+    }
+    if (g->ndim > 2) {
+        o += (k + g->halo) * g->stride[2];
+    }
+    return o;
+}
+
+size_t
+tn_grid_index (const tn_grid* g, size_t i, size_t j, size_t k)
+{
+    if (!g) {
+        tp_raiseError("Null pointer in tn_grid_index.");
+    }
+    if (i >= g->n[0] || j >= g->n[1] || k >= g->n[2]) {
+        tp_raiseError("Index out of range in tn_grid_index.");
+    }
+    return offset(g, i, j, k);
+}
+
+t_array*
+tn_grid_field_alloc (const tn_grid* g, int n_comp)
+{
+    if (!g) {
+        tp_raiseError("Null pointer in tn_grid_field_alloc.");
+    }
+    if (n_comp < 1) {
+        tp_raiseError("tn_grid_field_alloc needs n_comp > 0!");
+    }
+    t_array* field = t_array_alloc((size_t)n_comp * g->len);
+    memset(field->ptr, 0, field->len * sizeof(double));
+    return field;
+}
+
+static void
+check_field (const tn_grid* g, const t_array* field, int n_comp, char name[])
+{
+    if (!g || !field) {
+        tp_raiseError(name);
+    }
+    if (n_comp < 1 || field->len != (size_t)n_comp * g->len) {
+        tp_raiseError(name);
+    }
+}
+
+void
+tn_grid_set_interior (const tn_grid* g, t_array* field, const double* values)
+{
+    check_field(g, field, 1, "Invalid field in tn_grid_set_interior.");
+    for (size_t k = 0; k < g->n[2]; k++) {
+        for (size_t j = 0; j < g->n[1]; j++) {
+            memcpy(field->ptr + offset(g, 0, j, k), values, g->n[0] * sizeof(double));
+            values += g->n[0];
+        }
+    }
+}
+
+void
+tn_grid_get_interior (const tn_grid* g, const t_array* field, double* values)
+{
+    check_field(g, field, 1, "Invalid field in tn_grid_get_interior.");
+    for (size_t k = 0; k < g->n[2]; k++) {
+        for (size_t j = 0; j < g->n[1]; j++) {
+            memcpy(values, field->ptr + offset(g, 0, j, k), g->n[0] * sizeof(double));
+            values += g->n[0];
+        }
+    }
+}
+
+//-----------------------------------
+// boundaries
+//-----------------------------------
+
+/* ghost cells of one grid line along an axis: p points to the first
+ * interior value, s is the stride, n the number of interior values. The
+ * boundary lies half way between the outermost interior and ghost cell:
+ * Dirichlet mirrors the values odd around the prescribed value, Neumann
+ * even with the slope of the prescribed outward derivative. */
+static inline void
+fill_line (double* p, size_t s, size_t n, int halo, double h,
+           const tn_bc* lo, const tn_bc* hi)
+{
+    for (int m = 0; m < halo; m++) {
+        double* ghost_lo = p - (m + 1) * s;
+        double* ghost_hi = p + (n + m) * s;
+        double in_lo = p[m * s];
+        double in_hi = p[(n - 1 - m) * s];
+        switch (lo->type) {
+        case TN_BC_PERIODIC:
+            *ghost_lo = in_hi;
+            break;
+        case TN_BC_DIRICHLET:
+            *ghost_lo = 2.0 * lo->value - in_lo;
+            break;
+        default:
+            *ghost_lo = in_lo + (2 * m + 1) * h * lo->value;
+        }
+        switch (hi->type) {
+        case TN_BC_PERIODIC:
+            *ghost_hi = in_lo;
+            break;
+        case TN_BC_DIRICHLET:
+            *ghost_hi = 2.0 * hi->value - in_hi;
+            break;
+        default:
+            *ghost_hi = in_hi + (2 * m + 1) * h * hi->value;
+        }
+    }
+}
+
+static void
+fill_halo (const tn_grid* g, double* u)
+{
+    // x: contiguous lines, one per row
+    for (size_t k = 0; k < g->n[2]; k++) {
+        for (size_t j = 0; j < g->n[1]; j++) {
+            fill_line(u + offset(g, 0, j, k), 1, g->n[0], g->halo, g->h[0],
+                      &g->bc[0], &g->bc[1]);
+        }
+    }
+    // y and z: the ghost rows are filled for all x of a row at once, so the
+    // memory is still traversed contiguously; corners are not needed
+    if (g->ndim > 1) {
+        size_t sy = g->stride[1];
+        for (size_t k = 0; k < g->n[2]; k++) {
+            double* p = u + offset(g, 0, 0, k);
+            for (size_t i = 0; i < g->n[0]; i++) {
+                fill_line(p + i, sy, g->n[1], g->halo, g->h[1], &g->bc[2], &g->bc[3]);
+            }
+        }
+    }
+    if (g->ndim > 2) {
+        size_t sz = g->stride[2];
+        for (size_t j = 0; j < g->n[1]; j++) {
+            double* p = u + offset(g, 0, j, 0);
+            for (size_t i = 0; i < g->n[0]; i++) {
+                fill_line(p + i, sz, g->n[2], g->halo, g->h[2], &g->bc[4], &g->bc[5]);
+            }
+        }
+    }
+}
+
+void
+tn_grid_fill_halo (const tn_grid* g, t_array* field, int n_comp)
+{
+    check_field(g, field, n_comp, "Invalid field in tn_grid_fill_halo.");
+    for (int c = 0; c < n_comp; c++) {
+        fill_halo(g, field->ptr + c * g->len);
+    }
+}
+
+//-----------------------------------
+// stencils
+//-----------------------------------
+
+/* lap[i] = alpha * (Laplacian of u)(i) for n points starting at p */
+static inline void
+laplace_row (const tn_grid* g, const double* p, double* lap, size_t n, double alpha)
+{
+    if (g->order == 2) {
+        double cx = alpha / (g->h[0] * g->h[0]);
+        #pragma omp simd
+        for (size_t i = 0; i < n; i++) {
+            lap[i] = cx * (p[i - 1] - 2.0 * p[i] + p[i + 1]);
+        }
+        for (int d = 1; d < g->ndim; d++) {
+            size_t s = g->stride[d];
+            double c = alpha / (g->h[d] * g->h[d]);
+            #pragma omp simd
+            for (size_t i = 0; i < n; i++) {
+                lap[i] += c * (p[i - s] - 2.0 * p[i] + p[i + s]);
+            }
+        }
+    }
+    else {
+        double cx = alpha / (12.0 * g->h[0] * g->h[0]);
+        #pragma omp simd
+        for (size_t i = 0; i < n; i++) {
+            lap[i] = cx * (16.0 * (p[i - 1] + p[i + 1]) - (p[i - 2] + p[i + 2])
+                           - 30.0 * p[i]);
+        }
+        for (int d = 1; d < g->ndim; d++) {
+            size_t s = g->stride[d];
+            double c = alpha / (12.0 * g->h[d] * g->h[d]);
+            #pragma omp simd
+            for (size_t i = 0; i < n; i++) {
+                lap[i] += c * (16.0 * (p[i - s] + p[i + s]) - (p[i - 2 * s] + p[i + 2 * s])
+                               - 30.0 * p[i]);
+            }
+        }
+    }
+}
+
+/* the tiles: n_tx chunks in x times n_ty blocks in y, each walks through z */
+typedef struct {
+    size_t n_tx, n_ty, n_tiles;
+    int parallel;
+} tiling;
+
+static tiling
+make_tiling (const tn_grid* g)
+{
+    tiling t;
+    t.n_tx = (g->n[0] + TN_STENCIL_TILE_X - 1) / TN_STENCIL_TILE_X;
+    t.n_ty = (g->n[1] + TN_STENCIL_TILE_Y - 1) / TN_STENCIL_TILE_Y;
+    t.n_tiles = t.n_tx * t.n_ty;
+    t.parallel = t.n_tiles > 1 && tn_grid_points(g) >= TN_STENCIL_PARALLEL_MIN;
+    return t;
+}
+
+/* range of tile k: x in [*i0, *i0 + *ni), y in [*j0, *j1) */
+static inline void
+tile_range (const tn_grid* g, const tiling* t, size_t tile,
+            size_t* i0, size_t* ni, size_t* j0, size_t* j1)
+{
+    size_t tx = tile % t->n_tx;
+    size_t ty = tile / t->n_tx;
+    *i0 = tx * TN_STENCIL_TILE_X;
+    *ni = g->n[0] - *i0 < TN_STENCIL_TILE_X ? g->n[0] - *i0 : TN_STENCIL_TILE_X;
+    *j0 = ty * TN_STENCIL_TILE_Y;
+    *j1 = *j0 + TN_STENCIL_TILE_Y < g->n[1] ? *j0 + TN_STENCIL_TILE_Y : g->n[1];
+}
+
+void
+tn_grid_laplacian (const tn_grid* g, t_array* in, t_array* out, double alpha)
+{
+    TN_PROFILE_BEGIN(tn_grid_laplacian);
+    check_field(g, in, 1, "Invalid input field in tn_grid_laplacian.");
+    check_field(g, out, 1, "Invalid output field in tn_grid_laplacian.");
+    if (in == out) {
+        tp_raiseError("Output of tn_grid_laplacian must not be the input.");
+    }
+    fill_halo(g, in->ptr);
+    const double* u = in->ptr;
+    double* v = out->ptr;
+    tiling t = make_tiling(g);
+    #pragma omp parallel for schedule(static) if(t.parallel)
+    for (size_t tile = 0; tile < t.n_tiles; tile++) {
+        size_t i0, ni, j0, j1;
+        tile_range(g, &t, tile, &i0, &ni, &j0, &j1);
+        for (size_t k = 0; k < g->n[2]; k++) {
+            for (size_t j = j0; j < j1; j++) {
+                size_t o = offset(g, i0, j, k);
+                laplace_row(g, u + o, v + o, ni, alpha);
+            }
+        }
+    }
+    TN_PROFILE_END();
+}
+
+//-----------------------------------
+// method of lines
+//-----------------------------------
+
+/* Classic RK4 for du/dt = F(u) evaluates F four times and, written with a
+ * generic ODE stepper, streams through k1..k4, the stage state and the
+ * result in separate sweeps. Here each stage is one sweep that evaluates F
+ * on a row (stencil and reaction) and immediately folds it into the running
+ * RK sum and the input of the next stage; k1..k4 never reach memory:
+ *
+ *   stage 1: F(u)  -> acc = u + dt/6 k1,   s_a = u + dt/2 k1
+ *   stage 2: F(s_a) -> acc += dt/3 k2,     s_b = u + dt/2 k2
+ *   stage 3: F(s_b) -> acc += dt/3 k3,     s_a = u + dt k3
+ *   stage 4: F(s_a) -> u = acc + dt/6 k4
+ */
+
+typedef struct {
+    const double* in;     // stage input (ghost cells filled)
+    const double* base;   // acc = base + c_acc * k
+    double* acc;
+    double c_acc;
+    const double* u;      // next = u + c_next * k, next == NULL: none
+    double* next;
+    double c_next;
+    double t;             // time of the stage
+} mol_stage;
+
+static void
+mol_sweep (const tn_grid* g, const tn_mol_rhs* rhs, const double* diff,
+           const int* src, const mol_stage* st, const tiling* t)
+{
+    const int n_comp = rhs->n_comp;
+    const size_t len = g->len;
+    #pragma omp parallel if(t->parallel)
+    {
+        // rows of F for all components and one point of u and r for the
+        // reaction, per thread
+        double* buf = malloc(((size_t)n_comp * TN_STENCIL_TILE_X + 2 * n_comp)
+                             * sizeof(double));
+        Null_exit_message(buf, "Memory allocation failed in tn_mol_rk4!");
+        double* u_pt = buf + (size_t)n_comp * TN_STENCIL_TILE_X;
+        double* r_pt = u_pt + n_comp;
+
+        #pragma omp for schedule(static)
+        for (size_t tile = 0; tile < t->n_tiles; tile++) {
+            size_t i0, ni, j0, j1;
+            tile_range(g, t, tile, &i0, &ni, &j0, &j1);
+            for (size_t k = 0; k < g->n[2]; k++) {
+                for (size_t j = j0; j < j1; j++) {
+                    size_t o = offset(g, i0, j, k);
+                    for (int c = 0; c < n_comp; c++) {
+                        double* f = buf + (size_t)c * TN_STENCIL_TILE_X;
+                        if (diff[c] != 0.0) {
+                            laplace_row(g, st->in + src[c] * len + o, f, ni, diff[c]);
+                        }
+                        else {
+                            memset(f, 0, ni * sizeof(double));
+                        }
+                    }
+                    if (rhs->reaction) {
+                        for (size_t i = 0; i < ni; i++) {
+                            for (int c = 0; c < n_comp; c++) {
+                                u_pt[c] = st->in[c * len + o + i];
+                            }
+                            rhs->reaction(st->t, u_pt, r_pt, rhs->params);
+                            for (int c = 0; c < n_comp; c++) {
+                                buf[(size_t)c * TN_STENCIL_TILE_X + i] += r_pt[c];
+                            }
+                        }
+                    }
+                    for (int c = 0; c < n_comp; c++) {
+                        const double* f = buf + (size_t)c * TN_STENCIL_TILE_X;
+                        size_t oc = c * len + o;
+                        const double* base = st->base + oc;
+                        double* acc = st->acc + oc;
+                        double c_acc = st->c_acc;
+                        #pragma omp simd
+                        for (size_t i = 0; i < ni; i++) {
+                            acc[i] = base[i] + c_acc * f[i];
+                        }
+                        if (st->next) {
+                            const double* u = st->u + oc;
+                            double* next = st->next + oc;
+                            double c_next = st->c_next;
+                            #pragma omp simd
+                            for (size_t i = 0; i < ni; i++) {
+                                next[i] = u[i] + c_next * f[i];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        free(buf);
+    }
+}
+
+void
+tn_mol_rk4 (const tn_grid* g, const tn_mol_rhs* rhs, t_array* u,
+            double t0, double dt, long n_steps)
+{
+    TN_PROFILE_BEGIN(tn_mol_rk4);
+    if (!rhs) {
+        tp_raiseError("Null pointer in tn_mol_rk4.");
+    }
+    const int n_comp = rhs->n_comp;
+    if (n_comp > TN_STENCIL_MAX_COMP) {
+        tp_raiseError("Too many components in tn_mol_rk4.");
+    }
+    check_field(g, u, n_comp, "Invalid field in tn_mol_rk4.");
+    double diff[TN_STENCIL_MAX_COMP];
+    int src[TN_STENCIL_MAX_COMP];
+    for (int c = 0; c < n_comp; c++) {
+        diff[c] = rhs->diffusion ? rhs->diffusion[c] : 1.0;
+        src[c] = rhs->laplace_of ? rhs->laplace_of[c] : c;
+        if (src[c] < 0 || src[c] >= n_comp) {
+            tp_raiseError("Invalid component in laplace_of of tn_mol_rk4.");
+        }
+    }
+
+    // acc and the two stage states
+    size_t size = (size_t)n_comp * g->len;
+    double* work = malloc(3 * size * sizeof(double));
+    Null_exit_message(work, "Memory allocation failed in tn_mol_rk4!");
+    double* acc = work;
+    double* s_a = acc + size;
+    double* s_b = s_a + size;
+
+    tiling t = make_tiling(g);
+    double* y = u->ptr;
+    size_t n_calls = 0;
+    for (long step = 0; step < n_steps; step++) {
+        double time = t0 + step * dt;
+        mol_stage st1 = {y, y, acc, dt / 6.0, y, s_a, 0.5 * dt, time};
+        mol_stage st2 = {s_a, acc, acc, dt / 3.0, y, s_b, 0.5 * dt, time + 0.5 * dt};
+        mol_stage st3 = {s_b, acc, acc, dt / 3.0, y, s_a, dt, time + 0.5 * dt};
+        mol_stage st4 = {s_a, acc, y, dt / 6.0, NULL, NULL, 0.0, time + dt};
+        const mol_stage* stages[4] = {&st1, &st2, &st3, &st4};
+        for (int s = 0; s < 4; s++) {
+            for (int c = 0; c < n_comp; c++) {
+                fill_halo(g, (double*)stages[s]->in + c * g->len);
+            }
+            mol_sweep(g, rhs, diff, src, stages[s], &t);
+        }
+        if (rhs->reaction) {
+            n_calls += 4 * tn_grid_points(g);
+        }
+    }
+    // ghost cells consistent with the final state
+    for (int c = 0; c < n_comp; c++) {
+        fill_halo(g, y + c * g->len);
+    }
+    free(work);
+    TN_PROFILE_CALLBACKS(n_calls);
+    TN_PROFILE_END();
+}
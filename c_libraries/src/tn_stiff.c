@@ -0,0 +1,868 @@
+#include "t_numerics_intern.h"
+
+#include <float.h>
+
+//================================================================================
+//    implicit integrators for stiff ODEs
+//================================================================================
+
+/* Both integrators solve linear systems with W = I - c * J, J ~ df/dy. The
+ * expensive parts, the Jacobian and the LU factorization of W, are kept in
+ * tn_stiff_work and reused as long as possible:
+ *
+ * Rosenbrock-W (modified Rosenbrock formula of ode23s, Shampine and
+ * Reichelt 1997): the solution is second order for any matrix J, so J is
+ * only recomputed after a rejected step or max_jac_age steps. The third
+ * order error estimate is built from stages that were all multiplied by
+ * W^-1, so stiff components are damped in the estimate as in the solution
+ * and h is not limited by 1 / |lambda|. The estimate needs a current df/dt,
+ * one more evaluation of f per step unless f does not depend on t. The
+ * estimate is sensitive to an old J: a step that fails with an old J is
+ * repeated with a fresh one and the same h and is not counted as a
+ * rejection. h only grows after steps with a fresh J and is kept for
+ * proposed increases up to TN_ROS_KEEP_H, so the factorization stays valid
+ * over many steps.
+ *
+ * BDF/NDF of order 1 to 5 in the quasi constant step size formulation of
+ * Shampine and Reichelt (ode15s) with a modified divided difference array D.
+ * The Newton iteration of the corrector uses the stored factorization until
+ * it fails to converge; then J is recomputed, and only if that does not help
+ * the step is halved. W is refactorized only when h or the order changes. */
+
+#define TN_STIFF_MAX_ORDER 5
+#define TN_STIFF_NEWTON_MAXITER 4
+#define TN_STIFF_MIN_FACTOR 0.2
+#define TN_STIFF_MAX_FACTOR 10.0
+
+// ode23s parameters, d = 1 / (2 + sqrt(2)) gives L-stability, e32 = 6 + sqrt(2)
+#define TN_ROS23_D 0.29289321881345248
+#define TN_ROS23_E32 7.4142135623730950
+// Rosenbrock keeps h and the factorization for proposed increases up to this
+#define TN_ROS_KEEP_H 2.0
+
+enum {
+    TN_STIFF_NONE = 0,
+    TN_STIFF_ROSENBROCK = 1,
+    TN_STIFF_BDF = 2
+};
+
+struct tn_stiff_work {
+    int dim;
+    int method;           // method of last call, state is only valid for it
+    double t;             // time and state at the end of the last call
+    double* y_last;
+    double h;             // proposed next step size
+    int order;            // BDF order
+    int n_equal_steps;    // BDF steps since last change of h or order
+    int jac_valid;        // J belongs to the current problem
+    int jac_current;      // J was evaluated at the current (t, y)
+    int jac_age;          // accepted steps since evaluation of J
+    int t_dependent;      // Rosenbrock: df/dt was nonzero at the last J
+    int lu_valid;
+    double c_lu;          // W = I - c_lu * J is factorized in lu
+    double* jac;          // dim x dim, row major
+    double* lu;           // dim x dim
+    int* piv;
+    int* color;           // column groups of the finite difference Jacobian
+    int n_colors;
+    const unsigned char* sparsity;   // pattern the colors belong to
+    double* d;            // BDF differences, (MAX_ORDER + 3) x dim
+    double* d_tmp;        // (MAX_ORDER + 1) x dim
+    double* f0;
+    double* f1;           // Rosenbrock: f at the midpoint stage
+    double* dfdt;         // Rosenbrock: df/dt at the start of the step
+    double* k1;
+    double* k2;
+    double* k3;
+    double* y_new;
+    double* scale;
+    double* psi;
+    double* delta;        // Newton: accumulated correction
+    double* tmp;
+    double* y_pred;       // BDF predictor
+};
+
+tn_stiff_options
+tn_stiff_default_options (void)
+{
+    tn_stiff_options opt = {
+        .rtol = 1e-6,
+        .atol = 1e-9,
+        .h0 = 0.0,
+        .h_max = INFINITY,
+        .max_steps = 100000,
+        .max_order = TN_STIFF_MAX_ORDER,
+        .ndf = 1,
+        .max_jac_age = 20,
+        .sparsity = NULL
+    };
+    return opt;
+}
+
+tn_stiff_work*
+tn_stiff_work_alloc (int dim)
+{
+    if (dim <= 0) {
+        tp_raiseError("tn_stiff_work_alloc needs dim > 0!");
+    }
+    tn_stiff_work* w = malloc(sizeof(tn_stiff_work));
+    Null_exit_message(w, "Memory allocation failed in tn_stiff_work_alloc!");
+    size_t n = (size_t)dim;
+    w->dim = dim;
+
+    // one block for all buffers
+    size_t n_total = 2 * n * n + (2 * TN_STIFF_MAX_ORDER + 4) * n + 13 * n;
+    double* block = malloc(n_total * sizeof(double));
+    Null_exit_message(block, "Memory allocation failed in tn_stiff_work_alloc!");
+    w->jac = block;
+    w->lu = w->jac + n * n;
+    w->d = w->lu + n * n;
+    w->d_tmp = w->d + (TN_STIFF_MAX_ORDER + 3) * n;
+    w->y_last = w->d_tmp + (TN_STIFF_MAX_ORDER + 1) * n;
+    w->f0 = w->y_last + n;
+    w->f1 = w->f0 + n;
+    w->dfdt = w->f1 + n;
+    w->k1 = w->dfdt + n;
+    w->k2 = w->k1 + n;
+    w->k3 = w->k2 + n;
+    w->y_new = w->k3 + n;
+    w->scale = w->y_new + n;
+    w->psi = w->scale + n;
+    w->delta = w->psi + n;
+    w->tmp = w->delta + n;
+    w->y_pred = w->tmp + n;
+
+    w->piv = malloc(2 * n * sizeof(int));
+    Null_exit_message(w->piv, "Memory allocation failed in tn_stiff_work_alloc!");
+    w->color = w->piv + n;
+
+    w->n_colors = 0;
+    w->sparsity = NULL;
+    tn_stiff_work_reset(w);
+    return w;
+}
+
+void
+tn_stiff_work_free (tn_stiff_work* w)
+{
+    if (!w) {
+        return;
+    }
+    free(w->jac);
+    free(w->piv);
+    free(w);
+}
+
+void
+tn_stiff_work_reset (tn_stiff_work* w)
+{
+    if (!w) {
+        tp_raiseError("Null pointer in tn_stiff_work_reset.");
+    }
+    w->method = TN_STIFF_NONE;
+    w->t = NAN;
+    w->h = 0.0;
+    w->order = 1;
+    w->n_equal_steps = 0;
+    w->jac_valid = 0;
+    w->jac_current = 0;
+    w->jac_age = 0;
+    w->t_dependent = 1;
+    w->lu_valid = 0;
+    w->c_lu = 0.0;
+}
+
+//-----------------------------------
+// helpers
+//-----------------------------------
+
+/* weighted root mean square norm */
+static double
+rms_norm (const double* x, const double* scale, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        double r = x[i] / scale[i];
+        sum += r * r;
+    }
+    return sqrt(sum / n);
+}
+
+static void
+error_scale (const double* y, const double* y_new,
+             const tn_stiff_options* opt, int n, double* scale)
+{
+    for (int i = 0; i < n; i++) {
+        double a = fabs(y[i]);
+        if (y_new) {
+            a = fmax(a, fabs(y_new[i]));
+        }
+        scale[i] = opt->atol + opt->rtol * a;
+    }
+}
+
+/* factorizes W = I - c * J, counts in res */
+static int
+factorize (tn_stiff_work* w, double c, tn_stiff_result* res)
+{
+    int n = w->dim;
+    for (int i = 0; i < n * n; i++) {
+        w->lu[i] = -c * w->jac[i];
+    }
+    for (int i = 0; i < n; i++) {
+        w->lu[i * n + i] += 1.0;
+    }
+    res->n_lu++;
+    w->lu_valid = tn_lu_decomp_ptr(w->lu, w->piv, n) == 0;
+    w->c_lu = c;
+    return w->lu_valid;
+}
+
+/* greedy grouping of columns without common nonzero row, NULL: dense */
+static void
+color_columns (tn_stiff_work* w, const unsigned char* sparsity)
+{
+    int n = w->dim;
+    w->sparsity = sparsity;
+    if (!sparsity) {
+        for (int j = 0; j < n; j++) {
+            w->color[j] = j;
+        }
+        w->n_colors = n;
+        return;
+    }
+    // piv is free here and marks colors forbidden for column j
+    int* forbidden = w->piv;
+    for (int c = 0; c < n; c++) {
+        forbidden[c] = -1;
+    }
+    w->n_colors = 0;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            if (!sparsity[i * n + j]) {
+                continue;
+            }
+            for (int k = 0; k < j; k++) {
+                if (sparsity[i * n + k]) {
+                    forbidden[w->color[k]] = j;
+                }
+            }
+        }
+        int c = 0;
+        while (forbidden[c] == j) {
+            c++;
+        }
+        w->color[j] = c;
+        if (c + 1 > w->n_colors) {
+            w->n_colors = c + 1;
+        }
+    }
+    w->lu_valid = 0;
+}
+
+/* J at (t, y), analytic or by forward differences over column groups;
+ * f: ode_func(t, y) if already known, else NULL */
+static void
+jacobian (ODE_FUNC ode_func, ODE_JAC* jac, double t, const double* y,
+          const double* f, void* params, const tn_stiff_options* opt,
+          tn_stiff_work* w, tn_stiff_result* res)
+{
+    int n = w->dim;
+    res->n_jac++;
+    w->jac_valid = 1;
+    w->jac_current = 1;
+    w->jac_age = 0;
+    w->lu_valid = 0;
+    if (jac) {
+        jac(t, y, w->jac, params);
+        return;
+    }
+    if (!f) {
+        ode_func(t, y, w->f0, params);
+        res->n_rhs++;
+        f = w->f0;
+    }
+    if (w->n_colors == 0 || w->sparsity != opt->sparsity) {
+        color_columns(w, opt->sparsity);
+    }
+    const unsigned char* sp = opt->sparsity;
+    double sqrt_eps = sqrt(DBL_EPSILON);
+    double* y_pert = w->tmp;
+    double* f_pert = w->k2;
+    double* step = w->delta;
+    for (int i = 0; i < n * n; i++) {
+        w->jac[i] = 0.0;
+    }
+    for (int c = 0; c < w->n_colors; c++) {
+        memcpy(y_pert, y, n * sizeof(double));
+        for (int j = 0; j < n; j++) {
+            if (w->color[j] == c) {
+                // below atol / rtol the absolute tolerance sets the scale
+                double h = sqrt_eps * fmax(fabs(y[j]), opt->atol / opt->rtol);
+                y_pert[j] = y[j] + h;
+                step[j] = y_pert[j] - y[j];
+            }
+        }
+        ode_func(t, y_pert, f_pert, params);
+        res->n_rhs++;
+        for (int j = 0; j < n; j++) {
+            if (w->color[j] != c) {
+                continue;
+            }
+            for (int i = 0; i < n; i++) {
+                if (!sp || sp[i * n + j]) {
+                    w->jac[i * n + j] = (f_pert[i] - f[i]) / step[j];
+                }
+            }
+        }
+    }
+}
+
+/* df/dt at (t, y) by a forward difference, f = ode_func(t, y), span: time
+ * scale of the integration; returns 0 if df/dt vanishes */
+static int
+time_derivative (ODE_FUNC ode_func, double t, const double* y, const double* f,
+                 double span, void* params, tn_stiff_work* w, tn_stiff_result* res)
+{
+    int n = w->dim;
+    double t_pert = t + sqrt(DBL_EPSILON) * fmax(fabs(t), span);
+    double dt = t_pert - t;
+    ode_func(t_pert, y, w->dfdt, params);
+    res->n_rhs++;
+    int nonzero = 0;
+    for (int i = 0; i < n; i++) {
+        w->dfdt[i] = (w->dfdt[i] - f[i]) / dt;
+        nonzero = nonzero || w->dfdt[i] != 0.0;
+    }
+    return nonzero;
+}
+
+/* initial step size (Hairer, Norsett, Wanner), f0 = f(t, y), error ~ h^(order+1) */
+static double
+initial_step (ODE_FUNC ode_func, double t, const double* y, const double* f0,
+              void* params, int order, const tn_stiff_options* opt,
+              tn_stiff_work* w, tn_stiff_result* res)
+{
+    int n = w->dim;
+    if (opt->h0 > 0.0) {
+        return opt->h0;
+    }
+    error_scale(y, NULL, opt, n, w->scale);
+    double d0 = rms_norm(y, w->scale, n);
+    double d1 = rms_norm(f0, w->scale, n);
+    double h0 = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    for (int i = 0; i < n; i++) {
+        w->tmp[i] = y[i] + h0 * f0[i];
+    }
+    ode_func(t + h0, w->tmp, w->k2, params);
+    res->n_rhs++;
+    for (int i = 0; i < n; i++) {
+        w->k2[i] -= f0[i];
+    }
+    double d2 = rms_norm(w->k2, w->scale, n) / h0;
+    double h1;
+    if (d1 <= 1e-15 && d2 <= 1e-15) {
+        h1 = fmax(1e-6, 1e-3 * h0);
+    }
+    else {
+        h1 = pow(0.01 / fmax(d1, d2), 1.0 / (order + 1));
+    }
+    return fmin(fmin(100.0 * h0, h1), opt->h_max);
+}
+
+static void
+check_call (double t0, double t_end, double* y, int dim,
+            const tn_stiff_options* opt, tn_stiff_work* w, char name[])
+{
+    if (!y || !w) {
+        tp_raiseError(name);
+    }
+    if (dim != w->dim) {
+        tp_raiseError("Dimension does not match workspace in stiff integrator.");
+    }
+    if (!(t_end >= t0)) {
+        tp_raiseError("Stiff integrators need t_end >= t0.");
+    }
+    if (opt->rtol <= 0.0 || opt->atol <= 0.0) {
+        tp_raiseError("Stiff integrators need rtol > 0 and atol > 0.");
+    }
+}
+
+/* continue from the last call if the caller passes on its end point */
+static int
+can_resume (const tn_stiff_work* w, int method, double t0, const double* y)
+{
+    return w->method == method && t0 == w->t
+        && memcmp(y, w->y_last, w->dim * sizeof(double)) == 0;
+}
+
+static double
+min_step (double t)
+{
+    return 10.0 * fabs(nextafter(t, INFINITY) - t);
+}
+
+//-----------------------------------
+// Rosenbrock-W
+//-----------------------------------
+
+/* W = I - d h J, T = df/dt, F0 = f(t, y)
+ * W k1 = F0 + d h T
+ * W (k2 - k1) = F1 - k1,  F1 = f(t + h/2, y + h/2 k1)
+ * y_new = y + h k2
+ * W k3 = F2 - e32 (k2 - F1) - 2 (k1 - F0) + d h T,  F2 = f(t + h, y_new)
+ * error estimate h/6 (k1 - 2 k2 + k3), F2 is F0 of the next step */
+tn_stiff_result
+tn_rosenbrock_integrate (ODE_FUNC ode_func, ODE_JAC* jac,
+                         double t0, double t_end, double* y, int dim,
+                         void* params, const tn_stiff_options* opt,
+                         tn_stiff_work* w)
+{
+    TN_PROFILE_BEGIN(tn_rosenbrock_integrate);
+    tn_stiff_options default_opt = tn_stiff_default_options();
+    if (!opt) {
+        opt = &default_opt;
+    }
+    check_call(t0, t_end, y, dim, opt, w, "Null pointer in tn_rosenbrock_integrate.");
+    tn_stiff_result res = {0};
+    int n = dim;
+    double t = t0;
+
+    // f(t, y) in w->f0 is up to date, F2 of an accepted step is reused
+    int have_f0 = 0;
+    int rejected = 0;     // last try failed, no growth of h for the next step
+    if (!can_resume(w, TN_STIFF_ROSENBROCK, t0, y)) {
+        tn_stiff_work_reset(w);
+        w->method = TN_STIFF_ROSENBROCK;
+        ode_func(t, y, w->f0, params);
+        res.n_rhs++;
+        w->h = initial_step(ode_func, t, y, w->f0, params, 2, opt, w, &res);
+        have_f0 = 1;
+    }
+
+    res.status = TN_STIFF_SUCCESS;
+    while (t < t_end) {
+        if (res.n_steps >= (size_t)opt->max_steps) {
+            res.status = TN_STIFF_MAX_STEPS;
+            break;
+        }
+        double h = fmin(w->h, opt->h_max);
+        if (h < min_step(t)) {
+            res.status = TN_STIFF_STEP_TOO_SMALL;
+            break;
+        }
+        // last step ends exactly at t_end
+        int last = t + h >= t_end;
+        if (last) {
+            h = t_end - t;
+        }
+
+        if (!have_f0) {
+            ode_func(t, y, w->f0, params);
+            res.n_rhs++;
+            have_f0 = 1;
+        }
+        if (!w->jac_valid) {
+            jacobian(ode_func, jac, t, y, w->f0, params, opt, w, &res);
+        }
+        // unlike J, df/dt of a driven system must be current for the error
+        // estimate; autonomous systems skip it until the next J
+        if (w->jac_current || w->t_dependent) {
+            w->t_dependent = time_derivative(ode_func, t, y, w->f0, t_end - t0, params,
+                                             w, &res);
+        }
+        double c = TN_ROS23_D * h;
+        if ((!w->lu_valid || w->c_lu != c) && !factorize(w, c, &res)) {
+            w->h = 0.5 * h;
+            res.n_rejected++;
+            rejected = 1;
+            continue;
+        }
+        double t_new = last ? t_end : t + h;
+
+        for (int i = 0; i < n; i++) {
+            w->k1[i] = w->f0[i] + c * w->dfdt[i];
+        }
+        tn_lu_solve_ptr(w->lu, w->piv, n, w->k1);
+        for (int i = 0; i < n; i++) {
+            w->tmp[i] = y[i] + 0.5 * h * w->k1[i];
+        }
+        ode_func(t + 0.5 * h, w->tmp, w->f1, params);
+        for (int i = 0; i < n; i++) {
+            w->k2[i] = w->f1[i] - w->k1[i];
+        }
+        tn_lu_solve_ptr(w->lu, w->piv, n, w->k2);
+        for (int i = 0; i < n; i++) {
+            w->k2[i] += w->k1[i];
+            w->y_new[i] = y[i] + h * w->k2[i];
+        }
+        // F2 in tmp, becomes f0 if the step is accepted
+        ode_func(t_new, w->y_new, w->tmp, params);
+        res.n_rhs += 2;
+        for (int i = 0; i < n; i++) {
+            w->k3[i] = w->tmp[i] - TN_ROS23_E32 * (w->k2[i] - w->f1[i])
+                       - 2.0 * (w->k1[i] - w->f0[i]) + c * w->dfdt[i];
+        }
+        tn_lu_solve_ptr(w->lu, w->piv, n, w->k3);
+
+        for (int i = 0; i < n; i++) {
+            w->delta[i] = h / 6.0 * (w->k1[i] - 2.0 * w->k2[i] + w->k3[i]);
+        }
+        error_scale(y, w->y_new, opt, n, w->scale);
+        double err = rms_norm(w->delta, w->scale, n);
+
+        if (!(err <= 1.0)) {
+            // an old J may be the reason, the next try uses a fresh one
+            // with the same h
+            if (!w->jac_current) {
+                w->jac_valid = 0;
+                continue;
+            }
+            res.n_rejected++;
+            rejected = 1;
+            w->h = h * (isfinite(err)
+                ? fmax(TN_STIFF_MIN_FACTOR, 0.9 / cbrt(err)) : TN_STIFF_MIN_FACTOR);
+            continue;
+        }
+        int jac_fresh = w->jac_current;
+
+        t = t_new;
+        memcpy(y, w->y_new, n * sizeof(double));
+        memcpy(w->f0, w->tmp, n * sizeof(double));
+        res.n_steps++;
+        w->jac_current = 0;
+        w->jac_age++;
+        if (opt->max_jac_age > 0 && w->jac_age >= opt->max_jac_age) {
+            w->jac_valid = 0;
+        }
+
+        // h only grows if the error was measured with a fresh J, a larger
+        // step with the old J would fail and cost a new J anyway; no growth
+        // right after a rejection; h (and the factorization) is kept for
+        // proposed increases up to TN_ROS_KEEP_H
+        double factor = err > 0.0 ? 0.9 / cbrt(err) : TN_STIFF_MAX_FACTOR;
+        factor = fmin(TN_STIFF_MAX_FACTOR, fmax(TN_STIFF_MIN_FACTOR, factor));
+        if (factor > 1.0 && (!jac_fresh || rejected || factor <= TN_ROS_KEEP_H)) {
+            factor = 1.0;
+        }
+        rejected = 0;
+        if (!last || h >= w->h) {
+            w->h = h * factor;
+        }
+    }
+
+    w->t = t;
+    memcpy(w->y_last, y, n * sizeof(double));
+    res.t = t;
+    res.h = w->h;
+    res.order = 2;
+    TN_PROFILE_CALLBACKS(res.n_rhs);
+    TN_PROFILE_END();
+    return res;
+}
+
+//-----------------------------------
+// BDF / NDF
+//-----------------------------------
+
+/* R of the change of the step size by factor, (order + 1) x (order + 1) */
+static void
+compute_r (int order, double factor, double r[][TN_STIFF_MAX_ORDER + 1])
+{
+    for (int j = 0; j <= order; j++) {
+        r[0][j] = 1.0;
+    }
+    for (int i = 1; i <= order; i++) {
+        r[i][0] = 0.0;
+        for (int j = 1; j <= order; j++) {
+            r[i][j] = r[i - 1][j] * (i - 1 - factor * j) / i;
+        }
+    }
+}
+
+/* rescales the differences D[0..order] to step size factor * h */
+static void
+change_d (tn_stiff_work* w, int order, double factor)
+{
+    double r[TN_STIFF_MAX_ORDER + 1][TN_STIFF_MAX_ORDER + 1];
+    double u[TN_STIFF_MAX_ORDER + 1][TN_STIFF_MAX_ORDER + 1];
+    double ru[TN_STIFF_MAX_ORDER + 1][TN_STIFF_MAX_ORDER + 1];
+    compute_r(order, factor, r);
+    compute_r(order, 1.0, u);
+    for (int i = 0; i <= order; i++) {
+        for (int j = 0; j <= order; j++) {
+            double sum = 0.0;
+            for (int k = 0; k <= order; k++) {
+                sum += r[i][k] * u[k][j];
+            }
+            ru[i][j] = sum;
+        }
+    }
+    size_t n = (size_t)w->dim;
+    // D_new[j] = sum_i RU[i][j] D[i]
+    for (int j = 0; j <= order; j++) {
+        double* out = w->d_tmp + j * n;
+        for (size_t m = 0; m < n; m++) {
+            out[m] = 0.0;
+        }
+        for (int i = 0; i <= order; i++) {
+            double a = ru[i][j];
+            const double* in = w->d + i * n;
+            for (size_t m = 0; m < n; m++) {
+                out[m] += a * in[m];
+            }
+        }
+    }
+    memcpy(w->d, w->d_tmp, (order + 1) * n * sizeof(double));
+    w->n_equal_steps = 0;
+    w->lu_valid = 0;
+}
+
+/* simplified Newton iteration for the corrector, y starts at the predictor;
+ * returns 1 if converged, correction y - y_predict in w->delta */
+static int
+solve_corrector (ODE_FUNC ode_func, double t_new, double* y, double c,
+                 void* params, double tol, int* n_iter,
+                 tn_stiff_work* w, tn_stiff_result* res)
+{
+    int n = w->dim;
+    double* f = w->k1;
+    double* dy = w->k2;
+    double dy_norm_old = -1.0;
+    for (int i = 0; i < n; i++) {
+        w->delta[i] = 0.0;
+    }
+    for (int k = 0; k < TN_STIFF_NEWTON_MAXITER; k++) {
+        *n_iter = k + 1;
+        res->n_newton++;
+        ode_func(t_new, y, f, params);
+        res->n_rhs++;
+        for (int i = 0; i < n; i++) {
+            if (!isfinite(f[i])) {
+                return 0;
+            }
+            dy[i] = c * f[i] - w->psi[i] - w->delta[i];
+        }
+        tn_lu_solve_ptr(w->lu, w->piv, n, dy);
+        double dy_norm = rms_norm(dy, w->scale, n);
+        double rate = dy_norm_old > 0.0 ? dy_norm / dy_norm_old : -1.0;
+        if (rate >= 0.0 && (rate >= 1.0
+            || pow(rate, TN_STIFF_NEWTON_MAXITER - k) / (1.0 - rate) * dy_norm > tol)) {
+            return 0;
+        }
+        for (int i = 0; i < n; i++) {
+            y[i] += dy[i];
+            w->delta[i] += dy[i];
+        }
+        if (dy_norm == 0.0 || (rate >= 0.0 && rate / (1.0 - rate) * dy_norm < tol)) {
+            return 1;
+        }
+        dy_norm_old = dy_norm;
+    }
+    return 0;
+}
+
+tn_stiff_result
+tn_bdf_integrate (ODE_FUNC ode_func, ODE_JAC* jac,
+                  double t0, double t_end, double* y, int dim,
+                  void* params, const tn_stiff_options* opt,
+                  tn_stiff_work* w)
+{
+    TN_PROFILE_BEGIN(tn_bdf_integrate);
+    tn_stiff_options default_opt = tn_stiff_default_options();
+    if (!opt) {
+        opt = &default_opt;
+    }
+    check_call(t0, t_end, y, dim, opt, w, "Null pointer in tn_bdf_integrate.");
+    if (opt->max_order < 1 || opt->max_order > TN_STIFF_MAX_ORDER) {
+        tp_raiseError("max_order of tn_bdf_integrate has to be in 1..5.");
+    }
+    tn_stiff_result res = {0};
+    size_t n = (size_t)dim;
+    double t = t0;
+
+    // NDF: kappa != 0 (Klopfenstein-Shampine), BDF: kappa = 0
+    const double kappa_ndf[TN_STIFF_MAX_ORDER + 1] =
+        {0.0, -0.1850, -1.0 / 9.0, -0.0823, -0.0415, 0.0};
+    double gamma[TN_STIFF_MAX_ORDER + 1];
+    double alpha[TN_STIFF_MAX_ORDER + 1];
+    double error_const[TN_STIFF_MAX_ORDER + 2];
+    gamma[0] = 0.0;
+    for (int k = 1; k <= TN_STIFF_MAX_ORDER; k++) {
+        gamma[k] = gamma[k - 1] + 1.0 / k;
+    }
+    for (int k = 0; k <= TN_STIFF_MAX_ORDER; k++) {
+        double kappa = opt->ndf ? kappa_ndf[k] : 0.0;
+        alpha[k] = (1.0 - kappa) * gamma[k];
+        error_const[k] = kappa * gamma[k] + 1.0 / (k + 1);
+    }
+    error_const[TN_STIFF_MAX_ORDER + 1] = 1.0 / (TN_STIFF_MAX_ORDER + 2);
+    double newton_tol = fmax(10.0 * DBL_EPSILON / opt->rtol,
+                             fmin(0.03, sqrt(opt->rtol)));
+
+    double* d = w->d;
+    if (!can_resume(w, TN_STIFF_BDF, t0, y)) {
+        tn_stiff_work_reset(w);
+        w->method = TN_STIFF_BDF;
+        ode_func(t, y, w->f0, params);
+        res.n_rhs++;
+        w->h = initial_step(ode_func, t, y, w->f0, params, 1, opt, w, &res);
+        memcpy(d, y, n * sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            d[n + i] = w->h * w->f0[i];
+        }
+        jacobian(ode_func, jac, t, y, w->f0, params, opt, w, &res);
+    }
+
+    res.status = TN_STIFF_SUCCESS;
+    double* y_new = w->y_new;
+    while (t < t_end) {
+        if (res.n_steps >= (size_t)opt->max_steps) {
+            res.status = TN_STIFF_MAX_STEPS;
+            break;
+        }
+        int order = w->order;
+        double h = w->h;
+        if (h > opt->h_max) {
+            change_d(w, order, opt->h_max / h);
+            h = opt->h_max;
+        }
+        else if (h < min_step(t)) {
+            change_d(w, order, min_step(t) / h);
+            h = min_step(t);
+        }
+
+        int accepted = 0;
+        int n_iter = 0;
+        double t_new = t;
+        while (!accepted) {
+            if (h < min_step(t)) {
+                res.status = TN_STIFF_STEP_TOO_SMALL;
+                w->h = h;
+                break;
+            }
+            t_new = t + h;
+            if (t_new > t_end) {
+                change_d(w, order, (t_end - t) / h);
+                t_new = t_end;
+            }
+            h = t_new - t;
+
+            // predictor: sum of the differences
+            for (size_t i = 0; i < n; i++) {
+                double sum = 0.0;
+                for (int k = 0; k <= order; k++) {
+                    sum += d[k * n + i];
+                }
+                y_new[i] = sum;
+                double psi = 0.0;
+                for (int k = 1; k <= order; k++) {
+                    psi += gamma[k] * d[k * n + i];
+                }
+                w->psi[i] = psi / alpha[order];
+            }
+            memcpy(w->y_pred, y_new, n * sizeof(double));
+            error_scale(y_new, NULL, opt, dim, w->scale);
+
+            double c = h / alpha[order];
+            int converged = 0;
+            while (!converged) {
+                if ((!w->lu_valid || w->c_lu != c) && !factorize(w, c, &res)) {
+                    break;
+                }
+                converged = solve_corrector(ode_func, t_new, y_new, c, params,
+                                            newton_tol, &n_iter, w, &res);
+                if (!converged) {
+                    if (w->jac_current) {
+                        break;
+                    }
+                    // the stored J is too old, retry with a fresh one
+                    memcpy(y_new, w->y_pred, n * sizeof(double));
+                    jacobian(ode_func, jac, t_new, y_new, NULL, params, opt, w, &res);
+                }
+            }
+            if (!converged) {
+                res.n_rejected++;
+                memcpy(y_new, w->y_pred, n * sizeof(double));
+                change_d(w, order, 0.5);
+                h *= 0.5;
+                continue;
+            }
+
+            double safety = 0.9 * (2 * TN_STIFF_NEWTON_MAXITER + 1)
+                          / (2 * TN_STIFF_NEWTON_MAXITER + n_iter);
+            error_scale(y_new, NULL, opt, dim, w->scale);
+            double err = error_const[order] * rms_norm(w->delta, w->scale, dim);
+            if (err > 1.0) {
+                res.n_rejected++;
+                double factor = fmax(TN_STIFF_MIN_FACTOR,
+                                     safety * pow(err, -1.0 / (order + 1)));
+                change_d(w, order, factor);
+                h *= factor;
+                // J is fine, the factorization is renewed for the new h
+                continue;
+            }
+            accepted = 1;
+
+            // update of the differences: D[order + 1] = delta is the
+            // (order + 1)-th difference of the new step
+            double* da = d + (order + 1) * n;
+            double* db = d + (order + 2) * n;
+            for (size_t i = 0; i < n; i++) {
+                db[i] = w->delta[i] - da[i];
+                da[i] = w->delta[i];
+            }
+            for (int k = order; k >= 0; k--) {
+                for (size_t i = 0; i < n; i++) {
+                    d[k * n + i] += d[(k + 1) * n + i];
+                }
+            }
+            w->n_equal_steps++;
+            w->jac_current = 0;
+
+            // order and step size are only changed after order + 1 equal steps
+            w->h = h;
+            if (w->n_equal_steps < order + 1) {
+                break;
+            }
+            double err_m = INFINITY;
+            double err_p = INFINITY;
+            if (order > 1) {
+                err_m = error_const[order - 1] * rms_norm(d + order * n, w->scale, dim);
+            }
+            if (order < opt->max_order) {
+                err_p = error_const[order + 1] * rms_norm(d + (order + 2) * n, w->scale, dim);
+            }
+            double factors[3] = {
+                pow(err_m, -1.0 / order),
+                pow(err, -1.0 / (order + 1)),
+                pow(err_p, -1.0 / (order + 2))
+            };
+            int best = 0;
+            for (int k = 1; k < 3; k++) {
+                if (factors[k] > factors[best]) {
+                    best = k;
+                }
+            }
+            w->order = order + best - 1;
+            double factor = fmin(TN_STIFF_MAX_FACTOR, safety * factors[best]);
+            change_d(w, w->order, factor);
+            w->h = h * factor;
+        }
+        if (!accepted) {
+            break;
+        }
+        t = t_new;
+        memcpy(y, y_new, n * sizeof(double));
+        res.n_steps++;
+    }
+
+    w->t = t;
+    memcpy(w->y_last, y, n * sizeof(double));
+    res.t = t;
+    res.h = w->h;
+    res.order = w->order;
+    TN_PROFILE_CALLBACKS(res.n_rhs);
+    TN_PROFILE_END();
+    return res;
+}
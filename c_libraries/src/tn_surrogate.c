@@ -0,0 +1,461 @@
+#include "t_numerics_intern.h"
+
+//================================================================================
+//    surrogates of expensive functions
+//================================================================================
+
+/* [a, b] is bisected until the Chebyshev interpolant of degree d on each
+ * piece meets the tolerance: for d >= TN_SURROGATE_TAIL_DEGREE the size of
+ * the last two coefficients estimates the error (they decay geometrically
+ * for smooth functions), lower degrees are checked against f at the points
+ * half way between the nodes. The pieces sit in a max-heap of their errors
+ * and the worst one is split first, so a limit on the number of pieces
+ * leaves the error as small as that number allows instead of exhausting it
+ * on the left end of [a, b]. The tolerance is atol + rtol * max |f| with the
+ * maximum over all values seen so far, the same bound for every piece and
+ * for the reported error. All pieces are dyadic, [a, b] / 2^level, so
+ * a table over the finest level maps x to its piece with one
+ * multiplication; only levels beyond TN_SURROGATE_MAX_TABLE_LEVEL need a
+ * short scan.
+ *
+ * Pieces are evaluated by Clenshaw's recurrence. The batch evaluation
+ * first looks up the pieces of a block of points and then runs the
+ * recurrence for the whole block, with a fixed trip count the compiler
+ * vectorizes (the coefficients are gathered). */
+
+// degrees from which the coefficient tail is trusted as error estimate
+#define TN_SURROGATE_TAIL_DEGREE 8
+// finest level covered by the lookup table (2^level entries)
+#define TN_SURROGATE_MAX_TABLE_LEVEL 20
+#define TN_SURROGATE_MAX_DEGREE 64
+// points per block of the batch evaluation
+#define TN_SURROGATE_BLOCK 256
+
+struct tn_surrogate {
+    double a, b;
+    int degree;
+    size_t n_pieces;
+    double* lo;           // left ends, n_pieces + 1 (last: b)
+    double* center;       // mid points
+    double* scale;        // 2 / width
+    double* coef;         // n_pieces x (degree + 1) Chebyshev coefficients
+    int* table;           // first piece per cell of the lookup table
+    double table_scale;   // cells per unit of x
+    size_t table_len;
+    double error;         // max estimated absolute error
+    int status;
+};
+
+tn_surrogate_options
+tn_surrogate_default_options (void)
+{
+    tn_surrogate_options opt;
+    opt.degree = 16;
+    opt.atol = 0.0;
+    opt.rtol = 1e-12;
+    opt.max_pieces = 4096;
+    opt.max_level = 40;
+    return opt;
+}
+
+/* piece data during the build */
+typedef struct {
+    double lo, hi;
+    int level;
+    double error;
+    size_t slot;          // coefficients at coef + slot * (degree + 1)
+} piece;
+
+/* max-heap of piece indices by error */
+static void
+heap_push (size_t* heap, size_t* len, const piece* pieces, size_t k)
+{
+    size_t i = (*len)++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (pieces[heap[parent]].error >= pieces[k].error) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = k;
+}
+
+static void
+heap_pop (size_t* heap, size_t* len, const piece* pieces)
+{
+    size_t k = heap[--(*len)];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= *len) {
+            break;
+        }
+        if (child + 1 < *len && pieces[heap[child + 1]].error > pieces[heap[child]].error) {
+            child++;
+        }
+        if (pieces[heap[child]].error <= pieces[k].error) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*len > 0) {
+        heap[i] = k;
+    }
+}
+
+static int
+piece_compare (const void* p, const void* q)
+{
+    double lo_p = ((const piece*)p)->lo;
+    double lo_q = ((const piece*)q)->lo;
+    return (lo_p > lo_q) - (lo_p < lo_q);
+}
+
+/* Chebyshev coefficients c[0..d] of the interpolant at the points of the
+ * first kind from the values f[0..d]; cosines: (d+1) x (d+1) table */
+static void
+cheb_coef (const double* f, const double* cosines, int d, double* c)
+{
+    int n = d + 1;
+    for (int k = 0; k < n; k++) {
+        double s = 0.0;
+        for (int j = 0; j < n; j++) {
+            s += f[j] * cosines[k * n + j];
+        }
+        c[k] = (k == 0 ? 1.0 : 2.0) * s / n;
+    }
+}
+
+static inline double
+clenshaw (const double* c, int d, double t)
+{
+    double b1 = 0.0;
+    double b2 = 0.0;
+    double t2 = 2.0 * t;
+    for (int k = d; k >= 1; k--) {
+        double b0 = c[k] + t2 * b1 - b2;
+        b2 = b1;
+        b1 = b0;
+    }
+    return c[0] + t * b1 - b2;
+}
+
+/* fits f on [lo, hi], returns the estimated error, c: degree + 1 */
+static double
+fit_piece (STD_FUNC func, void* params, double lo, double hi, int d,
+           const double* nodes, const double* cosines, double* f, double* c,
+           double* f_max, size_t* n_calls)
+{
+    double mid = 0.5 * (lo + hi);
+    double half = 0.5 * (hi - lo);
+    *f_max = 0.0;
+    for (int j = 0; j <= d; j++) {
+        f[j] = func(mid + half * nodes[j], params);
+        *f_max = fmax(*f_max, fabs(f[j]));
+    }
+    *n_calls += d + 1;
+    cheb_coef(f, cosines, d, c);
+    if (d >= TN_SURROGATE_TAIL_DEGREE) {
+        return fabs(c[d - 1]) + fabs(c[d]);
+    }
+    // low degree: compare with f between the nodes
+    double err = 0.0;
+    for (int j = 0; j < d; j++) {
+        double t = 0.5 * (nodes[j] + nodes[j + 1]);
+        double fx = func(mid + half * t, params);
+        *f_max = fmax(*f_max, fabs(fx));
+        err = fmax(err, fabs(fx - clenshaw(c, d, t)));
+    }
+    *n_calls += d;
+    return err;
+}
+
+tn_surrogate*
+tn_surrogate_build (STD_FUNC func, void* params, double a, double b,
+                    const tn_surrogate_options* opt)
+{
+    TN_PROFILE_BEGIN(tn_surrogate_build);
+    if (!func) {
+        tp_raiseError("Null pointer in tn_surrogate_build.");
+    }
+    if (!(b > a)) {
+        tp_raiseError("tn_surrogate_build needs b > a!");
+    }
+    tn_surrogate_options o = opt ? *opt : tn_surrogate_default_options();
+    if (o.degree < 1 || o.degree > TN_SURROGATE_MAX_DEGREE) {
+        tp_raiseError("Degree of tn_surrogate_build has to be in 1 .. 64!");
+    }
+    if (o.max_pieces < 1) {
+        o.max_pieces = 1;
+    }
+    const int d = o.degree;
+    const int n = d + 1;
+
+    // nodes ascending: t_j = -cos(pi (j + 1/2) / n)
+    double nodes[TN_SURROGATE_MAX_DEGREE + 1];
+    double* cosines = malloc((size_t)n * n * sizeof(double));
+    Null_exit_message(cosines, "Memory allocation failed in tn_surrogate_build!");
+    for (int j = 0; j < n; j++) {
+        nodes[j] = -cos(M_PI * (j + 0.5) / n);
+    }
+    for (int k = 0; k < n; k++) {
+        for (int j = 0; j < n; j++) {
+            cosines[k * n + j] = cos(k * acos(nodes[j]));
+        }
+    }
+
+    // a split puts the left half into the slot of the parent and appends the
+    // right half, the heap holds slots
+    size_t cap = 64;
+    size_t n_pieces = 0;
+    size_t n_heap = 0;
+    piece* pieces = malloc(cap * sizeof(piece));
+    double* coef = malloc(cap * n * sizeof(double));
+    size_t* heap = malloc(cap * sizeof(size_t));
+    double f[TN_SURROGATE_MAX_DEGREE + 1];
+    if (!pieces || !coef || !heap) {
+        tp_raiseError("Memory allocation failed in tn_surrogate_build!");
+    }
+    size_t n_calls = 0;
+    double f_max = 0.0;
+    int status = TN_SURROGATE_SUCCESS;
+
+    pieces[0] = (piece){a, b, 0, 0.0, 0};
+    pieces[0].error = fit_piece(func, params, a, b, d, nodes, cosines, f, coef,
+                                &f_max, &n_calls);
+    n_pieces = 1;
+    heap_push(heap, &n_heap, pieces, 0);
+    while (n_heap > 0) {
+        size_t k = heap[0];
+        if (pieces[k].error <= o.atol + o.rtol * f_max) {
+            break;
+        }
+        if (n_pieces >= (size_t)o.max_pieces) {
+            status = TN_SURROGATE_TOL_NOT_REACHED;
+            break;
+        }
+        heap_pop(heap, &n_heap, pieces);
+        if (pieces[k].level >= o.max_level) {
+            // stays as it is, the remaining pieces may still be split
+            status = TN_SURROGATE_TOL_NOT_REACHED;
+            continue;
+        }
+        if (n_pieces == cap) {
+            cap *= 2;
+            piece* new_pieces = realloc(pieces, cap * sizeof(piece));
+            double* new_coef = realloc(coef, cap * n * sizeof(double));
+            size_t* new_heap = realloc(heap, cap * sizeof(size_t));
+            if (!new_pieces || !new_coef || !new_heap) {
+                tp_raiseError("Memory allocation failed in tn_surrogate_build!");
+            }
+            pieces = new_pieces;
+            coef = new_coef;
+            heap = new_heap;
+        }
+        piece p = pieces[k];
+        double mid = 0.5 * (p.lo + p.hi);
+        size_t right = n_pieces++;
+        double f_piece;
+        pieces[k] = (piece){p.lo, mid, p.level + 1, 0.0, k};
+        pieces[k].error = fit_piece(func, params, p.lo, mid, d, nodes, cosines, f,
+                                    coef + k * n, &f_piece, &n_calls);
+        f_max = fmax(f_max, f_piece);
+        pieces[right] = (piece){mid, p.hi, p.level + 1, 0.0, right};
+        pieces[right].error = fit_piece(func, params, mid, p.hi, d, nodes, cosines, f,
+                                        coef + right * n, &f_piece, &n_calls);
+        f_max = fmax(f_max, f_piece);
+        heap_push(heap, &n_heap, pieces, k);
+        heap_push(heap, &n_heap, pieces, right);
+    }
+    free(heap);
+    free(cosines);
+
+    // order of x for the lookup, the coefficients follow their pieces
+    piece* done = pieces;
+    size_t n_done = n_pieces;
+    qsort(done, n_done, sizeof(piece), piece_compare);
+    double* coef_sorted = malloc(n_done * n * sizeof(double));
+    Null_exit_message(coef_sorted, "Memory allocation failed in tn_surrogate_build!");
+    for (size_t k = 0; k < n_done; k++) {
+        memcpy(coef_sorted + k * n, coef + done[k].slot * n, n * sizeof(double));
+    }
+    free(coef);
+    coef = coef_sorted;
+
+    tn_surrogate* s = malloc(sizeof(tn_surrogate));
+    Null_exit_message(s, "Memory allocation failed in tn_surrogate_build!");
+    s->a = a;
+    s->b = b;
+    s->degree = d;
+    s->n_pieces = n_done;
+    s->coef = coef;
+    s->status = status;
+    s->error = 0.0;
+    s->lo = malloc((n_done + 1) * sizeof(double));
+    s->center = malloc(n_done * sizeof(double));
+    s->scale = malloc(n_done * sizeof(double));
+    if (!s->lo || !s->center || !s->scale) {
+        tp_raiseError("Memory allocation failed in tn_surrogate_build!");
+    }
+    int max_level = 0;
+    for (size_t k = 0; k < n_done; k++) {
+        s->lo[k] = done[k].lo;
+        s->center[k] = 0.5 * (done[k].lo + done[k].hi);
+        s->scale[k] = 2.0 / (done[k].hi - done[k].lo);
+        s->error = fmax(s->error, done[k].error);
+        max_level = done[k].level > max_level ? done[k].level : max_level;
+    }
+    s->lo[n_done] = b;
+
+    // cell c of the table covers [a + c w, a + (c + 1) w), its entry is the
+    // piece containing the left end
+    int table_level = max_level < TN_SURROGATE_MAX_TABLE_LEVEL
+                      ? max_level : TN_SURROGATE_MAX_TABLE_LEVEL;
+    s->table_len = (size_t)1 << table_level;
+    s->table_scale = (double)s->table_len / (b - a);
+    s->table = malloc(s->table_len * sizeof(int));
+    Null_exit_message(s->table, "Memory allocation failed in tn_surrogate_build!");
+    size_t k = 0;
+    for (size_t cell = 0; cell < s->table_len; cell++) {
+        double x = a + (b - a) * (double)cell / (double)s->table_len;
+        while (k + 1 < n_done && s->lo[k + 1] <= x) {
+            k++;
+        }
+        s->table[cell] = (int)k;
+    }
+    free(done);
+    TN_PROFILE_CALLBACKS(n_calls);
+    TN_PROFILE_END();
+    return s;
+}
+
+void
+tn_surrogate_free (tn_surrogate* s)
+{
+    if (!s) {
+        return;
+    }
+    free(s->lo);
+    free(s->center);
+    free(s->scale);
+    free(s->coef);
+    free(s->table);
+    free(s);
+}
+
+/* piece of x, outside [a, b] the end pieces */
+static inline size_t
+find_piece (const tn_surrogate* s, double x)
+{
+    double pos = (x - s->a) * s->table_scale;
+    size_t cell = pos <= 0.0 ? 0
+                  : pos >= (double)s->table_len ? s->table_len - 1 : (size_t)pos;
+    size_t k = (size_t)s->table[cell];
+    while (k + 1 < s->n_pieces && s->lo[k + 1] <= x) {
+        k++;
+    }
+    return k;
+}
+
+double
+tn_surrogate_eval (const tn_surrogate* s, double x)
+{
+    size_t k = find_piece(s, x);
+    double t = (x - s->center[k]) * s->scale[k];
+    return clenshaw(s->coef + k * (s->degree + 1), s->degree, t);
+}
+
+double
+tn_surrogate_func (double x, void* params)
+{
+    return tn_surrogate_eval((const tn_surrogate*)params, x);
+}
+
+void
+tn_surrogate_eval_ptr (const tn_surrogate* s, const double* x, double* y, size_t n)
+{
+    if (!s || !x || !y) {
+        tp_raiseError("Null pointer in tn_surrogate_eval_ptr.");
+    }
+    const int d = s->degree;
+    const size_t stride = (size_t)d + 1;
+    const double* coef = s->coef;
+    size_t piece_of[TN_SURROGATE_BLOCK];
+    double t_of[TN_SURROGATE_BLOCK];
+    for (size_t start = 0; start < n; start += TN_SURROGATE_BLOCK) {
+        size_t m = n - start < TN_SURROGATE_BLOCK ? n - start : TN_SURROGATE_BLOCK;
+        const double* xb = x + start;
+        double* yb = y + start;
+        for (size_t i = 0; i < m; i++) {
+            size_t k = find_piece(s, xb[i]);
+            piece_of[i] = k * stride;
+            t_of[i] = (xb[i] - s->center[k]) * s->scale[k];
+        }
+        #pragma omp simd
+        for (size_t i = 0; i < m; i++) {
+            const double* c = coef + piece_of[i];
+            double t = t_of[i];
+            double t2 = 2.0 * t;
+            double b1 = 0.0;
+            double b2 = 0.0;
+            for (int j = d; j >= 1; j--) {
+                double b0 = c[j] + t2 * b1 - b2;
+                b2 = b1;
+                b1 = b0;
+            }
+            yb[i] = c[0] + t * b1 - b2;
+        }
+    }
+}
+
+void
+tn_surrogate_eval_t_array (const tn_surrogate* s, const t_array* x, t_array* y)
+{
+    TN_PROFILE_BEGIN(tn_surrogate_eval_t_array);
+    if (!s || !x || !y) {
+        tp_raiseError("Null pointer in tn_surrogate_eval_t_array.");
+    }
+    if (x->len != y->len) {
+        tp_raiseError("Incompatible array lengths in tn_surrogate_eval_t_array.");
+    }
+    long n = (long)x->len;
+    long n_blocks = (n + TN_SURROGATE_BLOCK - 1) / TN_SURROGATE_BLOCK;
+    #pragma omp parallel for schedule(static) if(n_blocks > 64)
+    for (long blk = 0; blk < n_blocks; blk++) {
+        size_t start = (size_t)blk * TN_SURROGATE_BLOCK;
+        size_t m = (size_t)n - start < TN_SURROGATE_BLOCK ? (size_t)n - start
+                                                         : TN_SURROGATE_BLOCK;
+        tn_surrogate_eval_ptr(s, x->ptr + start, y->ptr + start, m);
+    }
+    TN_PROFILE_END();
+}
+
+size_t
+tn_surrogate_pieces (const tn_surrogate* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_surrogate_pieces.");
+    }
+    return s->n_pieces;
+}
+
+double
+tn_surrogate_error (const tn_surrogate* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_surrogate_error.");
+    }
+    return s->error;
+}
+
+int
+tn_surrogate_status (const tn_surrogate* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_surrogate_status.");
+    }
+    return s->status;
+}
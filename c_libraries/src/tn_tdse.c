@@ -0,0 +1,423 @@
+#include "t_numerics_intern.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    split-operator propagation of the Schroedinger equation
+//================================================================================
+
+/* i dpsi/dt = -1/(2m) lap(psi) + V(x) psi (hbar = 1) on a periodic box.
+ * Strang splitting
+ *
+ *   psi(t + dt) = exp(-i V dt/2) F^-1 exp(-i T(k) dt) F exp(-i V dt/2) psi(t)
+ *
+ * with the kinetic energy T(k) = k^2 / (2m) diagonal in Fourier space. The
+ * phase arrays are computed once; the 1/N of the inverse FFT is folded into
+ * the kinetic phase and consecutive half steps of V are merged into one
+ * full step, so a step costs two FFTs and two pointwise products.
+ *
+ * The multidimensional FFT transforms the lines of every axis with one
+ * tn_fft_plan per axis. Lines along x are contiguous; lines along y and z
+ * are gathered TN_TDSE_LINES at a time (neighbouring x) into a buffer, so
+ * the strided accesses still read whole cache lines. Lines are distributed
+ * over the threads. */
+
+// strided lines gathered together
+#define TN_TDSE_LINES 8
+// minimal number of grid points for threading
+#define TN_TDSE_PARALLEL_MIN 16384
+
+struct tn_tdse {
+    int ndim;
+    int imaginary;
+    size_t n[3];          // 1 for unused axes
+    size_t points;
+    double dx[3];
+    double dv;            // volume element
+    double mass;
+    double dt;
+    double t;
+    tn_fft_plan* plan[3];
+    t_carray* psi;
+    double* kinetic;      // T(k), N
+    double* potential;    // V(x), N
+    double* phase_t;      // exp(-i T dt) / N, interleaved
+    double* phase_v;      // exp(-i V dt), interleaved
+    double* phase_v2;     // exp(-i V dt / 2), interleaved
+    double* scratch;      // N complex values
+    double* lines;        // TN_TDSE_LINES * max n complex values per thread
+    int n_threads;
+    int parallel;
+};
+
+static double
+wave_number (size_t i, size_t n, double length)
+{
+    double m = i < n / 2 ? (double)i : (double)i - (double)n;
+    return 2.0 * M_PI * m / length;
+}
+
+/* phase = exp(-i e dt) for real time, exp(-e dt) for imaginary time */
+static void
+make_phase (const tn_tdse* s, const double* e, double dt, double factor,
+            double* phase)
+{
+    for (size_t p = 0; p < s->points; p++) {
+        if (s->imaginary) {
+            phase[2 * p] = factor * exp(-e[p] * dt);
+            phase[2 * p + 1] = 0.0;
+        }
+        else {
+            phase[2 * p] = factor * cos(e[p] * dt);
+            phase[2 * p + 1] = -factor * sin(e[p] * dt);
+        }
+    }
+}
+
+static void
+update_potential_phases (tn_tdse* s)
+{
+    make_phase(s, s->potential, s->dt, 1.0, s->phase_v);
+    make_phase(s, s->potential, 0.5 * s->dt, 1.0, s->phase_v2);
+}
+
+tn_tdse*
+tn_tdse_alloc (int ndim, const size_t n[], const double lo[], const double hi[],
+               double mass, double dt, int imaginary)
+{
+    if (ndim < 1 || ndim > 3) {
+        tp_raiseError("tn_tdse_alloc supports 1 to 3 dimensions!");
+    }
+    if (!n || !lo || !hi) {
+        tp_raiseError("Null pointer in tn_tdse_alloc.");
+    }
+    if (mass <= 0.0 || dt <= 0.0) {
+        tp_raiseError("tn_tdse_alloc needs mass > 0 and dt > 0!");
+    }
+    tn_tdse* s = malloc(sizeof(tn_tdse));
+    Null_exit_message(s, "Memory allocation failed in tn_tdse_alloc!");
+    s->ndim = ndim;
+    s->imaginary = imaginary != 0;
+    s->mass = mass;
+    s->dt = dt;
+    s->t = 0.0;
+    s->points = 1;
+    s->dv = 1.0;
+    size_t n_max = 1;
+    for (int d = 0; d < 3; d++) {
+        s->plan[d] = NULL;
+        if (d < ndim) {
+            if (hi[d] <= lo[d]) {
+                tp_raiseError("tn_tdse_alloc needs hi > lo!");
+            }
+            s->n[d] = n[d];
+            s->dx[d] = (hi[d] - lo[d]) / (double)n[d];
+            s->plan[d] = tn_fft_plan_alloc(n[d]);
+        }
+        else {
+            s->n[d] = 1;
+            s->dx[d] = 1.0;
+        }
+        s->points *= s->n[d];
+        s->dv *= s->dx[d];
+        n_max = s->n[d] > n_max ? s->n[d] : n_max;
+    }
+    s->n_threads = 1;
+    s->parallel = s->points >= TN_TDSE_PARALLEL_MIN;
+#ifdef _OPENMP
+    if (s->parallel) {
+        s->n_threads = omp_get_max_threads();
+    }
+#endif
+    size_t np = s->points;
+    s->psi = t_carray_alloc(np);
+    s->kinetic = malloc(np * sizeof(double));
+    s->potential = calloc(np, sizeof(double));
+    s->phase_t = malloc(2 * np * sizeof(double));
+    s->phase_v = malloc(2 * np * sizeof(double));
+    s->phase_v2 = malloc(2 * np * sizeof(double));
+    s->scratch = malloc(2 * np * sizeof(double));
+    s->lines = malloc((size_t)s->n_threads * TN_TDSE_LINES * 2 * n_max * sizeof(double));
+    if (!s->kinetic || !s->potential || !s->phase_t || !s->phase_v
+        || !s->phase_v2 || !s->scratch || !s->lines) {
+        tp_raiseError("Memory allocation failed in tn_tdse_alloc!");
+    }
+
+    // T(k) in the order of the FFT output
+    for (size_t k = 0; k < s->n[2]; k++) {
+        double kz = ndim > 2 ? wave_number(k, s->n[2], hi[2] - lo[2]) : 0.0;
+        for (size_t j = 0; j < s->n[1]; j++) {
+            double ky = ndim > 1 ? wave_number(j, s->n[1], hi[1] - lo[1]) : 0.0;
+            for (size_t i = 0; i < s->n[0]; i++) {
+                double kx = wave_number(i, s->n[0], hi[0] - lo[0]);
+                s->kinetic[(k * s->n[1] + j) * s->n[0] + i]
+                    = (kx * kx + ky * ky + kz * kz) / (2.0 * mass);
+            }
+        }
+    }
+    make_phase(s, s->kinetic, dt, 1.0 / (double)np, s->phase_t);
+    update_potential_phases(s);
+    return s;
+}
+
+void
+tn_tdse_free (tn_tdse* s)
+{
+    if (!s) {
+        return;
+    }
+    for (int d = 0; d < 3; d++) {
+        tn_fft_plan_free(s->plan[d]);
+    }
+    T_CARRAY_FREE(s->psi);
+    free(s->kinetic);
+    free(s->potential);
+    free(s->phase_t);
+    free(s->phase_v);
+    free(s->phase_v2);
+    free(s->scratch);
+    free(s->lines);
+    free(s);
+}
+
+t_carray*
+tn_tdse_psi (tn_tdse* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_tdse_psi.");
+    }
+    return s->psi;
+}
+
+double
+tn_tdse_time (const tn_tdse* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_tdse_time.");
+    }
+    return s->t;
+}
+
+void
+tn_tdse_set_time (tn_tdse* s, double t)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_tdse_set_time.");
+    }
+    s->t = t;
+}
+
+void
+tn_tdse_set_potential (tn_tdse* s, const t_array* v)
+{
+    if (!s || !v) {
+        tp_raiseError("Null pointer in tn_tdse_set_potential.");
+    }
+    if (v->len != s->points) {
+        tp_raiseError("Length of potential does not match the grid in tn_tdse_set_potential.");
+    }
+    memcpy(s->potential, v->ptr, s->points * sizeof(double));
+    update_potential_phases(s);
+}
+
+//-----------------------------------
+// kernels
+//-----------------------------------
+
+/* psi *= phase pointwise, both interleaved */
+static void
+multiply_phase (const tn_tdse* s, double* psi, const double* phase)
+{
+    long np = (long)s->points;
+    #pragma omp parallel for simd schedule(static) if(s->parallel)
+    for (long p = 0; p < np; p++) {
+        double re = psi[2 * p];
+        double im = psi[2 * p + 1];
+        double pr = phase[2 * p];
+        double pi = phase[2 * p + 1];
+        psi[2 * p] = pr * re - pi * im;
+        psi[2 * p + 1] = pr * im + pi * re;
+    }
+}
+
+static double
+norm2 (const tn_tdse* s, const double* psi)
+{
+    long np = (long)s->points;
+    double sum = 0.0;
+    #pragma omp parallel for simd reduction(+:sum) schedule(static) if(s->parallel)
+    for (long p = 0; p < np; p++) {
+        sum += psi[2 * p] * psi[2 * p] + psi[2 * p + 1] * psi[2 * p + 1];
+    }
+    return sum * s->dv;
+}
+
+/* in-place FFT over all axes of the grid, not normalized */
+static void
+fft_grid (tn_tdse* s, double* data, int sign)
+{
+    const size_t nx = s->n[0];
+    const size_t ny = s->n[1];
+    const size_t nz = s->n[2];
+    // x: contiguous lines
+    long n_rows = (long)(ny * nz);
+    #pragma omp parallel for schedule(static) if(s->parallel) num_threads(s->n_threads)
+    for (long r = 0; r < n_rows; r++) {
+        tn_fft_execute(s->plan[0], (double complex*)(data + 2 * (size_t)r * nx), sign);
+    }
+    // y and z: blocks of neighbouring lines are gathered and scattered
+    for (int d = 1; d < s->ndim; d++) {
+        const size_t len = s->n[d];
+        const size_t stride = d == 1 ? nx : nx * ny;
+        // lines start at (i, 0, k) for y and (i, j, 0) for z
+        const size_t n_outer = d == 1 ? nz : ny;
+        const size_t outer_stride = d == 1 ? nx * ny : nx;
+        const size_t n_blocks = (nx + TN_TDSE_LINES - 1) / TN_TDSE_LINES;
+        long n_tasks = (long)(n_outer * n_blocks);
+        #pragma omp parallel if(s->parallel) num_threads(s->n_threads)
+        {
+            int id = 0;
+#ifdef _OPENMP
+            id = omp_get_thread_num();
+#endif
+            double* buf = s->lines + (size_t)id * TN_TDSE_LINES * 2 * len;
+            #pragma omp for schedule(static)
+            for (long task = 0; task < n_tasks; task++) {
+                size_t o = (size_t)task / n_blocks;
+                size_t i0 = ((size_t)task % n_blocks) * TN_TDSE_LINES;
+                size_t nl = nx - i0 < TN_TDSE_LINES ? nx - i0 : TN_TDSE_LINES;
+                double* base = data + 2 * (o * outer_stride + i0);
+                for (size_t m = 0; m < len; m++) {
+                    const double* src = base + 2 * m * stride;
+                    for (size_t l = 0; l < nl; l++) {
+                        buf[2 * (l * len + m)] = src[2 * l];
+                        buf[2 * (l * len + m) + 1] = src[2 * l + 1];
+                    }
+                }
+                for (size_t l = 0; l < nl; l++) {
+                    tn_fft_execute(s->plan[d], (double complex*)(buf + 2 * l * len), sign);
+                }
+                for (size_t m = 0; m < len; m++) {
+                    double* dst = base + 2 * m * stride;
+                    for (size_t l = 0; l < nl; l++) {
+                        dst[2 * l] = buf[2 * (l * len + m)];
+                        dst[2 * l + 1] = buf[2 * (l * len + m) + 1];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void
+normalize (tn_tdse* s, double* psi)
+{
+    double nrm = sqrt(norm2(s, psi));
+    if (nrm > 0.0) {
+        long np = (long)s->points;
+        double scale = 1.0 / nrm;
+        #pragma omp parallel for simd schedule(static) if(s->parallel)
+        for (long p = 0; p < 2 * np; p++) {
+            psi[p] *= scale;
+        }
+    }
+}
+
+//-----------------------------------
+// propagation
+//-----------------------------------
+
+void
+tn_tdse_step (tn_tdse* s, long n_steps)
+{
+    TN_PROFILE_BEGIN(tn_tdse_step);
+    if (!s) {
+        tp_raiseError("Null pointer in tn_tdse_step.");
+    }
+    if (n_steps <= 0) {
+        TN_PROFILE_END();
+        return;
+    }
+    // psi is interleaved (t_carray_alloc), the FFT works on it in place
+    double* psi = s->psi->ptr;
+    multiply_phase(s, psi, s->phase_v2);
+    for (long step = 0; step < n_steps; step++) {
+        fft_grid(s, psi, -1);
+        multiply_phase(s, psi, s->phase_t);
+        fft_grid(s, psi, 1);
+        // two half steps of V merged, except after the last step
+        multiply_phase(s, psi, step + 1 < n_steps ? s->phase_v : s->phase_v2);
+        if (s->imaginary) {
+            normalize(s, psi);
+        }
+    }
+    s->t += n_steps * s->dt;
+    TN_PROFILE_END();
+}
+
+double
+tn_tdse_norm (const tn_tdse* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_tdse_norm.");
+    }
+    return sqrt(norm2(s, s->psi->ptr));
+}
+
+double
+tn_tdse_energy (tn_tdse* s)
+{
+    if (!s) {
+        tp_raiseError("Null pointer in tn_tdse_energy.");
+    }
+    const double* psi = s->psi->ptr;
+    long np = (long)s->points;
+    double e_pot = 0.0;
+    double nrm = 0.0;
+    #pragma omp parallel for simd reduction(+:e_pot, nrm) schedule(static) if(s->parallel)
+    for (long p = 0; p < np; p++) {
+        double rho = psi[2 * p] * psi[2 * p] + psi[2 * p + 1] * psi[2 * p + 1];
+        e_pot += s->potential[p] * rho;
+        nrm += rho;
+    }
+    // kinetic energy in Fourier space, Parseval: sum |psi|^2 = sum |F psi|^2 / N
+    memcpy(s->scratch, psi, 2 * s->points * sizeof(double));
+    fft_grid(s, s->scratch, -1);
+    const double* phi = s->scratch;
+    double e_kin = 0.0;
+    #pragma omp parallel for simd reduction(+:e_kin) schedule(static) if(s->parallel)
+    for (long p = 0; p < np; p++) {
+        e_kin += s->kinetic[p] * (phi[2 * p] * phi[2 * p] + phi[2 * p + 1] * phi[2 * p + 1]);
+    }
+    if (nrm == 0.0) {
+        return 0.0;
+    }
+    return (e_pot + e_kin / (double)np) / nrm;
+}
+
+void
+tn_tdse_snapshot (tn_tdse* s, t_io_writer* w, int what)
+{
+    if (!s || !w) {
+        tp_raiseError("Null pointer in tn_tdse_snapshot.");
+    }
+    const double* psi = s->psi->ptr;
+    if (what == TN_TDSE_PSI) {
+        if (t_io_writer_cols(w) != 2 * s->points) {
+            tp_raiseError("Writer of tn_tdse_snapshot needs 2 * points columns.");
+        }
+        t_io_writer_append(w, psi);
+    }
+    else {
+        if (t_io_writer_cols(w) != s->points) {
+            tp_raiseError("Writer of tn_tdse_snapshot needs points columns.");
+        }
+        double* rho = s->scratch;
+        for (size_t p = 0; p < s->points; p++) {
+            rho[p] = psi[2 * p] * psi[2 * p] + psi[2 * p + 1] * psi[2 * p + 1];
+        }
+        t_io_writer_append(w, rho);
+    }
+}
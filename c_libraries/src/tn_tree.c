@@ -0,0 +1,635 @@
+#include "t_numerics_intern.h"
+
+#include <float.h>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//================================================================================
+//    tree code for gravitational and Coulomb forces
+//================================================================================
+
+/* Build: the particles are mapped to 63 bit Morton codes (21 bits per
+ * axis) in their bounding cube and sorted by a radix sort; positions and
+ * weights are stored sorted as separate arrays (SoA). Every octree cell
+ * is then a contiguous range of the sorted particles, and the cells are
+ * found by splitting ranges at the next 3 bits of the codes.
+ *
+ * Each cell stores its multipole moments about the |w| weighted center:
+ * total weight, dipole (zero for masses) and optionally the second moment.
+ * The full (not traceless) second moment keeps the expansion consistent
+ * with the Plummer softened kernel, which is not harmonic. Forces are
+ * evaluated per particle in sorted order, so consecutive particles walk
+ * nearly the same cells. A cell is accepted if
+ * dist > size / theta + delta, delta being the offset of the expansion
+ * center from the cell center (Barnes 1994); this stays accurate for
+ * cells whose mass sits at one side. Leaves are summed directly with unit
+ * stride loops over the SoA arrays.
+ *
+ * Codes, sort and force evaluation are threaded; the topology is built
+ * serially in O(N) from the sorted codes. */
+
+// leaves have at most this many particles by default
+#define TN_TREE_LEAF_SIZE 16
+#define TN_TREE_LEVELS 21
+// minimal number of particles for threading
+#define TN_TREE_PARALLEL_MIN 4096
+
+_Static_assert(sizeof(Vec_3D) == 3 * sizeof(double),
+               "Vec_3D has to be three packed doubles");
+
+typedef struct {
+    double c[3];          // expansion center
+    double q;             // total weight
+    double aq;            // total |weight|
+    double d[3];          // dipole about c
+    double quad[6];       // second moment about c: xx, xy, xz, yy, yz, zz
+    double size;          // edge length
+    double open2;         // (size / theta + delta)^2
+    size_t begin, end;    // sorted particles
+    int first_child;      // -1: leaf
+    int n_children;
+} tree_node;
+
+struct tn_tree {
+    size_t n;
+    tn_tree_options opt;
+    double* x;            // sorted positions and weights
+    double* y;
+    double* z;
+    double* w;
+    double* s;            // scale of the field per particle, sorted
+    const double* mass;   // user arrays, original order
+    const double* charge;
+    size_t* perm;         // sorted index -> original index
+    uint64_t* code;
+    uint64_t* code_tmp;
+    size_t* perm_tmp;
+    tree_node* nodes;
+    size_t n_nodes;
+    size_t cap_nodes;
+    int built;
+};
+
+tn_tree_options
+tn_tree_default_options (void)
+{
+    tn_tree_options opt;
+    opt.kind = TN_TREE_GRAVITY;
+    opt.coupling = 1.0;
+    opt.theta = 0.5;
+    opt.softening = 0.0;
+    opt.leaf_size = TN_TREE_LEAF_SIZE;
+    opt.quadrupole = 1;
+    return opt;
+}
+
+tn_tree*
+tn_tree_alloc (size_t n, const tn_tree_options* opt)
+{
+    if (n == 0) {
+        tp_raiseError("tn_tree_alloc needs at least one particle!");
+    }
+    tn_tree* tree = malloc(sizeof(tn_tree));
+    Null_exit_message(tree, "Memory allocation failed in tn_tree_alloc!");
+    tree->n = n;
+    tree->opt = opt ? *opt : tn_tree_default_options();
+    if (tree->opt.leaf_size < 1) {
+        tree->opt.leaf_size = 1;
+    }
+    if (tree->opt.theta < 0.0) {
+        tree->opt.theta = 0.0;
+    }
+    tree->x = malloc(5 * n * sizeof(double));
+    tree->perm = malloc(2 * n * sizeof(size_t));
+    tree->code = malloc(2 * n * sizeof(uint64_t));
+    if (!tree->x || !tree->perm || !tree->code) {
+        tp_raiseError("Memory allocation failed in tn_tree_alloc!");
+    }
+    tree->y = tree->x + n;
+    tree->z = tree->y + n;
+    tree->w = tree->z + n;
+    tree->s = tree->w + n;
+    tree->perm_tmp = tree->perm + n;
+    tree->code_tmp = tree->code + n;
+    tree->mass = NULL;
+    tree->charge = NULL;
+    tree->cap_nodes = n / tree->opt.leaf_size * 2 + 64;
+    tree->nodes = malloc(tree->cap_nodes * sizeof(tree_node));
+    Null_exit_message(tree->nodes, "Memory allocation failed in tn_tree_alloc!");
+    tree->n_nodes = 0;
+    tree->built = 0;
+    return tree;
+}
+
+void
+tn_tree_free (tn_tree* tree)
+{
+    if (!tree) {
+        return;
+    }
+    free(tree->x);
+    free(tree->perm);
+    free(tree->code);
+    free(tree->nodes);
+    free(tree);
+}
+
+void
+tn_tree_set_weights (tn_tree* tree, const double* mass, const double* charge)
+{
+    if (!tree) {
+        tp_raiseError("Null pointer in tn_tree_set_weights.");
+    }
+    if (tree->opt.kind == TN_TREE_COULOMB && !charge) {
+        tp_raiseError("Coulomb trees need charges in tn_tree_set_weights.");
+    }
+    tree->mass = mass;
+    tree->charge = charge;
+    tree->built = 0;
+}
+
+size_t
+tn_tree_nodes (const tn_tree* tree)
+{
+    if (!tree) {
+        tp_raiseError("Null pointer in tn_tree_nodes.");
+    }
+    return tree->n_nodes;
+}
+
+//-----------------------------------
+// build
+//-----------------------------------
+
+/* spreads the lower 21 bits of v to every third bit */
+static inline uint64_t
+spread_bits (uint64_t v)
+{
+    v &= 0x1fffffULL;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+/* stable LSD radix sort of code with perm, 8 bits per pass, histograms
+ * per thread */
+static void
+radix_sort (tn_tree* tree)
+{
+    const size_t n = tree->n;
+    int n_threads = 1;
+#ifdef _OPENMP
+    if (n >= TN_TREE_PARALLEL_MIN) {
+        n_threads = omp_get_max_threads();
+    }
+#endif
+    size_t* count = malloc((size_t)n_threads * 256 * sizeof(size_t));
+    Null_exit_message(count, "Memory allocation failed in tn_tree_build!");
+    uint64_t* key = tree->code;
+    uint64_t* key_out = tree->code_tmp;
+    size_t* idx = tree->perm;
+    size_t* idx_out = tree->perm_tmp;
+    for (int shift = 0; shift < 3 * TN_TREE_LEVELS; shift += 8) {
+        #pragma omp parallel num_threads(n_threads)
+        {
+            int t = 0;
+            int nt = 1;
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+            nt = omp_get_num_threads();
+#endif
+            size_t lo = n * t / nt;
+            size_t hi = n * (t + 1) / nt;
+            size_t* c = count + (size_t)t * 256;
+            memset(c, 0, 256 * sizeof(size_t));
+            for (size_t i = lo; i < hi; i++) {
+                c[(key[i] >> shift) & 0xff]++;
+            }
+            #pragma omp barrier
+            #pragma omp single
+            {
+                // offsets: bucket major, thread minor keeps the sort stable
+                size_t sum = 0;
+                for (int b = 0; b < 256; b++) {
+                    for (int u = 0; u < nt; u++) {
+                        size_t tmp = count[(size_t)u * 256 + b];
+                        count[(size_t)u * 256 + b] = sum;
+                        sum += tmp;
+                    }
+                }
+            }
+            for (size_t i = lo; i < hi; i++) {
+                size_t pos = c[(key[i] >> shift) & 0xff]++;
+                key_out[pos] = key[i];
+                idx_out[pos] = idx[i];
+            }
+        }
+        uint64_t* swap_key = key;
+        key = key_out;
+        key_out = swap_key;
+        size_t* swap_idx = idx;
+        idx = idx_out;
+        idx_out = swap_idx;
+    }
+    // an odd number of passes leaves the result in the second buffers
+    if (key != tree->code) {
+        memcpy(tree->code, key, n * sizeof(uint64_t));
+        memcpy(tree->perm, idx, n * sizeof(size_t));
+    }
+    free(count);
+}
+
+static size_t
+new_nodes (tn_tree* tree, size_t count)
+{
+    if (tree->n_nodes + count > tree->cap_nodes) {
+        size_t cap = 2 * tree->cap_nodes + count;
+        tree_node* nodes = realloc(tree->nodes, cap * sizeof(tree_node));
+        Null_exit_message(nodes, "Memory allocation failed in tn_tree_build!");
+        tree->nodes = nodes;
+        tree->cap_nodes = cap;
+    }
+    size_t first = tree->n_nodes;
+    tree->n_nodes += count;
+    return first;
+}
+
+/* moments of a leaf from its particles */
+static void
+leaf_moments (const tn_tree* tree, tree_node* node)
+{
+    double q = 0.0;
+    double aq = 0.0;
+    double c[3] = {0.0, 0.0, 0.0};
+    for (size_t j = node->begin; j < node->end; j++) {
+        double a = fabs(tree->w[j]);
+        q += tree->w[j];
+        aq += a;
+        c[0] += a * tree->x[j];
+        c[1] += a * tree->y[j];
+        c[2] += a * tree->z[j];
+    }
+    if (aq > 0.0) {
+        for (int k = 0; k < 3; k++) {
+            c[k] /= aq;
+        }
+    }
+    else {
+        // only neutral particles: any point of the cell
+        c[0] = tree->x[node->begin];
+        c[1] = tree->y[node->begin];
+        c[2] = tree->z[node->begin];
+    }
+    memset(node->d, 0, sizeof(node->d));
+    memset(node->quad, 0, sizeof(node->quad));
+    for (size_t j = node->begin; j < node->end; j++) {
+        double r[3] = {tree->x[j] - c[0], tree->y[j] - c[1], tree->z[j] - c[2]};
+        double wj = tree->w[j];
+        for (int k = 0; k < 3; k++) {
+            node->d[k] += wj * r[k];
+        }
+        node->quad[0] += wj * r[0] * r[0];
+        node->quad[1] += wj * r[0] * r[1];
+        node->quad[2] += wj * r[0] * r[2];
+        node->quad[3] += wj * r[1] * r[1];
+        node->quad[4] += wj * r[1] * r[2];
+        node->quad[5] += wj * r[2] * r[2];
+    }
+    memcpy(node->c, c, sizeof(c));
+    node->q = q;
+    node->aq = aq;
+}
+
+/* moments of a cell from its children (parallel axis theorem) */
+static void
+merge_moments (tn_tree* tree, tree_node* node)
+{
+    const tree_node* ch = tree->nodes + node->first_child;
+    double q = 0.0;
+    double aq = 0.0;
+    double c[3] = {0.0, 0.0, 0.0};
+    for (int k = 0; k < node->n_children; k++) {
+        double a = ch[k].aq;
+        q += ch[k].q;
+        aq += a;
+        for (int m = 0; m < 3; m++) {
+            c[m] += a * ch[k].c[m];
+        }
+    }
+    for (int m = 0; m < 3; m++) {
+        c[m] = aq > 0.0 ? c[m] / aq : ch[0].c[m];
+    }
+    memset(node->d, 0, sizeof(node->d));
+    memset(node->quad, 0, sizeof(node->quad));
+    for (int k = 0; k < node->n_children; k++) {
+        double s[3] = {ch[k].c[0] - c[0], ch[k].c[1] - c[1], ch[k].c[2] - c[2]};
+        double qk = ch[k].q;
+        const double* dk = ch[k].d;
+        for (int m = 0; m < 3; m++) {
+            node->d[m] += dk[m] + qk * s[m];
+        }
+        // shifted second moment: M + s d + d s + q s s
+        const int ia[6] = {0, 0, 0, 1, 1, 2};
+        const int ib[6] = {0, 1, 2, 1, 2, 2};
+        for (int m = 0; m < 6; m++) {
+            node->quad[m] += ch[k].quad[m] + s[ia[m]] * dk[ib[m]] + dk[ia[m]] * s[ib[m]]
+                             + qk * s[ia[m]] * s[ib[m]];
+        }
+    }
+    memcpy(node->c, c, sizeof(c));
+    node->q = q;
+    node->aq = aq;
+}
+
+/* cell of particles [begin, end) at level (their codes agree in the upper
+ * 3 * level bits), corner and size of the cell, stored at nodes[index] */
+static void
+build_node (tn_tree* tree, size_t index, size_t begin, size_t end, int level,
+            const double corner[3], double size)
+{
+    tree_node* node = tree->nodes + index;
+    node->begin = begin;
+    node->end = end;
+    node->size = size;
+    node->first_child = -1;
+    node->n_children = 0;
+    if (end - begin <= (size_t)tree->opt.leaf_size || level == TN_TREE_LEVELS) {
+        leaf_moments(tree, node);
+    }
+    else {
+        // ranges of the 8 octants in the sorted codes
+        int shift = 3 * (TN_TREE_LEVELS - 1 - level);
+        size_t bounds[9];
+        int octant[8];
+        int n_children = 0;
+        size_t j = begin;
+        for (int o = 0; o < 8; o++) {
+            size_t start = j;
+            while (j < end && (int)((tree->code[j] >> shift) & 7) == o) {
+                j++;
+            }
+            if (j > start) {
+                bounds[n_children] = start;
+                octant[n_children] = o;
+                n_children++;
+            }
+        }
+        bounds[n_children] = end;
+        // new_nodes may move the array
+        size_t first = new_nodes(tree, (size_t)n_children);
+        node = tree->nodes + index;
+        node->first_child = (int)first;
+        node->n_children = n_children;
+        double half = 0.5 * size;
+        for (int k = 0; k < n_children; k++) {
+            // bit order of the codes: x highest, then y, then z
+            double c[3] = {corner[0] + ((octant[k] >> 2) & 1) * half,
+                           corner[1] + ((octant[k] >> 1) & 1) * half,
+                           corner[2] + (octant[k] & 1) * half};
+            build_node(tree, first + k, bounds[k], bounds[k + 1], level + 1, c, half);
+        }
+        node = tree->nodes + index;
+        merge_moments(tree, node);
+    }
+    // acceptance radius: size / theta plus the offset of the expansion center
+    double g[3] = {corner[0] + 0.5 * size, corner[1] + 0.5 * size, corner[2] + 0.5 * size};
+    double delta = sqrt((node->c[0] - g[0]) * (node->c[0] - g[0])
+                        + (node->c[1] - g[1]) * (node->c[1] - g[1])
+                        + (node->c[2] - g[2]) * (node->c[2] - g[2]));
+    double r_open = tree->opt.theta > 0.0 ? size / tree->opt.theta + delta : INFINITY;
+    node->open2 = r_open * r_open;
+}
+
+void
+tn_tree_build (tn_tree* tree, const Vec_3D* pos)
+{
+    TN_PROFILE_BEGIN(tn_tree_build);
+    if (!tree || !pos) {
+        tp_raiseError("Null pointer in tn_tree_build.");
+    }
+    if (tree->opt.kind == TN_TREE_COULOMB && !tree->charge) {
+        tp_raiseError("Coulomb trees need charges, see tn_tree_set_weights.");
+    }
+    const long n = (long)tree->n;
+
+    // bounding cube
+    double lo[3] = {INFINITY, INFINITY, INFINITY};
+    double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    #pragma omp parallel for reduction(min:lo[:3]) reduction(max:hi[:3]) if(n >= TN_TREE_PARALLEL_MIN)
+    for (long i = 0; i < n; i++) {
+        lo[0] = fmin(lo[0], pos[i].x);
+        lo[1] = fmin(lo[1], pos[i].y);
+        lo[2] = fmin(lo[2], pos[i].z);
+        hi[0] = fmax(hi[0], pos[i].x);
+        hi[1] = fmax(hi[1], pos[i].y);
+        hi[2] = fmax(hi[2], pos[i].z);
+    }
+    double size = fmax(hi[0] - lo[0], fmax(hi[1] - lo[1], hi[2] - lo[2]));
+    // a little larger, so the largest coordinate maps below 2^21
+    size = size > 0.0 ? size * (1.0 + 1e-12) + DBL_MIN : 1.0;
+    double to_int = (double)(1 << TN_TREE_LEVELS) / size;
+
+    #pragma omp parallel for schedule(static) if(n >= TN_TREE_PARALLEL_MIN)
+    for (long i = 0; i < n; i++) {
+        uint64_t ix = (uint64_t)((pos[i].x - lo[0]) * to_int);
+        uint64_t iy = (uint64_t)((pos[i].y - lo[1]) * to_int);
+        uint64_t iz = (uint64_t)((pos[i].z - lo[2]) * to_int);
+        tree->code[i] = spread_bits(ix) << 2 | spread_bits(iy) << 1 | spread_bits(iz);
+        tree->perm[i] = (size_t)i;
+    }
+    radix_sort(tree);
+
+    const int coulomb = tree->opt.kind == TN_TREE_COULOMB;
+    #pragma omp parallel for schedule(static) if(n >= TN_TREE_PARALLEL_MIN)
+    for (long i = 0; i < n; i++) {
+        size_t p = tree->perm[i];
+        double m = tree->mass ? tree->mass[p] : 1.0;
+        tree->x[i] = pos[p].x;
+        tree->y[i] = pos[p].y;
+        tree->z[i] = pos[p].z;
+        tree->w[i] = coulomb ? tree->charge[p] : m;
+        tree->s[i] = coulomb ? tree->charge[p] / m : 1.0;
+    }
+
+    tree->n_nodes = 0;
+    size_t root = new_nodes(tree, 1);
+    build_node(tree, root, 0, tree->n, 0, lo, size);
+    tree->built = 1;
+    TN_PROFILE_END();
+}
+
+//-----------------------------------
+// forces
+//-----------------------------------
+
+/* field E = -grad phi of the expansion of node at displacement r from its
+ * center, u = 1 / sqrt(r^2 + eps^2), M the second moment:
+ * phi = q u + d.r u^3 + (3 r.M.r u^5 - tr(M) u^3) / 2 */
+static inline void
+node_field (const tree_node* node, const double r[3], double eps2, int quadrupole,
+            double e[3])
+{
+    double u2 = 1.0 / (r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + eps2);
+    double u3 = u2 * sqrt(u2);
+    double u5 = u3 * u2;
+    double dr = node->d[0] * r[0] + node->d[1] * r[1] + node->d[2] * r[2];
+    double f = node->q * u3 + 3.0 * dr * u5;
+    for (int k = 0; k < 3; k++) {
+        e[k] += f * r[k] - node->d[k] * u3;
+    }
+    if (quadrupole) {
+        const double* m = node->quad;
+        double mr[3] = {m[0] * r[0] + m[1] * r[1] + m[2] * r[2],
+                        m[1] * r[0] + m[3] * r[1] + m[4] * r[2],
+                        m[2] * r[0] + m[4] * r[1] + m[5] * r[2]};
+        double rmr = r[0] * mr[0] + r[1] * mr[1] + r[2] * mr[2];
+        double g = 7.5 * rmr * u5 * u2 - 1.5 * (m[0] + m[3] + m[5]) * u5;
+        for (int k = 0; k < 3; k++) {
+            e[k] += g * r[k] - 3.0 * mr[k] * u5;
+        }
+    }
+}
+
+/* field at sorted particle i */
+static void
+field_at (const tn_tree* tree, size_t i, double e[3])
+{
+    const double px = tree->x[i];
+    const double py = tree->y[i];
+    const double pz = tree->z[i];
+    const double eps2 = tree->opt.softening * tree->opt.softening;
+    const int quadrupole = tree->opt.quadrupole;
+    int stack[8 * TN_TREE_LEVELS + 8];
+    int top = 0;
+    stack[top++] = 0;
+    double ex = 0.0;
+    double ey = 0.0;
+    double ez = 0.0;
+    e[0] = e[1] = e[2] = 0.0;
+    while (top > 0) {
+        const tree_node* node = tree->nodes + stack[--top];
+        double r[3] = {px - node->c[0], py - node->c[1], pz - node->c[2]};
+        double dist2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        int contains = i >= node->begin && i < node->end;
+        if (!contains && dist2 > node->open2) {
+            node_field(node, r, eps2, quadrupole, e);
+        }
+        else if (node->first_child < 0) {
+            // direct sum, the particle itself has r = 0 and adds nothing
+            const double* x = tree->x;
+            const double* y = tree->y;
+            const double* z = tree->z;
+            const double* w = tree->w;
+            #pragma omp simd reduction(+:ex, ey, ez)
+            for (size_t j = node->begin; j < node->end; j++) {
+                double dx = px - x[j];
+                double dy = py - y[j];
+                double dz = pz - z[j];
+                double r2 = dx * dx + dy * dy + dz * dz + eps2;
+                double inv = r2 > 0.0 ? 1.0 / sqrt(r2) : 0.0;
+                double f = w[j] * inv * inv * inv;
+                ex += f * dx;
+                ey += f * dy;
+                ez += f * dz;
+            }
+        }
+        else {
+            for (int k = node->n_children - 1; k >= 0; k--) {
+                stack[top++] = node->first_child + k;
+            }
+        }
+    }
+    e[0] += ex;
+    e[1] += ey;
+    e[2] += ez;
+}
+
+/* gravity: a = -G E with weights m, Coulomb: a = k q / m E with weights q */
+static inline double
+accel_factor (const tn_tree* tree)
+{
+    return tree->opt.kind == TN_TREE_COULOMB ? tree->opt.coupling : -tree->opt.coupling;
+}
+
+void
+tn_tree_accel (const tn_tree* tree, Vec_3D* acc)
+{
+    TN_PROFILE_BEGIN(tn_tree_accel);
+    if (!tree || !acc) {
+        tp_raiseError("Null pointer in tn_tree_accel.");
+    }
+    if (!tree->built) {
+        tp_raiseError("tn_tree_accel needs tn_tree_build first.");
+    }
+    const long n = (long)tree->n;
+    const double factor = accel_factor(tree);
+    // sorted order: neighbouring particles share most of their walk
+    #pragma omp parallel for schedule(dynamic, 64) if(tree->n >= TN_TREE_PARALLEL_MIN)
+    for (long i = 0; i < n; i++) {
+        double e[3];
+        field_at(tree, (size_t)i, e);
+        double f = factor * tree->s[i];
+        size_t p = tree->perm[i];
+        acc[p].x = f * e[0];
+        acc[p].y = f * e[1];
+        acc[p].z = f * e[2];
+    }
+    TN_PROFILE_END();
+}
+
+void
+tn_tree_direct (tn_tree* tree, const Vec_3D* pos, Vec_3D* acc)
+{
+    TN_PROFILE_BEGIN(tn_tree_direct);
+    if (!tree || !pos || !acc) {
+        tp_raiseError("Null pointer in tn_tree_direct.");
+    }
+    if (tree->opt.kind == TN_TREE_COULOMB && !tree->charge) {
+        tp_raiseError("Coulomb trees need charges, see tn_tree_set_weights.");
+    }
+    const long n = (long)tree->n;
+    const int coulomb = tree->opt.kind == TN_TREE_COULOMB;
+    const double eps2 = tree->opt.softening * tree->opt.softening;
+    const double factor = accel_factor(tree);
+    #pragma omp parallel for schedule(static) if(tree->n >= 256)
+    for (long i = 0; i < n; i++) {
+        double ex = 0.0;
+        double ey = 0.0;
+        double ez = 0.0;
+        for (long j = 0; j < n; j++) {
+            double dx = pos[i].x - pos[j].x;
+            double dy = pos[i].y - pos[j].y;
+            double dz = pos[i].z - pos[j].z;
+            double r2 = dx * dx + dy * dy + dz * dz + eps2;
+            double wj = coulomb ? tree->charge[j] : (tree->mass ? tree->mass[j] : 1.0);
+            double inv = r2 > 0.0 ? 1.0 / sqrt(r2) : 0.0;
+            double f = wj * inv * inv * inv;
+            ex += f * dx;
+            ey += f * dy;
+            ez += f * dz;
+        }
+        double m = tree->mass ? tree->mass[i] : 1.0;
+        double f = factor * (coulomb ? tree->charge[i] / m : 1.0);
+        acc[i].x = f * ex;
+        acc[i].y = f * ey;
+        acc[i].z = f * ez;
+    }
+    TN_PROFILE_END();
+}
+
+void
+tn_tree_ode_func (double t __attribute__((unused)), const double y[], double dy[],
+                  void* params)
+{
+    tn_tree* tree = params;
+    size_t n3 = 3 * tree->n;
+    tn_tree_build(tree, (const Vec_3D*)y);
+    memcpy(dy, y + n3, n3 * sizeof(double));
+    tn_tree_accel(tree, (Vec_3D*)(dy + n3));
+}
@@ -1,4 +1,4 @@
-__phydesim_submodules__ = {"rk_lib"}
+__phydesim_submodules__ = {"rk_lib", "tlib"}
 
 # define what is imported when using "from phydesim import *"
 __all__ = list(
@@ -10,6 +10,9 @@ def __getattr__(attr):
     if attr == "rk_lib":
         import phydesim.rk_lib
         return phydesim.rk_lib
+    if attr == "tlib":
+        import phydesim.tlib
+        return phydesim.tlib
     # !r represents object in ticks
     raise AttributeError(f"Module {__name__!r} has no attribute {attr!r}")
 
@@ -1,3 +1,3 @@
-from ._core import c_rk2_step, c_rk4_step
+from ._core import c_rk2_step, c_rk4_step, c_integrate, c_rk45_integrate
 
-__all__ = ["c_rk2_step", "c_rk4_step"]
\ No newline at end of file
+__all__ = ["c_rk2_step", "c_rk4_step", "c_integrate", "c_rk45_integrate"]
\ No newline at end of file
@@ -0,0 +1,19 @@
+# Shared helper for Cython modules of phydesim that accept C functions
+# (e.g. right-hand sides with the ODE_FUNC signature of tlib) from Python.
+# Usage: from phydesim.rk_lib._cython._cfunc cimport c_address
+
+from cpython.pycapsule cimport PyCapsule_CheckExact, PyCapsule_GetPointer, PyCapsule_GetName
+
+
+cdef inline size_t c_address(object obj) except? 0:
+    """address of C function/data if obj is an int, a ctypes object or a PyCapsule, else 0"""
+    import ctypes
+    if isinstance(obj, int):
+        return <size_t> obj
+    if PyCapsule_CheckExact(obj):
+        return <size_t> PyCapsule_GetPointer(obj, PyCapsule_GetName(obj))
+    if isinstance(obj, ctypes._CFuncPtr):
+        return <size_t> ctypes.cast(obj, ctypes.c_void_p).value
+    if isinstance(obj, (ctypes._SimpleCData, ctypes.Structure, ctypes.Array)):
+        return <size_t> ctypes.addressof(obj)
+    return 0
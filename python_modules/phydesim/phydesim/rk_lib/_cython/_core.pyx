@@ -103,4 +103,462 @@ cpdef np.ndarray[np.float64_t, ndim=1] c_rk4_step(
             k1_ptr[i] + 2.0 * k2_ptr[i] + 2.0 * k3_ptr[i] + k4_ptr[i]
         )
 
-    return y_new
\ No newline at end of file
+    return y_new
+
+
+#==============================================================================
+# whole trajectory integration
+#
+# The steppers above are called once per time step from Python. c_integrate
+# instead runs the entire time loop in C. If the right-hand side is a C
+# function, the loop runs without the GIL and without any Python call.
+# Python callables are still accepted as fallback, but even then all stage
+# buffers are allocated only once.
+
+from libc.string cimport memcpy
+from phydesim.rk_lib._cython._cfunc cimport c_address
+
+# same signature as ODE_FUNC in t_numerics.h:
+# void ode_func(double t, const double y[], double dy[], void* params)
+ctypedef void (*c_ode_func_t)(double, const double*, double*, void*) noexcept nogil
+
+
+cdef void _c_rk2_loop(c_ode_func_t f, double t, double dt, Py_ssize_t n_steps,
+                      double* traj, double* work, Py_ssize_t n, void* params) noexcept nogil:
+    cdef double* dy = work
+    cdef double* sup = work + n
+    cdef double* y
+    cdef Py_ssize_t step, i
+    for step in range(n_steps):
+        # start from previous row and step in place in the next one
+        y = traj + (step + 1) * n
+        memcpy(y, traj + step * n, n * sizeof(double))
+        f(t, y, dy, params)
+        for i in range(n):
+            sup[i] = y[i] + 0.5 * dt * dy[i]
+        f(t + 0.5 * dt, sup, dy, params)
+        for i in range(n):
+            y[i] += dt * dy[i]
+        t += dt
+
+
+cdef void _c_rk4_loop(c_ode_func_t f, double t, double dt, Py_ssize_t n_steps,
+                      double* traj, double* work, Py_ssize_t n, void* params) noexcept nogil:
+    cdef double* k1 = work
+    cdef double* k2 = work + n
+    cdef double* k3 = work + 2 * n
+    cdef double* k4 = work + 3 * n
+    cdef double* sup = work + 4 * n
+    cdef double* y
+    cdef Py_ssize_t step, i
+    for step in range(n_steps):
+        y = traj + (step + 1) * n
+        memcpy(y, traj + step * n, n * sizeof(double))
+        f(t, y, k1, params)
+        for i in range(n):
+            sup[i] = y[i] + 0.5 * dt * k1[i]
+        f(t + 0.5 * dt, sup, k2, params)
+        for i in range(n):
+            sup[i] = y[i] + 0.5 * dt * k2[i]
+        f(t + 0.5 * dt, sup, k3, params)
+        for i in range(n):
+            sup[i] = y[i] + dt * k3[i]
+        f(t + dt, sup, k4, params)
+        for i in range(n):
+            y[i] += (dt / 6.0) * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i])
+        t += dt
+
+
+cdef void _py_rk2_loop(object f, double t, double dt, Py_ssize_t n_steps,
+                       np.ndarray traj, np.ndarray work, object params):
+    cdef Py_ssize_t n = traj.shape[1]
+    cdef Py_ssize_t step, i
+    # numpy views on preallocated buffers, passed to f
+    cdef np.ndarray y = np.empty(n, dtype=np.float64)
+    cdef np.ndarray dy = work[0]
+    cdef np.ndarray sup = work[1]
+    cdef double[:, ::1] traj_v = traj
+    cdef double[::1] y_v = y
+    cdef double[::1] dy_v = dy
+    cdef double[::1] sup_v = sup
+    for step in range(n_steps):
+        y_v[:] = traj_v[step]
+        dy[:] = f(t, y, params)
+        for i in range(n):
+            sup_v[i] = y_v[i] + 0.5 * dt * dy_v[i]
+        dy[:] = f(t + 0.5 * dt, sup, params)
+        for i in range(n):
+            traj_v[step + 1, i] = y_v[i] + dt * dy_v[i]
+        t += dt
+
+
+cdef void _py_rk4_loop(object f, double t, double dt, Py_ssize_t n_steps,
+                       np.ndarray traj, np.ndarray work, object params):
+    cdef Py_ssize_t n = traj.shape[1]
+    cdef Py_ssize_t step, i
+    cdef np.ndarray y = np.empty(n, dtype=np.float64)
+    cdef np.ndarray k1 = work[0]
+    cdef np.ndarray k2 = work[1]
+    cdef np.ndarray k3 = work[2]
+    cdef np.ndarray k4 = work[3]
+    cdef np.ndarray sup = work[4]
+    cdef double[:, ::1] traj_v = traj
+    cdef double[::1] y_v = y
+    cdef double[::1] k1_v = k1
+    cdef double[::1] k2_v = k2
+    cdef double[::1] k3_v = k3
+    cdef double[::1] k4_v = k4
+    cdef double[::1] sup_v = sup
+    for step in range(n_steps):
+        y_v[:] = traj_v[step]
+        k1[:] = f(t, y, params)
+        for i in range(n):
+            sup_v[i] = y_v[i] + 0.5 * dt * k1_v[i]
+        k2[:] = f(t + 0.5 * dt, sup, params)
+        for i in range(n):
+            sup_v[i] = y_v[i] + 0.5 * dt * k2_v[i]
+        k3[:] = f(t + 0.5 * dt, sup, params)
+        for i in range(n):
+            sup_v[i] = y_v[i] + dt * k3_v[i]
+        k4[:] = f(t + dt, sup, params)
+        for i in range(n):
+            traj_v[step + 1, i] = y_v[i] + (dt / 6.0) * (
+                k1_v[i] + 2.0 * k2_v[i] + 2.0 * k3_v[i] + k4_v[i]
+            )
+        t += dt
+
+
+cpdef np.ndarray[np.float64_t, ndim=2] c_integrate(
+    object ode_func,
+    object y0,
+    double t0,
+    double dt,
+    Py_ssize_t n_steps,
+    object params = None,
+    str method = "rk4",
+    np.ndarray out = None):
+    """
+    Integrates n_steps steps of size dt starting at (t0, y0) and returns the
+    trajectory as array of shape (n_steps + 1, len(y0)), row 0 being y0.
+
+    ode_func is either
+    - a C function with signature of ODE_FUNC in t_numerics.h,
+          void f(double t, const double y[], double dy[], void* params),
+      passed as its address (int, e.g. int(ffi.cast("uintptr_t", f)) for cffi),
+      as ctypes function pointer or as PyCapsule (e.g. exported by a compiled
+      Cython extension). Then the whole loop runs in C with the GIL released.
+      params is passed as void* and may be None (NULL), an address (int), a
+      ctypes object or a C-contiguous numpy array of dtype float64.
+    - a Python callable f(t, y, params) returning the derivative as array
+      (same convention as c_rk4_step). This is the slow fallback.
+
+    method: "rk2" or "rk4"
+    out: optional preallocated C-contiguous float64 array of shape
+         (n_steps + 1, len(y0)) into which the trajectory is written.
+    """
+    cdef np.ndarray y_init = np.ascontiguousarray(y0, dtype=np.float64)
+    if y_init.ndim != 1:
+        raise ValueError("Input y0 must be a 1D array")
+    if n_steps < 0:
+        raise ValueError("n_steps must not be negative")
+    if method not in ("rk2", "rk4"):
+        raise ValueError(f"Unknown method {method!r}, use 'rk2' or 'rk4'")
+
+    cdef Py_ssize_t n = y_init.shape[0]
+    if out is None:
+        out = np.empty((n_steps + 1, n), dtype=np.float64)
+    elif out.dtype != np.float64 or not out.flags['C_CONTIGUOUS'] \
+            or out.ndim != 2 or out.shape[0] != n_steps + 1 or out.shape[1] != n:
+        raise ValueError("out must be a C-contiguous float64 array of shape (n_steps + 1, len(y0))")
+    out[0] = y_init
+
+    # stage buffers, allocated once for the whole trajectory
+    cdef bint use_rk4 = method == "rk4"
+    cdef int n_stages = 5 if use_rk4 else 2
+    cdef np.ndarray work = np.empty((n_stages, n), dtype=np.float64)
+
+    cdef size_t func_addr = c_address(ode_func)
+    cdef c_ode_func_t c_func
+    cdef void* c_params = NULL
+    cdef np.ndarray params_array
+    cdef double* traj_ptr
+    cdef double* work_ptr
+
+    if func_addr == 0:
+        if not callable(ode_func):
+            raise TypeError("ode_func must be a C function (address, ctypes, PyCapsule) or a callable")
+        if use_rk4:
+            _py_rk4_loop(ode_func, t0, dt, n_steps, out, work, params)
+        else:
+            _py_rk2_loop(ode_func, t0, dt, n_steps, out, work, params)
+        return out
+
+    c_func = <c_ode_func_t> func_addr
+    if isinstance(params, np.ndarray):
+        # keep reference to the (possibly converted) array during the loop
+        params_array = np.ascontiguousarray(params, dtype=np.float64)
+        c_params = <void*> params_array.data
+    elif params is not None:
+        c_params = <void*> c_address(params)
+        if c_params == NULL:
+            raise TypeError("params of C function must be None, an address, a ctypes object or a numpy array")
+
+    traj_ptr = <double*> out.data
+    work_ptr = <double*> work.data
+    with nogil:
+        if use_rk4:
+            _c_rk4_loop(c_func, t0, dt, n_steps, traj_ptr, work_ptr, n, c_params)
+        else:
+            _c_rk2_loop(c_func, t0, dt, n_steps, traj_ptr, work_ptr, n, c_params)
+    return out
+
+
+#==============================================================================
+# adaptive full interval driver
+#
+# Compiled counterpart of py_rk45_integrate (Dormand-Prince 5(4) with FSAL,
+# dense output and events). Tableau and step size controller constants are
+# read from _pycore at import, so both drivers take exactly the same steps.
+# Stages, error norm and dense output run in C loops on one preallocated
+# workspace; only ode_func (if it is a Python callable) and the event
+# functions are called through Python.
+
+from libc.math cimport fabs, pow
+from phydesim.rk_lib._python import _pycore
+
+cdef double _DP_C[7]
+cdef double _DP_A[7][7]
+cdef double _DP_E[7]
+cdef double _DP_D[7]
+cdef Py_ssize_t _i, _j
+for _i in range(7):
+    _DP_C[_i] = _pycore._DOPRI5_C[_i]
+    _DP_E[_i] = _pycore._DOPRI5_E[_i]
+    _DP_D[_i] = _pycore._DOPRI5_D[_i]
+    for _j in range(7):
+        _DP_A[_i][_j] = _pycore._DOPRI5_A[_i, _j] if _j < 6 else 0.0
+
+cdef double _SAFETY = _pycore._RK45_SAFETY
+cdef double _MIN_FACTOR = _pycore._RK45_MIN_FACTOR
+cdef double _MAX_FACTOR = _pycore._RK45_MAX_FACTOR
+
+
+cdef inline double _step_factor(double err_ratio, bint rejected) noexcept nogil:
+    # same as _pycore._rk45_step_factor
+    cdef double factor, upper
+    if err_ratio == 0.0:
+        factor = _MAX_FACTOR
+    else:
+        factor = _SAFETY * pow(err_ratio, -0.2)
+    upper = 1.0 if rejected else _MAX_FACTOR
+    if factor < _MIN_FACTOR:
+        factor = _MIN_FACTOR
+    return factor if factor < upper else upper
+
+
+cdef inline void _dense_eval(double theta, const double* y, const double* dense,
+                             double* out, Py_ssize_t n) noexcept nogil:
+    cdef double theta1 = 1.0 - theta
+    cdef Py_ssize_t i
+    for i in range(n):
+        out[i] = y[i] + theta * (dense[i] + theta1 * (dense[n + i] + theta * (
+            dense[2 * n + i] + theta1 * dense[3 * n + i])))
+
+
+cdef class _Rhs:
+    """right-hand side, either C function (ODE_FUNC) or Python callable"""
+    cdef c_ode_func_t c_func
+    cdef void* c_params
+    cdef object py_func
+    cdef object params
+    cdef object params_array
+    cdef Py_ssize_t nfev
+
+    def __cinit__(self, object ode_func, object params):
+        cdef size_t func_addr = c_address(ode_func)
+        self.c_func = NULL
+        self.c_params = NULL
+        self.params = params
+        self.nfev = 0
+        if func_addr == 0:
+            if not callable(ode_func):
+                raise TypeError("ode_func must be a C function (address, ctypes, PyCapsule) or a callable")
+            self.py_func = ode_func
+            return
+        self.c_func = <c_ode_func_t> func_addr
+        if isinstance(params, np.ndarray):
+            self.params_array = np.ascontiguousarray(params, dtype=np.float64)
+            self.c_params = <void*> (<np.ndarray> self.params_array).data
+        elif params is not None:
+            self.c_params = <void*> c_address(params)
+            if self.c_params == NULL:
+                raise TypeError("params of C function must be None, an address, a ctypes object or a numpy array")
+
+    cdef int call(self, double t, np.ndarray y, np.ndarray dy) except -1:
+        self.nfev += 1
+        if self.c_func != NULL:
+            self.c_func(t, <double*> y.data, <double*> dy.data, self.c_params)
+        else:
+            dy[:] = self.py_func(t, y, self.params)
+        return 0
+
+
+def c_rk45_integrate(
+    object ode_func,
+    object y0,
+    double t0,
+    double t_end,
+    object dt0 = None,
+    object params = None,
+    double sigmaokay = 1e-6,
+    double rtol = 0.0,
+    object t_eval = None,
+    object events = None,
+    Py_ssize_t max_steps = 100000):
+    """
+    Integrates from t0 to t_end with adaptive Dormand-Prince 5(4) steps,
+    same arguments and result (RK45Result) as py_rk45_integrate.
+
+    ode_func is a C function with the ODE_FUNC signature of tlib (address,
+    ctypes function pointer or PyCapsule, params passed as void* as in
+    c_integrate) or a Python callable f(t, y, params).
+    """
+    cdef np.ndarray y
+    cdef double h
+    y, h, t_eval, events, terminal, direction = _pycore._prepare_integrate(
+        y0, t0, t_end, dt0, t_eval, events)
+    cdef _Rhs rhs = _Rhs(ode_func, params)
+    cdef Py_ssize_t n = y.shape[0]
+    cdef Py_ssize_t i, j, s
+
+    # k1..k7, new state, scratch and dense output as in py_rk45_integrate
+    cdef np.ndarray work = np.empty((_pycore._DOPRI5_BUFFERS, n), dtype=np.float64)
+    cdef list k = [work[s] for s in range(7)]
+    cdef np.ndarray y_new = work[7]
+    cdef np.ndarray scratch = work[8]
+    cdef np.ndarray dense = work[9:13]
+    cdef double* w = <double*> work.data
+    cdef double* yp = <double*> y.data
+    cdef double* kp = w
+    cdef double* ynp = w + 7 * n
+    cdef double* sp = w + 8 * n
+    cdef double* dp = w + 9 * n
+
+    cdef bint use_eval = t_eval is not None
+    cdef bint use_dense = use_eval or len(events) > 0
+    cdef np.ndarray ts_eval
+    cdef double[:, ::1] ys_eval
+    cdef Py_ssize_t i_eval = 0, n_eval = 0
+    cdef list ts, ys
+    if use_eval:
+        ts_eval = t_eval
+        n_eval = ts_eval.shape[0]
+        ys_arr = np.empty((n_eval, n), dtype=np.float64)
+        ys_eval = ys_arr
+        i_eval = np.searchsorted(t_eval, t0, side="right")
+        ys_arr[:i_eval] = y
+    else:
+        ts = [t0]
+        ys = [y.copy()]
+    cdef list t_events = [[] for _ in events]
+    cdef list y_events = [[] for _ in events]
+    cdef list g_old = [event(t0, y, params) for event in events]
+    cdef list g_new
+
+    cdef double t = t0, t_new, t_stop, err_ratio, err, scale, theta, acc
+    cdef Py_ssize_t n_accepted = 0, n_rejected = 0
+    cdef bint rejected = False, last
+    cdef int status = 0
+    cdef double* stage
+
+    rhs.call(t0, y, k[0])
+    while t < t_end:
+        if n_accepted + n_rejected >= max_steps:
+            raise RuntimeError(f"c_rk45_integrate: max_steps={max_steps} reached at t={t}")
+        last = h >= t_end - t
+        if last:
+            h = t_end - t
+
+        # stages 2 to 7, the input of the last stage is the new state
+        for s in range(1, 7):
+            stage = ynp if s == 6 else sp
+            for i in range(n):
+                acc = 0.0
+                for j in range(s):
+                    acc += _DP_A[s][j] * kp[j * n + i]
+                stage[i] = yp[i] + h * acc
+            rhs.call(t + _DP_C[s] * h, y_new if s == 6 else scratch, k[s])
+
+        # error relative to the tolerance
+        err_ratio = 0.0
+        for i in range(n):
+            acc = 0.0
+            for j in range(7):
+                acc += _DP_E[j] * kp[j * n + i]
+            scale = sigmaokay
+            if rtol != 0.0:
+                scale += rtol * (fabs(yp[i]) if fabs(yp[i]) > fabs(ynp[i]) else fabs(ynp[i]))
+            err = fabs(h * acc) / scale
+            if not err <= err_ratio:
+                err_ratio = err
+
+        if not err_ratio <= 1.0:
+            h *= _step_factor(err_ratio, True)
+            rejected = True
+            n_rejected += 1
+            continue
+
+        t_new = t_end if last else t + h
+        t_stop = t_new
+        if use_dense:
+            for i in range(n):
+                dp[i] = ynp[i] - yp[i]
+                dp[n + i] = h * kp[i] - dp[i]
+                dp[2 * n + i] = dp[i] - h * kp[6 * n + i] - dp[n + i]
+                acc = 0.0
+                for j in range(7):
+                    acc += _DP_D[j] * kp[j * n + i]
+                dp[3 * n + i] = h * acc
+
+        if events:
+            g_new = [event(t_new, y_new, params) for event in events]
+            for theta, j in _pycore._find_events(events, terminal, direction, g_old, g_new,
+                                                 t, h, y, dense, params, scratch):
+                t_events[j].append(t + theta * h)
+                _dense_eval(theta, yp, dp, sp, n)
+                y_events[j].append(scratch.copy())
+                if terminal[j]:
+                    status = 1
+                    t_stop = t + theta * h
+            g_old = g_new
+
+        if use_eval:
+            while i_eval < n_eval and ts_eval[i_eval] <= t_stop:
+                _dense_eval((ts_eval[i_eval] - t) / h, yp, dp, &ys_eval[i_eval, 0], n)
+                i_eval += 1
+
+        if status == 1:
+            _dense_eval((t_stop - t) / h, yp, dp, sp, n)
+            memcpy(yp, sp, n * sizeof(double))
+        else:
+            memcpy(yp, ynp, n * sizeof(double))
+            # first same as last
+            memcpy(kp, kp + 6 * n, n * sizeof(double))
+        t = t_stop
+        if not use_eval:
+            ts.append(t)
+            ys.append(y.copy())
+        n_accepted += 1
+        if status == 1:
+            break
+        h *= _step_factor(err_ratio, rejected)
+        rejected = False
+
+    if use_eval:
+        t_out, y_out = ts_eval[:i_eval], ys_arr[:i_eval]
+    else:
+        t_out, y_out = np.asarray(ts), np.asarray(ys).reshape(-1, n)
+    return _pycore.RK45Result(t_out, y_out,
+                              [np.asarray(te) for te in t_events],
+                              [np.asarray(ye).reshape(-1, n) for ye in y_events],
+                              status, rhs.nfev, n_accepted, n_rejected)
@@ -1,3 +1,9 @@
 from ._pycore import py_rk2_step, py_rk4_step, py_rk45_step
+from ._pycore import (py_rk2_step_ensemble, py_rk4_step_ensemble,
+                      py_rk45_step_ensemble, ensemble_work)
+from ._pycore import py_rk45_integrate, RK45Result
 
-__all__ = ["py_rk2_step", "py_rk4_step", "py_rk45_step"]
\ No newline at end of file
+__all__ = ["py_rk2_step", "py_rk4_step", "py_rk45_step",
+           "py_rk2_step_ensemble", "py_rk4_step_ensemble",
+           "py_rk45_step_ensemble", "ensemble_work",
+           "py_rk45_integrate", "RK45Result"]
@@ -49,40 +49,472 @@ def py_rk4_step (t: float, dt: float, y: np.array, ode_func, params):
     y += (dt / 6.0) * (k1 + 2 * k2 + 2 * k3 + k4)
     return y
 
-def py_rk45_step(t, dt, y, ode_func, params, sigmaokay):
-    # butcher table
-    a = np.array([0, 1 / 4, 3 / 8, 12 / 13, 1, 1 / 2])
-    b = np.array([
-        [0, 0, 0, 0, 0],
-        [1 / 4, 0, 0, 0, 0],
-        [3 / 32, 9 / 32, 0, 0, 0],
-        [1932 / 2197, -7200 / 2197, 7296 / 2197, 0, 0],
-        [439 / 216, -8, 3680 / 513, -845 / 4104, 0],
-        [-8 / 27, 2, -3544 / 2565, 1859 / 4104, -11 / 40]
-    ])
-    c4 = np.array([25 / 216, 0, 1408 / 2565, 2197 / 4104, -1 / 5, 0])
-    c5 = np.array([16 / 135, 0, 6656 / 12825, 28561 / 56430, -9 / 50, 2 / 55])
-
-    # Compute all ks
-    k = np.empty((6, len(y)))
-    for i in range(6):
-        yi = y + dt * np.dot(b[i, :i], k[:i])
-        k[i] = ode_func(t + a[i] * dt, yi, params)
-
-    # 4th and 5th order estimates
-    y4 = y + dt * np.dot(c4, k)
-    y5 = y + dt * np.dot(c5, k)
-
-    # Error estimate and adaptive time step
-    err = np.linalg.norm(y5 - y4, ord=np.inf)
-    #safety = 0.9
-    if err == 0:
-        dt_next = dt * 2
+# butcher table of Runge-Kutta-Fehlberg 4(5)
+_RK45_A = np.array([0, 1 / 4, 3 / 8, 12 / 13, 1, 1 / 2])
+_RK45_B = np.array([
+    [0, 0, 0, 0, 0],
+    [1 / 4, 0, 0, 0, 0],
+    [3 / 32, 9 / 32, 0, 0, 0],
+    [1932 / 2197, -7200 / 2197, 7296 / 2197, 0, 0],
+    [439 / 216, -8, 3680 / 513, -845 / 4104, 0],
+    [-8 / 27, 2, -3544 / 2565, 1859 / 4104, -11 / 40]
+])
+_RK45_C4 = np.array([25 / 216, 0, 1408 / 2565, 2197 / 4104, -1 / 5, 0])
+_RK45_C5 = np.array([16 / 135, 0, 6656 / 12825, 28561 / 56430, -9 / 50, 2 / 55])
+_RK45_E = _RK45_C5 - _RK45_C4
+
+def py_rk45_step(t, dt, y, ode_func, params, sigmaokay, work=None, out=None, max_rejects=50):
+    '''
+    Runge-Kutta-Fehlberg step with step size control. Rejected steps are
+    retried in a loop with the reduced step size (at most max_rejects times).
+    work: optional stage buffers of shape (7, len(y)), reused if given
+    out: optional array into which the 5th order solution is written
+
+    returns the new state and the proposed step size for the next step
+    '''
+    n = len(y)
+    if work is None:
+        work = np.empty((7, n))
+    k = work[:6]
+    yi = work[6]
+    if out is None:
+        out = np.empty(n)
+
+    for _ in range(max_rejects + 1):
+        # Compute all ks
+        for i in range(6):
+            np.dot(_RK45_B[i, :i], k[:i], out=yi)
+            yi *= dt
+            yi += y
+            k[i] = ode_func(t + _RK45_A[i] * dt, yi, params)
+
+        # difference of 4th and 5th order estimate as error
+        np.dot(_RK45_E, k, out=yi)
+        err = dt * np.linalg.norm(yi, ord=np.inf)
+        #safety = 0.9
+        if err == 0:
+            dt_next = dt * 2
+        else:
+            dt_next = dt * 0.9 * (sigmaokay / err) ** 0.25
+
+        #if error okay, return 5th order calculation
+        if err < sigmaokay:
+            # increment in yi first, out may be y itself
+            np.dot(_RK45_C5, k, out=yi)
+            yi *= dt
+            np.add(y, yi, out=out)
+            return out, dt_next
+        dt = dt_next
+
+    raise RuntimeError(f"py_rk45_step: step still rejected after {max_rejects} step size reductions")
+
+#=============================================================================
+# ensemble mode
+#
+# y has shape (members, dim) and ode_func is called once per stage for the
+# whole ensemble, i.e. ode_func must be vectorized over the first axis of y
+# and return an array of the same shape. The Python call overhead is paid
+# once per stage instead of once per stage and member. All stage buffers live
+# in work (see ensemble_work) and are reused in place, y is updated in place.
+
+# number of (members, dim) buffers needed by the ensemble steppers
+_ENSEMBLE_BUFFERS = {"rk2": 2, "rk4": 5, "rk45": 8}
+
+def ensemble_work(y: np.array, method: str = "rk4"):
+    '''stage buffers for the ensemble stepper method ("rk2", "rk4", "rk45")'''
+    if method not in _ENSEMBLE_BUFFERS:
+        raise ValueError(f"Unknown method {method!r}, expected one of {list(_ENSEMBLE_BUFFERS)}")
+    return np.empty((_ENSEMBLE_BUFFERS[method],) + np.shape(y), dtype=np.float64)
+
+def _check_ensemble(y, work, method):
+    if y.ndim != 2:
+        raise ValueError(f"y must have shape (members, dim), got {y.shape}")
+    if work is None:
+        return ensemble_work(y, method)
+    if work.shape[0] < _ENSEMBLE_BUFFERS[method] or work.shape[1:] != y.shape:
+        raise ValueError(f"work must have shape ({_ENSEMBLE_BUFFERS[method]}, {y.shape[0]}, {y.shape[1]})")
+    return work
+
+def py_rk2_step_ensemble (t: float, dt: float, y: np.array, ode_func, params, work=None):
+    work = _check_ensemble(y, work, "rk2")
+    dy, sup = work[0], work[1]
+
+    dy[...] = ode_func(t, y, params)
+    np.multiply(dy, 0.5 * dt, out=sup)
+    sup += y
+
+    dy[...] = ode_func(t + 0.5 * dt, sup, params)
+    dy *= dt
+    y += dy
+    return y
+
+def py_rk4_step_ensemble (t: float, dt: float, y: np.array, ode_func, params, work=None):
+    work = _check_ensemble(y, work, "rk4")
+    k1, k2, k3, k4, sup = work[:5]
+
+    k1[...] = ode_func(t, y, params)
+
+    np.multiply(k1, 0.5 * dt, out=sup)
+    sup += y
+    k2[...] = ode_func(t + 0.5 * dt, sup, params)
+
+    np.multiply(k2, 0.5 * dt, out=sup)
+    sup += y
+    k3[...] = ode_func(t + 0.5 * dt, sup, params)
+
+    np.multiply(k3, dt, out=sup)
+    sup += y
+    k4[...] = ode_func(t + dt, sup, params)
+
+    # y += dt / 6 * (k1 + 2 * k2 + 2 * k3 + k4) without temporaries
+    k2 += k3
+    k2 *= 2.0
+    k1 += k2
+    k1 += k4
+    k1 *= dt / 6.0
+    y += k1
+    return y
+
+def py_rk45_step_ensemble (t, dt, y: np.array, ode_func, params, sigmaokay, work=None, max_rejects=50):
+    '''
+    Every member has its own step size: dt is a scalar or an array (members,)
+    and ode_func receives t as column (members, 1) which broadcasts against y.
+    Instead of recursing, rejected members are retried with their reduced step
+    size while accepted members are frozen (step size 0), so all arrays keep
+    the shape of the ensemble and ode_func always sees all members.
+
+    returns y (updated in place), the step sizes actually taken and the
+    proposed step sizes for the next step, both arrays (members,)
+    '''
+    work = _check_ensemble(y, work, "rk45")
+    k = work[:6]
+    sup, delta = work[6], work[7]
+
+    members = y.shape[0]
+    t = np.broadcast_to(np.asarray(t, dtype=np.float64), (members,))[:, None]
+    h = np.array(np.broadcast_to(dt, (members,)), dtype=np.float64)
+    dt_used = np.zeros(members)
+    dt_next = np.empty(members)
+    pending = np.ones(members, dtype=bool)
+
+    for _ in range(max_rejects + 1):
+        hc = h[:, None]
+
+        # stages, sup = y + h * sum_j b_ij * k_j
+        for i in range(6):
+            np.copyto(sup, y)
+            for j in range(i):
+                np.multiply(k[j], hc * _RK45_B[i, j], out=delta)
+                sup += delta
+            k[i][...] = ode_func(t + _RK45_A[i] * hc, sup, params)
+
+        # 5th order solution into sup, difference to 4th order into delta
+        # (sup is used as scratch first, the stages are scaled in place)
+        delta.fill(0.0)
+        for i in range(6):
+            if _RK45_C5[i] != _RK45_C4[i]:
+                np.multiply(k[i], hc * (_RK45_C5[i] - _RK45_C4[i]), out=sup)
+                delta += sup
+        np.copyto(sup, y)
+        for i in range(6):
+            if _RK45_C5[i] != 0.0:
+                k[i] *= hc * _RK45_C5[i]
+                sup += k[i]
+
+        # error estimate and adaptive time step per member
+        err = np.max(np.abs(delta), axis=1)
+        with np.errstate(divide="ignore"):
+            factor = np.where(err == 0, 2.0, 0.9 * (sigmaokay / err) ** 0.25)
+
+        #if error okay, take 5th order calculation
+        accept = pending & (err < sigmaokay)
+        np.copyto(y, sup, where=accept[:, None])
+        dt_used[accept] = h[accept]
+        dt_next[pending] = h[pending] * factor[pending]
+
+        pending &= ~accept
+        if not pending.any():
+            return y, dt_used, dt_next
+        h = np.where(pending, dt_next, 0.0)
+
+    raise RuntimeError(f"py_rk45_step_ensemble: {np.count_nonzero(pending)} member(s) "
+                       f"still rejected after {max_rejects} step size reductions")
+
+
+#=============================================================================
+# full interval driver
+#
+# py_rk45_integrate integrates from t0 to t_end with the Dormand-Prince 5(4)
+# pair. Its last stage is the derivative at the new state (first same as
+# last, FSAL), so an accepted step costs 6 instead of 7 calls of ode_func,
+# and it comes with a 4th order dense output used for t_eval and to locate
+# events. c_rk45_integrate in _core.pyx is the compiled counterpart and takes
+# tableau and step size controller from here, so both take the same steps.
+
+# butcher table of Dormand-Prince 5(4), the last row holds the 5th order weights
+_DOPRI5_C = np.array([0, 1 / 5, 3 / 10, 4 / 5, 8 / 9, 1, 1])
+_DOPRI5_A = np.array([
+    [0, 0, 0, 0, 0, 0],
+    [1 / 5, 0, 0, 0, 0, 0],
+    [3 / 40, 9 / 40, 0, 0, 0, 0],
+    [44 / 45, -56 / 15, 32 / 9, 0, 0, 0],
+    [19372 / 6561, -25360 / 2187, 64448 / 6561, -212 / 729, 0, 0],
+    [9017 / 3168, -355 / 33, 46732 / 5247, 49 / 176, -5103 / 18656, 0],
+    [35 / 384, 0, 500 / 1113, 125 / 192, -2187 / 6784, 11 / 84]
+])
+# difference of 5th and 4th order weights
+_DOPRI5_E = np.array([71 / 57600, 0, -71 / 16695, 71 / 1920, -17253 / 339200, 22 / 525, -1 / 40])
+# dense output (Hairer, Norsett, Wanner: Solving ODE I)
+_DOPRI5_D = np.array([-12715105075 / 11282082432, 0, 87487479700 / 32700410799,
+                      -10690763975 / 1880347072, 701980252875 / 199316789632,
+                      -1453857185 / 822651844, 69997945 / 29380423])
+
+# step size controller
+_RK45_SAFETY = 0.9
+_RK45_MIN_FACTOR = 0.2
+_RK45_MAX_FACTOR = 5.0
+
+# stage workspace: k1..k7, new state, scratch and 4 dense output coefficients
+_DOPRI5_BUFFERS = 13
+
+def _rk45_step_factor(err_ratio, rejected):
+    '''
+    factor for the next step size from err_ratio = error / tolerance, a step
+    is accepted if err_ratio <= 1. Directly after a rejection the step size
+    must not grow again.
+    '''
+    if err_ratio == 0:
+        factor = _RK45_MAX_FACTOR
     else:
-        dt_next = dt * 0.9 * (sigmaokay / err) ** 0.25
+        factor = _RK45_SAFETY * err_ratio ** -0.2
+    upper = 1.0 if rejected else _RK45_MAX_FACTOR
+    return min(upper, max(_RK45_MIN_FACTOR, factor))
+
+def _dopri5_dense(theta, y, dense, out):
+    '''state at t + theta * h from the dense output coefficients of the step'''
+    theta1 = 1.0 - theta
+    np.multiply(dense[3], theta1, out=out)
+    out += dense[2]
+    out *= theta
+    out += dense[1]
+    out *= theta1
+    out += dense[0]
+    out *= theta
+    out += y
+    return out
+
+def _locate_event(event, t, h, y, dense, params, g_lo, g_hi, scratch):
+    '''root of event in the step [t, t + h] (Illinois method on the dense output)'''
+    a, b = 0.0, 1.0
+    side = 0
+    theta = 1.0
+    for _ in range(100):
+        theta = (a * g_hi - b * g_lo) / (g_hi - g_lo)
+        if (b - a) * abs(h) <= 4 * np.finfo(float).eps * max(abs(t), abs(h)):
+            break
+        g = event(t + theta * h, _dopri5_dense(theta, y, dense, scratch), params)
+        if g * g_hi > 0:
+            b, g_hi = theta, g
+            if side == -1:
+                g_lo *= 0.5
+            side = -1
+        elif g * g_lo > 0:
+            a, g_lo = theta, g
+            if side == 1:
+                g_hi *= 0.5
+            side = 1
+        else:
+            break
+    return theta
+
+class RK45Result:
+    '''
+    result of py_rk45_integrate and c_rk45_integrate
+    t, y: times and states (rows), at t_eval if given, else at every accepted step
+    t_events, y_events: one array per event function with the located roots
+    status: 0 if t_end was reached, 1 if a terminal event stopped the integration
+    nfev, n_accepted, n_rejected: calls of ode_func and number of steps
+    '''
+    def __init__(self, t, y, t_events, y_events, status, nfev, n_accepted, n_rejected):
+        self.t = t
+        self.y = y
+        self.t_events = t_events
+        self.y_events = y_events
+        self.status = status
+        self.nfev = nfev
+        self.n_accepted = n_accepted
+        self.n_rejected = n_rejected
+
+    def __repr__(self):
+        return (f"RK45Result(status={self.status}, t_final={self.t[-1] if len(self.t) else None}, "
+                f"nfev={self.nfev}, n_accepted={self.n_accepted}, n_rejected={self.n_rejected})")
 
-    #if error okay, return 5th order calculation
-    if err < sigmaokay:
-        return y5, dt_next
+def _prepare_integrate(y0, t0, t_end, dt0, t_eval, events):
+    '''checks the arguments shared by py_rk45_integrate and c_rk45_integrate'''
+    y = np.array(y0, dtype=np.float64)
+    if y.ndim != 1:
+        raise ValueError("y0 must be a 1D array")
+    if not t_end > t0:
+        raise ValueError("t_end must be larger than t0")
+    h = (t_end - t0) / 100 if dt0 is None else float(dt0)
+    if not h > 0:
+        raise ValueError("dt0 must be positive")
+    if t_eval is not None:
+        t_eval = np.asarray(t_eval, dtype=np.float64)
+        if t_eval.ndim != 1 or np.any(np.diff(t_eval) < 0) \
+                or (len(t_eval) and (t_eval[0] < t0 or t_eval[-1] > t_end)):
+            raise ValueError("t_eval must be sorted and lie within [t0, t_end]")
+    if events is None:
+        events = []
+    elif callable(events):
+        events = [events]
+    # event attributes as in scipy: terminal (stop at first root) and direction
+    # (+1 only rising, -1 only falling zero crossings, 0 both)
+    terminal = [bool(getattr(ev, "terminal", False)) for ev in events]
+    direction = [float(getattr(ev, "direction", 0)) for ev in events]
+    return y, h, t_eval, list(events), terminal, direction
+
+def _find_events(events, terminal, direction, g_old, g_new, t, h, y, dense, params, scratch):
+    '''located roots of all events in the step as sorted list of (theta, index)'''
+    found = []
+    for j, event in enumerate(events):
+        rising = g_old[j] < 0 <= g_new[j]
+        falling = g_old[j] > 0 >= g_new[j]
+        if (rising and direction[j] >= 0) or (falling and direction[j] <= 0):
+            theta = _locate_event(event, t, h, y, dense, params, g_old[j], g_new[j], scratch)
+            found.append((theta, j))
+    found.sort()
+    # nothing after the first terminal event happens
+    for i, (_, j) in enumerate(found):
+        if terminal[j]:
+            return found[:i + 1]
+    return found
+
+def py_rk45_integrate(ode_func, y0, t0, t_end, dt0=None, params=None, sigmaokay=1e-6, rtol=0.0,
+                      t_eval=None, events=None, max_steps=100000):
+    '''
+    Integrates from t0 to t_end with adaptive Dormand-Prince 5(4) steps.
+    A step is accepted if the error estimate of every component is below
+    sigmaokay + rtol * |y|. All stage buffers are allocated once.
+
+    dt0: initial step size, (t_end - t0) / 100 if None
+    t_eval: sorted output times in [t0, t_end], interpolated by the dense
+            output; if None, the state after every accepted step is returned
+    events: callable or list of callables event(t, y, params), whose zero
+            crossings are located; optional attributes terminal and direction
+            of the callables as in scipy.integrate.solve_ivp
+
+    returns RK45Result
+    '''
+    y, h, t_eval, events, terminal, direction = _prepare_integrate(y0, t0, t_end, dt0, t_eval, events)
+    n = len(y)
+    work = np.empty((_DOPRI5_BUFFERS, n))
+    k = work[:7]
+    y_new, scratch = work[7], work[8]
+    dense = work[9:13]
+
+    if t_eval is not None:
+        ts = t_eval
+        ys = np.empty((len(t_eval), n))
+        i_eval = np.searchsorted(t_eval, t0, side="right")
+        ys[:i_eval] = y
     else:
-        return py_rk45_step(t, dt_next, y, ode_func, params, sigmaokay)
\ No newline at end of file
+        ts = [t0]
+        ys = [y.copy()]
+    t_events = [[] for _ in events]
+    y_events = [[] for _ in events]
+    g_old = [event(t0, y, params) for event in events]
+
+    k[0] = ode_func(t0, y, params)
+    nfev = 1
+    n_accepted = n_rejected = 0
+    rejected = False
+    status = 0
+    t = t0
+    while t < t_end:
+        if n_accepted + n_rejected >= max_steps:
+            raise RuntimeError(f"py_rk45_integrate: max_steps={max_steps} reached at t={t}")
+        last = h >= t_end - t
+        if last:
+            h = t_end - t
+
+        # stages 2 to 7, the input of the last stage is the new state
+        for i in range(1, 7):
+            stage = y_new if i == 6 else scratch
+            np.dot(_DOPRI5_A[i, :i], k[:i], out=stage)
+            stage *= h
+            stage += y
+            k[i] = ode_func(t + _DOPRI5_C[i] * h, stage, params)
+        nfev += 6
+
+        # error relative to the tolerance (dense rows are free as scratch)
+        np.dot(_DOPRI5_E, k, out=scratch)
+        scratch *= h
+        np.abs(scratch, out=scratch)
+        if rtol:
+            np.abs(y, out=dense[0])
+            np.abs(y_new, out=dense[1])
+            np.maximum(dense[0], dense[1], out=dense[0])
+            dense[0] *= rtol
+            dense[0] += sigmaokay
+            scratch /= dense[0]
+            err_ratio = scratch.max()
+        else:
+            err_ratio = scratch.max() / sigmaokay
+
+        if not err_ratio <= 1.0:
+            h *= _rk45_step_factor(err_ratio, True)
+            rejected = True
+            n_rejected += 1
+            continue
+
+        t_new = t_end if last else t + h
+        t_stop = t_new
+        if events or t_eval is not None:
+            np.subtract(y_new, y, out=dense[0])
+            np.multiply(k[0], h, out=dense[1])
+            dense[1] -= dense[0]
+            np.multiply(k[6], h, out=dense[2])
+            np.subtract(dense[0], dense[2], out=dense[2])
+            dense[2] -= dense[1]
+            np.dot(_DOPRI5_D, k, out=dense[3])
+            dense[3] *= h
+
+        if events:
+            g_new = [event(t_new, y_new, params) for event in events]
+            for theta, j in _find_events(events, terminal, direction, g_old, g_new,
+                                         t, h, y, dense, params, scratch):
+                t_events[j].append(t + theta * h)
+                y_events[j].append(_dopri5_dense(theta, y, dense, scratch).copy())
+                if terminal[j]:
+                    status = 1
+                    t_stop = t + theta * h
+            g_old = g_new
+
+        if t_eval is not None:
+            while i_eval < len(ts) and ts[i_eval] <= t_stop:
+                _dopri5_dense((ts[i_eval] - t) / h, y, dense, ys[i_eval])
+                i_eval += 1
+
+        if status == 1:
+            np.copyto(y, _dopri5_dense((t_stop - t) / h, y, dense, scratch))
+        else:
+            np.copyto(y, y_new)
+            # first same as last
+            np.copyto(k[0], k[6])
+        t = t_stop
+        if t_eval is None:
+            ts.append(t)
+            ys.append(y.copy())
+        n_accepted += 1
+        if status == 1:
+            break
+        h *= _rk45_step_factor(err_ratio, rejected)
+        rejected = False
+
+    if t_eval is not None:
+        ts, ys = ts[:i_eval], ys[:i_eval]
+    return RK45Result(np.asarray(ts), np.asarray(ys).reshape(-1, n),
+                      [np.asarray(te) for te in t_events],
+                      [np.asarray(ye).reshape(-1, n) for ye in y_events],
+                      status, nfev, n_accepted, n_rejected)
@@ -0,0 +1,21 @@
+from ._tlib import (
+    TArray, TMatrix,
+    linspace, arange, logspace,
+    dot, matrix_dot_vector, matrix_dot_matrix, vec_dist, len_vec, norm_vec,
+    gauss_seidel,
+    find_root, integrate_midpoint, integrate_simpson, fourier_transform,
+    diff_1, diff_2,
+    euler_step, rk2_step, rk4_step, vv_step,
+    rand
+)
+
+__all__ = [
+    "TArray", "TMatrix",
+    "linspace", "arange", "logspace",
+    "dot", "matrix_dot_vector", "matrix_dot_matrix", "vec_dist", "len_vec", "norm_vec",
+    "gauss_seidel",
+    "find_root", "integrate_midpoint", "integrate_simpson", "fourier_transform",
+    "diff_1", "diff_2",
+    "euler_step", "rk2_step", "rk4_step", "vv_step",
+    "rand"
+]
@@ -0,0 +1,613 @@
+# Python bindings of tlib (c_libraries in this repository).
+#
+# TArray and TMatrix own a reference to a t_array/t_matrix and implement the
+# buffer protocol, so np.asarray(TArray) is a view on the tlib storage without
+# copying. In the other direction, TArray(numpy_array) and TMatrix(numpy_array)
+# wrap the memory of a C-contiguous float64 numpy array; the numpy array is
+# kept alive until tlib drops its last reference (t_array_unref).
+# Every call into tlib releases the GIL, so several Python threads can run
+# tlib kernels concurrently.
+
+import numpy as np
+cimport numpy as np
+
+from cpython.ref cimport Py_INCREF, Py_DECREF
+from cpython.buffer cimport PyBUF_STRIDES, PyBUF_C_CONTIGUOUS, PyBUF_F_CONTIGUOUS, PyBUF_ANY_CONTIGUOUS
+from cpython.mem cimport PyMem_Malloc, PyMem_Free
+from libc.math cimport NAN
+
+from phydesim.rk_lib._cython._cfunc cimport c_address
+from phydesim.tlib.t_numerics cimport *
+
+np.import_array()
+
+
+#==============================================================================
+# containers
+
+cdef void _release_pyobject(double* data, void* ctx) noexcept with gil:
+    # release of wrapped numpy memory: drop the reference taken in _wrap_numpy
+    Py_DECREF(<object> ctx)
+
+
+cdef t_array* _wrap_numpy(np.ndarray arr):
+    Py_INCREF(arr)
+    return t_array_wrap(<double*> arr.data, arr.size, _release_pyobject, <void*> arr)
+
+
+cdef np.ndarray _as_float64(object obj, int ndim):
+    # only copies if obj is not already a C-contiguous float64 array
+    cdef np.ndarray arr = np.ascontiguousarray(obj, dtype=np.float64)
+    if arr.ndim != ndim:
+        raise ValueError(f"Expected {ndim}D array, got {arr.ndim}D")
+    return arr
+
+
+cdef bint _rows_wrappable(object obj):
+    # float64 matrix whose rows are contiguous and equally spaced (e.g. a[:, :k]),
+    # t_matrix_wrap takes the stride
+    return (isinstance(obj, np.ndarray) and obj.dtype == np.float64 and obj.ndim == 2
+            and obj.strides[1] == sizeof(double)
+            and obj.strides[0] % sizeof(double) == 0
+            and obj.strides[0] >= obj.shape[1] * sizeof(double))
+
+
+cdef np.ndarray _as_float64_rows(object obj):
+    # like _as_float64(obj, 2), but keeps wrappable matrices as they are
+    if _rows_wrappable(obj):
+        return obj
+    return _as_float64(obj, 2)
+
+
+cdef class TArray:
+    """
+    1D array of doubles in tlib storage.
+
+    TArray(n)           --> new zero-initialized t_array of length n
+    TArray(array_like)  --> wraps float64 numpy array without copy
+                            (copies only if not C-contiguous float64)
+    np.asarray(TArray)  --> numpy view on the t_array
+    """
+    cdef t_array* arr
+    cdef Py_ssize_t _shape[1]
+    cdef Py_ssize_t _strides[1]
+
+    def __cinit__(self, obj = None):
+        cdef size_t n
+        self.arr = NULL
+        if obj is None:
+            return
+        if isinstance(obj, int):
+            if obj < 0:
+                raise ValueError("Length of TArray must not be negative")
+            n = obj
+            with nogil:
+                self.arr = t_array_alloc(n)
+        else:
+            self.arr = _wrap_numpy(_as_float64(obj, 1))
+
+    def __init__(self, obj = None):
+        # __cinit__ accepts None only for from_ptr (TArray.__new__ skips
+        # __init__), an empty TArray must not reach tlib with a NULL pointer
+        if obj is None:
+            raise TypeError("TArray needs a length or an array_like")
+
+    @staticmethod
+    cdef TArray from_ptr(t_array* arr):
+        """takes over one reference of arr"""
+        cdef TArray self = TArray.__new__(TArray)
+        self.arr = arr
+        return self
+
+    def __dealloc__(self):
+        if self.arr != NULL:
+            t_array_unref(self.arr)
+
+    def __len__(self):
+        return t_array_len(self.arr)
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        self._shape[0] = t_array_len(self.arr)
+        self._strides[0] = sizeof(double)
+        buffer.buf = <void*> t_array_data(self.arr)
+        buffer.format = b"d"
+        buffer.internal = NULL
+        buffer.itemsize = sizeof(double)
+        buffer.len = self._shape[0] * sizeof(double)
+        buffer.ndim = 1
+        # exporter keeps reference on t_array as long as the view lives
+        buffer.obj = self
+        buffer.readonly = 0
+        buffer.shape = self._shape
+        buffer.strides = self._strides
+        buffer.suboffsets = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+    def numpy(self):
+        """numpy view on data (no copy)"""
+        return np.asarray(self)
+
+    def __repr__(self):
+        return f"TArray({np.asarray(self)!r})"
+
+
+cdef class TMatrix:
+    """
+    2D row major matrix of doubles in tlib storage.
+
+    TMatrix(rows, cols)  --> new zero-initialized t_matrix
+    TMatrix(array_like)  --> wraps 2D float64 numpy array without copy
+                             (also row strided, e.g. a[:, :k])
+    np.asarray(TMatrix)  --> numpy view on the t_matrix
+    """
+    cdef t_matrix* m
+    cdef Py_ssize_t _shape[2]
+    cdef Py_ssize_t _strides[2]
+
+    def __cinit__(self, obj = None, cols = None):
+        cdef np.ndarray arr
+        self.m = NULL
+        if obj is None:
+            return
+        if cols is not None:
+            if obj <= 0 or cols <= 0:
+                raise ValueError("Neither rows nor columns can be zero")
+            self.m = t_matrix_alloc(<size_t> obj, <size_t> cols)
+        else:
+            arr = _as_float64_rows(obj)
+            if arr.shape[0] == 0 or arr.shape[1] == 0:
+                raise ValueError("Neither rows nor columns can be zero")
+            # reference on arr is dropped by _release_pyobject
+            Py_INCREF(arr)
+            self.m = t_matrix_wrap(<double*> arr.data, arr.shape[0], arr.shape[1],
+                                   arr.strides[0] // sizeof(double),
+                                   _release_pyobject, <void*> arr)
+
+    def __init__(self, obj = None, cols = None):
+        # see TArray.__init__
+        if obj is None:
+            raise TypeError("TMatrix needs rows and cols or an array_like")
+
+    @staticmethod
+    cdef TMatrix from_ptr(t_matrix* m):
+        """takes over one reference of m"""
+        cdef TMatrix self = TMatrix.__new__(TMatrix)
+        self.m = m
+        return self
+
+    def __dealloc__(self):
+        if self.m != NULL:
+            t_matrix_unref(self.m)
+
+    @property
+    def shape(self):
+        return (t_matrix_rows(self.m), t_matrix_cols(self.m))
+
+    @property
+    def tda(self):
+        """row stride in elements, > cols for padded storage"""
+        return t_matrix_tda(self.m)
+
+    @property
+    def array(self):
+        """storage as TArray (rows are tda apart, see TMatrix.tda), no copy"""
+        cdef t_array* data = t_matrix_get_t_array(self.m)
+        t_array_ref(data)
+        return TArray.from_ptr(data)
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        self._shape[0] = t_matrix_rows(self.m)
+        self._shape[1] = t_matrix_cols(self.m)
+        # padded rows can only be exported to consumers that take strides and
+        # do not insist on contiguous memory
+        if t_matrix_tda(self.m) != t_matrix_cols(self.m) and self._shape[0] > 1:
+            if ((flags & PyBUF_STRIDES) != PyBUF_STRIDES
+                    or (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS
+                    or (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS
+                    or (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS):
+                raise BufferError("TMatrix with padded rows (tda > cols) is not contiguous")
+        # rows of wrapped storage may be padded
+        self._strides[0] = t_matrix_tda(self.m) * sizeof(double)
+        self._strides[1] = sizeof(double)
+        buffer.buf = <void*> t_array_data(t_matrix_get_t_array(self.m))
+        buffer.format = b"d"
+        buffer.internal = NULL
+        buffer.itemsize = sizeof(double)
+        buffer.len = self._shape[0] * self._shape[1] * sizeof(double)
+        buffer.ndim = 2
+        buffer.obj = self
+        buffer.readonly = 0
+        buffer.shape = self._shape
+        buffer.strides = self._strides
+        buffer.suboffsets = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+    def numpy(self):
+        """numpy view on data (no copy)"""
+        return np.asarray(self)
+
+    def __repr__(self):
+        return f"TMatrix({np.asarray(self)!r})"
+
+
+cdef TArray _as_tarray(object obj):
+    if isinstance(obj, TArray):
+        return <TArray> obj
+    return TArray(obj)
+
+
+cdef TMatrix _as_tmatrix(object obj):
+    if isinstance(obj, TMatrix):
+        return <TMatrix> obj
+    return TMatrix(obj)
+
+
+# Arguments written in place are never converted: the result would end up in
+# the temporary copy and the caller's array would stay unchanged.
+
+cdef TArray _inplace_tarray(object obj, str name):
+    if isinstance(obj, TArray):
+        return <TArray> obj
+    if not isinstance(obj, np.ndarray):
+        raise TypeError(f"{name} must be a TArray or a numpy array, got {type(obj).__name__}")
+    if (obj.dtype != np.float64 or obj.ndim != 1 or not obj.flags['C_CONTIGUOUS']
+            or not obj.flags['WRITEABLE']):
+        raise ValueError(f"{name} must be a writeable 1D C-contiguous float64 array "
+                         "to be written in place")
+    return TArray(obj)
+
+
+cdef TMatrix _inplace_tmatrix(object obj, str name):
+    if isinstance(obj, TMatrix):
+        return <TMatrix> obj
+    if not isinstance(obj, np.ndarray):
+        raise TypeError(f"{name} must be a TMatrix or a numpy array, got {type(obj).__name__}")
+    if not _rows_wrappable(obj) or not obj.flags['WRITEABLE']:
+        raise ValueError(f"{name} must be a writeable 2D float64 array with contiguous "
+                         "rows to be written in place")
+    return TMatrix(obj)
+
+
+#==============================================================================
+# callbacks
+#
+# func is either a C function (address, ctypes function pointer or PyCapsule)
+# which is passed directly to tlib, or a Python callable which is called
+# through a trampoline that re-acquires the GIL. Exceptions raised by Python
+# callables are stored and re-raised after the C call returned.
+
+cdef class _Callback:
+    cdef object func
+    cdef object params
+    cdef object error
+    cdef Py_ssize_t dim
+    cdef void* c_func
+    cdef void* c_params
+    # keeps converted params array of C function alive
+    cdef object keep
+
+    def __cinit__(self, object func, object params, Py_ssize_t dim = 0):
+        cdef size_t addr = c_address(func)
+        self.func = func
+        self.params = params
+        self.error = None
+        self.dim = dim
+        self.c_func = <void*> addr
+        self.c_params = NULL
+        if addr == 0:
+            if not callable(func):
+                raise TypeError("func must be a C function (address, ctypes, PyCapsule) or a callable")
+            return
+        if isinstance(params, np.ndarray):
+            self.keep = np.ascontiguousarray(params, dtype=np.float64)
+            self.c_params = <void*> (<np.ndarray> self.keep).data
+        elif params is not None:
+            self.c_params = <void*> c_address(params)
+            if self.c_params == NULL:
+                raise TypeError("params of C function must be None, an address, a ctypes object or a numpy array")
+
+    cdef void* payload(self):
+        return self.c_params if self.c_func != NULL else <void*> self
+
+    cdef check(self):
+        if self.error is not None:
+            raise self.error
+
+
+cdef double _py_std_func(double x, void* payload) noexcept with gil:
+    cdef _Callback cb = <_Callback> payload
+    if cb.error is not None:
+        return NAN
+    try:
+        return cb.func(x, cb.params)
+    except BaseException as e:
+        cb.error = e
+        return NAN
+
+
+cdef double complex _py_complex_func(double x, void* payload) noexcept with gil:
+    cdef _Callback cb = <_Callback> payload
+    if cb.error is not None:
+        return NAN
+    try:
+        return cb.func(x, cb.params)
+    except BaseException as e:
+        cb.error = e
+        return NAN
+
+
+cdef void _py_ode_func(double t, const double* y, double* dy, void* payload) noexcept with gil:
+    # same convention as phydesim steppers: dy = ode_func(t, y, params)
+    cdef _Callback cb = <_Callback> payload
+    if cb.error is not None:
+        return
+    try:
+        np.asarray(<double[:cb.dim]> dy)[:] = cb.func(
+            t, np.asarray(<double[:cb.dim]> (<double*> y)), cb.params)
+    except BaseException as e:
+        cb.error = e
+
+
+cdef std_func_ptr _std_func(_Callback cb):
+    return <std_func_ptr> cb.c_func if cb.c_func != NULL else _py_std_func
+
+
+cdef ode_func_ptr _ode_func(_Callback cb):
+    return <ode_func_ptr> cb.c_func if cb.c_func != NULL else _py_ode_func
+
+
+#==============================================================================
+# array creation
+
+def linspace(double start, double stop, unsigned int n):
+    cdef t_array* arr
+    with nogil:
+        arr = tn_linspace_alloc(start, stop, n)
+    return TArray.from_ptr(arr)
+
+
+def arange(double start, double step, unsigned int n):
+    cdef t_array* arr
+    with nogil:
+        arr = tn_arange_alloc(start, step, n)
+    return TArray.from_ptr(arr)
+
+
+def logspace(double start, double stop, unsigned int n):
+    cdef t_array* arr
+    with nogil:
+        arr = tn_logspace_alloc(start, stop, n)
+    return TArray.from_ptr(arr)
+
+
+#==============================================================================
+# linear algebra
+
+def dot(x, y):
+    cdef TArray a = _as_tarray(x)
+    cdef TArray b = _as_tarray(y)
+    cdef double result
+    if len(a) != len(b):
+        raise ValueError("Incompatible array lengths in dot")
+    with nogil:
+        result = tn_dot_product(a.arr, b.arr)
+    return result
+
+
+def matrix_dot_vector(m, v, out = None):
+    """b = m * v, written into out if given"""
+    cdef TMatrix a = _as_tmatrix(m)
+    cdef TArray x = _as_tarray(v)
+    rows, cols = a.shape
+    cdef TArray b = TArray(rows) if out is None else _inplace_tarray(out, "out")
+    if len(x) != cols or len(b) != rows:
+        raise ValueError("Incompatible shapes in matrix_dot_vector")
+    with nogil:
+        tn_matrix_dot_vector(a.m, x.arr, b.arr)
+    return b if out is None else out
+
+
+def matrix_dot_matrix(m1, m2, out = None):
+    """c = m1 * m2, written into out if given"""
+    cdef TMatrix a = _as_tmatrix(m1)
+    cdef TMatrix b = _as_tmatrix(m2)
+    if a.shape[1] != b.shape[0]:
+        raise ValueError("Incompatible shapes in matrix_dot_matrix")
+    cdef TMatrix c = TMatrix(a.shape[0], b.shape[1]) if out is None else _inplace_tmatrix(out, "out")
+    if c.shape != (a.shape[0], b.shape[1]):
+        raise ValueError("Incompatible shape of out in matrix_dot_matrix")
+    with nogil:
+        tn_matrix_dot_matrix(a.m, b.m, c.m)
+    return c if out is None else out
+
+
+def vec_dist(y1, y2):
+    cdef TArray a = _as_tarray(y1)
+    cdef TArray b = _as_tarray(y2)
+    cdef double result
+    if len(a) != len(b):
+        raise ValueError("Incompatible array lengths in vec_dist")
+    with nogil:
+        result = tn_vec_dist(a.arr, b.arr)
+    return result
+
+
+def len_vec(y):
+    cdef TArray a = _as_tarray(y)
+    cdef double result
+    with nogil:
+        result = tn_len_vec(a.arr)
+    return result
+
+
+def norm_vec(v):
+    """normalizes v in place (v must be TArray or float64 numpy array)"""
+    cdef TArray a = _inplace_tarray(v, "v")
+    with nogil:
+        tn_norm_vec(a.arr)
+    return v
+
+
+def gauss_seidel(m, b, v = None, double tol = 1e-10, int max_iter = 1000):
+    """solves m * v = b, v is initial guess and solution (in place)"""
+    cdef TMatrix a = _as_tmatrix(m)
+    cdef TArray rhs = _as_tarray(b)
+    rows, cols = a.shape
+    if v is None:
+        v = TArray(rows)
+    cdef TArray x = _inplace_tarray(v, "v")
+    if rows != cols or len(rhs) != rows or len(x) != rows:
+        raise ValueError("Gauss-Seidel needs quadratic matrix and matching vectors")
+    with nogil:
+        tn_gauss_seidel(a.m, rhs.arr, x.arr, tol, max_iter)
+    return v
+
+
+#==============================================================================
+# analysis
+# func(x, params) -> float or C function with STD_FUNC signature
+
+def find_root(func, double x0, double dx = 1e-6, double tol = 1e-10,
+              int max_iter = 1000, double close = 1e-8, params = None):
+    cdef _Callback cb = _Callback(func, params)
+    cdef std_func_ptr f = _std_func(cb)
+    cdef void* p = cb.payload()
+    cdef double result
+    with nogil:
+        result = tn_find_root(f, x0, dx, tol, max_iter, close, p)
+    cb.check()
+    return result
+
+
+def integrate_midpoint(func, double a, double b, double dx, params = None):
+    cdef _Callback cb = _Callback(func, params)
+    cdef std_func_ptr f = _std_func(cb)
+    cdef void* p = cb.payload()
+    cdef double result
+    with nogil:
+        result = tn_integrate_midpoint(f, a, b, dx, p)
+    cb.check()
+    return result
+
+
+def integrate_simpson(func, double a, double b, double dx, params = None):
+    cdef _Callback cb = _Callback(func, params)
+    cdef std_func_ptr f = _std_func(cb)
+    cdef void* p = cb.payload()
+    cdef double result
+    with nogil:
+        result = tn_integrate_simpson(f, a, b, dx, p)
+    cb.check()
+    return result
+
+
+def fourier_transform(func, double m, double k, double dt, params = None):
+    """func(t, params) -> complex or C function returning double complex"""
+    cdef _Callback cb = _Callback(func, params)
+    cdef complex_func_ptr f = <complex_func_ptr> cb.c_func if cb.c_func != NULL else _py_complex_func
+    cdef void* p = cb.payload()
+    cdef double complex result
+    with nogil:
+        result = tn_fourier_transform(f, m, k, dt, p)
+    cb.check()
+    return result
+
+
+def diff_1(func, double x, double dx, params = None):
+    cdef _Callback cb = _Callback(func, params)
+    cdef std_func_ptr f = _std_func(cb)
+    cdef void* p = cb.payload()
+    cdef double result
+    with nogil:
+        result = tn_diff_1(f, x, dx, p)
+    cb.check()
+    return result
+
+
+def diff_2(func, double x, double dx, params = None):
+    cdef _Callback cb = _Callback(func, params)
+    cdef std_func_ptr f = _std_func(cb)
+    cdef void* p = cb.payload()
+    cdef double result
+    with nogil:
+        result = tn_diff_2(f, x, dx, p)
+    cb.check()
+    return result
+
+
+#==============================================================================
+# differential equations
+# y is stepped in place and must be a TArray or a C-contiguous float64 numpy
+# array. ode_func(t, y, params) -> dy or C function with ODE_FUNC signature.
+
+cdef TArray _state(object y):
+    return _inplace_tarray(y, "y")
+
+
+def euler_step(double t, double dt, y, ode_func, params = None):
+    cdef TArray state = _state(y)
+    cdef int dim = len(state)
+    cdef _Callback cb = _Callback(ode_func, params, dim)
+    cdef ode_func_ptr f = _ode_func(cb)
+    cdef void* p = cb.payload()
+    with nogil:
+        tn_euler_step(t, dt, t_array_data(state.arr), f, dim, p)
+    cb.check()
+    return y
+
+
+def rk2_step(double t, double dt, y, ode_func, params = None):
+    cdef TArray state = _state(y)
+    cdef int dim = len(state)
+    cdef _Callback cb = _Callback(ode_func, params, dim)
+    cdef ode_func_ptr f = _ode_func(cb)
+    cdef void* p = cb.payload()
+    with nogil:
+        tn_rk2_step(t, dt, t_array_data(state.arr), f, dim, p)
+    cb.check()
+    return y
+
+
+def rk4_step(double t, double dt, y, ode_func, params = None):
+    cdef TArray state = _state(y)
+    cdef int dim = len(state)
+    cdef _Callback cb = _Callback(ode_func, params, dim)
+    cdef ode_func_ptr f = _ode_func(cb)
+    cdef void* p = cb.payload()
+    cdef double* k = <double*> PyMem_Malloc(5 * dim * sizeof(double))
+    if k == NULL:
+        raise MemoryError()
+    with nogil:
+        tn_rk4_step(t, dt, t_array_data(state.arr), k, f, dim, p)
+    PyMem_Free(k)
+    cb.check()
+    return y
+
+
+def vv_step(double t, double dt, y, ode_func, params = None):
+    cdef TArray state = _state(y)
+    cdef int dim = len(state)
+    if dim % 2 != 0:
+        raise ValueError("Dimension of y must not be odd in Velocity-Verlet")
+    cdef _Callback cb = _Callback(ode_func, params, dim)
+    cdef ode_func_ptr f = _ode_func(cb)
+    cdef void* p = cb.payload()
+    with nogil:
+        tn_vv_step(t, dt, t_array_data(state.arr), f, dim, p)
+    cb.check()
+    return y
+
+
+#==============================================================================
+# stochastics
+
+def rand(int n, double sigma = 1.0, int seed = 0):
+    """n normally distributed random numbers with standard deviation sigma"""
+    cdef t_array* arr
+    with nogil:
+        arr = tn_rand_alloc(n, sigma, seed)
+    return TArray.from_ptr(arr)
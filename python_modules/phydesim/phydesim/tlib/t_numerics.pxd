@@ -0,0 +1,93 @@
+# Cython declarations of the tlib C library (c_libraries/include/t_numerics.h).
+# Only the part of the API that is wrapped by _tlib.pyx is declared here.
+# All functions are declared nogil so that they can be called without the GIL;
+# the callbacks passed to them must then acquire the GIL themselves if they
+# call into Python.
+
+# pointer types of the callbacks STD_FUNC, ODE_FUNC and the complex integrand
+# of tn_fourier_transform
+ctypedef double (*std_func_ptr)(double, void*) noexcept nogil
+ctypedef double complex (*complex_func_ptr)(double, void*) noexcept nogil
+ctypedef void (*ode_func_ptr)(double, const double*, double*, void*) noexcept nogil
+# t_release_func of t_array_wrap
+ctypedef void (*release_func_ptr)(double*, void*) noexcept nogil
+
+cdef extern from "t_numerics.h" nogil:
+
+    #--------------------------------------------------------------------------
+    # arrays
+
+    ctypedef struct t_array:
+        pass
+
+    t_array* t_array_alloc(size_t len)
+    t_array* t_array_wrap(double* data, size_t len, release_func_ptr release, void* ctx)
+    void t_array_ref(t_array* arr)
+    void t_array_unref(t_array* arr)
+    double* t_array_data(t_array* arr)
+    size_t t_array_len(const t_array* arr)
+
+    t_array* tn_linspace_alloc(double start, double stop, unsigned int n)
+    t_array* tn_arange_alloc(double start, double step, unsigned int n)
+    t_array* tn_logspace_alloc(double start, double stop, unsigned int n)
+
+    #--------------------------------------------------------------------------
+    # matrices
+
+    ctypedef struct t_matrix:
+        pass
+
+    t_matrix* t_matrix_alloc(size_t rows, size_t cols)
+    t_matrix* t_matrix_create_from_t_array(t_array* arr, size_t rows, size_t cols)
+    t_matrix* t_matrix_wrap(double* data, size_t rows, size_t cols, size_t tda,
+                            release_func_ptr release, void* ctx)
+    void t_matrix_ref(t_matrix* m)
+    void t_matrix_unref(t_matrix* m)
+    size_t t_matrix_rows(const t_matrix* m)
+    size_t t_matrix_cols(const t_matrix* m)
+    size_t t_matrix_tda(const t_matrix* m)
+    t_array* t_matrix_get_t_array(t_matrix* m)
+
+    #--------------------------------------------------------------------------
+    # linear algebra
+
+    double tn_dot_product(const t_array* x, const t_array* y)
+    void tn_matrix_dot_vector(t_matrix* a, const t_array* v, t_array* b)
+    void tn_matrix_dot_matrix(t_matrix* a, t_matrix* b, t_matrix* c)
+    double tn_vec_dist(t_array* y1, t_array* y2)
+    double tn_len_vec(t_array* y)
+    void tn_norm_vec(t_array* v)
+    void tn_gauss_seidel(const t_matrix* m, const t_array* b, t_array* v,
+                         double tol, int max_iter)
+
+    #--------------------------------------------------------------------------
+    # analysis
+
+
+    double tn_find_root(std_func_ptr func, double x0, double dx, double tol,
+                        int max_iter, double close, void* params)
+    double tn_integrate_midpoint(std_func_ptr integrand, double a, double b,
+                                 double dx, void* params)
+    double tn_integrate_simpson(std_func_ptr integrand, double a, double b,
+                                double dx, void* params)
+    double complex tn_fourier_transform(complex_func_ptr integrand,
+                                        double m, double k, double dt, void* params)
+    double tn_diff_1(std_func_ptr func, double x, double dx, void* params)
+    double tn_diff_2(std_func_ptr func, double x, double dx, void* params)
+
+    #--------------------------------------------------------------------------
+    # differential equations
+
+    void tn_euler_step(double t, double dt, double* y, ode_func_ptr ode_func,
+                       int dim, void* params)
+    void tn_rk2_step(double t, double dt, double* y, ode_func_ptr ode_func,
+                     int dim, void* params)
+    void tn_rk4_step(double t, double dt, double* y, double* kArray,
+                     ode_func_ptr ode_func, int dim, void* params)
+    void tn_vv_step(double t, double dt, double* y, ode_func_ptr ode_func,
+                    int dim, void* params)
+
+    #--------------------------------------------------------------------------
+    # stochastics
+
+    t_array* tn_rand_alloc(int n, double sigma, int seed)
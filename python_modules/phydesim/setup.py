@@ -1,4 +1,7 @@
 import sys # inbuilt module
+import os
+import shlex
+import subprocess
 
 # use: "python setup.py --debug=True build_ext --inplace" for quick debugging
 if len(sys.argv) > 1 and sys.argv[1].startswith("--debug="):
@@ -31,6 +34,11 @@ name = "_core"  # name of the library
 filepath = "phydesim/rk_lib/_cython/"
 modulepath = "phydesim.rk_lib._cython."
 
+# bindings of tlib (c_libraries in this repository)
+tlib_name = "_tlib"
+tlib_filepath = "phydesim/tlib/"
+tlib_modulepath = "phydesim.tlib."
+
 
 #==============================================================================
 # additional flags for compilation of .c file:
@@ -46,8 +54,27 @@ elif sys.platform == "darwin":  # macOS
 
 #==============================================================================
 # append flags for linking C libraries: e.g. -lm (link math library)
+# tlib is expected in TLIB_PATH with headers in include/ and libtlib.so in lib/
+# (see "make build" and "make submit" in c_libraries/config). The path can be
+# overwritten with the environment variable TLIB_PATH. If libtlib.so is not
+# found, phydesim is built without phydesim.tlib.
+TLIB_PATH = os.path.abspath(os.environ.get("TLIB_PATH", "../../c_libraries"))
+USE_TLIB = os.path.isfile(os.path.join(TLIB_PATH, "lib", "libtlib.so"))
+
 c_header_compile_args = []
-c_header_path = []
+c_header_path = [os.path.join(TLIB_PATH, "include")]
+c_library_path = [os.path.join(TLIB_PATH, "lib")]
+
+# t_numerics.h includes GSL headers
+try:
+    gsl_cflags = subprocess.run(["pkg-config", "--cflags", "gsl"],
+                                capture_output=True, text=True).stdout
+    c_header_compile_args += shlex.split(gsl_cflags)
+except FileNotFoundError:
+    pass
+
+if not USE_TLIB:
+    print(f"libtlib.so not found in {TLIB_PATH}/lib, building without phydesim.tlib.")
 
 #==============================================================================
 extension = Extension(
@@ -62,11 +89,26 @@ extension = Extension(
     define_macros=[("NPY_NO_DEPRECATED_API", "NPY_1_7_API_VERSION")],
 )
 
+extensions = [extension]
+
+if USE_TLIB:
+    extensions.append(Extension(
+        name = tlib_modulepath + tlib_name,
+        sources = [tlib_filepath + tlib_name + ".pyx"],
+        extra_compile_args = extra_compile_args + c_header_compile_args,
+        include_dirs = [numpy.get_include()] + c_header_path,
+        library_dirs = c_library_path,
+        libraries = ["tlib"],
+        # so that libtlib.so is found at runtime without LD_LIBRARY_PATH
+        runtime_library_dirs = c_library_path,
+        define_macros=[("NPY_NO_DEPRECATED_API", "NPY_1_7_API_VERSION")],
+    ))
+
 setup(
     name = name,
     packages = find_packages(),
     ext_modules = cythonize(
-        extension,
+        extensions,
         compiler_directives = {
             "language_level": 3,  # Python-3 syntax
             # next two are set to False for performance
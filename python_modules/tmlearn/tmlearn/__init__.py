@@ -1,6 +1,6 @@
-__name__ = "tmlearns"
+__name__ = "tmlearn"
 
-__submodules__ = {"linregress"}
+__submodules__ = {"linregress", "curvefit"}
 
 # define what is imported when using "from phydesim import *"
 __all__ = list(
@@ -11,7 +11,10 @@ __all__ = list(
 def __getattr__(attr):
     if attr == "linregress":
         import tmlearn.linregress
-        return phydesim.text
+        return tmlearn.linregress
+    if attr == "curvefit":
+        import tmlearn.curvefit
+        return tmlearn.curvefit
     # !r represents object in ticks
     raise AttributeError(f"Module {__name__!r} has no attribute {attr!r}")
 
@@ -0,0 +1,116 @@
+#------------------------------------------------------------------------------------------------------------------------------------
+# access to the C library libtlib.so (c_libraries) via ctypes
+#
+# The library is searched in $TLIB_PATH/lib, then in the system library path
+# and finally in c_libraries/lib of this repository. Only the functions used
+# by tmlearn are declared here.
+
+import ctypes
+import ctypes.util
+import os
+
+import numpy as np
+
+_lib = None
+
+# structs of t_numerics.h
+class tn_lm_options(ctypes.Structure):
+    _fields_ = [("max_iter", ctypes.c_int), ("ftol", ctypes.c_double),
+                ("xtol", ctypes.c_double), ("gtol", ctypes.c_double),
+                ("lambda0", ctypes.c_double), ("n_threads", ctypes.c_int)]
+
+class tn_lm_result(ctypes.Structure):
+    _fields_ = [("status", ctypes.c_int), ("n_iter", ctypes.c_int),
+                ("chi2", ctypes.c_double), ("n_eval", ctypes.c_size_t)]
+
+# function types STD_FUNC and FIT_JAC
+STD_FUNC = ctypes.CFUNCTYPE(ctypes.c_double, ctypes.c_double, ctypes.c_void_p)
+FIT_JAC = ctypes.CFUNCTYPE(None, ctypes.c_double, ctypes.c_void_p, ctypes.POINTER(ctypes.c_double))
+
+def _find_library():
+    candidates = []
+    if "TLIB_PATH" in os.environ:
+        candidates.append(os.path.join(os.environ["TLIB_PATH"], "lib", "libtlib.so"))
+    system = ctypes.util.find_library("tlib")
+    if system:
+        candidates.append(system)
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates.append(os.path.join(here, "..", "..", "..", "c_libraries", "lib", "libtlib.so"))
+    for path in candidates:
+        try:
+            return ctypes.CDLL(path)
+        except OSError:
+            continue
+    raise ImportError("libtlib.so not found, build it in c_libraries/config (make && make submit) "
+                      "or set TLIB_PATH to the directory containing lib/libtlib.so")
+
+def _declare(lib):
+    c_size = ctypes.c_size_t
+    c_ptr = ctypes.c_void_p
+    c_dbl_p = ctypes.POINTER(ctypes.c_double)
+    signatures = {
+        # arrays and matrices
+        "t_array_wrap": (c_ptr, [c_dbl_p, c_size, c_ptr, c_ptr]),
+        "t_array_unref": (None, [c_ptr]),
+        "t_matrix_create_from_t_array": (c_ptr, [c_ptr, c_size, c_size]),
+        "t_matrix_unref": (None, [c_ptr]),
+        # incremental least squares
+        "tn_lstsq_alloc": (c_ptr, [c_size, ctypes.c_int]),
+        "tn_lstsq_free": (None, [c_ptr]),
+        "tn_lstsq_reset": (None, [c_ptr]),
+        "tn_lstsq_add_batch": (None, [c_ptr, c_ptr, c_ptr]),
+        "tn_lstsq_solve": (ctypes.c_double, [c_ptr, c_ptr]),
+        "tn_lstsq_count": (c_size, [c_ptr]),
+        "tn_lstsq_rss": (ctypes.c_double, [c_ptr]),
+        "tn_lstsq_mse": (ctypes.c_double, [c_ptr]),
+        "tn_lstsq_r2": (ctypes.c_double, [c_ptr]),
+        # Levenberg-Marquardt
+        "tn_lm_default_options": (tn_lm_options, []),
+        "tn_lm_fit_batch": (None, [c_ptr, c_ptr, c_ptr, c_ptr, c_ptr, c_ptr, c_ptr,
+                                   ctypes.POINTER(tn_lm_options), ctypes.POINTER(tn_lm_result)]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        func = getattr(lib, name)
+        func.restype = restype
+        func.argtypes = argtypes
+
+def lib():
+    """loaded libtlib.so (loaded and declared on first use)"""
+    global _lib
+    if _lib is None:
+        _lib = _find_library()
+        _declare(_lib)
+    return _lib
+
+def as_c_array(data, ndim):
+    """C-contiguous float64 copy or view of data with ndim dimensions"""
+    arr = np.ascontiguousarray(data, dtype=np.float64)
+    if arr.ndim != ndim:
+        raise ValueError(f"Expected {ndim}D data, got shape {arr.shape}")
+    return arr
+
+class borrowed_t_array:
+    """t_array borrowing the memory of a numpy array (context manager)"""
+    def __init__(self, arr):
+        self.arr = arr
+        self.ptr = lib().t_array_wrap(arr.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), arr.size, None, None)
+
+    def __enter__(self):
+        return self.ptr
+
+    def __exit__(self, *args):
+        lib().t_array_unref(self.ptr)
+
+class borrowed_t_matrix:
+    """t_matrix borrowing the memory of a 2D numpy array (context manager)"""
+    def __init__(self, arr):
+        self.arr = arr
+        with borrowed_t_array(arr) as data:
+            # matrix holds its own reference on data
+            self.ptr = lib().t_matrix_create_from_t_array(data, arr.shape[0], arr.shape[1])
+
+    def __enter__(self):
+        return self.ptr
+
+    def __exit__(self, *args):
+        lib().t_matrix_unref(self.ptr)
@@ -0,0 +1,11 @@
+from .levenberg_marquardt import (
+    fit_lm,
+    fit_lm_batch,
+    LM_STATUS
+)
+
+__all__ = [
+    "fit_lm",
+    "fit_lm_batch",
+    "LM_STATUS"
+]
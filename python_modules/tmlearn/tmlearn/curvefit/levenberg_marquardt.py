@@ -0,0 +1,137 @@
+#------------------------------------------------------------------------------------------------------------------------------------
+# nonlinear curve fitting (Levenberg-Marquardt of libtlib)
+#
+# fit_lm_batch fits the same model to many datasets (e.g. one spectrum per
+# row) in one call. The fits run in C, distributed over threads, each thread
+# with its own preallocated workspace.
+#
+# model(x, params) follows the STD_FUNC convention of tlib: params holds the
+# fit parameters followed by the fixed parameters. It is either
+# - a C function double model(double x, void* params), passed as address or
+#   ctypes function pointer --> fits run in parallel without Python calls
+# - a Python callable model(x, params) returning a float --> called from C for
+#   every point, the threads then share the GIL (slow, one thread by default)
+# jac(x, params) is optional in the same way and returns d model / d p_k for
+# all fit parameters (C: void jac(double x, void* params, double* grad)).
+
+import contextlib
+import ctypes
+
+import numpy as np
+
+from .. import _tlib
+
+# status codes of tn_lm_result
+LM_STATUS = {
+    0: "max_iter reached",
+    1: "converged (ftol)",
+    2: "converged (xtol)",
+    3: "converged (gtol)",
+    4: "no further improvement"
+}
+
+def _as_c_callback(func, n_params, n_total, kind, errors):
+    """
+    C function pointer for model/jac and the object keeping it alive
+
+    ctypes cannot pass an exception through C: the first one of a Python
+    callable is stored in errors and the callback returns NaN instead
+    """
+    if func is None:
+        return None, None
+    if isinstance(func, int):
+        return ctypes.c_void_p(func), None
+    if isinstance(func, ctypes._CFuncPtr):
+        return ctypes.cast(func, ctypes.c_void_p), func
+
+    if kind == "model":
+        def trampoline(x, params):
+            try:
+                return float(func(x, np.ctypeslib.as_array(ctypes.cast(params, ctypes.POINTER(ctypes.c_double)), (n_total,))))
+            except BaseException as e:
+                errors.append(e)
+                return np.nan
+        c_func = _tlib.STD_FUNC(trampoline)
+    else:
+        def trampoline(x, params, grad):
+            g = np.ctypeslib.as_array(grad, (n_params,))
+            try:
+                p = np.ctypeslib.as_array(ctypes.cast(params, ctypes.POINTER(ctypes.c_double)), (n_total,))
+                g[:] = func(x, p)
+            except BaseException as e:
+                errors.append(e)
+                g[:] = np.nan
+        c_func = _tlib.FIT_JAC(trampoline)
+    return ctypes.cast(c_func, ctypes.c_void_p), c_func
+
+def fit_lm_batch (model, x, y, p0, sigma = None, jac = None, fixed = None, n_threads = None, **kwargs):
+    """
+    fits model to every row of y
+
+    x: grid shared by all datasets (n_points) or one per dataset (n_fits x n_points)
+    y, sigma: n_fits x n_points, sigma = None --> unweighted
+    p0: initial guess, either (n_params) for all fits or (n_fits x n_params)
+    fixed: fixed parameters appended to the fit parameters passed to model
+    n_threads: number of threads, None --> all for C functions, 1 for Python callables
+    kwargs: max_iter, ftol, xtol, gtol, lambda0 (see tn_lm_options)
+
+    returns parameters (n_fits x n_params) and structured array of results
+    with fields status (see LM_STATUS), n_iter, chi2 and n_eval
+    """
+    lib = _tlib.lib()
+    y = _tlib.as_c_array(y, 2)
+    n_fits, n_points = y.shape
+    x = _tlib.as_c_array(np.atleast_2d(x), 2)
+    p = np.array(np.broadcast_to(np.asarray(p0, dtype=np.float64), (n_fits, np.shape(p0)[-1])), order = "C")
+    n_params = p.shape[1]
+    fixed = None if fixed is None else _tlib.as_c_array(np.atleast_1d(fixed), 1)
+    n_total = n_params + (0 if fixed is None else len(fixed))
+    if x.shape[1] != n_points or x.shape[0] not in (1, n_fits):
+        raise ValueError("x must have shape (n_points) or (n_fits, n_points)")
+    if n_points < n_params:
+        raise ValueError("Every dataset needs at least as many points as parameters")
+    if sigma is not None:
+        sigma = _tlib.as_c_array(np.broadcast_to(sigma, y.shape), 2)
+
+    # exceptions of Python callbacks, raised after the C call
+    errors = []
+    c_model, keep_model = _as_c_callback(model, n_params, n_total, "model", errors)
+    c_jac, keep_jac = _as_c_callback(jac, n_params, n_total, "jac", errors)
+    if c_model is None:
+        raise ValueError("model must not be None")
+
+    opt = lib.tn_lm_default_options()
+    for key, value in kwargs.items():
+        if key not in ("max_iter", "ftol", "xtol", "gtol", "lambda0"):
+            raise TypeError(f"Unknown option {key!r}")
+        setattr(opt, key, value)
+    if n_threads is None:
+        python_callback = keep_model is not None and not isinstance(model, ctypes._CFuncPtr)
+        n_threads = 1 if python_callback else 0
+    opt.n_threads = n_threads
+
+    results = (_tlib.tn_lm_result * n_fits)()
+    with contextlib.ExitStack() as stack:
+        x_m = stack.enter_context(_tlib.borrowed_t_matrix(x))
+        y_m = stack.enter_context(_tlib.borrowed_t_matrix(y))
+        p_m = stack.enter_context(_tlib.borrowed_t_matrix(p))
+        sigma_m = None if sigma is None else stack.enter_context(_tlib.borrowed_t_matrix(sigma))
+        fixed_a = None if fixed is None else stack.enter_context(_tlib.borrowed_t_array(fixed))
+        lib.tn_lm_fit_batch(c_model, c_jac, x_m, y_m, sigma_m, p_m, fixed_a,
+                            ctypes.byref(opt), results)
+    if errors:
+        raise errors[0]
+
+    return p, np.ctypeslib.as_array(results).copy()
+
+def fit_lm (model, x, y, p0, sigma = None, jac = None, fixed = None, **kwargs):
+    """
+    fits model to one dataset (x, y +- sigma), same arguments as fit_lm_batch
+    returns parameters and dict with status, n_iter, chi2 and n_eval
+    """
+    p, results = fit_lm_batch(model, np.ravel(x), np.atleast_2d(y), np.ravel(p0),
+                              None if sigma is None else np.atleast_2d(sigma),
+                              jac, fixed, n_threads = 1, **kwargs)
+    info = {name: results[0][name].item() for name in results.dtype.names}
+    info["message"] = LM_STATUS[info["status"]]
+    return p[0], info
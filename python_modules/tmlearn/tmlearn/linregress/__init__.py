@@ -6,6 +6,10 @@ from .linregress import (
     evaluation_linregress,
     test_linregress_model
 )
+from .incremental import (
+    IncrementalLinearRegression,
+    make_linear_regression_stream
+)
 
 __all__ = [
     "make_linear_regression",
@@ -13,5 +17,7 @@ __all__ = [
     "str_regression_line",
     "plot_regression_line",
     "evaluation_linregress",
-    "test_linregress_model"
+    "test_linregress_model",
+    "IncrementalLinearRegression",
+    "make_linear_regression_stream"
 ]
\ No newline at end of file
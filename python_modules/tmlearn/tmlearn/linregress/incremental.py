@@ -0,0 +1,119 @@
+#------------------------------------------------------------------------------------------------------------------------------------
+# incremental linear regression
+#
+# make_linear_regression needs all data in memory. IncrementalLinearRegression
+# instead consumes the data in batches of rows: every row is rotated into the
+# QR decomposition kept by tn_lstsq of libtlib, so memory only depends on the
+# number of features. Coefficients, R^2 and MSE of the fit to all rows seen so
+# far are available at any time, without a second pass over the data.
+
+import numpy as np
+import pandas as pd
+
+from .. import _tlib
+
+class IncrementalLinearRegression:
+    """
+    least squares fit y = x * w + w_0 over batches of rows
+
+    attributes with the layout of sklearn's LinearRegression fitted on a 2D y
+    (so that str_regression_line and plot_regression_line can be used):
+    - coef_ [[w_1, w_2, ...]], intercept_ [w_0]
+    - r2_, mse_: R^2 and MSE on all rows seen so far
+    - n_samples_: number of rows seen so far
+    """
+
+    def __init__(self, n_features = None, fit_intercept = True):
+        self.fit_intercept = fit_intercept
+        self.n_features_in_ = n_features
+        self.feature_names_in_ = None
+        self._ls = None
+        self._lib = _tlib.lib()
+
+    def __del__(self):
+        if getattr(self, "_ls", None):
+            self._lib.tn_lstsq_free(self._ls)
+            self._ls = None
+
+    def partial_fit(self, x_batch, y_batch):
+        """adds rows of x_batch (DataFrame or array, rows x features) and y_batch to the fit"""
+        if isinstance(x_batch, pd.DataFrame) and self.feature_names_in_ is None:
+            self.feature_names_in_ = np.asarray(x_batch.columns)
+        x = _tlib.as_c_array(x_batch, 2)
+        y = _tlib.as_c_array(np.ravel(np.asarray(y_batch, dtype=np.float64)), 1)
+        if self.n_features_in_ is None:
+            self.n_features_in_ = x.shape[1]
+        if x.shape[1] != self.n_features_in_:
+            raise ValueError(f"Expected {self.n_features_in_} features, got {x.shape[1]}")
+        if x.shape[0] != y.shape[0]:
+            raise ValueError("x_batch and y_batch must have the same number of rows")
+        if self._ls is None:
+            self._ls = self._lib.tn_lstsq_alloc(self.n_features_in_, int(self.fit_intercept))
+        if x.shape[0] == 0:
+            return self
+
+        with _tlib.borrowed_t_matrix(x) as x_m, _tlib.borrowed_t_array(y) as y_a:
+            self._lib.tn_lstsq_add_batch(self._ls, x_m, y_a)
+        return self
+
+    def reset(self):
+        """forgets all rows"""
+        if self._ls is not None:
+            self._lib.tn_lstsq_reset(self._ls)
+
+    def _check_fitted(self):
+        if self._ls is None or self.n_samples_ == 0:
+            raise ValueError("No data has been added with partial_fit yet")
+
+    def _solve(self):
+        self._check_fitted()
+        coef = np.empty(self.n_features_in_)
+        with _tlib.borrowed_t_array(coef) as coef_a:
+            intercept = self._lib.tn_lstsq_solve(self._ls, coef_a)
+        return coef, intercept
+
+    @property
+    def coef_(self):
+        return self._solve()[0].reshape(1, -1)
+
+    @property
+    def intercept_(self):
+        return np.array([self._solve()[1]])
+
+    @property
+    def n_samples_(self):
+        return 0 if self._ls is None else self._lib.tn_lstsq_count(self._ls)
+
+    @property
+    def r2_(self):
+        self._check_fitted()
+        return self._lib.tn_lstsq_r2(self._ls)
+
+    @property
+    def mse_(self):
+        self._check_fitted()
+        return self._lib.tn_lstsq_mse(self._ls)
+
+    def predict(self, x_data):
+        """predictions of shape (rows, 1) as LinearRegression fitted on 2D y"""
+        coef, intercept = self._solve()
+        return (np.asarray(x_data, dtype=np.float64) @ coef + intercept).reshape(-1, 1)
+
+def make_linear_regression_stream (batches, n_features = None, fit_intercept = True, **kwargs):
+    """
+    trains linear regression on an iterable of (x_batch, y_batch) tuples,
+    e.g. chunks of pd.read_csv(..., chunksize = ...), without keeping them in memory
+    """
+    print_result = kwargs.get("print_result", False)
+
+    model = IncrementalLinearRegression(n_features, fit_intercept)
+    for x_batch, y_batch in batches:
+        model.partial_fit(x_batch, y_batch)
+    if model.n_samples_ == 0:
+        raise ValueError("batches did not contain any rows")
+
+    if print_result == True:
+        print("The R^2 score of the train data: {:.3f}".format(model.r2_))
+        print("MSE for the train data: {:0.2f}".format(model.mse_))
+
+    return model
@@ -1,8 +1,757 @@
 #include "../c_libraries/include/t_numerics.h"
+#include "../c_libraries/include/t_ode_inline.h"
 
 #define copy_from_heap 1
 
+// y' = -1000 (y - cos t), the error estimate of the Rosenbrock method must
+// stay small in the stiff component (the solver used to stop at t = 1.6)
+static void stiff_scalar (double t, const double y[], double dy[], void* params) {
+    (void)params;
+    dy[0] = -1000.0 * (y[0] - cos(t));
+}
+
+static void oscillator (double t, const double y[], double dy[], void* params) {
+    (void)t;
+    (void)params;
+    dy[0] = y[1];
+    dy[1] = -y[0];
+}
+
+TN_DEFINE_ODE_STEPPERS(osc, oscillator)
+
+// zero exactly at the end of step 28 for dt = 0.25
+static double event_t7 (double t, const double y[], void* params) {
+    (void)y;
+    (void)params;
+    return t - 7.0;
+}
+
+static int check (int ok, const char* name) {
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+// neighbour list forces against all pairs, n above the threading threshold;
+// the second call runs nested in a parallel region where the inner team has
+// a single thread and must not add buffers of the first call
+static int test_nlist (void) {
+    const int m = 13;
+    const size_t n = (size_t)m * m * m;
+    const double box = cbrt(n / 0.8);
+    const double a = box / m;
+    tn_lj_params lj = {1.0, 1.0, 2.5};
+    tn_nlist_options opt = tn_nlist_default_options();
+    for (int k = 0; k < 3; k++) {
+        opt.box[k] = box;
+    }
+    Vec_3D* pos = malloc(n * sizeof(Vec_3D));
+    Vec_3D* force = malloc(n * sizeof(Vec_3D));
+    Vec_3D* exact = calloc(n, sizeof(Vec_3D));
+    srand(1);
+    for (size_t q = 0; q < n; q++) {
+        pos[q].x = (q / (m * m) + 0.5) * a + 0.1 * ((double)rand() / RAND_MAX - 0.5);
+        pos[q].y = (q / m % m + 0.5) * a;
+        pos[q].z = (q % m + 0.5) * a;
+    }
+    tn_nlist* list = tn_nlist_alloc(n, &opt);
+    tn_nlist_set_pair(list, tn_pair_lennard_jones, &lj);
+    tn_nlist_forces(list, pos, force);
+    for (size_t q = 0; q < n; q++) {
+        pos[q].y += 0.01 * ((double)rand() / RAND_MAX - 0.5);
+    }
+    double energy = 0.0;
+    #pragma omp parallel
+    {
+        #pragma omp single
+        energy = tn_nlist_forces(list, pos, force);
+    }
+
+    double energy_exact = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double d[3] = {pos[i].x - pos[j].x, pos[i].y - pos[j].y, pos[i].z - pos[j].z};
+            for (int k = 0; k < 3; k++) {
+                d[k] -= box * round(d[k] / box);
+            }
+            double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+            if (r2 >= lj.cutoff * lj.cutoff) {
+                continue;
+            }
+            double f_r;
+            energy_exact += tn_pair_lennard_jones(r2, &f_r, &lj);
+            exact[i].x += f_r * d[0];
+            exact[i].y += f_r * d[1];
+            exact[i].z += f_r * d[2];
+            exact[j].x -= f_r * d[0];
+            exact[j].y -= f_r * d[1];
+            exact[j].z -= f_r * d[2];
+        }
+    }
+    double err = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        err = fmax(err, fabs(force[i].x - exact[i].x) + fabs(force[i].y - exact[i].y)
+                        + fabs(force[i].z - exact[i].z));
+    }
+    tn_nlist_free(list);
+    free(pos);
+    free(force);
+    free(exact);
+    return check(err < 1e-9 && fabs(energy - energy_exact) < 1e-9 * fabs(energy_exact),
+                 "tn_nlist_forces against all pairs");
+}
+
+// energy per site of the infinite 2D Ising model (Onsager), K(k) via the
+// arithmetic-geometric mean
+static double ising_energy (double beta) {
+    double k = 2.0 * sinh(2.0 * beta) / pow(cosh(2.0 * beta), 2);
+    double a = 1.0;
+    double b = sqrt(1.0 - k * k);
+    for (int i = 0; i < 40; i++) {
+        double mean = 0.5 * (a + b);
+        b = sqrt(a * b);
+        a = mean;
+    }
+    double K = M_PI / (2.0 * a);
+    double t = tanh(2.0 * beta);
+    return -(1.0 + 2.0 / M_PI * (2.0 * t * t - 1.0) * K) / t;
+}
+
+// Wolff sweeps on L = 32 against the exact 2D Ising energy and spontaneous
+// magnetization; the replica is calibrated at beta = 0.2 and then moved, as
+// parallel tempering does, which must recalibrate the number of clusters
+static int test_mcmc (void) {
+    int failed = 0;
+    tn_mcmc_options opt = tn_mcmc_default_options();
+    tn_mcmc* mc = tn_mcmc_alloc(&opt, 0.2);
+    tn_mcmc_run(mc, TN_MCMC_WOLFF, 20, 0);
+    const double betas[2] = {0.6, 0.3};
+    for (int i = 0; i < 2; i++) {
+        tn_mcmc_set_beta(mc, betas[i]);
+        tn_mcmc_run(mc, TN_MCMC_WOLFF, 200, 0);
+        tn_mcmc_reset_observables(mc);
+        tn_mcmc_run(mc, TN_MCMC_WOLFF, 4000, 1);
+        const tn_mcmc_observables* obs = tn_mcmc_observables_get(mc);
+        int ok = fabs(obs->energy.mean - ising_energy(betas[i])) < 5e-3;
+        if (betas[i] > 0.5) {
+            double m = pow(1.0 - pow(sinh(2.0 * betas[i]), -4), 0.125);
+            ok = ok && fabs(obs->magnetization.mean - m) < 5e-3;
+        }
+        failed += check(ok, betas[i] > 0.5 ? "tn_mcmc 2D Ising beta = 0.6"
+                                           : "tn_mcmc 2D Ising beta = 0.3");
+    }
+    tn_mcmc_free(mc);
+    return failed;
+}
+
+// exact linear data: coefficients and intercept are recovered, solving does
+// not change the accumulated fit
+static int test_lstsq (void) {
+    tn_lstsq* ls = tn_lstsq_alloc(2, 1);
+    t_array* coef = t_array_alloc(2);
+    int ok = 1;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 25; i++) {
+            double x[2] = {sin(i + 25.0 * pass), cos(3.0 * i)};
+            tn_lstsq_add_row(ls, x, 1.5 * x[0] - 2.0 * x[1] + 0.5);
+        }
+        for (int k = 0; k < 2; k++) {
+            double intercept = tn_lstsq_solve(ls, coef);
+            ok = ok && fabs(t_array_get(coef, 0) - 1.5) < 1e-10
+                    && fabs(t_array_get(coef, 1) + 2.0) < 1e-10
+                    && fabs(intercept - 0.5) < 1e-10;
+        }
+    }
+    ok = ok && tn_lstsq_count(ls) == 50 && fabs(tn_lstsq_r2(ls) - 1.0) < 1e-10;
+    T_ARRAY_FREE(coef);
+    tn_lstsq_free(ls);
+    return check(ok, "tn_lstsq exact fit");
+}
+
+static double damped_sine (double x, void* params) {
+    (void)params;
+    return sin(x) / (x + 1.0);
+}
+
+// piecewise cubics: with the piece limit the worst pieces are refined, so the
+// error is still small; a reachable tolerance holds on a fine grid
+static int test_surrogate (void) {
+    tn_surrogate_options opt = tn_surrogate_default_options();
+    opt.degree = 3;
+    tn_surrogate* s = tn_surrogate_build(damped_sine, NULL, 0.0, 200.0, &opt);
+    int ok = tn_surrogate_status(s) == TN_SURROGATE_TOL_NOT_REACHED
+             && tn_surrogate_pieces(s) == (size_t)opt.max_pieces
+             && tn_surrogate_error(s) < 1e-9;
+    tn_surrogate_free(s);
+
+    opt.rtol = 1e-8;
+    s = tn_surrogate_build(damped_sine, NULL, 0.0, 200.0, &opt);
+    double err = 0.0;
+    double f_max = 0.0;
+    for (int i = 0; i <= 200000; i++) {
+        double x = 1e-3 * i;
+        err = fmax(err, fabs(tn_surrogate_eval(s, x) - damped_sine(x, NULL)));
+        f_max = fmax(f_max, fabs(damped_sine(x, NULL)));
+    }
+    ok = ok && tn_surrogate_status(s) == TN_SURROGATE_SUCCESS
+            && tn_surrogate_error(s) <= opt.rtol * f_max && err < 2.0 * opt.rtol * f_max;
+    tn_surrogate_free(s);
+    return check(ok, "tn_surrogate sin(x) / (x + 1), degree 3");
+}
+
+// rows of the streaming writer come back through load and mmap
+static int test_io_writer (void) {
+    const char* path = "test_io_writer.bin";
+    t_io_writer* w = t_io_writer_open(path, 3);
+    for (int i = 0; i < 4; i++) {
+        double row[3] = {i, 10.0 * i, -1.0 * i};
+        t_io_writer_append(w, row);
+    }
+    t_io_writer_close(w);
+    t_matrix* loaded = t_matrix_load(path);
+    t_matrix* mapped = t_matrix_mmap(path, T_MMAP_READONLY);
+    int ok = t_matrix_get(loaded, 3, 1) == 30.0 && t_matrix_get(mapped, 2, 2) == -2.0;
+    T_MATRIX_FREE(loaded);
+    T_MATRIX_FREE(mapped);
+    remove(path);
+    return check(ok, "t_io_writer rows through t_matrix_load and t_matrix_mmap");
+}
+
+static double mean_estimator (const double* s, size_t n, size_t dim, void* params) {
+    (void)dim;
+    (void)params;
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += s[i];
+    }
+    return sum / n;
+}
+
+// blocked jackknife of the mean: equal blocks, the error is the standard
+// error of the block means; 10 records in blocks of 3 drop the last one
+static int test_jackknife (void) {
+    const double values[10] = {1.0, 4.0, 2.0, 8.0, 5.0, 7.0, 3.0, 6.0, 9.0, 100.0};
+    t_array* data = t_array_alloc(10);
+    for (size_t i = 0; i < 10; i++) {
+        t_array_set(data, i, values[i]);
+    }
+    tn_resample_options opt = tn_resample_default_options();
+    opt.block_len = 3;
+    tn_resample_result res;
+    tn_jackknife(mean_estimator, data, 1, NULL, &opt, NULL, &res);
+    // block means 7/3, 20/3, 6, overall mean 5
+    double m[3] = {7.0 / 3.0, 20.0 / 3.0, 6.0};
+    double var = 0.0;
+    for (int k = 0; k < 3; k++) {
+        var += (m[k] - 5.0) * (m[k] - 5.0) / 2.0;
+    }
+    int ok = fabs(res.estimate - 5.0) < 1e-12 && fabs(res.bias) < 1e-12
+             && fabs(res.std_error - sqrt(var / 3.0)) < 1e-12;
+    T_ARRAY_FREE(data);
+    return check(ok, "tn_jackknife mean in blocks of 3");
+}
+
+static void sine_vec (const double* x, double* y, size_t n, void* params) {
+    (void)params;
+    for (size_t i = 0; i < n; i++) {
+        y[i] = sin(x[i]);
+    }
+}
+
+// batched Ridders derivatives of sin: the error estimates are never 0 and
+// bound the actual error up to a small factor
+static int test_diff (void) {
+    const size_t n = 10000;
+    t_array* x = t_array_alloc(n);
+    t_array* df = t_array_alloc(n);
+    t_array* err = t_array_alloc(n);
+    for (size_t i = 0; i < n; i++) {
+        t_array_set(x, i, -5.0 + 10.0 * i / n);
+    }
+    tn_diff_batch(sine_vec, NULL, x, df, 1, NULL, err);
+    int ok = 1;
+    for (size_t i = 0; i < n; i++) {
+        double e = t_array_get(err, i);
+        double actual = fabs(t_array_get(df, i) - cos(t_array_get(x, i)));
+        ok = ok && e > 0.0 && actual <= 4.0 * e;
+    }
+    T_ARRAY_FREE(x);
+    T_ARRAY_FREE(df);
+    T_ARRAY_FREE(err);
+    return check(ok, "tn_diff_batch sin error estimates");
+}
+
+/* relative rms difference of the tree accelerations from direct summation */
+static double tree_error (tn_tree* tree, const Vec_3D* pos, size_t n) {
+    Vec_3D* acc = malloc(n * sizeof(Vec_3D));
+    Vec_3D* exact = malloc(n * sizeof(Vec_3D));
+    tn_tree_build(tree, pos);
+    tn_tree_accel(tree, acc);
+    tn_tree_direct(tree, pos, exact);
+    double diff = 0.0;
+    double norm = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double d[3] = {acc[i].x - exact[i].x, acc[i].y - exact[i].y, acc[i].z - exact[i].z};
+        diff += d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        norm += exact[i].x * exact[i].x + exact[i].y * exact[i].y + exact[i].z * exact[i].z;
+    }
+    free(acc);
+    free(exact);
+    return sqrt(diff / norm);
+}
+
+// Barnes-Hut against direct summation: gravity with theta 0 and 0.5, Coulomb
+// with charges of both signs (the fields cancel, so the relative error is
+// larger than for gravity)
+static int test_tree (void) {
+    const size_t n = 3000;
+    Vec_3D* pos = malloc(n * sizeof(Vec_3D));
+    double* charge = malloc(n * sizeof(double));
+    srand(2);
+    for (size_t i = 0; i < n; i++) {
+        pos[i].x = (double)rand() / RAND_MAX;
+        pos[i].y = (double)rand() / RAND_MAX;
+        pos[i].z = (double)rand() / RAND_MAX;
+        charge[i] = i % 2 ? 1.0 : -1.0;
+    }
+    tn_tree_options opt = tn_tree_default_options();
+    opt.theta = 0.0;
+    tn_tree* tree = tn_tree_alloc(n, &opt);
+    double err_exact = tree_error(tree, pos, n);
+    tn_tree_free(tree);
+
+    opt.theta = 0.5;
+    tree = tn_tree_alloc(n, &opt);
+    double err_gravity = tree_error(tree, pos, n);
+    tn_tree_free(tree);
+
+    opt.kind = TN_TREE_COULOMB;
+    opt.softening = 0.01;
+    tree = tn_tree_alloc(n, &opt);
+    tn_tree_set_weights(tree, NULL, charge);
+    double err_coulomb = tree_error(tree, pos, n);
+    tn_tree_free(tree);
+    free(pos);
+    free(charge);
+    return check(err_exact < 1e-12 && err_gravity < 2e-3 && err_coulomb < 5e-3,
+                 "tn_tree_accel against tn_tree_direct");
+}
+
+static void laplace_1d (const double* x, double* y, void* params) {
+    size_t n = *(const size_t*)params;
+    for (size_t i = 0; i < n; i++) {
+        y[i] = -2.0 * x[i] + (i > 0 ? x[i - 1] : 0.0) + (i + 1 < n ? x[i + 1] : 0.0);
+    }
+}
+
+// exp(t A) of a rotation, the propagator trajectory and the Krylov product
+// for two eigenmodes of the 1D Laplacian against their exact values
+static int test_expm (void) {
+    const double w = 10.0;
+    t_matrix* a = t_matrix_alloc(2, 2);
+    t_matrix_set(a, 0, 1, w);
+    t_matrix_set(a, 1, 0, -w);
+    t_matrix* e = t_matrix_alloc(2, 2);
+    tn_expm(a, 3.0, e);
+    int ok = fabs(t_matrix_get(e, 0, 0) - cos(3.0 * w)) < 1e-12
+             && fabs(t_matrix_get(e, 0, 1) - sin(3.0 * w)) < 1e-12
+             && fabs(t_matrix_get(e, 1, 0) + sin(3.0 * w)) < 1e-12;
+
+    tn_expm_prop* prop = tn_expm_prop_alloc(a, 0.1);
+    t_array* y0 = t_array_alloc(2);
+    t_array_set(y0, 0, 1.0);
+    t_matrix* traj = t_matrix_alloc(50, 2);
+    tn_expm_prop_trajectory(prop, y0, traj);
+    for (size_t k = 0; k < 50; k++) {
+        ok = ok && fabs(t_matrix_get(traj, k, 0) - cos(0.1 * w * k)) < 1e-11
+                && fabs(t_matrix_get(traj, k, 1) + sin(0.1 * w * k)) < 1e-11;
+    }
+    tn_expm_prop_free(prop);
+    T_MATRIX_FREE(traj);
+    T_ARRAY_FREE(y0);
+    T_MATRIX_FREE(e);
+    T_MATRIX_FREE(a);
+
+    size_t n = 200;
+    double* v = malloc(n * sizeof(double));
+    double* out = malloc(n * sizeof(double));
+    double lambda[2];
+    for (int m = 0; m < 2; m++) {
+        double k = (m ? 7.0 : 1.0) * M_PI / (n + 1);
+        lambda[m] = 2.0 * cos(k) - 2.0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        v[i] = sin(M_PI * (i + 1) / (n + 1)) + sin(7.0 * M_PI * (i + 1) / (n + 1));
+    }
+    tn_expmv_options opt = tn_expmv_default_options();
+    opt.symmetric = 1;
+    tn_expmv_result res = tn_expmv(laplace_1d, &n, n, 20.0, v, out, &opt);
+    double err = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double exact = exp(20.0 * lambda[0]) * sin(M_PI * (i + 1) / (n + 1))
+                       + exp(20.0 * lambda[1]) * sin(7.0 * M_PI * (i + 1) / (n + 1));
+        err = fmax(err, fabs(out[i] - exact));
+    }
+    free(v);
+    free(out);
+    ok = ok && res.status == TN_EXPMV_SUCCESS && err < 1e-8;
+    return check(ok, "tn_expm and tn_expmv against exact exponentials");
+}
+
+// u = sin(2 pi x) sin(pi y) on [0, 1]^2, periodic in x and 0 on the faces in
+// y: eigenfunction of the Laplacian, also under the heat equation; the bound
+// of the Laplacian holds for order 4 only
+static int test_stencil (void) {
+    const size_t n[2] = {64, 32};
+    const double h[2] = {1.0 / 64, 1.0 / 32};
+    const double k2 = 5.0 * M_PI * M_PI;
+    tn_bc bc[4] = {{TN_BC_PERIODIC, 0.0}, {TN_BC_PERIODIC, 0.0},
+                   {TN_BC_DIRICHLET, 0.0}, {TN_BC_DIRICHLET, 0.0}};
+    tn_grid* g = tn_grid_alloc(2, n, h, 4, bc);
+    size_t points = tn_grid_points(g);
+    double* u0 = malloc(points * sizeof(double));
+    double* values = malloc(points * sizeof(double));
+    for (size_t j = 0; j < n[1]; j++) {
+        for (size_t i = 0; i < n[0]; i++) {
+            u0[j * n[0] + i] = sin(2.0 * M_PI * (i + 0.5) * h[0]) * sin(M_PI * (j + 0.5) * h[1]);
+        }
+    }
+    t_array* u = tn_grid_field_alloc(g, 1);
+    t_array* lap = tn_grid_field_alloc(g, 1);
+    tn_grid_set_interior(g, u, u0);
+    tn_grid_laplacian(g, u, lap, 1.0);
+    tn_grid_get_interior(g, lap, values);
+    double err_lap = 0.0;
+    for (size_t q = 0; q < points; q++) {
+        err_lap = fmax(err_lap, fabs(values[q] + k2 * u0[q]));
+    }
+
+    const double kappa = 0.1;
+    tn_mol_rhs heat = {1, &kappa, NULL, NULL, NULL};
+    tn_mol_rk4(g, &heat, u, 0.0, 1e-4, 1000);
+    tn_grid_get_interior(g, u, values);
+    double err_heat = 0.0;
+    for (size_t q = 0; q < points; q++) {
+        err_heat = fmax(err_heat, fabs(values[q] - exp(-k2 * kappa * 0.1) * u0[q]));
+    }
+    T_ARRAY_FREE(u);
+    T_ARRAY_FREE(lap);
+    free(u0);
+    free(values);
+    tn_grid_free(g);
+    return check(err_lap < 1e-5 * k2 && err_heat < 1e-5, "tn_grid_laplacian and tn_mol_rk4 eigenmode");
+}
+
+// harmonic oscillator V = x^2 / 2: imaginary time finds E0 = 1/2, a
+// displaced ground state (coherent state) returns after one period with
+// conserved norm and energy 1/2 + x0^2 / 2
+static int test_tdse (void) {
+    const size_t n[1] = {256};
+    const double lo[1] = {-10.0};
+    const double hi[1] = {10.0};
+    const double dx = 20.0 / 256;
+    const double x0 = 2.0;
+    t_array* v = t_array_alloc(n[0]);
+    t_array* guess = t_array_alloc(n[0]);
+    for (size_t i = 0; i < n[0]; i++) {
+        double x = lo[0] + i * dx;
+        t_array_set(v, i, 0.5 * x * x);
+        t_array_set(guess, i, exp(-(x - 1.0) * (x - 1.0)));
+    }
+    tn_tdse* s = tn_tdse_alloc(1, n, lo, hi, 1.0, 1e-3, 1);
+    tn_tdse_set_potential(s, v);
+    t_carray_copy_from_parts(tn_tdse_psi(s), guess, NULL);
+    tn_tdse_step(s, 10000);
+    int ok = fabs(tn_tdse_energy(s) - 0.5) < 1e-5;
+    tn_tdse_free(s);
+
+    const long steps = 4000;
+    s = tn_tdse_alloc(1, n, lo, hi, 1.0, 2.0 * M_PI / steps, 0);
+    tn_tdse_set_potential(s, v);
+    for (size_t i = 0; i < n[0]; i++) {
+        double x = lo[0] + i * dx;
+        t_array_set(guess, i, pow(M_PI, -0.25) * exp(-0.5 * (x - x0) * (x - x0)));
+    }
+    t_carray_copy_from_parts(tn_tdse_psi(s), guess, NULL);
+    double norm0 = tn_tdse_norm(s);
+    tn_tdse_step(s, steps);
+    double diff = 0.0;
+    for (size_t i = 0; i < n[0]; i++) {
+        // one period of the oscillator adds the phase exp(-i E0 2 pi) = -1
+        diff = fmax(diff, cabs(t_carray_get(tn_tdse_psi(s), i) + t_array_get(guess, i)));
+    }
+    ok = ok && fabs(tn_tdse_norm(s) - norm0) < 1e-12 && fabs(norm0 - 1.0) < 1e-12
+            && fabs(tn_tdse_energy(s) - (0.5 + 0.5 * x0 * x0)) < 1e-8 && diff < 1e-5;
+    tn_tdse_free(s);
+    T_ARRAY_FREE(v);
+    T_ARRAY_FREE(guess);
+    return check(ok, "tn_tdse harmonic oscillator");
+}
+
+// fused expressions against the same formula in a plain loop, on a length
+// that is no multiple of the block size; in place updates with a changed
+// scalar and a rebound array reuse the compiled program
+static int test_expr (void) {
+    const size_t n = 100003;
+    t_array* x = t_array_alloc(n);
+    t_array* v = t_array_alloc(n);
+    t_array* w = t_array_alloc(n);
+    t_array* out = t_array_alloc(n);
+    double* x_ref = malloc(n * sizeof(double));
+    for (size_t i = 0; i < n; i++) {
+        x_ref[i] = sin(0.001 * i);
+        t_array_set(x, i, x_ref[i]);
+        t_array_set(v, i, cos(0.002 * i));
+        t_array_set(w, i, 0.5 + 1e-5 * i);
+    }
+    tn_expr* e = tn_expr_alloc();
+    int ex = tn_expr_array(e, x);
+    int ev = tn_expr_array(e, v);
+    int ew = tn_expr_array(e, w);
+    int one = tn_expr_scalar(e, 1.0);
+    int two = tn_expr_scalar(e, 2.0);
+    int root = tn_expr_sub(e,
+        tn_expr_add(e, tn_expr_mul(e, tn_expr_unary(e, TN_EXPR_SQRT, tn_expr_unary(e, TN_EXPR_ABS, ex)),
+                                   tn_expr_unary(e, TN_EXPR_EXP, tn_expr_unary(e, TN_EXPR_NEG, ev))),
+                    tn_expr_binary(e, TN_EXPR_POW, ew, two)),
+        tn_expr_div(e, tn_expr_binary(e, TN_EXPR_MAX, ex, ev),
+                    tn_expr_add(e, one, tn_expr_unary(e, TN_EXPR_SQUARE, ew))));
+    tn_expr_eval(e, root, out);
+    double err = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double xi = x_ref[i];
+        double vi = t_array_get(v, i);
+        double wi = t_array_get(w, i);
+        double ref = sqrt(fabs(xi)) * exp(-vi) + pow(wi, 2.0) - fmax(xi, vi) / (1.0 + wi * wi);
+        err = fmax(err, fabs(t_array_get(out, i) - ref));
+    }
+
+    // x += dt * v twice with different dt, then with w bound in place of v
+    int dt = tn_expr_scalar(e, 0.1);
+    int ev2 = tn_expr_array(e, v);
+    int step = tn_expr_add(e, ex, tn_expr_mul(e, dt, ev2));
+    tn_expr_eval(e, step, x);
+    tn_expr_set_scalar(e, dt, 0.3);
+    tn_expr_eval(e, step, x);
+    tn_expr_bind(e, ev2, w);
+    tn_expr_eval(e, step, x);
+    for (size_t i = 0; i < n; i++) {
+        double ref = x_ref[i] + 0.1 * t_array_get(v, i) + 0.3 * t_array_get(v, i)
+                     + 0.3 * t_array_get(w, i);
+        err = fmax(err, fabs(t_array_get(x, i) - ref));
+    }
+    tn_expr_free(e);
+    T_ARRAY_FREE(x);
+    T_ARRAY_FREE(v);
+    T_ARRAY_FREE(w);
+    T_ARRAY_FREE(out);
+    free(x_ref);
+    return check(err < 1e-13, "tn_expr_eval against plain loops");
+}
+
+// complex kernels on mixed layouts (x interleaved, y split) against plain
+// double complex loops
+static int test_complex (void) {
+    const size_t n = 1001;
+    t_carray* x = t_carray_alloc(n);
+    t_carray* y = t_carray_alloc_split(n);
+    double complex* xr = malloc(n * sizeof(double complex));
+    double complex* yr = malloc(n * sizeof(double complex));
+    for (size_t i = 0; i < n; i++) {
+        xr[i] = cos(0.1 * i) + I * sin(0.3 * i);
+        yr[i] = 0.5 * i / n - I * cos(0.7 * i);
+        t_carray_set(x, i, xr[i]);
+        t_carray_set(y, i, yr[i]);
+    }
+    const double complex a = 0.3 - 1.2 * I;
+    tn_caxpy(a, x, y);
+    tn_cscale(I, x);
+    double complex dotu = 0.0;
+    double complex dotc = 0.0;
+    double norm = 0.0;
+    double err = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        yr[i] += a * xr[i];
+        xr[i] *= I;
+        dotu += xr[i] * yr[i];
+        dotc += conj(xr[i]) * yr[i];
+        norm += creal(xr[i] * conj(xr[i]));
+        err = fmax(err, cabs(t_carray_get(x, i) - xr[i]) + cabs(t_carray_get(y, i) - yr[i]));
+    }
+    err = fmax(err, cabs(tn_cdotu(x, y) - dotu) / cabs(dotu));
+    err = fmax(err, cabs(tn_cdotc(x, y) - dotc) / cabs(dotc));
+    err = fmax(err, fabs(tn_cnorm(x) - sqrt(norm)) / sqrt(norm));
+
+    // (3 x 4) (4 x 2) and (3 x 4) v
+    t_cmatrix* am = t_cmatrix_alloc(3, 4);
+    t_cmatrix* bm = t_cmatrix_alloc(4, 2);
+    t_cmatrix* cm = t_cmatrix_alloc(3, 2);
+    t_carray* v = t_carray_alloc(4);
+    t_carray* b = t_carray_alloc_split(3);
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            t_cmatrix_set(am, j, i, (double)(i + j) + I * (double)i * j);
+        }
+        for (size_t j = 0; j < 2; j++) {
+            t_cmatrix_set(bm, i, j, 1.0 - I * (double)(i + 2 * j));
+        }
+        t_carray_set(v, i, I - (double)i);
+    }
+    tn_cmatrix_dot_matrix(am, bm, cm);
+    tn_cmatrix_dot_vector(am, v, b);
+    for (size_t j = 0; j < 3; j++) {
+        double complex bj = 0.0;
+        for (size_t i = 0; i < 4; i++) {
+            bj += t_cmatrix_get(am, j, i) * t_carray_get(v, i);
+        }
+        err = fmax(err, cabs(t_carray_get(b, j) - bj));
+        for (size_t k = 0; k < 2; k++) {
+            double complex c = 0.0;
+            for (size_t i = 0; i < 4; i++) {
+                c += t_cmatrix_get(am, j, i) * t_cmatrix_get(bm, i, k);
+            }
+            err = fmax(err, cabs(t_cmatrix_get(cm, j, k) - c));
+        }
+    }
+    T_CMATRIX_FREE(am);
+    T_CMATRIX_FREE(bm);
+    T_CMATRIX_FREE(cm);
+    T_CARRAY_FREE(v);
+    T_CARRAY_FREE(b);
+    T_CARRAY_FREE(x);
+    T_CARRAY_FREE(y);
+    free(xr);
+    free(yr);
+    return check(err < 1e-12, "complex kernels against double complex loops");
+}
+
+// streaming statistics: Welford moments with a large offset against two
+// passes, merged halves, histogram, quantiles and the autocorrelation of an
+// AR(1) series x_t = phi x_(t-1) + noise with rho(t) = phi^t and
+// tau_int = 0.5 + phi / (1 - phi)
+static int test_stats (void) {
+    const size_t n = 1 << 18;
+    const double phi = 0.8;
+    t_array* noise = tn_rand_alloc((int)n, 1.0, 7);
+    t_array* series = t_array_alloc(n);
+    double x = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        x = phi * x + t_array_get(noise, i);
+        t_array_set(series, i, x);
+    }
+
+    tn_moments all, lo_half, hi_half;
+    tn_moments_init(&all);
+    tn_moments_init(&lo_half);
+    tn_moments_init(&hi_half);
+    double sum = 0.0;
+    for (size_t i = 0; i < 1000; i++) {
+        double y = 1e8 + sin(i);
+        tn_moments_add(&all, y);
+        tn_moments_add(i < 400 ? &lo_half : &hi_half, y);
+        sum += sin(i);
+    }
+    double mean = sum / 1000;
+    double var = 0.0;
+    for (size_t i = 0; i < 1000; i++) {
+        var += (sin(i) - mean) * (sin(i) - mean) / 999;
+    }
+    tn_moments_merge(&lo_half, &hi_half);
+    // a few ulp of 1e8 in the mean, E[y^2] - E[y]^2 would lose all digits
+    int ok = fabs(tn_moments_mean(&all) - 1e8 - mean) < 1e-6
+             && fabs(tn_moments_variance(&all) - var) < 1e-8
+             && fabs(tn_moments_variance(&lo_half) - var) < 1e-8;
+
+    tn_histogram* h = tn_histogram_alloc(-1.0, 1.0, 4, 0);
+    const double samples[6] = {-2.0, -0.9, -0.1, 0.2, 0.3, 1.0};
+    for (int i = 0; i < 6; i++) {
+        tn_histogram_add(h, samples[i]);
+    }
+    ok = ok && tn_histogram_underflow(h) == 1.0 && tn_histogram_overflow(h) == 1.0
+            && tn_histogram_count(h, 0) == 1.0 && tn_histogram_count(h, 1) == 1.0
+            && tn_histogram_count(h, 2) == 2.0 && tn_histogram_total(h) == 6.0
+            && fabs(tn_histogram_density(h, 2) - 2.0 / (6.0 * 0.5)) < 1e-15;
+    tn_histogram_free(h);
+
+    t_array* data = t_array_alloc(101);
+    for (size_t i = 0; i < 101; i++) {
+        t_array_set(data, i, (double)((i * 37) % 101));
+    }
+    ok = ok && tn_median(data) == 50.0 && fabs(tn_quantile(data, 0.255) - 25.5) < 1e-12;
+
+    t_array* acf = t_array_alloc(20);
+    tn_autocorr(series, acf);
+    for (size_t t = 0; t < 20; t++) {
+        ok = ok && fabs(t_array_get(acf, t) - pow(phi, t)) < 0.02;
+    }
+    double tau = tn_tau_int(series, 6.0, NULL);
+    tn_binning* b = tn_binning_alloc(20);
+    tn_binning_add_t_array(b, series);
+    double tau_bin = tn_binning_tau_int(b, tn_binning_plateau(b, 64));
+    ok = ok && fabs(tau / 4.5 - 1.0) < 0.1 && fabs(tau_bin / 4.5 - 1.0) < 0.2;
+    tn_binning_free(b);
+    T_ARRAY_FREE(acf);
+    T_ARRAY_FREE(data);
+    T_ARRAY_FREE(noise);
+    T_ARRAY_FREE(series);
+    return check(ok, "streaming statistics");
+}
+
+// inlined RK4 and Velocity-Verlet against the library steppers (same
+// arithmetic) and the exact solution cos t
+static int test_ode_inline (void) {
+    const long n_steps = 1000;
+    const double dt = 0.01;
+    double work[TN_ODE_INLINE_WORK(2)];
+    double k[10];
+    double y_lib[2] = {1.0, 0.0};
+    double y_inl[2] = {1.0, 0.0};
+    double* traj = malloc(2 * n_steps * sizeof(double));
+    for (long i = 0; i < n_steps; i++) {
+        tn_rk4_step(i * dt, dt, y_lib, k, oscillator, 2, NULL);
+    }
+    osc_rk4_integrate(0.0, dt, n_steps, y_inl, work, traj, 2, NULL);
+    int ok = fabs(y_inl[0] - y_lib[0]) < 1e-13 && fabs(y_inl[1] - y_lib[1]) < 1e-13
+             && fabs(y_inl[0] - cos(10.0)) < 1e-9
+             && traj[2 * (n_steps - 1)] == y_inl[0] && fabs(traj[0] - cos(dt)) < 1e-12;
+
+    double y_vv[2] = {1.0, 0.0};
+    double y_vv_lib[2] = {1.0, 0.0};
+    for (long i = 0; i < n_steps; i++) {
+        tn_vv_step(i * dt, dt, y_vv_lib, oscillator, 2, NULL);
+    }
+    osc_vv_integrate(0.0, dt, n_steps, y_vv, work, NULL, 2, NULL);
+    ok = ok && fabs(y_vv[0] - y_vv_lib[0]) < 1e-12 && fabs(y_vv[0] - cos(10.0)) < 1e-4;
+    free(traj);
+    return check(ok, "inline steppers against library and cos t");
+}
+
+// wrapped GSL storage is shared in both directions, a padded view keeps its
+// tda, an owned matrix is freed with the last reference
+static int test_gsl_wrap (void) {
+    double data[12];
+    for (int i = 0; i < 12; i++) {
+        data[i] = i;
+    }
+    // columns 1 and 2 of a 3 x 4 array
+    gsl_matrix_view view = gsl_matrix_view_array_with_tda(data + 1, 3, 2, 4);
+    t_matrix* m = t_matrix_wrap_gsl_matrix(&view.matrix, 0);
+    int ok = t_matrix_get(m, 2, 1) == 10.0 && t_matrix_get(m, 1, 0) == 5.0;
+    t_matrix_set(m, 0, 1, -1.0);
+    ok = ok && data[2] == -1.0;
+    T_MATRIX_FREE(m);
+
+    gsl_vector* g = gsl_vector_alloc(5);
+    g->data[3] = 7.0;
+    t_array* v = t_array_wrap_gsl_vector(g, 1);
+    ok = ok && t_array_get(v, 3) == 7.0;
+    t_array_set(v, 4, 2.0);
+    ok = ok && g->data[4] == 2.0;
+    T_ARRAY_FREE(v);
+    return check(ok, "t_matrix and t_array share wrapped GSL storage");
+}
+
 int main(void) {
+    int failed = 0;
     t_matrix* m = t_matrix_alloc(3, 3);
 
     #if copy_from_heap == 1
@@ -48,6 +797,54 @@ int main(void) {
     T_ARRAY_FREE(b_array);
     T_ARRAY_FREE(v);
     #endif
-    
-    return 0;
+
+    // Regressionstests
+    tn_stiff_options opt = tn_stiff_default_options();
+    tn_stiff_work* w = tn_stiff_work_alloc(1);
+    double y_stiff[1] = {0.0};
+    tn_stiff_result res = tn_rosenbrock_integrate(stiff_scalar, NULL, 0.0, 10.0, y_stiff, 1,
+                                                  NULL, &opt, w);
+    // exact solution without the transient C exp(-1000 t)
+    double y_exact = 1e6 / (1e6 + 1.0) * (cos(10.0) + sin(10.0) / 1000.0);
+    failed += check(res.status == TN_STIFF_SUCCESS && fabs(y_stiff[0] - y_exact) < 1e-5,
+                    "tn_rosenbrock_integrate y' = -1000 (y - cos t)");
+    // J and the factorization are reused over many steps
+    failed += check(res.n_rejected < 10 && 4 * res.n_lu < res.n_steps,
+                    "tn_rosenbrock_integrate reuses the factorization");
+    tn_stiff_work_free(w);
+
+    for (int terminal = 0; terminal < 2; terminal++) {
+        double y_osc[2] = {1.0, 0.0};
+        tn_event ev = {event_t7, 0, terminal, NULL};
+        tn_event_log* log = tn_event_log_alloc(2);
+        tn_event_result ev_res = tn_rk4_integrate_events(oscillator, 0.0, 0.25, 40, y_osc, 2,
+                                                         NULL, &ev, 1, 0.0, log);
+        int ok = tn_event_log_count(log) == 1 && fabs(tn_event_log_time(log, 0) - 7.0) < 1e-12;
+        if (terminal)
+            ok = ok && ev_res.status == TN_EVENTS_TERMINATED && fabs(ev_res.t - 7.0) < 1e-12;
+        else
+            ok = ok && ev_res.status == TN_EVENTS_DONE;
+        failed += check(ok, terminal ? "terminal event g = t - 7, dt = 0.25"
+                                     : "event g = t - 7, dt = 0.25");
+        tn_event_log_free(log);
+    }
+
+    failed += test_nlist();
+    failed += test_tree();
+    failed += test_mcmc();
+    failed += test_lstsq();
+    failed += test_surrogate();
+    failed += test_io_writer();
+    failed += test_jackknife();
+    failed += test_diff();
+    failed += test_expm();
+    failed += test_stencil();
+    failed += test_tdse();
+    failed += test_expr();
+    failed += test_complex();
+    failed += test_stats();
+    failed += test_ode_inline();
+    failed += test_gsl_wrap();
+
+    return failed != 0;
 }
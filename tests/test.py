@@ -1,3 +1,130 @@
+import ctypes
+import struct
+import sys
+
+import numpy as np
+
 from io_utils.cli import ts_confirm
+from phydesim.rk_lib import (c_integrate, c_rk45_integrate, py_rk4_step, py_rk4_step_ensemble,
+                             py_rk45_integrate, py_rk45_step_ensemble)
+from phydesim.tlib import _tlib
+from tmlearn.curvefit.levenberg_marquardt import fit_lm
+from tmlearn.linregress.incremental import IncrementalLinearRegression
+
+def check(ok, name):
+    print(f"{name}: {'ok' if ok else 'FAILED'}")
+    return 0 if ok else 1
+
+def raises(exc, func, *args, **kwargs):
+    try:
+        func(*args, **kwargs)
+    except exc:
+        return True
+    return False
+
+# Regressionstests
+failed = 0
+
+# r2_ and mse_ of an unfitted model raise instead of handing a NULL pointer
+# to libtlib
+model = IncrementalLinearRegression(n_features = 2)
+for name in ("r2_", "mse_"):
+    failed += check(raises(ValueError, getattr, model, name), f"unfitted {name}")
+
+# outputs of phydesim.tlib are written in place and never converted
+m = np.array([[1.0, 2.0], [3.0, 4.0]])
+failed += check(raises(ValueError, _tlib.matrix_dot_vector, m, np.ones(2),
+                       out = np.zeros(2, dtype = np.float32)),
+                "matrix_dot_vector rejects float32 out")
+failed += check(raises(TypeError, _tlib.norm_vec, [3.0, 4.0]), "norm_vec rejects list")
+v = np.array([3.0, 4.0])
+_tlib.norm_vec(v)
+failed += check(np.allclose(v, [0.6, 0.8]), "norm_vec in place")
+
+# padded TMatrix (tda > cols) is exported with strides only, a consumer of
+# contiguous memory (struct reads a simple buffer) would see wrong elements
+a = np.arange(12.0).reshape(3, 4)
+padded = _tlib.TMatrix(a[:, :2])
+failed += check(np.array_equal(np.asarray(padded), a[:, :2]), "padded TMatrix as strided array")
+failed += check(raises(BufferError, struct.unpack_from, "6d", padded),
+                "padded TMatrix refuses contiguous buffer")
+
+# exceptions of Python models pass through the C fit
+def broken_model(x, p):
+    raise ZeroDivisionError("model")
+
+x = np.linspace(0.0, 1.0, 20)
+p, info = fit_lm(lambda x, p: p[0] * x + p[1], x, 2.0 * x + 1.0, [1.0, 0.0])
+failed += check(np.allclose(p, [2.0, 1.0]), "fit_lm straight line")
+failed += check(raises(ZeroDivisionError, fit_lm, broken_model, x, x, [1.0, 0.0]),
+                "fit_lm raises exception of model")
+
+# ensemble steps advance every member like the single-member step
+def oscillator(t, y, params):
+    return np.stack((y[..., 1], -y[..., 0]), axis = -1)
+
+ensemble = np.stack((np.linspace(0.5, 2.0, 8), np.zeros(8)), axis = 1)
+members = ensemble.copy()
+t, dt = 0.0, 0.01
+for _ in range(628):
+    py_rk4_step_ensemble(t, dt, ensemble, oscillator, None)
+    members = np.array([py_rk4_step(t, dt, y, oscillator, None) for y in members])
+    t += dt
+failed += check(np.allclose(ensemble, members, rtol = 0.0, atol = 1e-13),
+                "py_rk4_step_ensemble matches py_rk4_step")
+failed += check(np.allclose(ensemble[:, 0], np.linspace(0.5, 2.0, 8) * np.cos(t), atol = 1e-9),
+                "py_rk4_step_ensemble oscillator")
+
+ensemble = np.stack((np.linspace(0.5, 2.0, 8), np.zeros(8)), axis = 1)
+# every member has its own time and step size, all stop exactly at t = 10
+t, dt = np.zeros(8), np.full(8, 0.1)
+while np.any(t < 10.0):
+    ensemble, dt_used, dt = py_rk45_step_ensemble(t, np.minimum(dt, 10.0 - t), ensemble, oscillator, None, 1e-8)
+    t += dt_used
+failed += check(np.allclose(ensemble[:, 0], np.linspace(0.5, 2.0, 8) * np.cos(10.0), atol = 1e-6),
+                "py_rk45_step_ensemble oscillator")
+
+# whole trajectories in Cython, with a Python callable and a C function
+# pointer, step by step equal to py_rk4_step
+@ctypes.CFUNCTYPE(None, ctypes.c_double, ctypes.POINTER(ctypes.c_double),
+                  ctypes.POINTER(ctypes.c_double), ctypes.c_void_p)
+def c_oscillator(t, y, dy, params):
+    dy[0], dy[1] = y[1], -y[0]
+
+y = np.array([1.0, 0.0])
+traj = [y.copy()]
+for step in range(100):
+    y = py_rk4_step(0.05 * step, 0.05, y, oscillator, None)
+    traj.append(y.copy())
+for func, name in ((oscillator, "Python callable"), (c_oscillator, "C function")):
+    failed += check(np.allclose(c_integrate(func, [1.0, 0.0], 0.0, 0.05, 100), traj, rtol = 0.0, atol = 1e-14),
+                    f"c_integrate with {name}")
+
+# adaptive integration with dense output and events against the exact
+# oscillator x = cos t, Python and Cython version alike
+def crossing(t, y, params):
+    return y[0]
+
+def rising(t, y, params):
+    return y[0]
+rising.terminal = True
+rising.direction = 1
+
+t_eval = np.linspace(0.0, 10.0, 51)
+for integrate in (py_rk45_integrate, c_rk45_integrate):
+    name = integrate.__name__
+    res = integrate(oscillator, [1.0, 0.0], 0.0, 10.0, sigmaokay = 1e-10, t_eval = t_eval, events = crossing)
+    failed += check(res.status == 0 and np.array_equal(res.t, t_eval)
+                    and np.allclose(res.y, np.stack((np.cos(t_eval), -np.sin(t_eval)), axis = 1), atol = 1e-7),
+                    f"{name} at t_eval")
+    failed += check(np.allclose(res.t_events[0], np.pi * np.array([0.5, 1.5, 2.5]), atol = 1e-7),
+                    f"{name} event roots")
+    res = integrate(oscillator, [1.0, 0.0], 0.0, 10.0, sigmaokay = 1e-10, events = rising)
+    failed += check(res.status == 1 and abs(res.t[-1] - 1.5 * np.pi) < 1e-7
+                    and np.allclose(res.y_events[0], [[0.0, 1.0]], atol = 1e-7),
+                    f"{name} stops at terminal event")
+
+if failed:
+    sys.exit(1)
 
-ts_confirm(index_argv=1)
\ No newline at end of file
+ts_confirm(index_argv=1)